@@ -0,0 +1,288 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "common.h"
+#include "alloc.h"
+
+
+/*
+ * Most gamestates we keep separate totals for.
+ */
+#define SB_ALLOC_MAX_GAMESTATES 16
+
+
+typedef struct sb_alloc_totals {
+    const char *gamestate;
+    uint64_t    frames;
+    uint64_t    frames_allocating;
+    uint64_t    allocs;
+    uint64_t    bytes;
+    uint64_t    max_allocs;
+} sb_alloc_totals_type;
+
+
+typedef struct sb_alloc {
+    bool                 enabled;
+    bool                 strict;
+    SDL_malloc_func      sdl_malloc;
+    SDL_calloc_func      sdl_calloc;
+    SDL_realloc_func     sdl_realloc;
+    SDL_free_func        sdl_free;
+    uint64_t             frame_allocs;
+    uint64_t             frame_bytes;
+    uint64_t             other_allocs;
+    uint64_t             other_bytes;
+    const char          *last_gamestate;
+    uint64_t             steady_frames;
+    bool                 settle;
+    sb_alloc_totals_type totals[SB_ALLOC_MAX_GAMESTATES];
+    size_t               totals_count;
+} sb_alloc_type;
+
+
+static sb_alloc_type sb_alloc;
+
+
+/*
+ * Set on the thread that called sb_alloc_setup - only its allocations go
+ * into the frame counts, so they need no locking.
+ */
+static __thread bool sb_alloc_main_thread;
+
+
+static inline void
+sb_alloc_count (size_t size)
+{
+    sb_alloc_type *alloc = &sb_alloc;
+
+    if (!alloc->enabled) {
+        return;
+    }
+
+    if (sb_alloc_main_thread) {
+        alloc->frame_allocs++;
+        alloc->frame_bytes += size;
+    } else {
+        __atomic_fetch_add(&alloc->other_allocs, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&alloc->other_bytes, size, __ATOMIC_RELAXED);
+    }
+}
+
+
+static void *
+sb_alloc_sdl_malloc (size_t size)
+{
+    sb_alloc_count(size);
+    return sb_alloc.sdl_malloc(size);
+}
+
+
+static void *
+sb_alloc_sdl_calloc (size_t nmemb,
+                     size_t size)
+{
+    sb_alloc_count(nmemb * size);
+    return sb_alloc.sdl_calloc(nmemb, size);
+}
+
+
+static void *
+sb_alloc_sdl_realloc (void   *ptr,
+                      size_t  size)
+{
+    sb_alloc_count(size);
+    return sb_alloc.sdl_realloc(ptr, size);
+}
+
+
+static void
+sb_alloc_sdl_free (void *ptr)
+{
+    sb_alloc.sdl_free(ptr);
+}
+
+
+#ifdef SB_ALLOC_WRAP
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+
+void *
+__wrap_malloc (size_t size)
+{
+    sb_alloc_count(size);
+    return __real_malloc(size);
+}
+
+
+void *
+__wrap_calloc (size_t nmemb,
+               size_t size)
+{
+    sb_alloc_count(nmemb * size);
+    return __real_calloc(nmemb, size);
+}
+
+
+void *
+__wrap_realloc (void   *ptr,
+                size_t  size)
+{
+    sb_alloc_count(size);
+    return __real_realloc(ptr, size);
+}
+
+#endif /* SB_ALLOC_WRAP */
+
+
+/*
+ * Start counting. Must be called before SDL_Init, so SDL never sees the
+ * memory functions change under allocations it has already made.
+ */
+void
+sb_alloc_setup (bool strict)
+{
+    sb_alloc_type *alloc = &sb_alloc;
+
+    memset(alloc, 0, sizeof(*alloc));
+    alloc->strict = strict;
+    sb_alloc_main_thread = true;
+
+    SDL_GetMemoryFunctions(&alloc->sdl_malloc, &alloc->sdl_calloc,
+                           &alloc->sdl_realloc, &alloc->sdl_free);
+    if (SDL_SetMemoryFunctions(&sb_alloc_sdl_malloc, &sb_alloc_sdl_calloc,
+                               &sb_alloc_sdl_realloc,
+                               &sb_alloc_sdl_free) != 0) {
+        SDL_Log("Unable to track SDL allocations: %s", SDL_GetError());
+    }
+
+    alloc->enabled = true;
+}
+
+
+void
+sb_alloc_frame_begin (void)
+{
+    sb_alloc.frame_allocs = 0;
+    sb_alloc.frame_bytes = 0;
+}
+
+
+/*
+ * Something was changed on purpose (e.g. the render scale) that will
+ * allocate as it takes effect - start warming up again, as for a new
+ * gamestate.
+ */
+void
+sb_alloc_settle (void)
+{
+    sb_alloc.settle = true;
+}
+
+
+/*
+ * The main thread's allocations so far this frame (zero unless counting).
+ */
+void
+sb_alloc_get_frame (uint64_t *allocs,
+                    uint64_t *bytes)
+{
+    *allocs = sb_alloc.frame_allocs;
+    *bytes = sb_alloc.frame_bytes;
+}
+
+
+static sb_alloc_totals_type *
+sb_alloc_get_totals (sb_alloc_type *alloc,
+                     const char    *gamestate)
+{
+    size_t i;
+
+    for (i = 0; i < alloc->totals_count; i++) {
+        if (alloc->totals[i].gamestate == gamestate) {
+            return &alloc->totals[i];
+        }
+    }
+
+    if (alloc->totals_count == SB_ALLOC_MAX_GAMESTATES) {
+        return NULL;
+    }
+
+    alloc->totals[alloc->totals_count].gamestate = gamestate;
+    return &alloc->totals[alloc->totals_count++];
+}
+
+
+/*
+ * Charge this frame's allocations to the gamestate that ran it. A frame in
+ * which the gamestate changed counts against the one it ended with, but
+ * never as steady state.
+ */
+void
+sb_alloc_frame_end (const char *gamestate,
+                    bool        no_alloc)
+{
+    sb_alloc_type        *alloc = &sb_alloc;
+    sb_alloc_totals_type *totals;
+
+    if (!alloc->enabled) {
+        return;
+    }
+
+    if (gamestate == alloc->last_gamestate && !alloc->settle) {
+        alloc->steady_frames++;
+    } else {
+        alloc->last_gamestate = gamestate;
+        alloc->steady_frames = 0;
+        alloc->settle = false;
+    }
+
+    totals = sb_alloc_get_totals(alloc, gamestate);
+    if (totals != NULL) {
+        totals->frames++;
+        totals->allocs += alloc->frame_allocs;
+        totals->bytes += alloc->frame_bytes;
+        totals->max_allocs = MAX(totals->max_allocs, alloc->frame_allocs);
+        if (alloc->frame_allocs != 0) {
+            totals->frames_allocating++;
+        }
+    }
+
+    if (alloc->strict && no_alloc && alloc->frame_allocs != 0 &&
+        alloc->steady_frames >= SB_ALLOC_WARMUP_FRAMES) {
+        fprintf(stderr, "%s frame made %" PRIu64 " allocations (%" PRIu64
+                        " bytes) after warming up\n",
+                gamestate, alloc->frame_allocs, alloc->frame_bytes);
+        abort();
+    }
+}
+
+
+void
+sb_alloc_print_stats (void)
+{
+    sb_alloc_type        *alloc = &sb_alloc;
+    sb_alloc_totals_type *totals;
+    size_t                i;
+
+    if (!alloc->enabled) {
+        return;
+    }
+
+    printf("Allocation stats (main thread, per gamestate):\n");
+    for (i = 0; i < alloc->totals_count; i++) {
+        totals = &alloc->totals[i];
+        printf("  %-12s %8" PRIu64 " frames, %" PRIu64 " allocating; "
+               "%.2f allocs, %.0f bytes per frame; max %" PRIu64 "\n",
+               totals->gamestate, totals->frames, totals->frames_allocating,
+               (double)totals->allocs / totals->frames,
+               (double)totals->bytes / totals->frames, totals->max_allocs);
+    }
+    printf("  other threads: %" PRIu64 " allocs, %" PRIu64 " bytes\n",
+           __atomic_load_n(&alloc->other_allocs, __ATOMIC_RELAXED),
+           __atomic_load_n(&alloc->other_bytes, __ATOMIC_RELAXED));
+}
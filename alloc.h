@@ -0,0 +1,36 @@
+#ifndef __ALLOC_H__
+#define __ALLOC_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*
+ * Heap allocation accounting. sb_alloc_setup installs counting allocators
+ * with SDL_SetMemoryFunctions (which catches SDL and the SDL_* libraries),
+ * and when built with SB_ALLOC_WRAP the game's own malloc, calloc and
+ * realloc calls are counted too, through the linker's --wrap.
+ *
+ * Allocations made on the main thread are totted up per frame, and the
+ * totals kept against the gamestate that ran the frame. Allocations on
+ * other threads (e.g. the mugshot loader) are only counted overall.
+ *
+ * In strict mode, a frame that allocates while a gamestate flagged
+ * SB_GAMESTATE_FLAG_NO_ALLOC has been running for SB_ALLOC_WARMUP_FRAMES
+ * aborts the game, so anything that creeps into the steady state is
+ * caught straight away. sb_alloc_settle restarts the warm up after a
+ * deliberate change, such as a new render scale.
+ */
+#define SB_ALLOC_WARMUP_FRAMES 60
+
+
+void sb_alloc_setup(bool strict);
+void sb_alloc_frame_begin(void);
+void sb_alloc_settle(void);
+void sb_alloc_get_frame(uint64_t *allocs, uint64_t *bytes);
+void sb_alloc_frame_end(const char *gamestate, bool no_alloc);
+void sb_alloc_print_stats(void);
+
+
+#endif /* __ALLOC_H__ */
@@ -0,0 +1,387 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_mixer.h>
+#include "util.h"
+#include "audio.h"
+
+
+/*
+ * Max number of effects playing at once, and max number of play requests
+ * that can be waiting for the mixer. The queue must be a power of two.
+ */
+#define SB_AUDIO_MAX_VOICES 16
+#define SB_AUDIO_QUEUE_SIZE 64
+
+
+/*
+ * Overall level of the synthesized effects, as a fraction of full scale.
+ */
+#define SB_AUDIO_LEVEL 0.2f
+
+
+/*
+ * A decoded effect, as mono samples at the device frequency.
+ */
+typedef struct sb_audio_chunk {
+    int16_t  *samples;
+    uint32_t  length;
+} sb_audio_chunk_type;
+
+
+typedef struct sb_audio_voice {
+    const sb_audio_chunk_type *chunk;
+    uint32_t                   position;
+} sb_audio_voice_type;
+
+
+typedef struct sb_audio_request {
+    sb_audio_effect_type effect;
+    uint64_t             trigger_time;
+} sb_audio_request_type;
+
+
+/*
+ * The request queue is single-producer (the main thread) single-consumer
+ * (the mixer callback). Each side only ever writes its own index, so
+ * neither needs to take a lock.
+ */
+typedef struct sb_audio {
+    bool                  open;
+    int                   frequency;
+    int                   channels;
+    sb_audio_chunk_type   chunks[SB_AUDIO_EFFECT_COUNT];
+    sb_audio_voice_type   voices[SB_AUDIO_MAX_VOICES];
+    sb_audio_request_type queue[SB_AUDIO_QUEUE_SIZE];
+    SDL_atomic_t          queue_head;
+    SDL_atomic_t          queue_tail;
+    SDL_atomic_t          queue_dropped;
+    uint64_t              perf_frequency;
+    sb_audio_stats_type   stats;
+} sb_audio_type;
+
+
+static sb_audio_type sb_audio;
+
+
+/*
+ * Allocate a chunk of the given length in ms.
+ */
+static bool
+sb_audio_chunk_alloc (sb_audio_type       *audio,
+                      sb_audio_chunk_type *chunk,
+                      uint32_t             length_ms)
+{
+    chunk->length = (uint64_t)audio->frequency * length_ms / 1000;
+    chunk->samples = calloc(chunk->length, sizeof(chunk->samples[0]));
+
+    return (chunk->samples != NULL);
+}
+
+
+/*
+ * Fill a chunk with a pair of tones, switched on and off with the given
+ * cadence (in ms). This is how the exchange signalling tones are made.
+ */
+static void
+sb_audio_synth_tones (sb_audio_type       *audio,
+                      sb_audio_chunk_type *chunk,
+                      float                freq_a,
+                      float                freq_b,
+                      uint32_t             on_ms,
+                      uint32_t             off_ms)
+{
+    uint32_t i;
+    uint32_t period = (uint64_t)audio->frequency * (on_ms + off_ms) / 1000;
+    uint32_t on = (uint64_t)audio->frequency * on_ms / 1000;
+    float    t;
+    float    sample;
+
+    for (i = 0; i < chunk->length; i++) {
+        if (i % period >= on) {
+            continue;
+        }
+
+        t = (float)i / audio->frequency;
+        sample = 0.5f * sinf(2.0f * M_PI * freq_a * t) +
+                 0.5f * sinf(2.0f * M_PI * freq_b * t);
+        chunk->samples[i] = sample * SB_AUDIO_LEVEL * INT16_MAX;
+    }
+}
+
+
+/*
+ * Fill a chunk with an exponentially decaying tone plus some noise - the
+ * noise gives the click or thunk its attack.
+ */
+static void
+sb_audio_synth_hit (sb_audio_type       *audio,
+                    sb_audio_chunk_type *chunk,
+                    float                freq,
+                    float                decay,
+                    float                noise)
+{
+    uint32_t i;
+    uint32_t seed = 0x1234567;
+    float    t;
+    float    sample;
+    float    rand_value;
+
+    for (i = 0; i < chunk->length; i++) {
+        seed = seed * 1103515245 + 12345;
+        rand_value = (float)((seed >> 16) & 0x7fff) / 0x4000 - 1.0f;
+
+        t = (float)i / audio->frequency;
+        sample = ((1.0f - noise) * sinf(2.0f * M_PI * freq * t) +
+                  noise * rand_value) * expf(-t * decay);
+        chunk->samples[i] = sample * SB_AUDIO_LEVEL * 2 * INT16_MAX;
+    }
+}
+
+
+/*
+ * Decode every effect up front, so playing one is just a matter of pointing
+ * a voice at it. There are no audio files, so the effects are synthesized.
+ */
+static bool
+sb_audio_load_chunks (sb_audio_type *audio)
+{
+    sb_audio_chunk_type *chunk;
+
+    chunk = &audio->chunks[SB_AUDIO_EFFECT_RING];
+    if (!sb_audio_chunk_alloc(audio, chunk, 1200)) {
+        return false;
+    }
+    sb_audio_synth_tones(audio, chunk, 400.0f, 450.0f, 400, 200);
+
+    chunk = &audio->chunks[SB_AUDIO_EFFECT_DIAL_CLICK];
+    if (!sb_audio_chunk_alloc(audio, chunk, 15)) {
+        return false;
+    }
+    sb_audio_synth_hit(audio, chunk, 2000.0f, 400.0f, 0.7f);
+
+    chunk = &audio->chunks[SB_AUDIO_EFFECT_PLUG];
+    if (!sb_audio_chunk_alloc(audio, chunk, 120)) {
+        return false;
+    }
+    sb_audio_synth_hit(audio, chunk, 90.0f, 35.0f, 0.3f);
+
+    chunk = &audio->chunks[SB_AUDIO_EFFECT_BUSY];
+    if (!sb_audio_chunk_alloc(audio, chunk, 1500)) {
+        return false;
+    }
+    sb_audio_synth_tones(audio, chunk, 480.0f, 620.0f, 375, 375);
+
+    return true;
+}
+
+
+/*
+ * Pull any new play requests off the queue and start them on free voices.
+ */
+static void
+sb_audio_start_requests (sb_audio_type *audio,
+                         uint32_t       buffer_frames)
+{
+    sb_audio_request_type *request;
+    uint64_t               now = SDL_GetPerformanceCounter();
+    double                 latency_ms;
+    int                    head;
+    int                    tail;
+    size_t                 i;
+
+    head = SDL_AtomicGet(&audio->queue_head);
+    SDL_MemoryBarrierAcquire();
+    tail = SDL_AtomicGet(&audio->queue_tail);
+
+    for (; tail != head; tail = (tail + 1) & (SB_AUDIO_QUEUE_SIZE - 1)) {
+        request = &audio->queue[tail];
+
+        for (i = 0; i < SB_AUDIO_MAX_VOICES; i++) {
+            if (audio->voices[i].chunk == NULL) {
+                break;
+            }
+        }
+
+        if (i == SB_AUDIO_MAX_VOICES) {
+            audio->stats.dropped++;
+            continue;
+        }
+
+        audio->voices[i].chunk = &audio->chunks[request->effect];
+        audio->voices[i].position = 0;
+
+        latency_ms = (double)(now - request->trigger_time) * 1000.0 /
+                                                        audio->perf_frequency +
+                     (double)buffer_frames * 1000.0 / audio->frequency;
+        audio->stats.triggers++;
+        audio->stats.latency_total_ms += latency_ms;
+        audio->stats.latency_max_ms = MAX(audio->stats.latency_max_ms,
+                                          latency_ms);
+    }
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&audio->queue_tail, tail);
+}
+
+
+/*
+ * Runs on the audio thread after SDL_mixer has mixed its own channels (of
+ * which there are none) - mix in the active voices.
+ */
+static void
+sb_audio_postmix (void  *udata,
+                  Uint8 *stream,
+                  int    len)
+{
+    sb_audio_type       *audio = udata;
+    sb_audio_voice_type *voice;
+    int16_t             *out = (int16_t *)stream;
+    uint32_t             frames = len / (sizeof(int16_t) * audio->channels);
+    uint32_t             voices = 0;
+    uint32_t             count;
+    uint32_t             i;
+    int                  c;
+    int32_t              mixed;
+    size_t               v;
+
+    sb_audio_start_requests(audio, frames);
+
+    for (v = 0; v < SB_AUDIO_MAX_VOICES; v++) {
+        voice = &audio->voices[v];
+        if (voice->chunk == NULL) {
+            continue;
+        }
+        voices++;
+
+        count = MIN(frames, voice->chunk->length - voice->position);
+        for (i = 0; i < count; i++) {
+            for (c = 0; c < audio->channels; c++) {
+                mixed = out[i * audio->channels + c] +
+                        voice->chunk->samples[voice->position + i];
+                out[i * audio->channels + c] = MAX(INT16_MIN,
+                                                   MIN(INT16_MAX, mixed));
+            }
+        }
+
+        voice->position += count;
+        if (voice->position >= voice->chunk->length) {
+            voice->chunk = NULL;
+        }
+    }
+
+    audio->stats.voices = voices;
+    audio->stats.peak_voices = MAX(audio->stats.peak_voices, voices);
+}
+
+
+/*
+ * Open the audio device with a buffer of the given number of sample frames
+ * (smaller is lower latency, but more likely to underrun) and decode all of
+ * the effects. Returns false if there is no usable audio, in which case
+ * sb_audio_play is a no-op.
+ */
+bool
+sb_audio_setup (int buffer_frames)
+{
+    sb_audio_type *audio = &sb_audio;
+    Uint16         format;
+
+    memset(audio, 0, sizeof(*audio));
+
+    if (Mix_OpenAudio(MIX_DEFAULT_FREQUENCY, AUDIO_S16SYS,
+                      MIX_DEFAULT_CHANNELS, buffer_frames) != 0) {
+        SDL_Log("Unable to open audio: %s", Mix_GetError());
+        return false;
+    }
+    audio->open = true;
+
+    (void)Mix_QuerySpec(&audio->frequency, &format, &audio->channels);
+    if (format != AUDIO_S16SYS || audio->channels <= 0) {
+        SDL_Log("Unsupported audio format %x", format);
+        sb_audio_cleanup();
+        return false;
+    }
+
+    if (!sb_audio_load_chunks(audio)) {
+        sb_audio_cleanup();
+        return false;
+    }
+
+    audio->perf_frequency = SDL_GetPerformanceFrequency();
+    audio->stats.frequency = audio->frequency;
+    audio->stats.buffer_frames = buffer_frames;
+
+    /*
+     * All mixing is done in the post-mix hook, so SDL_mixer's own channels
+     * (and the audio lock that playing on them takes) are never used.
+     */
+    (void)Mix_AllocateChannels(0);
+    Mix_SetPostMix(&sb_audio_postmix, audio);
+
+    return true;
+}
+
+
+void
+sb_audio_cleanup (void)
+{
+    sb_audio_type *audio = &sb_audio;
+    size_t         i;
+
+    if (audio->open) {
+        Mix_SetPostMix(NULL, NULL);
+        Mix_CloseAudio();
+        audio->open = false;
+    }
+
+    for (i = 0; i < SB_AUDIO_EFFECT_COUNT; i++) {
+        free(audio->chunks[i].samples);
+        audio->chunks[i].samples = NULL;
+    }
+
+    audio->stats.dropped += SDL_AtomicGet(&audio->queue_dropped);
+    SDL_AtomicSet(&audio->queue_dropped, 0);
+}
+
+
+/*
+ * Ask for an effect to be played. This never blocks - if the mixer has
+ * fallen so far behind that the queue is full, the request is dropped.
+ */
+void
+sb_audio_play (sb_audio_effect_type effect)
+{
+    sb_audio_type *audio = &sb_audio;
+    int            head;
+    int            next;
+
+    if (!audio->open) {
+        return;
+    }
+
+    head = SDL_AtomicGet(&audio->queue_head);
+    next = (head + 1) & (SB_AUDIO_QUEUE_SIZE - 1);
+    if (next == SDL_AtomicGet(&audio->queue_tail)) {
+        SDL_AtomicAdd(&audio->queue_dropped, 1);
+        return;
+    }
+
+    audio->queue[head].effect = effect;
+    audio->queue[head].trigger_time = SDL_GetPerformanceCounter();
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&audio->queue_head, next);
+}
+
+
+/*
+ * See audio.h for details.
+ */
+void
+sb_audio_get_stats (sb_audio_stats_type *stats)
+{
+    *stats = sb_audio.stats;
+    stats->dropped += SDL_AtomicGet(&sb_audio.queue_dropped);
+}
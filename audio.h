@@ -0,0 +1,43 @@
+#ifndef __AUDIO_H__
+#define __AUDIO_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef enum {
+    SB_AUDIO_EFFECT_RING,
+    SB_AUDIO_EFFECT_DIAL_CLICK,
+    SB_AUDIO_EFFECT_PLUG,
+    SB_AUDIO_EFFECT_BUSY,
+    SB_AUDIO_EFFECT_COUNT
+} sb_audio_effect_type;
+
+
+/*
+ * Counts kept by the mixer callback. Latency is the time from
+ * sb_audio_play being called to the callback picking the effect up, plus
+ * the length of the buffer it is mixed into - i.e. an estimate of when it
+ * reaches the speaker. These are written from the audio thread, so only
+ * read them after sb_audio_cleanup if exact values are needed.
+ */
+typedef struct sb_audio_stats {
+    uint32_t frequency;
+    uint32_t buffer_frames;
+    uint64_t triggers;
+    uint64_t dropped;
+    uint32_t voices;
+    uint32_t peak_voices;
+    double   latency_total_ms;
+    double   latency_max_ms;
+} sb_audio_stats_type;
+
+
+bool sb_audio_setup(int buffer_frames);
+void sb_audio_cleanup(void);
+void sb_audio_play(sb_audio_effect_type effect);
+void sb_audio_get_stats(sb_audio_stats_type *stats);
+
+
+#endif /* __AUDIO_H__ */
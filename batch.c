@@ -0,0 +1,435 @@
+/*
+ * Batch driver - plays lots of seeded games with the bot, spread across all
+ * cores, and prints statistics over the lot. Used for tuning call rates and
+ * timings without sitting through rounds by hand. Doesn't need SDL.
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "game.h"
+#include "bot.h"
+#include "job.h"
+
+
+/*
+ * Most worker threads we'll start.
+ */
+#define BATCH_MAX_THREADS SB_JOB_MAX_THREADS
+
+
+/*
+ * The per-round numbers we keep statistics on.
+ */
+typedef enum {
+    BATCH_METRIC_SCORE,
+    BATCH_METRIC_CALLS,
+    BATCH_METRIC_CONNECTED,
+    BATCH_METRIC_MISSED,
+    BATCH_METRIC_DROPPED,
+    BATCH_METRIC_COUNT
+} sb_batch_metric_type;
+
+
+static const char *sb_batch_metric_names[BATCH_METRIC_COUNT] = {
+    "score",
+    "calls",
+    "connected",
+    "missed",
+    "dropped",
+};
+
+
+/*
+ * Running totals for one metric. Integer sums keep the result identical
+ * however the runs are split between threads.
+ */
+typedef struct sb_batch_stat {
+    uint64_t sum;
+    uint64_t sum_sq;
+    uint32_t min;
+    uint32_t max;
+} sb_batch_stat_type;
+
+
+typedef struct sb_batch_totals {
+    uint64_t           runs;
+    sb_batch_stat_type stats[BATCH_METRIC_COUNT];
+} sb_batch_totals_type;
+
+
+typedef struct sb_batch_options {
+    uint64_t            runs;
+    unsigned            threads;
+    uint32_t            seed;
+    uint32_t            step;
+    bool                scaling;
+    sb_game_config_type game_config;
+    sb_bot_config_type  bot_config;
+} sb_batch_options_type;
+
+
+/*
+ * Shared between the jobs. Each thread keeps its own totals, which are only
+ * merged at the end, so the jobs share nothing but the options.
+ */
+typedef struct sb_batch {
+    const sb_batch_options_type *options;
+    sb_batch_totals_type         totals[BATCH_MAX_THREADS];
+} sb_batch_type;
+
+
+static void
+sb_batch_totals_init (sb_batch_totals_type *totals)
+{
+    size_t i;
+
+    memset(totals, 0, sizeof(*totals));
+    for (i = 0; i < BATCH_METRIC_COUNT; i++) {
+        totals->stats[i].min = UINT32_MAX;
+    }
+}
+
+
+static void
+sb_batch_stat_add (sb_batch_stat_type *stat,
+                   uint32_t            value)
+{
+    stat->sum += value;
+    stat->sum_sq += (uint64_t)value * value;
+    stat->min = MIN(stat->min, value);
+    stat->max = MAX(stat->max, value);
+}
+
+
+static void
+sb_batch_totals_merge (sb_batch_totals_type       *totals,
+                       const sb_batch_totals_type *other)
+{
+    size_t i;
+
+    totals->runs += other->runs;
+    for (i = 0; i < BATCH_METRIC_COUNT; i++) {
+        totals->stats[i].sum += other->stats[i].sum;
+        totals->stats[i].sum_sq += other->stats[i].sum_sq;
+        totals->stats[i].min = MIN(totals->stats[i].min, other->stats[i].min);
+        totals->stats[i].max = MAX(totals->stats[i].max, other->stats[i].max);
+    }
+}
+
+
+/*
+ * Mix the batch seed and run number into a seed for one game or bot, so
+ * neighbouring runs aren't correlated.
+ */
+static uint32_t
+sb_batch_seed (uint32_t seed,
+               uint64_t run,
+               uint32_t salt)
+{
+    uint64_t x = ((uint64_t)seed << 32) ^ (run * 0x9e3779b97f4a7c15ULL) ^ salt;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    return (uint32_t)x;
+}
+
+
+/*
+ * Play one round with the bot and add its results to totals.
+ */
+static void
+sb_batch_run (const sb_batch_options_type *options,
+              uint64_t                     run,
+              sb_batch_totals_type        *totals)
+{
+    sb_game_config_type  game_config = options->game_config;
+    sb_bot_config_type   bot_config = options->bot_config;
+    sb_game_type        *game;
+    sb_bot_type         *bot;
+    sb_game_stats_type   stats;
+
+    game_config.seed = sb_batch_seed(options->seed, run, 0);
+    bot_config.seed = sb_batch_seed(options->seed, run, 1);
+
+    game = sb_game_create(&game_config);
+    bot = sb_bot_create(&bot_config);
+    if (game == NULL || bot == NULL) {
+        fprintf(stderr, "Failed to create game for run %" PRIu64 "\n", run);
+        exit(EXIT_FAILURE);
+    }
+
+    /*
+     * The bot acts on what it saw last step, as it would on screen.
+     */
+    while (!sb_game_is_over(game)) {
+        sb_bot_step(bot, game, options->step);
+        sb_game_step(game, options->step);
+    }
+
+    sb_game_get_stats(game, &stats);
+    totals->runs++;
+    sb_batch_stat_add(&totals->stats[BATCH_METRIC_SCORE], stats.score);
+    sb_batch_stat_add(&totals->stats[BATCH_METRIC_CALLS], stats.calls);
+    sb_batch_stat_add(&totals->stats[BATCH_METRIC_CONNECTED],
+                      stats.connected);
+    sb_batch_stat_add(&totals->stats[BATCH_METRIC_MISSED], stats.missed);
+    sb_batch_stat_add(&totals->stats[BATCH_METRIC_DROPPED], stats.dropped);
+
+    sb_bot_destroy(bot);
+    sb_game_destroy(game);
+}
+
+
+/*
+ * Job - play runs [begin, end).
+ */
+static void
+sb_batch_run_range (void   *data,
+                    size_t  begin,
+                    size_t  end)
+{
+    sb_batch_type *batch = data;
+    size_t         run;
+
+    for (run = begin; run < end; run++) {
+        sb_batch_run(batch->options, run,
+                     &batch->totals[sb_job_get_thread_index()]);
+    }
+}
+
+
+static double
+sb_batch_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ * Play all the runs on the given number of threads. Returns the wall clock
+ * time taken, in seconds.
+ */
+static double
+sb_batch_play (const sb_batch_options_type *options,
+               unsigned                     threads,
+               sb_batch_totals_type        *totals,
+               sb_job_stats_type           *job_stats)
+{
+    static sb_batch_type batch;
+    sb_job_counter_type  counter = SB_JOB_COUNTER_INIT;
+    unsigned             i;
+    double               start;
+
+    batch.options = options;
+    for (i = 0; i < threads; i++) {
+        sb_batch_totals_init(&batch.totals[i]);
+    }
+    sb_batch_totals_init(totals);
+
+    start = sb_batch_now();
+
+    if (!sb_job_setup(threads)) {
+        fprintf(stderr, "Failed to start worker thread\n");
+        exit(EXIT_FAILURE);
+    }
+    sb_job_parallel_for(options->runs, 1, &sb_batch_run_range, &batch,
+                        &counter);
+    sb_job_wait(&counter);
+    sb_job_cleanup();
+
+    for (i = 0; i < threads; i++) {
+        sb_batch_totals_merge(totals, &batch.totals[i]);
+    }
+    if (job_stats != NULL) {
+        sb_job_get_stats(job_stats);
+    }
+
+    return sb_batch_now() - start;
+}
+
+
+static void
+sb_batch_print (const sb_batch_options_type *options,
+                const sb_batch_totals_type  *totals,
+                double                       elapsed)
+{
+    const sb_batch_stat_type *stat;
+    double                    mean;
+    double                    var;
+    double                    simulated;
+    size_t                    i;
+
+    simulated = (double)totals->runs * options->game_config.leveltime;
+    printf("%" PRIu64 " runs on %u threads in %.2f s "
+           "(%.0f runs/s, %.0fx real time)\n",
+           totals->runs, options->threads, elapsed,
+           totals->runs / elapsed, simulated / elapsed);
+
+    if (totals->runs == 0) {
+        return;
+    }
+
+    printf("  %-10s %10s %10s %8s %8s\n", "", "mean", "stddev", "min", "max");
+    for (i = 0; i < BATCH_METRIC_COUNT; i++) {
+        stat = &totals->stats[i];
+        mean = (double)stat->sum / totals->runs;
+        var = (double)stat->sum_sq / totals->runs - mean * mean;
+        printf("  %-10s %10.2f %10.2f %8" PRIu32 " %8" PRIu32 "\n",
+               sb_batch_metric_names[i], mean, sqrt(MAX(0.0, var)),
+               stat->min, stat->max);
+    }
+
+    stat = &totals->stats[BATCH_METRIC_CALLS];
+    if (stat->sum != 0) {
+        printf("  missed call rate: %.1f%%\n",
+               100.0 * totals->stats[BATCH_METRIC_MISSED].sum / stat->sum);
+    }
+}
+
+
+/*
+ * Play the batch on 1, 2, 4... threads up to the number asked for, and
+ * print the speedup over a single thread.
+ */
+static void
+sb_batch_scaling (const sb_batch_options_type *options)
+{
+    sb_batch_totals_type totals;
+    sb_job_stats_type    job_stats;
+    unsigned             threads;
+    double               elapsed;
+    double               base = 0.0;
+
+    printf("%8s %10s %10s %10s %10s\n", "threads", "time (s)", "speedup",
+           "efficiency", "stolen");
+    for (threads = 1; threads <= options->threads; threads *= 2) {
+        elapsed = sb_batch_play(options, threads, &totals, &job_stats);
+        if (threads == 1) {
+            base = elapsed;
+        }
+        printf("%8u %10.2f %10.2f %9.0f%% %10" PRIu64 "\n", threads, elapsed,
+               base / elapsed, 100.0 * base / elapsed / threads,
+               job_stats.stolen);
+    }
+}
+
+
+static void
+sb_batch_usage (const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --runs N            rounds to play (default 1000)\n"
+            "  --threads N         worker threads (default: one per core)\n"
+            "  --seed N            seed for the whole batch (default 1)\n"
+            "  --step MS           simulation step (default 16)\n"
+            "  --level-time S      round length in seconds\n"
+            "  --lines N           customers on the board (default 20)\n"
+            "  --call-min MS       shortest time between new calls\n"
+            "  --call-max MS       longest time between new calls\n"
+            "  --bot-reaction MS   bot reaction time (default 400)\n"
+            "  --bot-accuracy P    bot accuracy, 0 to 1 (default 0.95)\n"
+            "  --scaling           time the batch on 1, 2, 4... threads\n",
+            name);
+}
+
+
+static void
+sb_batch_parse_options (int                    argc,
+                        char                  *argv[],
+                        sb_batch_options_type *options)
+{
+    long cores;
+    int  i;
+
+    memset(options, 0, sizeof(*options));
+    options->runs = 1000;
+    options->seed = 1;
+    options->step = 16;
+    sb_game_config_default(&options->game_config);
+    options->bot_config.reaction_time = 400;
+    options->bot_config.accuracy = 0.95f;
+
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+    options->threads = cores > 0 ? cores : 1;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            options->runs = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options->threads = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options->seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--step") == 0 && i + 1 < argc) {
+            options->step = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--level-time") == 0 && i + 1 < argc) {
+            options->game_config.leveltime = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+            options->game_config.customer_count =
+                                            strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--call-min") == 0 && i + 1 < argc) {
+            options->game_config.new_call_time_min =
+                                            strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--call-max") == 0 && i + 1 < argc) {
+            options->game_config.new_call_time_max =
+                                            strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--bot-reaction") == 0 && i + 1 < argc) {
+            options->bot_config.reaction_time = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--bot-accuracy") == 0 && i + 1 < argc) {
+            options->bot_config.accuracy = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--scaling") == 0) {
+            options->scaling = true;
+        } else {
+            sb_batch_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    options->threads = MAX(1, MIN(options->threads, BATCH_MAX_THREADS));
+    options->step = MAX(1, options->step);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    sb_batch_options_type options;
+    sb_batch_totals_type  totals;
+    sb_game_type         *game;
+    double                elapsed;
+
+    sb_batch_parse_options(argc, argv, &options);
+
+    /*
+     * Check the settings make a game before starting any threads.
+     */
+    game = sb_game_create(&options.game_config);
+    if (game == NULL) {
+        fprintf(stderr, "Invalid game settings\n");
+        return EXIT_FAILURE;
+    }
+    sb_game_destroy(game);
+
+    if (options.scaling) {
+        sb_batch_scaling(&options);
+        return EXIT_SUCCESS;
+    }
+
+    elapsed = sb_batch_play(&options, options.threads, &totals, NULL);
+    sb_batch_print(&options, &totals, elapsed);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,682 @@
+#include <string.h>
+#include "blit.h"
+#include "common.h"
+#include "rng.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SB_BLIT_X86
+#include <immintrin.h>
+#endif
+
+
+/*
+ * The self-check runs each kernel on rows of every length up to this
+ * (covering the SIMD tails), SB_BLIT_CHECK_ROUNDS times over.
+ */
+#define SB_BLIT_CHECK_LENGTH 67
+#define SB_BLIT_CHECK_ROUNDS 64
+
+
+typedef struct sb_blit_kernels {
+    void (*copy)(uint32_t *dst, const uint32_t *src, size_t count);
+    void (*blend)(uint32_t *dst, const uint32_t *src, size_t count);
+    void (*tint)(uint32_t       *dst,
+                 const uint32_t *src,
+                 size_t          count,
+                 uint32_t        color);
+    void (*fill)(uint32_t *dst, size_t count, uint32_t color);
+} sb_blit_kernels_type;
+
+
+typedef struct sb_blit {
+    sb_blit_impl_type           impl;
+    const sb_blit_kernels_type *kernels;
+} sb_blit_type;
+
+
+static const char *sb_blit_impl_names[SB_BLIT_IMPL_COUNT] = {
+    "scalar",
+    "sse2",
+    "avx2",
+};
+
+
+/*
+ * Exact x / 255 for x up to 255 * 255.
+ */
+static inline unsigned
+sb_blit_div255 (unsigned x)
+{
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+
+/*
+ * Blend a source pixel (given as straight, not premultiplied, channels)
+ * onto dst.
+ */
+static inline uint32_t
+sb_blit_blend_pixel (uint32_t dst,
+                     unsigned sr,
+                     unsigned sg,
+                     unsigned sb,
+                     unsigned sa)
+{
+    unsigned inv = 255 - sa;
+    unsigned dr = (dst >> 16) & 0xff;
+    unsigned dg = (dst >> 8) & 0xff;
+    unsigned db = dst & 0xff;
+    unsigned da = dst >> 24;
+
+    dr = sb_blit_div255(sr * sa) + sb_blit_div255(dr * inv);
+    dg = sb_blit_div255(sg * sa) + sb_blit_div255(dg * inv);
+    db = sb_blit_div255(sb * sa) + sb_blit_div255(db * inv);
+    da = sa + sb_blit_div255(da * inv);
+
+    return da << 24 | dr << 16 | dg << 8 | db;
+}
+
+
+static void
+sb_blit_copy_scalar (uint32_t       *dst,
+                     const uint32_t *src,
+                     size_t          count)
+{
+    /*
+     * libc's memcpy is already vectorized, so this is every version's copy.
+     */
+    memcpy(dst, src, count * sizeof(uint32_t));
+}
+
+
+static void
+sb_blit_blend_scalar (uint32_t       *dst,
+                      const uint32_t *src,
+                      size_t          count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        dst[i] = sb_blit_blend_pixel(dst[i], (src[i] >> 16) & 0xff,
+                                     (src[i] >> 8) & 0xff, src[i] & 0xff,
+                                     src[i] >> 24);
+    }
+}
+
+
+static void
+sb_blit_tint_scalar (uint32_t       *dst,
+                     const uint32_t *src,
+                     size_t          count,
+                     uint32_t        color)
+{
+    unsigned cr = (color >> 16) & 0xff;
+    unsigned cg = (color >> 8) & 0xff;
+    unsigned cb = color & 0xff;
+    unsigned ca = color >> 24;
+    size_t   i;
+
+    for (i = 0; i < count; i++) {
+        dst[i] = sb_blit_blend_pixel(dst[i],
+                                     sb_blit_div255(((src[i] >> 16) & 0xff) *
+                                                    cr),
+                                     sb_blit_div255(((src[i] >> 8) & 0xff) *
+                                                    cg),
+                                     sb_blit_div255((src[i] & 0xff) * cb),
+                                     sb_blit_div255((src[i] >> 24) * ca));
+    }
+}
+
+
+static void
+sb_blit_fill_scalar (uint32_t *dst,
+                     size_t    count,
+                     uint32_t  color)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        dst[i] = sb_blit_blend_pixel(dst[i], (color >> 16) & 0xff,
+                                     (color >> 8) & 0xff, color & 0xff,
+                                     color >> 24);
+    }
+}
+
+
+static const sb_blit_kernels_type sb_blit_kernels_scalar = {
+    sb_blit_copy_scalar,
+    sb_blit_blend_scalar,
+    sb_blit_tint_scalar,
+    sb_blit_fill_scalar,
+};
+
+
+#ifdef SB_BLIT_X86
+
+/*
+ * The SIMD versions unpack pixels to 16 bits per channel, two pixels per
+ * 128 bits, in memory order (B, G, R, A). The alpha lane of each
+ * multiplier is forced to 255 so that it comes through the premultiply
+ * unchanged, which makes the destination alpha fall out of the same
+ * src + (255 - srcA) * dst / 255 as the colours.
+ */
+#define SB_BLIT_ALPHA_LANES 0x00ff000000000000ULL
+
+#define SB_BLIT_SSE2 __attribute__((target("sse2")))
+#define SB_BLIT_AVX2 __attribute__((target("avx2")))
+
+
+static inline SB_BLIT_SSE2 __m128i
+sb_blit_div255_sse2 (__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_add_epi16(_mm_set1_epi16(1),
+                                       _mm_srli_epi16(x, 8)));
+    return _mm_srli_epi16(x, 8);
+}
+
+
+static inline SB_BLIT_SSE2 __m128i
+sb_blit_alpha_sse2 (__m128i px)
+{
+    px = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+
+/*
+ * Blend two unpacked source pixels onto two unpacked destination pixels.
+ */
+static inline SB_BLIT_SSE2 __m128i
+sb_blit_blend_sse2 (__m128i dst,
+                    __m128i src)
+{
+    __m128i alpha_lanes = _mm_set1_epi64x(SB_BLIT_ALPHA_LANES);
+    __m128i alpha = sb_blit_alpha_sse2(src);
+    __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+
+    alpha = _mm_or_si128(_mm_andnot_si128(alpha_lanes, alpha), alpha_lanes);
+    src = sb_blit_div255_sse2(_mm_mullo_epi16(src, alpha));
+    dst = sb_blit_div255_sse2(_mm_mullo_epi16(dst, inv));
+
+    return _mm_add_epi16(src, dst);
+}
+
+
+static SB_BLIT_SSE2 void
+sb_blit_blend_sse2_row (uint32_t       *dst,
+                        const uint32_t *src,
+                        size_t          count)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i s;
+    __m128i d;
+    __m128i lo;
+    __m128i hi;
+    size_t  i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        s = _mm_loadu_si128((const __m128i *)(src + i));
+        d = _mm_loadu_si128((const __m128i *)(dst + i));
+        lo = sb_blit_blend_sse2(_mm_unpacklo_epi8(d, zero),
+                                _mm_unpacklo_epi8(s, zero));
+        hi = sb_blit_blend_sse2(_mm_unpackhi_epi8(d, zero),
+                                _mm_unpackhi_epi8(s, zero));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    sb_blit_blend_scalar(dst + i, src + i, count - i);
+}
+
+
+static SB_BLIT_SSE2 void
+sb_blit_tint_sse2_row (uint32_t       *dst,
+                       const uint32_t *src,
+                       size_t          count,
+                       uint32_t        color)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i mod = _mm_unpacklo_epi8(_mm_set1_epi32(color), zero);
+    __m128i s;
+    __m128i d;
+    __m128i lo;
+    __m128i hi;
+    size_t  i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        s = _mm_loadu_si128((const __m128i *)(src + i));
+        d = _mm_loadu_si128((const __m128i *)(dst + i));
+        lo = sb_blit_div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero),
+                                                 mod));
+        hi = sb_blit_div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero),
+                                                 mod));
+        lo = sb_blit_blend_sse2(_mm_unpacklo_epi8(d, zero), lo);
+        hi = sb_blit_blend_sse2(_mm_unpackhi_epi8(d, zero), hi);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    sb_blit_tint_scalar(dst + i, src + i, count - i, color);
+}
+
+
+static SB_BLIT_SSE2 void
+sb_blit_fill_sse2_row (uint32_t *dst,
+                       size_t    count,
+                       uint32_t  color)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i src = _mm_unpacklo_epi8(_mm_set1_epi32(color), zero);
+    __m128i d;
+    __m128i lo;
+    __m128i hi;
+    size_t  i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        d = _mm_loadu_si128((const __m128i *)(dst + i));
+        lo = sb_blit_blend_sse2(_mm_unpacklo_epi8(d, zero), src);
+        hi = sb_blit_blend_sse2(_mm_unpackhi_epi8(d, zero), src);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    sb_blit_fill_scalar(dst + i, count - i, color);
+}
+
+
+static const sb_blit_kernels_type sb_blit_kernels_sse2 = {
+    sb_blit_copy_scalar,
+    sb_blit_blend_sse2_row,
+    sb_blit_tint_sse2_row,
+    sb_blit_fill_sse2_row,
+};
+
+
+/*
+ * The AVX2 versions are the SSE2 ones at twice the width - unpacking and
+ * packing work within each 128 bit half, so the pixel order is kept. The
+ * SSE2 versions finish off each row, so the upper halves of the registers
+ * are cleared first; the compiler doesn't do this for a tail call, and
+ * running SSE2 code with them dirty is very slow on some CPUs (which hurts
+ * most on short rows, like particles).
+ */
+static inline SB_BLIT_AVX2 __m256i
+sb_blit_div255_avx2 (__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_add_epi16(_mm256_set1_epi16(1),
+                                             _mm256_srli_epi16(x, 8)));
+    return _mm256_srli_epi16(x, 8);
+}
+
+
+static inline SB_BLIT_AVX2 __m256i
+sb_blit_blend_avx2 (__m256i dst,
+                    __m256i src)
+{
+    __m256i alpha_lanes = _mm256_set1_epi64x(SB_BLIT_ALPHA_LANES);
+    __m256i alpha;
+    __m256i inv;
+
+    alpha = _mm256_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    inv = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+
+    alpha = _mm256_or_si256(_mm256_andnot_si256(alpha_lanes, alpha),
+                            alpha_lanes);
+    src = sb_blit_div255_avx2(_mm256_mullo_epi16(src, alpha));
+    dst = sb_blit_div255_avx2(_mm256_mullo_epi16(dst, inv));
+
+    return _mm256_add_epi16(src, dst);
+}
+
+
+static SB_BLIT_AVX2 void
+sb_blit_blend_avx2_row (uint32_t       *dst,
+                        const uint32_t *src,
+                        size_t          count)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i s;
+    __m256i d;
+    __m256i lo;
+    __m256i hi;
+    size_t  i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        s = _mm256_loadu_si256((const __m256i *)(src + i));
+        d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        lo = sb_blit_blend_avx2(_mm256_unpacklo_epi8(d, zero),
+                                _mm256_unpacklo_epi8(s, zero));
+        hi = sb_blit_blend_avx2(_mm256_unpackhi_epi8(d, zero),
+                                _mm256_unpackhi_epi8(s, zero));
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_packus_epi16(lo, hi));
+    }
+
+    _mm256_zeroupper();
+    sb_blit_blend_sse2_row(dst + i, src + i, count - i);
+}
+
+
+static SB_BLIT_AVX2 void
+sb_blit_tint_avx2_row (uint32_t       *dst,
+                       const uint32_t *src,
+                       size_t          count,
+                       uint32_t        color)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i mod = _mm256_unpacklo_epi8(_mm256_set1_epi32(color), zero);
+    __m256i s;
+    __m256i d;
+    __m256i lo;
+    __m256i hi;
+    size_t  i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        s = _mm256_loadu_si256((const __m256i *)(src + i));
+        d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        lo = sb_blit_div255_avx2(
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), mod));
+        hi = sb_blit_div255_avx2(
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), mod));
+        lo = sb_blit_blend_avx2(_mm256_unpacklo_epi8(d, zero), lo);
+        hi = sb_blit_blend_avx2(_mm256_unpackhi_epi8(d, zero), hi);
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_packus_epi16(lo, hi));
+    }
+
+    _mm256_zeroupper();
+    sb_blit_tint_sse2_row(dst + i, src + i, count - i, color);
+}
+
+
+static SB_BLIT_AVX2 void
+sb_blit_fill_avx2_row (uint32_t *dst,
+                       size_t    count,
+                       uint32_t  color)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i src = _mm256_unpacklo_epi8(_mm256_set1_epi32(color), zero);
+    __m256i d;
+    __m256i lo;
+    __m256i hi;
+    size_t  i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        lo = sb_blit_blend_avx2(_mm256_unpacklo_epi8(d, zero), src);
+        hi = sb_blit_blend_avx2(_mm256_unpackhi_epi8(d, zero), src);
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_packus_epi16(lo, hi));
+    }
+
+    _mm256_zeroupper();
+    sb_blit_fill_sse2_row(dst + i, count - i, color);
+}
+
+
+static const sb_blit_kernels_type sb_blit_kernels_avx2 = {
+    sb_blit_copy_scalar,
+    sb_blit_blend_avx2_row,
+    sb_blit_tint_avx2_row,
+    sb_blit_fill_avx2_row,
+};
+
+#endif /* SB_BLIT_X86 */
+
+
+static sb_blit_type sb_blit = {
+    SB_BLIT_IMPL_SCALAR,
+    &sb_blit_kernels_scalar,
+};
+
+
+static const sb_blit_kernels_type *
+sb_blit_get_kernels (sb_blit_impl_type impl)
+{
+    switch (impl) {
+#ifdef SB_BLIT_X86
+    case SB_BLIT_IMPL_SSE2:
+        return &sb_blit_kernels_sse2;
+    case SB_BLIT_IMPL_AVX2:
+        return &sb_blit_kernels_avx2;
+#endif
+    case SB_BLIT_IMPL_SCALAR:
+        return &sb_blit_kernels_scalar;
+    default:
+        return NULL;
+    }
+}
+
+
+bool
+sb_blit_supported (sb_blit_impl_type impl)
+{
+    switch (impl) {
+    case SB_BLIT_IMPL_SCALAR:
+        return true;
+#ifdef SB_BLIT_X86
+    case SB_BLIT_IMPL_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case SB_BLIT_IMPL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+
+/*
+ * A test pixel. Alpha is picked from the ends of the range more often than
+ * not, as 0 and 255 are where rounding slips would show first.
+ */
+static uint32_t
+sb_blit_check_pixel (sb_rng_type *rng)
+{
+    static const uint32_t alphas[] = { 0x00, 0x01, 0x7f, 0x80, 0xfe, 0xff };
+    uint32_t              pixel = sb_rng_next(rng);
+    uint32_t              count = sizeof(alphas) / sizeof(alphas[0]);
+
+    if (pixel & 0x100) {
+        pixel = (pixel & 0x00ffffff) |
+                alphas[sb_rng_range(rng, 0, count - 1)] << 24;
+    }
+
+    return pixel;
+}
+
+
+/*
+ * Run every kernel of both sets on one row, and report whether they agree.
+ */
+static bool
+sb_blit_check_row (const sb_blit_kernels_type *kernels,
+                   const uint32_t             *src,
+                   const uint32_t             *dst,
+                   size_t                      length,
+                   uint32_t                    color)
+{
+    const sb_blit_kernels_type *scalar = &sb_blit_kernels_scalar;
+    uint32_t                    expect[SB_BLIT_CHECK_LENGTH];
+    uint32_t                    got[SB_BLIT_CHECK_LENGTH];
+    size_t                      size = length * sizeof(uint32_t);
+    int                         kernel;
+
+    for (kernel = 0; kernel < 4; kernel++) {
+        memcpy(expect, dst, size);
+        memcpy(got, dst, size);
+
+        switch (kernel) {
+        case 0:
+            scalar->copy(expect, src, length);
+            kernels->copy(got, src, length);
+            break;
+        case 1:
+            scalar->blend(expect, src, length);
+            kernels->blend(got, src, length);
+            break;
+        case 2:
+            scalar->tint(expect, src, length, color);
+            kernels->tint(got, src, length, color);
+            break;
+        default:
+            scalar->fill(expect, length, color);
+            kernels->fill(got, length, color);
+            break;
+        }
+
+        if (memcmp(expect, got, size) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ * Run impl's kernels against the scalar ones on random rows, and report
+ * whether every output pixel matched.
+ */
+bool
+sb_blit_check (sb_blit_impl_type impl)
+{
+    const sb_blit_kernels_type *kernels = sb_blit_get_kernels(impl);
+    uint32_t                    src[SB_BLIT_CHECK_LENGTH];
+    uint32_t                    dst[SB_BLIT_CHECK_LENGTH];
+    sb_rng_type                 rng;
+    size_t                      length;
+    size_t                      i;
+    int                         round;
+
+    if (kernels == NULL || !sb_blit_supported(impl)) {
+        return false;
+    }
+
+    sb_rng_seed(&rng, 1);
+    for (round = 0; round < SB_BLIT_CHECK_ROUNDS; round++) {
+        for (length = 0; length <= SB_BLIT_CHECK_LENGTH; length++) {
+            for (i = 0; i < length; i++) {
+                src[i] = sb_blit_check_pixel(&rng);
+                dst[i] = sb_blit_check_pixel(&rng);
+            }
+            if (!sb_blit_check_row(kernels, src, dst, length,
+                                   sb_blit_check_pixel(&rng))) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ * Use the widest kernels up to max_impl that the CPU has and that pass the
+ * check. Returns false if something had to be skipped because it failed
+ * the check (which would be a bug).
+ */
+bool
+sb_blit_setup (sb_blit_impl_type max_impl)
+{
+    sb_blit_type *blit = &sb_blit;
+    bool          ok = true;
+    int           impl;
+
+    for (impl = MIN(max_impl, SB_BLIT_IMPL_COUNT - 1);
+         impl > SB_BLIT_IMPL_SCALAR; impl--) {
+        if (!sb_blit_supported(impl)) {
+            continue;
+        }
+        if (sb_blit_check(impl)) {
+            break;
+        }
+        ok = false;
+    }
+
+    blit->impl = impl;
+    blit->kernels = sb_blit_get_kernels(impl);
+
+    return ok;
+}
+
+
+sb_blit_impl_type
+sb_blit_get_impl (void)
+{
+    return sb_blit.impl;
+}
+
+
+const char *
+sb_blit_impl_name (sb_blit_impl_type impl)
+{
+    return sb_blit_impl_names[impl];
+}
+
+
+bool
+sb_blit_parse_impl (const char        *name,
+                    sb_blit_impl_type *impl)
+{
+    int i;
+
+    for (i = 0; i < SB_BLIT_IMPL_COUNT; i++) {
+        if (strcmp(name, sb_blit_impl_names[i]) == 0) {
+            *impl = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * Copy count pixels as they are.
+ */
+void
+sb_blit_copy (uint32_t       *dst,
+              const uint32_t *src,
+              size_t          count)
+{
+    sb_blit.kernels->copy(dst, src, count);
+}
+
+
+/*
+ * Alpha blend count pixels onto dst.
+ */
+void
+sb_blit_blend (uint32_t       *dst,
+               const uint32_t *src,
+               size_t          count)
+{
+    sb_blit.kernels->blend(dst, src, count);
+}
+
+
+/*
+ * Alpha blend count pixels onto dst, after multiplying each by color (the
+ * way SDL's texture colour and alpha modulation does).
+ */
+void
+sb_blit_tint (uint32_t       *dst,
+              const uint32_t *src,
+              size_t          count,
+              uint32_t        color)
+{
+    sb_blit.kernels->tint(dst, src, count, color);
+}
+
+
+/*
+ * Alpha blend a solid colour onto count pixels of dst.
+ */
+void
+sb_blit_fill (uint32_t *dst,
+              size_t    count,
+              uint32_t  color)
+{
+    sb_blit.kernels->fill(dst, count, color);
+}
@@ -0,0 +1,45 @@
+#ifndef __BLIT_H__
+#define __BLIT_H__
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Pixel kernels for the software compositor, working on rows of ARGB8888
+ * pixels (alpha in the top byte).
+ *
+ * Each kernel has a scalar version and, on x86, SSE2 and AVX2 versions.
+ * sb_blit_setup picks the widest the CPU supports and checks it against
+ * the scalar version on a spread of test rows before using it, falling
+ * back to the next one down if anything differs - so the output is the
+ * same whichever is in use. The arithmetic is SDL's generic blend:
+ * premultiply, then src + (255 - srcA) * dst / 255, dividing exactly.
+ */
+typedef enum {
+    SB_BLIT_IMPL_SCALAR,
+    SB_BLIT_IMPL_SSE2,
+    SB_BLIT_IMPL_AVX2,
+    SB_BLIT_IMPL_COUNT,
+} sb_blit_impl_type;
+
+
+bool sb_blit_setup(sb_blit_impl_type max_impl);
+bool sb_blit_check(sb_blit_impl_type impl);
+bool sb_blit_supported(sb_blit_impl_type impl);
+sb_blit_impl_type sb_blit_get_impl(void);
+const char *sb_blit_impl_name(sb_blit_impl_type impl);
+bool sb_blit_parse_impl(const char *name, sb_blit_impl_type *impl);
+
+void sb_blit_copy(uint32_t *dst, const uint32_t *src, size_t count);
+void sb_blit_blend(uint32_t *dst, const uint32_t *src, size_t count);
+void sb_blit_tint(uint32_t       *dst,
+                  const uint32_t *src,
+                  size_t          count,
+                  uint32_t        color);
+void sb_blit_fill(uint32_t *dst, size_t count, uint32_t color);
+
+
+#endif /* __BLIT_H__ */
@@ -0,0 +1,592 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "rng.h"
+#include "game.h"
+#include "bot.h"
+
+
+/*
+ * Maximum number of queued input actions. A rotary turn is the longest
+ * single task, at roughly 40 actions.
+ */
+#define BOT_MAX_ACTIONS 128
+
+
+/*
+ * Time (in ms) between motion inputs while dragging, and the
+ * distance (in pixels) covered by each one.
+ */
+#define BOT_MOTION_INTERVAL 16
+#define BOT_MOTION_STEP     24
+
+
+/*
+ * Time (in ms) a button is held down for a simple click.
+ */
+#define BOT_CLICK_TIME 60
+
+
+/*
+ * Angle step (in degrees) between motion events when turning the rotary,
+ * and the absolute angle of the finger stop.
+ */
+#define BOT_ROTARY_STEP      10
+#define BOT_ROTARY_STOP      120
+#define BOT_ROTARY_OVERSHOOT 15
+
+
+/*
+ * Chance (out of 100) that the bot plays with the rotary dial when there is
+ * nothing else to do.
+ */
+#define BOT_ROTARY_CHANCE 25
+
+
+/*
+ * A single piece of input to give the game, after waiting for delay ms.
+ */
+typedef struct sb_bot_action {
+    sb_game_input_type input;
+    uint32_t           delay;
+} sb_bot_action_type;
+
+
+struct sb_bot {
+    sb_bot_config_type    config;
+    sb_rng_type           rng;
+    sb_bot_action_type    actions[BOT_MAX_ACTIONS];
+    size_t                action_count;
+    size_t                next_action;
+    uint32_t              wait;
+    int                   mouse_x;
+    int                   mouse_y;
+    sb_bot_input_fn_type  input;
+    void                 *input_ctx;
+};
+
+
+/*
+ * The bot has its own generator so that a given seed produces the same run
+ * regardless of what the game does.
+ */
+static uint32_t
+sb_bot_rand (sb_bot_type *bot)
+{
+    return sb_rng_next(&bot->rng);
+}
+
+
+static float
+sb_bot_rand_float (sb_bot_type *bot)
+{
+    return sb_rng_float(&bot->rng);
+}
+
+
+/*
+ * Reaction time with +/-25% jitter, so the bot doesn't act in lockstep with
+ * the frame rate.
+ */
+static uint32_t
+sb_bot_reaction_time (sb_bot_type *bot)
+{
+    uint32_t base = bot->config.reaction_time;
+    uint32_t jitter = base / 2;
+
+    if (jitter == 0) {
+        return base;
+    }
+
+    return base - jitter / 2 + sb_bot_rand(bot) % jitter;
+}
+
+
+/*
+ * Pick a point to aim for within a rect. Depending on the accuracy setting
+ * the point may be pushed just outside the rect instead.
+ */
+static void
+sb_bot_aim (sb_bot_type             *bot,
+            const sb_game_rect_type *rect,
+            int                     *x,
+            int                     *y)
+{
+    /*
+     * The game's hit tests exclude the edges, so stay strictly inside.
+     */
+    *x = rect->x + 1 + (rect->w > 2 ? sb_bot_rand(bot) % (rect->w - 2) : 0);
+    *y = rect->y + 1 + (rect->h > 2 ? sb_bot_rand(bot) % (rect->h - 2) : 0);
+
+    if (sb_bot_rand_float(bot) >= bot->config.accuracy) {
+        switch (sb_bot_rand(bot) % 4) {
+        case 0:
+            *x = rect->x - 2 - sb_bot_rand(bot) % 8;
+            break;
+        case 1:
+            *x = rect->x + rect->w + 2 + sb_bot_rand(bot) % 8;
+            break;
+        case 2:
+            *y = rect->y - 2 - sb_bot_rand(bot) % 8;
+            break;
+        default:
+            *y = rect->y + rect->h + 2 + sb_bot_rand(bot) % 8;
+            break;
+        }
+    }
+}
+
+
+/*
+ * Aim for a customer's port, which is on the board, and find the point on
+ * the screen showing it. When zoomed out that may be a board pixel or two
+ * away, so near the edges the bot can miss a little more than it meant to.
+ */
+static void
+sb_bot_aim_port (sb_bot_type             *bot,
+                 const sb_game_view_type *view,
+                 const sb_game_rect_type *rect,
+                 int                     *x,
+                 int                     *y)
+{
+    sb_bot_aim(bot, rect, x, y);
+    sb_game_view_to_screen(view, *x, *y, x, y);
+}
+
+
+/*
+ * Whether the middle of a port can be clicked on - it may be behind the
+ * console.
+ */
+static bool
+sb_bot_can_reach (const sb_game_board_type *board,
+                  const sb_game_rect_type  *rect)
+{
+    int x;
+    int y;
+
+    sb_game_view_to_screen(&board->view, rect->x + rect->w / 2,
+                           rect->y + rect->h / 2, &x, &y);
+
+    return !sb_game_on_console(x, y);
+}
+
+
+static void
+sb_bot_queue (sb_bot_type             *bot,
+              sb_game_input_kind_type  kind,
+              int                      x,
+              int                      y,
+              uint32_t                 delay)
+{
+    sb_bot_action_type *action;
+
+    if (bot->action_count >= BOT_MAX_ACTIONS) {
+        return;
+    }
+
+    action = &bot->actions[bot->action_count++];
+    action->input.kind = kind;
+    action->input.x = x;
+    action->input.y = y;
+    action->delay = delay;
+}
+
+
+/*
+ * Queue motion moving in a straight line from the last queued
+ * position to the given point.
+ */
+static void
+sb_bot_queue_move (sb_bot_type *bot,
+                   int          x,
+                   int          y,
+                   uint32_t     delay)
+{
+    int    fromx = bot->mouse_x;
+    int    fromy = bot->mouse_y;
+    int    distx = x - fromx;
+    int    disty = y - fromy;
+    int    steps;
+    int    i;
+
+    steps = sqrtf(distx * distx + disty * disty) / BOT_MOTION_STEP;
+    for (i = 1; i <= steps; i++) {
+        sb_bot_queue(bot, SB_GAME_INPUT_MOTION,
+                     fromx + distx * i / (steps + 1),
+                     fromy + disty * i / (steps + 1),
+                     i == 1 ? delay : BOT_MOTION_INTERVAL);
+    }
+    sb_bot_queue(bot, SB_GAME_INPUT_MOTION, x, y,
+                 steps == 0 ? delay : BOT_MOTION_INTERVAL);
+
+    bot->mouse_x = x;
+    bot->mouse_y = y;
+}
+
+
+static void
+sb_bot_queue_click (sb_bot_type             *bot,
+                    const sb_game_rect_type *rect)
+{
+    int x;
+    int y;
+
+    sb_bot_aim(bot, rect, &x, &y);
+    sb_bot_queue_move(bot, x, y, sb_bot_reaction_time(bot));
+    sb_bot_queue(bot, SB_GAME_INPUT_BUTTON_DOWN, x, y, BOT_MOTION_INTERVAL);
+    sb_bot_queue(bot, SB_GAME_INPUT_BUTTON_UP, x, y, BOT_CLICK_TIME);
+}
+
+
+/*
+ * Drag from one rect to another. Each is a customer's port, if there is a
+ * view to find it on the screen with, and otherwise on the console.
+ */
+static void
+sb_bot_queue_drag (sb_bot_type             *bot,
+                   const sb_game_rect_type *from,
+                   const sb_game_view_type *from_view,
+                   const sb_game_rect_type *to,
+                   const sb_game_view_type *to_view)
+{
+    int x;
+    int y;
+
+    if (from_view != NULL) {
+        sb_bot_aim_port(bot, from_view, from, &x, &y);
+    } else {
+        sb_bot_aim(bot, from, &x, &y);
+    }
+    sb_bot_queue_move(bot, x, y, sb_bot_reaction_time(bot));
+    sb_bot_queue(bot, SB_GAME_INPUT_BUTTON_DOWN, x, y, BOT_MOTION_INTERVAL);
+
+    if (to_view != NULL) {
+        sb_bot_aim_port(bot, to_view, to, &x, &y);
+    } else {
+        sb_bot_aim(bot, to, &x, &y);
+    }
+    sb_bot_queue_move(bot, x, y, BOT_MOTION_INTERVAL);
+    sb_bot_queue(bot, SB_GAME_INPUT_BUTTON_UP, x, y, BOT_MOTION_INTERVAL);
+}
+
+
+/*
+ * Grab a random number on the rotary dial and wind it round to the finger
+ * stop, the same way a player would.
+ */
+static void
+sb_bot_queue_rotary (sb_bot_type              *bot,
+                     const sb_game_board_type *board)
+{
+    const sb_game_rect_type *number_rect;
+    int                      centerx;
+    int                      centery;
+    int                      x;
+    int                      y;
+    float                    radius;
+    float                    angle;
+    float                    end_angle;
+
+    number_rect = &board->rotary_number_rects[sb_bot_rand(bot) % ROTARY_NUMS];
+    if (number_rect->w == 0) {
+        /*
+         * The dial hasn't been laid out yet.
+         */
+        return;
+    }
+
+    centerx = board->rotary_bounds.x + board->rotary_bounds.w / 2;
+    centery = board->rotary_bounds.y + board->rotary_bounds.h / 2;
+    sb_bot_aim(bot, number_rect, &x, &y);
+    radius = sqrtf((x - centerx) * (x - centerx) +
+                   (y - centery) * (y - centery));
+    angle = RAD_TO_DEG(atan2f(x - centerx, centery - y));
+    if (angle < 0.0f) {
+        angle += 360.0f;
+    }
+
+    /*
+     * Turn clockwise until just past the stop, which may be on this side of
+     * the top of the dial or the next.
+     */
+    end_angle = BOT_ROTARY_STOP + BOT_ROTARY_OVERSHOOT;
+    if (angle >= BOT_ROTARY_STOP) {
+        end_angle += 360.0f;
+    }
+
+    sb_bot_queue_move(bot, x, y, sb_bot_reaction_time(bot));
+    sb_bot_queue(bot, SB_GAME_INPUT_BUTTON_DOWN, x, y, BOT_MOTION_INTERVAL);
+    for (angle += BOT_ROTARY_STEP; angle < end_angle;
+         angle += BOT_ROTARY_STEP) {
+        x = centerx + radius * sinf(DEG_TO_RAD(angle));
+        y = centery - radius * cosf(DEG_TO_RAD(angle));
+        sb_bot_queue(bot, SB_GAME_INPUT_MOTION, x, y, BOT_MOTION_INTERVAL);
+    }
+    sb_bot_queue(bot, SB_GAME_INPUT_BUTTON_UP, x, y, BOT_MOTION_INTERVAL);
+
+    bot->mouse_x = x;
+    bot->mouse_y = y;
+}
+
+
+/*
+ * Work out what to do with a pair of cables. Even cables are used for the
+ * caller and odd cables for the customer being called. Returns true if an
+ * action was queued.
+ */
+static bool
+sb_bot_think_pair (sb_bot_type              *bot,
+                   const sb_game_board_type *board,
+                   size_t                    src_index)
+{
+    const sb_game_board_cable_type    *src_cable;
+    const sb_game_board_cable_type    *tgt_cable;
+    const sb_game_board_customer_type *src = NULL;
+    const sb_game_board_customer_type *tgt = NULL;
+    const sb_game_board_customer_type *wanted;
+
+    src_cable = &board->cables[src_index];
+    tgt_cable = &board->cables[src_index + 1];
+    if (src_cable->customer >= 0) {
+        src = &board->customers[src_cable->customer];
+    }
+    if (tgt_cable->customer >= 0) {
+        tgt = &board->customers[tgt_cable->customer];
+    }
+
+    if (src == NULL) {
+        /*
+         * Nothing to do unless a stray target cable needs tidying away.
+         */
+        if (tgt != NULL && tgt->line_state == LINE_STATE_IDLE &&
+            sb_bot_can_reach(board, &tgt->port_rect)) {
+            sb_bot_queue_drag(bot, &tgt->port_rect, &board->view,
+                              &tgt_cable->cable_base_rect, NULL);
+            return true;
+        }
+        return false;
+    }
+
+    switch (src->line_state) {
+    case LINE_STATE_IDLE:
+        /*
+         * The call is over (or failed) - unplug everything.
+         */
+        if (!sb_bot_can_reach(board, &src->port_rect)) {
+            return false;
+        }
+        sb_bot_queue_drag(bot, &src->port_rect, &board->view,
+                          &src_cable->cable_base_rect, NULL);
+        if (tgt != NULL && sb_bot_can_reach(board, &tgt->port_rect)) {
+            sb_bot_queue_drag(bot, &tgt->port_rect, &board->view,
+                              &tgt_cable->cable_base_rect, NULL);
+        }
+        return true;
+
+    case LINE_STATE_DIALING:
+        sb_bot_queue_click(bot, &src_cable->speak_button_rect);
+        return true;
+
+    case LINE_STATE_OPERATOR_REQUEST:
+        if (src->target_cust < 0) {
+            return false;
+        }
+        wanted = &board->customers[src->target_cust];
+
+        if (tgt == NULL) {
+            if (wanted->port_cable < 0 &&
+                sb_bot_can_reach(board, &wanted->port_rect)) {
+                sb_bot_queue_drag(bot, &tgt_cable->cable_base_rect, NULL,
+                                  &wanted->port_rect, &board->view);
+                return true;
+            }
+        } else if (tgt != wanted) {
+            if (!sb_bot_can_reach(board, &tgt->port_rect)) {
+                return false;
+            }
+            sb_bot_queue_drag(bot, &tgt->port_rect, &board->view,
+                              &tgt_cable->cable_base_rect, NULL);
+            return true;
+        } else if (tgt->line_state == LINE_STATE_IDLE) {
+            sb_bot_queue_click(bot, &tgt_cable->dial_button_rect);
+            return true;
+        } else if (tgt->line_state == LINE_STATE_OPERATOR_REPLY &&
+                   board->active_cable == (int)src_index + 1) {
+            sb_bot_queue_click(bot, &tgt_cable->speak_button_rect);
+            return true;
+        }
+        return false;
+
+    default:
+        return false;
+    }
+}
+
+
+/*
+ * Look at the board and queue up the next task.
+ */
+static void
+sb_bot_think (sb_bot_type        *bot,
+              const sb_game_type *game)
+{
+    sb_game_board_type                 board;
+    const sb_game_board_customer_type *cust;
+    size_t                             i;
+    size_t                             j;
+
+    sb_game_get_board(game, &board);
+
+    if (board.held_cable >= 0) {
+        /*
+         * Something went wrong mid-drag (e.g. a missed click) - put the
+         * plug back.
+         */
+        sb_bot_queue_move(bot,
+                          board.cables[board.held_cable].cable_base_rect.x,
+                          board.cables[board.held_cable].cable_base_rect.y,
+                          sb_bot_reaction_time(bot));
+        sb_bot_queue(bot, SB_GAME_INPUT_BUTTON_UP, bot->mouse_x, bot->mouse_y,
+                     BOT_MOTION_INTERVAL);
+        return;
+    }
+
+    for (i = 0; i + 1 < board.cable_count; i += 2) {
+        if (sb_bot_think_pair(bot, &board, i)) {
+            return;
+        }
+    }
+
+    /*
+     * Answer any new calls with a free pair of cables.
+     */
+    for (i = 0; i < board.customer_count; i++) {
+        cust = &board.customers[i];
+        if (cust->line_state != LINE_STATE_DIALING || cust->port_cable >= 0 ||
+            !sb_bot_can_reach(&board, &cust->port_rect)) {
+            continue;
+        }
+
+        for (j = 0; j + 1 < board.cable_count; j += 2) {
+            if (board.cables[j].customer < 0 &&
+                board.cables[j + 1].customer < 0) {
+                sb_bot_queue_drag(bot, &board.cables[j].cable_base_rect,
+                                  NULL, &cust->port_rect, &board.view);
+                return;
+            }
+        }
+    }
+
+    if (board.rotary_idle && sb_bot_rand(bot) % 100 < BOT_ROTARY_CHANCE) {
+        sb_bot_queue_rotary(bot, &board);
+    }
+}
+
+
+/*
+ * Create a bot - see bot.h for the meaning of the config.
+ */
+sb_bot_type *
+sb_bot_create (const sb_bot_config_type *config)
+{
+    sb_bot_type *bot;
+
+    bot = calloc(1, sizeof(*bot));
+    if (bot == NULL) {
+        return NULL;
+    }
+
+    bot->config = *config;
+    sb_rng_seed(&bot->rng, config->seed);
+    bot->wait = config->reaction_time;
+
+    return bot;
+}
+
+
+void
+sb_bot_destroy (sb_bot_type *bot)
+{
+    free(bot);
+}
+
+
+/*
+ * Send the bot's input to input rather than straight to the game (see
+ * bot.h).
+ */
+void
+sb_bot_set_input (sb_bot_type          *bot,
+                  sb_bot_input_fn_type  input,
+                  void                 *ctx)
+{
+    bot->input = input;
+    bot->input_ctx = ctx;
+}
+
+
+/*
+ * Drop anything half done, e.g. because the game has been paused or a new
+ * round started. The bot looks at the board afresh after a reaction time.
+ */
+void
+sb_bot_reset (sb_bot_type *bot)
+{
+    bot->action_count = 0;
+    bot->next_action = 0;
+    bot->wait = sb_bot_reaction_time(bot);
+}
+
+
+/*
+ * Advance the bot by frametime ms, giving the game any input that is due.
+ * The game itself is not stepped.
+ */
+void
+sb_bot_step (sb_bot_type  *bot,
+             sb_game_type *game,
+             uint32_t      frametime)
+{
+    sb_bot_action_type *action;
+
+    while (frametime > 0 || bot->wait == 0) {
+        if (bot->next_action == bot->action_count) {
+            bot->action_count = 0;
+            bot->next_action = 0;
+            sb_bot_think(bot, game);
+            if (bot->action_count == 0) {
+                /*
+                 * Nothing to do - look again after a reaction time.
+                 */
+                sb_bot_queue(bot, SB_GAME_INPUT_MOTION,
+                             bot->mouse_x, bot->mouse_y,
+                             MAX(1, sb_bot_reaction_time(bot)));
+            }
+            bot->wait = bot->actions[0].delay;
+        }
+
+        if (bot->wait > frametime) {
+            bot->wait -= frametime;
+            break;
+        }
+
+        frametime -= bot->wait;
+        action = &bot->actions[bot->next_action++];
+        bot->mouse_x = action->input.x;
+        bot->mouse_y = action->input.y;
+        if (bot->input != NULL) {
+            bot->input(&action->input, bot->input_ctx);
+        } else {
+            sb_game_input(game, &action->input);
+        }
+
+        if (sb_game_is_over(game)) {
+            break;
+        }
+
+        bot->wait = (bot->next_action < bot->action_count ?
+                        bot->actions[bot->next_action].delay : 0);
+    }
+}
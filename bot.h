@@ -0,0 +1,58 @@
+#ifndef __BOT_H__
+#define __BOT_H__
+
+
+#include <stdint.h>
+#include "game.h"
+
+
+/*
+ * A computer operator that plays a game through the same pointer input a
+ * player gives it. Like the game it knows nothing about SDL, so it can play
+ * on screen or in the batch driver.
+ *
+ * It finds customers' ports on the screen through the game's view, so it
+ * plays wherever the board has been moved to, reaching off the edge of the
+ * screen if it has to. Ports hidden behind the console are left alone
+ * until they aren't.
+ */
+typedef struct sb_bot sb_bot_type;
+
+
+/*
+ * Where the bot's input goes. Unless one is set, it's given straight to
+ * the game with sb_game_input, as the batch driver wants; on screen it is
+ * handed to the input function instead, to be sent the way a player's
+ * would be.
+ */
+typedef void (*sb_bot_input_fn_type)(const sb_game_input_type *input,
+                                     void                     *ctx);
+
+
+/*
+ * Tunables for the bot operator.
+ *
+ * reaction_time is the delay (in ms) between the bot noticing something on
+ *   the board and starting to act on it.
+ * accuracy is the chance (0 to 1) that any given click or drag lands on what
+ *   the bot was aiming for.
+ * seed makes a run repeatable - the bot keeps its own random state and does
+ *   not disturb the game's.
+ */
+typedef struct sb_bot_config {
+    uint32_t reaction_time;
+    float    accuracy;
+    uint32_t seed;
+} sb_bot_config_type;
+
+
+sb_bot_type *sb_bot_create(const sb_bot_config_type *config);
+void sb_bot_destroy(sb_bot_type *bot);
+void sb_bot_set_input(sb_bot_type          *bot,
+                      sb_bot_input_fn_type  input,
+                      void                 *ctx);
+void sb_bot_reset(sb_bot_type *bot);
+void sb_bot_step(sb_bot_type *bot, sb_game_type *game, uint32_t frametime);
+
+
+#endif /* __BOT_H__ */
@@ -0,0 +1,237 @@
+#include <math.h>
+#include <string.h>
+#include "common.h"
+#include "simd.h"
+#include "cable.h"
+
+
+/*
+ * Gravity in pixels per second squared, and how much of its velocity a
+ * particle keeps each step.
+ */
+#define SB_CABLE_GRAVITY 1500.0f
+#define SB_CABLE_DAMPING 0.98f
+
+
+/*
+ * A cord's length is the distance between its ends times SLACK, plus
+ * EXTRA pixels.
+ */
+#define SB_CABLE_SLACK 1.05f
+#define SB_CABLE_EXTRA 20.0f
+
+
+/*
+ * At most this many steps are taken per call; any more time than that is
+ * dropped (e.g. after the game has been paused).
+ */
+#define SB_CABLE_MAX_STEPS 8
+
+
+#if MAX_CABLES % 4 != 0
+#error MAX_CABLES must be a multiple of 4
+#endif
+
+
+/*
+ * See cable.h for details.
+ */
+void
+sb_cable_reset (sb_cables_type *cables)
+{
+    memset(cables, 0, sizeof(*cables));
+}
+
+
+/*
+ * Move every free particle on by its velocity, plus gravity.
+ */
+static void
+sb_cable_integrate (sb_cables_type *cables)
+{
+    sb_simd_type damping = sb_simd_set(SB_CABLE_DAMPING);
+    sb_simd_type gravity = sb_simd_set(
+        SB_CABLE_GRAVITY * SB_CABLE_STEP_MS * SB_CABLE_STEP_MS / 1.0e6f);
+    sb_simd_type x;
+    sb_simd_type y;
+    sb_simd_type vx;
+    sb_simd_type vy;
+    size_t       p;
+    size_t       c;
+
+    for (p = 1; p < SB_CABLE_POINTS - 1; p++) {
+        for (c = 0; c < MAX_CABLES; c += 4) {
+            x = sb_simd_load(&cables->x[p][c]);
+            y = sb_simd_load(&cables->y[p][c]);
+            vx = sb_simd_sub(x, sb_simd_load(&cables->prev_x[p][c]));
+            vy = sb_simd_sub(y, sb_simd_load(&cables->prev_y[p][c]));
+            sb_simd_store(&cables->prev_x[p][c], x);
+            sb_simd_store(&cables->prev_y[p][c], y);
+
+            x = sb_simd_add(x, sb_simd_mul(vx, damping));
+            y = sb_simd_add(y, sb_simd_add(sb_simd_mul(vy, damping),
+                                           gravity));
+            sb_simd_store(&cables->x[p][c], x);
+            sb_simd_store(&cables->y[p][c], y);
+        }
+    }
+}
+
+
+/*
+ * Pull each pair of neighbouring particles back together wherever they
+ * are further apart than the rest length. A cord doesn't resist being
+ * squashed, so closer is left alone. The end particles are pinned, so
+ * the links to them move only the free particle.
+ */
+static void
+sb_cable_constrain (sb_cables_type *cables)
+{
+    sb_simd_type zero = sb_simd_set(0.0f);
+    sb_simd_type tiny = sb_simd_set(1.0e-6f);
+    sb_simd_type weight_a;
+    sb_simd_type weight_b;
+    sb_simd_type ax;
+    sb_simd_type ay;
+    sb_simd_type bx;
+    sb_simd_type by;
+    sb_simd_type dx;
+    sb_simd_type dy;
+    sb_simd_type dist;
+    sb_simd_type stretch;
+    size_t       p;
+    size_t       c;
+
+    for (p = 0; p < SB_CABLE_POINTS - 1; p++) {
+        weight_a = sb_simd_set((p == 0) ? 0.0f :
+                               (p == SB_CABLE_POINTS - 2) ? 1.0f : 0.5f);
+        weight_b = sb_simd_set((p == 0) ? 1.0f :
+                               (p == SB_CABLE_POINTS - 2) ? 0.0f : 0.5f);
+
+        for (c = 0; c < MAX_CABLES; c += 4) {
+            ax = sb_simd_load(&cables->x[p][c]);
+            ay = sb_simd_load(&cables->y[p][c]);
+            bx = sb_simd_load(&cables->x[p + 1][c]);
+            by = sb_simd_load(&cables->y[p + 1][c]);
+
+            dx = sb_simd_sub(bx, ax);
+            dy = sb_simd_sub(by, ay);
+            dist = sb_simd_sqrt(sb_simd_add(sb_simd_mul(dx, dx),
+                                           sb_simd_mul(dy, dy)));
+            stretch = sb_simd_div(
+                sb_simd_max(sb_simd_sub(dist,
+                                       sb_simd_load(&cables->rest[c])),
+                            zero),
+                sb_simd_max(dist, tiny));
+            dx = sb_simd_mul(dx, stretch);
+            dy = sb_simd_mul(dy, stretch);
+
+            sb_simd_store(&cables->x[p][c],
+                          sb_simd_add(ax, sb_simd_mul(dx, weight_a)));
+            sb_simd_store(&cables->y[p][c],
+                          sb_simd_add(ay, sb_simd_mul(dy, weight_a)));
+            sb_simd_store(&cables->x[p + 1][c],
+                          sb_simd_sub(bx, sb_simd_mul(dx, weight_b)));
+            sb_simd_store(&cables->y[p + 1][c],
+                          sb_simd_sub(by, sb_simd_mul(dy, weight_b)));
+        }
+    }
+}
+
+
+/*
+ * Move a cable's ends to its anchors, and pull it all the way in if it
+ * isn't active.
+ */
+static void
+sb_cable_pin (sb_cables_type             *cables,
+              const sb_cable_anchor_type *anchor,
+              size_t                      c)
+{
+    size_t last = SB_CABLE_POINTS - 1;
+    size_t p;
+
+    if (!anchor->active) {
+        for (p = 0; p < SB_CABLE_POINTS; p++) {
+            cables->x[p][c] = anchor->start_x;
+            cables->y[p][c] = anchor->start_y;
+            cables->prev_x[p][c] = anchor->start_x;
+            cables->prev_y[p][c] = anchor->start_y;
+        }
+        cables->rest[c] = 0.0f;
+        return;
+    }
+
+    cables->x[0][c] = anchor->start_x;
+    cables->y[0][c] = anchor->start_y;
+    cables->x[last][c] = anchor->end_x;
+    cables->y[last][c] = anchor->end_y;
+    cables->rest[c] = (hypotf(anchor->end_x - anchor->start_x,
+                              anchor->end_y - anchor->start_y) *
+                       SB_CABLE_SLACK + SB_CABLE_EXTRA) / last;
+}
+
+
+/*
+ * See cable.h for details. Unused cables should be left inactive, with
+ * their start anywhere.
+ */
+void
+sb_cable_step (sb_cables_type             *cables,
+               const sb_cable_anchor_type  anchors[MAX_CABLES],
+               uint32_t                    time)
+{
+    size_t steps;
+    size_t c;
+    size_t i;
+
+    /*
+     * Cables start out pulled in.
+     */
+    if (!cables->placed) {
+        for (c = 0; c < MAX_CABLES; c++) {
+            sb_cable_anchor_type anchor = anchors[c];
+
+            anchor.active = false;
+            sb_cable_pin(cables, &anchor, c);
+        }
+        cables->placed = true;
+    }
+
+    cables->time += time;
+    steps = MIN(cables->time / SB_CABLE_STEP_MS, SB_CABLE_MAX_STEPS);
+    cables->time = (steps == SB_CABLE_MAX_STEPS) ?
+                   0 : cables->time % SB_CABLE_STEP_MS;
+
+    /*
+     * The constraints never move the end particles, so pinning once a step
+     * is enough.
+     */
+    while (steps-- > 0) {
+        sb_cable_integrate(cables);
+        for (c = 0; c < MAX_CABLES; c++) {
+            sb_cable_pin(cables, &anchors[c], c);
+        }
+        for (i = 0; i < SB_CABLE_ITERATIONS; i++) {
+            sb_cable_constrain(cables);
+        }
+    }
+}
+
+
+/*
+ * Copy out where one cable's particles are, from the start to the end.
+ */
+void
+sb_cable_get_points (const sb_cables_type *cables,
+                     size_t                cable,
+                     float                 xs[SB_CABLE_POINTS],
+                     float                 ys[SB_CABLE_POINTS])
+{
+    size_t p;
+
+    for (p = 0; p < SB_CABLE_POINTS; p++) {
+        xs[p] = cables->x[p][cable];
+        ys[p] = cables->y[p][cable];
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef __CABLE_H__
+#define __CABLE_H__
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+
+
+/*
+ * Cord physics - each cord is a chain of Verlet particles, pinned at the
+ * cord hole and at the plug (or the hand holding it), hanging under
+ * gravity between them.
+ *
+ * Like a real switchboard cord, which is weighted so it is pulled back
+ * into the desk, a cord's length follows the distance between its ends,
+ * with some slack to sag. Cords that are neither plugged in nor held are
+ * pulled all the way in, so they sit at their hole.
+ *
+ * All the cords are stored together as structure of arrays, one array per
+ * particle across every cable, and stepped four cables at a time with SSE
+ * where it is available (plain C otherwise). The simulation steps in fixed
+ * increments of SB_CABLE_STEP_MS, carrying any remainder over to the next
+ * call, so it behaves the same at any frame rate.
+ *
+ * Doesn't need SDL.
+ */
+#define SB_CABLE_POINTS     24
+#define SB_CABLE_ITERATIONS 12
+#define SB_CABLE_STEP_MS    8
+
+
+/*
+ * Where a cable's ends are this step. Cables that aren't active are pulled
+ * in to start.
+ */
+typedef struct sb_cable_anchor {
+    bool  active;
+    float start_x;
+    float start_y;
+    float end_x;
+    float end_y;
+} sb_cable_anchor_type;
+
+
+typedef struct sb_cables {
+    float    x[SB_CABLE_POINTS][MAX_CABLES];
+    float    y[SB_CABLE_POINTS][MAX_CABLES];
+    float    prev_x[SB_CABLE_POINTS][MAX_CABLES];
+    float    prev_y[SB_CABLE_POINTS][MAX_CABLES];
+    float    rest[MAX_CABLES];
+    uint32_t time;
+    bool     placed;
+} sb_cables_type;
+
+
+void sb_cable_reset(sb_cables_type *cables);
+void sb_cable_step(sb_cables_type             *cables,
+                   const sb_cable_anchor_type  anchors[MAX_CABLES],
+                   uint32_t                    time);
+void sb_cable_get_points(const sb_cables_type *cables,
+                         size_t                cable,
+                         float                 xs[SB_CABLE_POINTS],
+                         float                 ys[SB_CABLE_POINTS]);
+
+
+#endif /* __CABLE_H__ */
@@ -0,0 +1,374 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "common.h"
+#include "capture.h"
+
+
+/*
+ * Longest gap (in frames) the writer will fill by repeating a frame, so a
+ * long stall (e.g. the window being dragged) doesn't write out minutes of
+ * the same picture.
+ */
+#define SB_CAPTURE_MAX_REPEAT 120
+
+
+/*
+ * A captured frame. slot is the frame's position in the video, counting
+ * from zero at the first capture.
+ */
+typedef struct sb_capture_buffer {
+    uint32_t *pixels;
+    uint32_t  ticks;
+    uint32_t  slot;
+} sb_capture_buffer_type;
+
+
+/*
+ * The buffers move between the free stack (owned by the main thread while
+ * it reads into one) and the filled queue (in capture order, consumed by
+ * the writer). Both are only touched under the lock.
+ */
+typedef struct sb_capture {
+    bool                   enabled;
+    FILE                  *file;
+    int                    width;
+    int                    height;
+    uint32_t               interval;
+    bool                   started;
+    uint32_t               start_ticks;
+    uint32_t               next_slot;
+    sb_capture_buffer_type buffers[SB_CAPTURE_BUFFERS];
+    size_t                 free[SB_CAPTURE_BUFFERS];
+    size_t                 free_count;
+    size_t                 filled[SB_CAPTURE_BUFFERS];
+    size_t                 filled_head;
+    size_t                 filled_count;
+    uint8_t               *yuv;
+    size_t                 yuv_size;
+    SDL_Thread            *thread;
+    SDL_mutex             *lock;
+    SDL_cond              *cond;
+    bool                   quit;
+    sb_capture_stats_type  stats;
+} sb_capture_type;
+
+
+static sb_capture_type sb_capture;
+
+
+/*
+ * Convert an ARGB frame to planar 4:2:0 YUV, BT.601 full range (JPEG
+ * style, as the header says). Chroma is taken from the average of each 2x2
+ * block.
+ */
+static void
+sb_capture_convert (const uint32_t *pixels,
+                    int             width,
+                    int             height,
+                    uint8_t        *yuv)
+{
+    uint8_t        *y_plane = yuv;
+    uint8_t        *u_plane = y_plane + width * height;
+    uint8_t        *v_plane = u_plane + ((width + 1) / 2) * ((height + 1) / 2);
+    const uint32_t *row;
+    uint32_t        pixel;
+    int             r;
+    int             g;
+    int             b;
+    int             x;
+    int             y;
+    int             dx;
+    int             dy;
+    int             n;
+
+    for (y = 0; y < height; y++) {
+        row = pixels + y * width;
+        for (x = 0; x < width; x++) {
+            pixel = row[x];
+            r = (pixel >> 16) & 0xff;
+            g = (pixel >> 8) & 0xff;
+            b = pixel & 0xff;
+            *y_plane++ = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+        }
+    }
+
+    for (y = 0; y < height; y += 2) {
+        for (x = 0; x < width; x += 2) {
+            r = g = b = n = 0;
+            for (dy = 0; dy < 2 && y + dy < height; dy++) {
+                for (dx = 0; dx < 2 && x + dx < width; dx++) {
+                    pixel = pixels[(y + dy) * width + x + dx];
+                    r += (pixel >> 16) & 0xff;
+                    g += (pixel >> 8) & 0xff;
+                    b += pixel & 0xff;
+                    n++;
+                }
+            }
+            r /= n;
+            g /= n;
+            b /= n;
+            *u_plane++ = (-11059 * r - 21709 * g + 32768 * b +
+                          (128 << 16) + 32768) >> 16;
+            *v_plane++ = (32768 * r - 27439 * g - 5329 * b +
+                          (128 << 16) + 32768) >> 16;
+        }
+    }
+}
+
+
+static void
+sb_capture_write_frame (sb_capture_type *capture,
+                        uint32_t         ticks)
+{
+    fprintf(capture->file, "FRAME XTS=%" PRIu32 "\n", ticks);
+    (void)fwrite(capture->yuv, 1, capture->yuv_size, capture->file);
+}
+
+
+/*
+ * Writer thread - convert and write out filled buffers, in order, until
+ * told to quit and the queue is empty.
+ */
+static int
+sb_capture_writer (void *data)
+{
+    sb_capture_type        *capture = data;
+    sb_capture_buffer_type *buffer;
+    size_t                  index;
+    uint32_t                last_slot = 0;
+    uint32_t                last_ticks = 0;
+    uint32_t                repeat;
+    uint32_t                i;
+    bool                    have_last = false;
+
+    SDL_LockMutex(capture->lock);
+    while (!capture->quit || capture->filled_count > 0) {
+        if (capture->filled_count == 0) {
+            SDL_CondWait(capture->cond, capture->lock);
+            continue;
+        }
+
+        index = capture->filled[capture->filled_head];
+        capture->filled_head = (capture->filled_head + 1) %
+                                                        SB_CAPTURE_BUFFERS;
+        capture->filled_count--;
+        SDL_UnlockMutex(capture->lock);
+
+        buffer = &capture->buffers[index];
+
+        /*
+         * Fill any gap left by dropped frames with the last frame written,
+         * which is still in the YUV buffer.
+         */
+        repeat = 0;
+        if (have_last && buffer->slot > last_slot + 1) {
+            repeat = MIN(buffer->slot - last_slot - 1,
+                         SB_CAPTURE_MAX_REPEAT);
+        }
+        for (i = 0; i < repeat; i++) {
+            sb_capture_write_frame(capture, last_ticks);
+        }
+
+        sb_capture_convert(buffer->pixels, capture->width, capture->height,
+                           capture->yuv);
+        sb_capture_write_frame(capture, buffer->ticks);
+        last_slot = buffer->slot;
+        last_ticks = buffer->ticks;
+        have_last = true;
+
+        SDL_LockMutex(capture->lock);
+        capture->stats.written++;
+        capture->stats.repeated += repeat;
+        capture->free[capture->free_count++] = index;
+    }
+    SDL_UnlockMutex(capture->lock);
+
+    return 0;
+}
+
+
+/*
+ * Start recording the renderer's output to filename at fps frames per
+ * second. Returns false if the file or buffers couldn't be set up.
+ */
+bool
+sb_capture_setup (SDL_Renderer *renderer,
+                  const char   *filename,
+                  uint32_t      fps)
+{
+    sb_capture_type *capture = &sb_capture;
+    size_t           i;
+
+    memset(capture, 0, sizeof(*capture));
+    fps = MAX(1, MIN(fps, 1000));
+    capture->interval = 1000 / fps;
+
+    if (SDL_GetRendererOutputSize(renderer, &capture->width,
+                                  &capture->height) != 0) {
+        return false;
+    }
+
+    capture->yuv_size = capture->width * capture->height +
+                        2 * ((capture->width + 1) / 2) *
+                            ((capture->height + 1) / 2);
+    capture->yuv = malloc(capture->yuv_size);
+    for (i = 0; i < SB_CAPTURE_BUFFERS; i++) {
+        capture->buffers[i].pixels = malloc(capture->width *
+                                            capture->height *
+                                            sizeof(uint32_t));
+        capture->free[capture->free_count++] = i;
+    }
+
+    capture->file = fopen(filename, "wb");
+    if (capture->file != NULL) {
+        fprintf(capture->file, "YUV4MPEG2 W%d H%d F%" PRIu32 ":1 Ip A1:1 "
+                               "C420jpeg XCOLORRANGE=FULL\n",
+                capture->width, capture->height, fps);
+    }
+
+    capture->lock = SDL_CreateMutex();
+    capture->cond = SDL_CreateCond();
+    capture->enabled = true;
+    capture->thread = SDL_CreateThread(&sb_capture_writer, "capture writer",
+                                       capture);
+
+    for (i = 0; i < SB_CAPTURE_BUFFERS; i++) {
+        if (capture->buffers[i].pixels == NULL) {
+            capture->enabled = false;
+        }
+    }
+    if (capture->file == NULL || capture->yuv == NULL ||
+        capture->thread == NULL) {
+        capture->enabled = false;
+    }
+    if (!capture->enabled) {
+        sb_capture_cleanup();
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * Stop the writer once it has written everything captured, and close the
+ * file.
+ */
+void
+sb_capture_cleanup (void)
+{
+    sb_capture_type *capture = &sb_capture;
+    size_t           i;
+
+    capture->enabled = false;
+
+    if (capture->thread != NULL) {
+        SDL_LockMutex(capture->lock);
+        capture->quit = true;
+        SDL_CondSignal(capture->cond);
+        SDL_UnlockMutex(capture->lock);
+        SDL_WaitThread(capture->thread, NULL);
+        capture->thread = NULL;
+    }
+
+    if (capture->file != NULL) {
+        fclose(capture->file);
+        capture->file = NULL;
+    }
+
+    for (i = 0; i < SB_CAPTURE_BUFFERS; i++) {
+        free(capture->buffers[i].pixels);
+        capture->buffers[i].pixels = NULL;
+    }
+    free(capture->yuv);
+    capture->yuv = NULL;
+
+    SDL_DestroyCond(capture->cond);
+    capture->cond = NULL;
+    SDL_DestroyMutex(capture->lock);
+    capture->lock = NULL;
+}
+
+
+/*
+ * Capture the frame just drawn, if it's time for the next video frame.
+ * Must be called after drawing and before SDL_RenderPresent, as the back
+ * buffer is undefined after presenting.
+ */
+void
+sb_capture_frame (SDL_Renderer *renderer,
+                  uint32_t      ticks)
+{
+    sb_capture_type        *capture = &sb_capture;
+    sb_capture_buffer_type *buffer;
+    size_t                  index;
+    uint32_t                slot;
+    uint64_t                start;
+    double                  ms;
+
+    if (!capture->enabled) {
+        return;
+    }
+
+    if (!capture->started) {
+        capture->started = true;
+        capture->start_ticks = ticks;
+    }
+    slot = (ticks - capture->start_ticks) / capture->interval;
+    if (slot < capture->next_slot) {
+        return;
+    }
+    capture->next_slot = slot + 1;
+    capture->stats.captured++;
+
+    SDL_LockMutex(capture->lock);
+    if (capture->free_count == 0) {
+        capture->stats.dropped++;
+        SDL_UnlockMutex(capture->lock);
+        return;
+    }
+    index = capture->free[--capture->free_count];
+    SDL_UnlockMutex(capture->lock);
+
+    buffer = &capture->buffers[index];
+    buffer->ticks = ticks - capture->start_ticks;
+    buffer->slot = slot;
+
+    start = SDL_GetPerformanceCounter();
+    (void)SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888,
+                               buffer->pixels,
+                               capture->width * sizeof(uint32_t));
+    ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+         SDL_GetPerformanceFrequency();
+    capture->stats.readback_total_ms += ms;
+    capture->stats.readback_max_ms = MAX(capture->stats.readback_max_ms, ms);
+
+    SDL_LockMutex(capture->lock);
+    capture->filled[(capture->filled_head + capture->filled_count) %
+                                            SB_CAPTURE_BUFFERS] = index;
+    capture->filled_count++;
+    SDL_CondSignal(capture->cond);
+    SDL_UnlockMutex(capture->lock);
+}
+
+
+/*
+ * Call after sb_capture_cleanup for the final numbers, once the writer has
+ * caught up.
+ */
+void
+sb_capture_get_stats (sb_capture_stats_type *stats)
+{
+    sb_capture_type *capture = &sb_capture;
+
+    if (capture->lock != NULL) {
+        SDL_LockMutex(capture->lock);
+    }
+    *stats = capture->stats;
+    if (capture->lock != NULL) {
+        SDL_UnlockMutex(capture->lock);
+    }
+}
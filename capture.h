@@ -0,0 +1,43 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+
+/*
+ * Recording of the game to a Y4M video file, for bug reports and reviews.
+ *
+ * Frames are read back from the renderer into a small pool of buffers
+ * allocated at setup, and a writer thread converts them to YUV and writes
+ * them out - so the main thread only pays for the readback. If the writer
+ * falls behind and no buffer is free, the frame is dropped, and the writer
+ * repeats the previous frame in its place to keep the video in time.
+ *
+ * Each frame header carries the time it was captured at, in ms from the
+ * start of the recording, as an XTS= parameter (players ignore it).
+ */
+#define SB_CAPTURE_BUFFERS 6
+
+
+typedef struct sb_capture_stats {
+    uint64_t captured;
+    uint64_t dropped;
+    uint64_t written;
+    uint64_t repeated;
+    double   readback_total_ms;
+    double   readback_max_ms;
+} sb_capture_stats_type;
+
+
+bool sb_capture_setup(SDL_Renderer *renderer,
+                      const char   *filename,
+                      uint32_t      fps);
+void sb_capture_cleanup(void);
+void sb_capture_frame(SDL_Renderer *renderer, uint32_t ticks);
+void sb_capture_get_stats(sb_capture_stats_type *stats);
+
+
+#endif /* __CAPTURE_H__ */
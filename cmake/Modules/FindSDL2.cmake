@@ -165,8 +165,25 @@ IF(SDL2_LIBRARY_TEMP)
 	SET(SDL2_LIBRARY_TEMP "${SDL2_LIBRARY_TEMP}" CACHE INTERNAL "")
 ENDIF(SDL2_LIBRARY_TEMP)
 
+# Read the version from the headers, so callers can ask for a minimum.
+IF(SDL2_INCLUDE_DIR AND EXISTS "${SDL2_INCLUDE_DIR}/SDL_version.h")
+	FILE(STRINGS "${SDL2_INCLUDE_DIR}/SDL_version.h" SDL2_VERSION_LINES
+	     REGEX "^#define[ \t]+SDL_(MAJOR_VERSION|MINOR_VERSION|PATCHLEVEL)[ \t]+[0-9]+")
+	STRING(REGEX REPLACE ".*SDL_MAJOR_VERSION[ \t]+([0-9]+).*" "\\1"
+	       SDL2_VERSION_MAJOR "${SDL2_VERSION_LINES}")
+	STRING(REGEX REPLACE ".*SDL_MINOR_VERSION[ \t]+([0-9]+).*" "\\1"
+	       SDL2_VERSION_MINOR "${SDL2_VERSION_LINES}")
+	STRING(REGEX REPLACE ".*SDL_PATCHLEVEL[ \t]+([0-9]+).*" "\\1"
+	       SDL2_VERSION_PATCH "${SDL2_VERSION_LINES}")
+	SET(SDL2_VERSION_STRING
+	    "${SDL2_VERSION_MAJOR}.${SDL2_VERSION_MINOR}.${SDL2_VERSION_PATCH}")
+	UNSET(SDL2_VERSION_LINES)
+ENDIF()
+
 # message("</FindSDL2.cmake>")
 
 INCLUDE(FindPackageHandleStandardArgs)
 
-FIND_PACKAGE_HANDLE_STANDARD_ARGS(SDL2 REQUIRED_VARS SDL2_LIBRARY SDL2_INCLUDE_DIR)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(SDL2
+                                  REQUIRED_VARS SDL2_LIBRARY SDL2_INCLUDE_DIR
+                                  VERSION_VAR SDL2_VERSION_STRING)
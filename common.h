@@ -0,0 +1,20 @@
+#ifndef __COMMON_H__
+#define __COMMON_H__
+
+
+/*
+ * Helpers with no dependencies, usable by the simulation code which must
+ * build without SDL.
+ */
+#include <math.h>
+
+
+#define MIN(a, b) ((a) > (b) ? (b) : (a))
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+
+
+#define DEG_TO_RAD(angle) ((angle) * M_PI / 180.0)
+#define RAD_TO_DEG(angle) ((angle) * 180.0 / M_PI)
+
+
+#endif /* __COMMON_H__ */
@@ -0,0 +1,1265 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "blit.h"
+#include "common.h"
+#include "composite.h"
+#include "job.h"
+
+
+/*
+ * A tile's list of ops to draw, as indices into the current op list.
+ */
+typedef struct sb_composite_tile {
+    SDL_Rect  rect;
+    uint16_t *ops;
+    size_t    op_count;
+} sb_composite_tile_type;
+
+
+/*
+ * The frame buffer and tiles are allocated for the largest frame at setup;
+ * a smaller frame (reduced render scale) uses the start of the buffer with
+ * a pitch of its own width, so it can be uploaded in one go.
+ *
+ * Each draw submits a job per helping thread to the job system; the jobs
+ * and the main thread then take tiles from next_tile until there are none
+ * left.
+ */
+typedef struct sb_composite {
+    bool                        enabled;
+    uint32_t                   *frame;
+    int                         max_width;
+    int                         max_height;
+    int                         width;
+    int                         height;
+    size_t                      max_ops;
+    sb_composite_tile_type     *tiles;
+    size_t                      tile_count;
+    const sb_composite_op_type *ops;
+    SDL_Texture                *texture;
+    int                         texture_width;
+    int                         texture_height;
+    int                         threads;
+    sb_job_counter_type         helpers;
+    SDL_atomic_t                next_tile;
+    sb_composite_stats_type     stats;
+} sb_composite_type;
+
+
+static sb_composite_type sb_composite;
+
+
+static inline double
+sb_composite_ms_since (uint64_t start)
+{
+    return (SDL_GetPerformanceCounter() - start) * 1000.0 /
+           SDL_GetPerformanceFrequency();
+}
+
+
+/*
+ * Blend one (already colour modulated) source pixel onto dst, the way
+ * SDL's generic blitters do.
+ */
+static inline uint32_t
+sb_composite_blend (uint32_t      dst,
+                    unsigned      sr,
+                    unsigned      sg,
+                    unsigned      sb,
+                    unsigned      sa,
+                    SDL_BlendMode blend)
+{
+    unsigned dr = (dst >> 16) & 0xff;
+    unsigned dg = (dst >> 8) & 0xff;
+    unsigned db = dst & 0xff;
+    unsigned da = dst >> 24;
+
+    switch (blend) {
+    case SDL_BLENDMODE_NONE:
+        return sa << 24 | sr << 16 | sg << 8 | sb;
+
+    case SDL_BLENDMODE_ADD:
+        if (sa < 255) {
+            sr = sr * sa / 255;
+            sg = sg * sa / 255;
+            sb = sb * sa / 255;
+        }
+        dr = MIN(255, sr + dr);
+        dg = MIN(255, sg + dg);
+        db = MIN(255, sb + db);
+        break;
+
+    case SDL_BLENDMODE_MOD:
+        dr = sr * dr / 255;
+        dg = sg * dg / 255;
+        db = sb * db / 255;
+        break;
+
+    default:
+        if (sa < 255) {
+            sr = sr * sa / 255;
+            sg = sg * sa / 255;
+            sb = sb * sa / 255;
+        }
+        dr = sr + (255 - sa) * dr / 255;
+        dg = sg + (255 - sa) * dg / 255;
+        db = sb + (255 - sa) * db / 255;
+        da = sa + (255 - sa) * da / 255;
+        break;
+    }
+
+    return da << 24 | dr << 16 | dg << 8 | db;
+}
+
+
+/*
+ * Modulate a texture pixel by the op's colour and blend it onto dst.
+ */
+static inline uint32_t
+sb_composite_blend_texel (uint32_t                    dst,
+                          uint32_t                    texel,
+                          const sb_composite_op_type *op)
+{
+    unsigned sr = (texel >> 16) & 0xff;
+    unsigned sg = (texel >> 8) & 0xff;
+    unsigned sb = texel & 0xff;
+    unsigned sa = texel >> 24;
+
+    if (sa == 0 && op->blend != SDL_BLENDMODE_NONE &&
+        op->blend != SDL_BLENDMODE_MOD) {
+        return dst;
+    }
+
+    sr = sr * op->color.r / 255;
+    sg = sg * op->color.g / 255;
+    sb = sb * op->color.b / 255;
+    sa = sa * op->color.a / 255;
+
+    return sb_composite_blend(dst, sr, sg, sb, sa, op->blend);
+}
+
+
+static inline bool
+sb_composite_intersect (const SDL_Rect *a,
+                        const SDL_Rect *b,
+                        SDL_Rect       *result)
+{
+    int x0 = MAX(a->x, b->x);
+    int y0 = MAX(a->y, b->y);
+    int x1 = MIN(a->x + a->w, b->x + b->w);
+    int y1 = MIN(a->y + a->h, b->y + b->h);
+
+    result->x = x0;
+    result->y = y0;
+    result->w = x1 - x0;
+    result->h = y1 - y0;
+
+    return (result->w > 0 && result->h > 0);
+}
+
+
+/*
+ * The area an op may touch, before clipping.
+ */
+static void
+sb_composite_op_bounds (const sb_composite_type    *composite,
+                        const sb_composite_op_type *op,
+                        SDL_Rect                   *bounds)
+{
+    double cx;
+    double cy;
+    double hw;
+    double hh;
+    double c;
+    double s;
+
+    if (op->kind == SB_COMPOSITE_OP_CLEAR) {
+        bounds->x = 0;
+        bounds->y = 0;
+        bounds->w = composite->width;
+        bounds->h = composite->height;
+        return;
+    }
+
+    *bounds = op->dst;
+    if (op->kind != SB_COMPOSITE_OP_COPY || op->angle == 0.0) {
+        return;
+    }
+
+    c = fabs(cos(DEG_TO_RAD(op->angle)));
+    s = fabs(sin(DEG_TO_RAD(op->angle)));
+    cx = op->dst.x + op->dst.w / 2.0;
+    cy = op->dst.y + op->dst.h / 2.0;
+    hw = (op->dst.w * c + op->dst.h * s) / 2.0;
+    hh = (op->dst.w * s + op->dst.h * c) / 2.0;
+    bounds->x = floor(cx - hw);
+    bounds->y = floor(cy - hh);
+    bounds->w = (int)ceil(cx + hw) - bounds->x;
+    bounds->h = (int)ceil(cy + hh) - bounds->y;
+}
+
+
+static inline uint32_t
+sb_composite_color (SDL_Color color)
+{
+    return (uint32_t)color.a << 24 | (uint32_t)color.r << 16 |
+           (uint32_t)color.g << 8 | color.b;
+}
+
+
+/*
+ * Alpha blended fills, and copies in blend mode with no rotation (i.e. most
+ * of what gets drawn), go through the row kernels in blit.c. Everything
+ * else is done a pixel at a time here.
+ */
+static void
+sb_composite_fill (sb_composite_type          *composite,
+                   const sb_composite_op_type *op,
+                   const SDL_Rect             *area)
+{
+    uint32_t *row;
+    uint32_t  color = sb_composite_color(op->color);
+    int       x;
+    int       y;
+
+    for (y = area->y; y < area->y + area->h; y++) {
+        row = composite->frame + y * composite->width;
+        if (op->blend == SDL_BLENDMODE_NONE) {
+            for (x = area->x; x < area->x + area->w; x++) {
+                row[x] = color;
+            }
+        } else if (op->blend == SDL_BLENDMODE_BLEND) {
+            sb_blit_fill(row + area->x, area->w, color);
+        } else {
+            for (x = area->x; x < area->x + area->w; x++) {
+                row[x] = sb_composite_blend(row[x], op->color.r,
+                                            op->color.g, op->color.b,
+                                            op->color.a, op->blend);
+            }
+        }
+    }
+}
+
+
+/*
+ * Draw one row of a copy through the kernels. Scaled rows are gathered
+ * into a row of texels first; texels outside the texture come out
+ * transparent, which blending leaves alone.
+ */
+static void
+sb_composite_copy_row (const sb_composite_op_type *op,
+                       const uint32_t             *src_row,
+                       uint32_t                   *row,
+                       const SDL_Rect             *area,
+                       int64_t                     incx)
+{
+    const SDL_Surface *pixels = op->pixels;
+    const uint32_t    *src;
+    uint32_t           texels[SB_COMPOSITE_TILE_SIZE];
+    uint32_t           color = sb_composite_color(op->color);
+    int                sx;
+    int                i;
+
+    sx = op->src.x + (area->x - op->dst.x);
+    if (incx == 1 << 16 && sx >= 0 && sx + area->w <= pixels->w) {
+        src = src_row + sx;
+    } else {
+        for (i = 0; i < area->w; i++) {
+            sx = op->src.x + (int)(((area->x + i - op->dst.x) * incx +
+                                    incx / 2) >> 16);
+            texels[i] = (sx >= 0 && sx < pixels->w) ? src_row[sx] : 0;
+        }
+        src = texels;
+    }
+
+    if (op->blend == SDL_BLENDMODE_NONE) {
+        sb_blit_copy(row + area->x, src, area->w);
+    } else if (color == 0xffffffff) {
+        sb_blit_blend(row + area->x, src, area->w);
+    } else {
+        sb_blit_tint(row + area->x, src, area->w, color);
+    }
+}
+
+
+/*
+ * Copy with scaling. Source positions are worked out from the start of the
+ * destination rect rather than the clipped area, so every tile samples
+ * exactly the pixels a single unclipped blit would.
+ */
+static void
+sb_composite_copy (sb_composite_type          *composite,
+                   const sb_composite_op_type *op,
+                   const SDL_Rect             *area)
+{
+    const SDL_Surface *pixels = op->pixels;
+    const uint32_t    *src_row;
+    uint32_t          *row;
+    int64_t            incx = ((int64_t)op->src.w << 16) / op->dst.w;
+    int64_t            incy = ((int64_t)op->src.h << 16) / op->dst.h;
+    bool               kernel;
+    int                sx;
+    int                sy;
+    int                x;
+    int                y;
+
+    /*
+     * Blend mode copies always can; unblended ones only when it's a
+     * straight copy (the gather can't leave pixels alone).
+     */
+    kernel = (op->blend == SDL_BLENDMODE_BLEND ||
+              (op->blend == SDL_BLENDMODE_NONE &&
+               sb_composite_color(op->color) == 0xffffffff &&
+               incx == 1 << 16 && op->src.x >= 0 &&
+               op->src.x + op->src.w <= pixels->w));
+
+    for (y = area->y; y < area->y + area->h; y++) {
+        sy = op->src.y + (int)(((y - op->dst.y) * incy + incy / 2) >> 16);
+        if (sy < 0 || sy >= pixels->h) {
+            continue;
+        }
+        src_row = (const uint32_t *)((const uint8_t *)pixels->pixels +
+                                     sy * pixels->pitch);
+        row = composite->frame + y * composite->width;
+
+        if (kernel) {
+            sb_composite_copy_row(op, src_row, row, area, incx);
+            continue;
+        }
+
+        for (x = area->x; x < area->x + area->w; x++) {
+            sx = op->src.x + (int)(((x - op->dst.x) * incx + incx / 2) >> 16);
+            if (sx < 0 || sx >= pixels->w) {
+                continue;
+            }
+            row[x] = sb_composite_blend_texel(row[x], src_row[sx], op);
+        }
+    }
+}
+
+
+/*
+ * Copy rotated clockwise about the centre of dst, by mapping each pixel
+ * centre back into the unrotated rect.
+ */
+static void
+sb_composite_copy_rotated (sb_composite_type          *composite,
+                           const sb_composite_op_type *op,
+                           const SDL_Rect             *area)
+{
+    const SDL_Surface *pixels = op->pixels;
+    uint32_t          *row;
+    double             c = cos(DEG_TO_RAD(op->angle));
+    double             s = sin(DEG_TO_RAD(op->angle));
+    double             cx = op->dst.x + op->dst.w / 2.0;
+    double             cy = op->dst.y + op->dst.h / 2.0;
+    double             rx;
+    double             ry;
+    double             lx;
+    double             ly;
+    int                sx;
+    int                sy;
+    int                x;
+    int                y;
+
+    for (y = area->y; y < area->y + area->h; y++) {
+        row = composite->frame + y * composite->width;
+        ry = y + 0.5 - cy;
+
+        for (x = area->x; x < area->x + area->w; x++) {
+            rx = x + 0.5 - cx;
+            lx = rx * c + ry * s + op->dst.w / 2.0;
+            ly = -rx * s + ry * c + op->dst.h / 2.0;
+            if (lx < 0.0 || ly < 0.0 || lx >= op->dst.w || ly >= op->dst.h) {
+                continue;
+            }
+
+            sx = op->src.x + (int)(lx * op->src.w / op->dst.w);
+            sy = op->src.y + (int)(ly * op->src.h / op->dst.h);
+            if (sx < 0 || sy < 0 || sx >= pixels->w || sy >= pixels->h) {
+                continue;
+            }
+            row[x] = sb_composite_blend_texel(
+                row[x],
+                ((const uint32_t *)((const uint8_t *)pixels->pixels +
+                                    sy * pixels->pitch))[sx],
+                op);
+        }
+    }
+}
+
+
+/*
+ * Which side of the line from a to b the point (x, y) is on.
+ */
+static inline float
+sb_composite_edge (const SDL_FPoint *a,
+                   const SDL_FPoint *b,
+                   float             x,
+                   float             y)
+{
+    return (b->x - a->x) * (y - a->y) - (b->y - a->y) * (x - a->x);
+}
+
+
+static inline bool
+sb_composite_inside (const SDL_FPoint *a,
+                     const SDL_FPoint *b,
+                     const SDL_FPoint *c,
+                     int               x,
+                     int               y)
+{
+    return (sb_composite_edge(a, b, x + 0.5f, y + 0.5f) >= 0.0f &&
+            sb_composite_edge(b, c, x + 0.5f, y + 0.5f) >= 0.0f &&
+            sb_composite_edge(c, a, x + 0.5f, y + 0.5f) >= 0.0f);
+}
+
+
+/*
+ * Fill the pixels of area whose centres are inside the triangle abc. Each
+ * row's pixels inside form a single run, filled in one go.
+ */
+static void
+sb_composite_triangle (sb_composite_type          *composite,
+                       const sb_composite_op_type *op,
+                       const SDL_FPoint           *a,
+                       const SDL_FPoint           *b,
+                       const SDL_FPoint           *c,
+                       const SDL_Rect             *area)
+{
+    const SDL_FPoint *swap;
+    SDL_Rect          bounds;
+    SDL_Rect          clip;
+    uint32_t         *row;
+    uint32_t          color = sb_composite_color(op->color);
+    float             winding = sb_composite_edge(a, b, c->x, c->y);
+    int               start;
+    int               x;
+    int               y;
+
+    if (winding == 0.0f) {
+        return;
+    }
+    if (winding < 0.0f) {
+        swap = b;
+        b = c;
+        c = swap;
+    }
+
+    bounds.x = floorf(MIN(a->x, MIN(b->x, c->x)));
+    bounds.y = floorf(MIN(a->y, MIN(b->y, c->y)));
+    bounds.w = (int)ceilf(MAX(a->x, MAX(b->x, c->x))) - bounds.x + 1;
+    bounds.h = (int)ceilf(MAX(a->y, MAX(b->y, c->y))) - bounds.y + 1;
+    if (!sb_composite_intersect(&bounds, area, &clip)) {
+        return;
+    }
+
+    for (y = clip.y; y < clip.y + clip.h; y++) {
+        row = composite->frame + y * composite->width;
+
+        x = clip.x;
+        while (x < clip.x + clip.w && !sb_composite_inside(a, b, c, x, y)) {
+            x++;
+        }
+        start = x;
+        while (x < clip.x + clip.w && sb_composite_inside(a, b, c, x, y)) {
+            x++;
+        }
+
+        if (op->blend == SDL_BLENDMODE_BLEND) {
+            sb_blit_fill(row + start, x - start, color);
+            continue;
+        }
+        for (; start < x; start++) {
+            row[start] = sb_composite_blend(row[start], op->color.r,
+                                            op->color.g, op->color.b,
+                                            op->color.a, op->blend);
+        }
+    }
+}
+
+
+static void
+sb_composite_strip (sb_composite_type          *composite,
+                    const sb_composite_op_type *op,
+                    const SDL_Rect             *area)
+{
+    size_t i;
+
+    for (i = 0; i + 2 < op->vertex_count; i++) {
+        sb_composite_triangle(composite, op, &op->vertices[i].position,
+                              &op->vertices[i + 1].position,
+                              &op->vertices[i + 2].position, area);
+    }
+}
+
+
+/*
+ * Fill each quad as the rect between its first and last corners.
+ */
+static void
+sb_composite_quads (sb_composite_type          *composite,
+                    const sb_composite_op_type *op,
+                    const SDL_Rect             *area)
+{
+    const SDL_Vertex *quad;
+    SDL_Rect          rect;
+    SDL_Rect          clip;
+    uint32_t         *row;
+    uint32_t          color;
+    float             left = area->x;
+    float             top = area->y;
+    float             right = area->x + area->w;
+    float             bottom = area->y + area->h;
+    size_t            i;
+    int               x;
+    int               y;
+
+    for (i = 0; i + 3 < op->vertex_count; i += 4) {
+        /*
+         * Most quads miss the tile altogether (particles are small), so
+         * weed those out before doing the rounding.
+         */
+        quad = &op->vertices[i];
+        if (quad[3].position.x < left || quad[0].position.x > right ||
+            quad[3].position.y < top || quad[0].position.y > bottom) {
+            continue;
+        }
+
+        rect.x = ceilf(quad[0].position.x - 0.5f);
+        rect.y = ceilf(quad[0].position.y - 0.5f);
+        rect.w = (int)floorf(quad[3].position.x - 0.5f) - rect.x + 1;
+        rect.h = (int)floorf(quad[3].position.y - 0.5f) - rect.y + 1;
+        if (!sb_composite_intersect(&rect, area, &clip)) {
+            continue;
+        }
+
+        color = sb_composite_color(quad->color);
+        for (y = clip.y; y < clip.y + clip.h; y++) {
+            row = composite->frame + y * composite->width;
+            if (op->blend == SDL_BLENDMODE_BLEND) {
+                sb_blit_fill(row + clip.x, clip.w, color);
+                continue;
+            }
+            for (x = clip.x; x < clip.x + clip.w; x++) {
+                row[x] = sb_composite_blend(row[x], quad->color.r,
+                                            quad->color.g, quad->color.b,
+                                            quad->color.a, op->blend);
+            }
+        }
+    }
+}
+
+
+static void
+sb_composite_draw_tile (sb_composite_type      *composite,
+                        sb_composite_tile_type *tile)
+{
+    const sb_composite_op_type *op;
+    SDL_Rect                    bounds;
+    SDL_Rect                    area;
+    size_t                      i;
+
+    for (i = 0; i < tile->op_count; i++) {
+        op = &composite->ops[tile->ops[i]];
+        sb_composite_op_bounds(composite, op, &bounds);
+        if (!sb_composite_intersect(&bounds, &tile->rect, &area)) {
+            continue;
+        }
+
+        switch (op->kind) {
+        case SB_COMPOSITE_OP_CLEAR:
+        case SB_COMPOSITE_OP_FILL:
+            sb_composite_fill(composite, op, &area);
+            break;
+
+        case SB_COMPOSITE_OP_COPY:
+            if (op->angle != 0.0) {
+                sb_composite_copy_rotated(composite, op, &area);
+            } else {
+                sb_composite_copy(composite, op, &area);
+            }
+            break;
+
+        case SB_COMPOSITE_OP_STRIP:
+            sb_composite_strip(composite, op, &area);
+            break;
+
+        case SB_COMPOSITE_OP_QUADS:
+            sb_composite_quads(composite, op, &area);
+            break;
+        }
+    }
+}
+
+
+static void
+sb_composite_run_tiles (sb_composite_type *composite)
+{
+    size_t tile;
+
+    for (;;) {
+        tile = SDL_AtomicAdd(&composite->next_tile, 1);
+        if (tile >= composite->tile_count) {
+            break;
+        }
+        sb_composite_draw_tile(composite, &composite->tiles[tile]);
+    }
+}
+
+
+/*
+ * Job - help draw tiles.
+ */
+static void
+sb_composite_tiles_job (void *data)
+{
+    sb_composite_run_tiles(data);
+}
+
+
+/*
+ * Set up for frames of at most width x height, drawn in batches of at most
+ * max_ops, on at most the given number of threads (including the main
+ * one). The helpers come from the job system, so that should be set up
+ * with at least as many.
+ */
+bool
+sb_composite_setup (int    width,
+                    int    height,
+                    size_t max_ops,
+                    int    threads)
+{
+    sb_composite_type *composite = &sb_composite;
+    size_t             tiles_x;
+    size_t             tiles_y;
+    size_t             i;
+
+    memset(composite, 0, sizeof(*composite));
+    composite->max_width = width;
+    composite->max_height = height;
+    composite->max_ops = MIN(max_ops, UINT16_MAX + 1);
+
+    tiles_x = (width + SB_COMPOSITE_TILE_SIZE - 1) / SB_COMPOSITE_TILE_SIZE;
+    tiles_y = (height + SB_COMPOSITE_TILE_SIZE - 1) / SB_COMPOSITE_TILE_SIZE;
+    composite->frame = malloc(width * height * sizeof(uint32_t));
+    composite->tiles = calloc(tiles_x * tiles_y, sizeof(*composite->tiles));
+    if (composite->frame == NULL || composite->tiles == NULL) {
+        sb_composite_cleanup();
+        return false;
+    }
+    for (i = 0; i < tiles_x * tiles_y; i++) {
+        composite->tiles[i].ops = malloc(composite->max_ops *
+                                         sizeof(composite->tiles[i].ops[0]));
+        if (composite->tiles[i].ops == NULL) {
+            sb_composite_cleanup();
+            return false;
+        }
+    }
+    composite->tile_count = tiles_x * tiles_y;
+
+    sb_composite_set_threads(threads);
+    composite->enabled = true;
+
+    sb_composite_frame_begin(width, height);
+
+    return true;
+}
+
+
+void
+sb_composite_cleanup (void)
+{
+    sb_composite_type *composite = &sb_composite;
+    size_t             i;
+
+    if (composite->tiles != NULL) {
+        for (i = 0; i < composite->tile_count; i++) {
+            free(composite->tiles[i].ops);
+        }
+        free(composite->tiles);
+        composite->tiles = NULL;
+    }
+    free(composite->frame);
+    composite->frame = NULL;
+
+    if (composite->texture != NULL) {
+        SDL_DestroyTexture(composite->texture);
+        composite->texture = NULL;
+    }
+
+    composite->enabled = false;
+}
+
+
+/*
+ * Change how many threads take part, e.g. for benchmarking.
+ */
+void
+sb_composite_set_threads (int threads)
+{
+    sb_composite.threads = MAX(1, MIN(threads, SB_COMPOSITE_MAX_THREADS));
+}
+
+
+/*
+ * Create a texture from a surface, keeping a copy of its pixels for the
+ * compositor.
+ */
+SDL_Texture *
+sb_composite_create_texture (SDL_Renderer *renderer,
+                             SDL_Surface  *surf)
+{
+    SDL_Texture *texture;
+    SDL_Surface *pixels;
+
+    texture = SDL_CreateTextureFromSurface(renderer, surf);
+    if (texture == NULL) {
+        return NULL;
+    }
+
+    pixels = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (pixels == NULL) {
+        SDL_DestroyTexture(texture);
+        return NULL;
+    }
+    (void)SDL_SetTextureUserData(texture, pixels);
+
+    return texture;
+}
+
+
+void
+sb_composite_destroy_texture (SDL_Texture *texture)
+{
+    if (texture == NULL) {
+        return;
+    }
+
+    SDL_FreeSurface(SDL_GetTextureUserData(texture));
+    SDL_DestroyTexture(texture);
+}
+
+
+/*
+ * The compositor's copy of a texture's pixels, or NULL if it doesn't have
+ * one (so can't draw it).
+ */
+const SDL_Surface *
+sb_composite_get_pixels (SDL_Texture *texture)
+{
+    return SDL_GetTextureUserData(texture);
+}
+
+
+/*
+ * Replace an area of the compositor's copy of a texture with ARGB pixels,
+ * pitch bytes to a row. The area must be inside the texture. The SDL
+ * texture itself is never drawn when compositing, so is left alone.
+ */
+void
+sb_composite_update_texture (SDL_Texture    *texture,
+                             const SDL_Rect *rect,
+                             const uint32_t *pixels,
+                             int             pitch)
+{
+    SDL_Surface *surf = SDL_GetTextureUserData(texture);
+    int          y;
+
+    if (surf == NULL || rect->x < 0 || rect->y < 0 ||
+        rect->x + rect->w > surf->w || rect->y + rect->h > surf->h) {
+        return;
+    }
+
+    for (y = 0; y < rect->h; y++) {
+        memcpy((uint8_t *)surf->pixels + (rect->y + y) * surf->pitch +
+               rect->x * sizeof(uint32_t),
+               (const uint8_t *)pixels + y * pitch,
+               rect->w * sizeof(uint32_t));
+    }
+}
+
+
+/*
+ * Start a frame of the given size, cleared to opaque black like the window
+ * would be.
+ */
+void
+sb_composite_frame_begin (int width,
+                          int height)
+{
+    sb_composite_type      *composite = &sb_composite;
+    sb_composite_tile_type *tile;
+    size_t                  tiles_x;
+    size_t                  tiles_y;
+    size_t                  i;
+
+    composite->width = MAX(1, MIN(width, composite->max_width));
+    composite->height = MAX(1, MIN(height, composite->max_height));
+
+    tiles_x = (composite->width + SB_COMPOSITE_TILE_SIZE - 1) /
+              SB_COMPOSITE_TILE_SIZE;
+    tiles_y = (composite->height + SB_COMPOSITE_TILE_SIZE - 1) /
+              SB_COMPOSITE_TILE_SIZE;
+    composite->tile_count = tiles_x * tiles_y;
+    for (i = 0; i < composite->tile_count; i++) {
+        tile = &composite->tiles[i];
+        tile->rect.x = (i % tiles_x) * SB_COMPOSITE_TILE_SIZE;
+        tile->rect.y = (i / tiles_x) * SB_COMPOSITE_TILE_SIZE;
+        tile->rect.w = MIN(SB_COMPOSITE_TILE_SIZE,
+                           composite->width - tile->rect.x);
+        tile->rect.h = MIN(SB_COMPOSITE_TILE_SIZE,
+                           composite->height - tile->rect.y);
+    }
+
+    for (i = 0; i < (size_t)(composite->width * composite->height); i++) {
+        composite->frame[i] = 0xff000000;
+    }
+}
+
+
+/*
+ * Draw a list of ops, in order, into the frame.
+ */
+void
+sb_composite_draw (const sb_composite_op_type *ops,
+                   size_t                      count)
+{
+    sb_composite_type      *composite = &sb_composite;
+    sb_composite_tile_type *tile;
+    SDL_Rect                frame_rect = { 0, 0, 0, 0 };
+    SDL_Rect                bounds;
+    SDL_Rect                area;
+    size_t                  tiles_x;
+    size_t                  i;
+    int                     tx;
+    int                     ty;
+    int                     helpers;
+    uint64_t                start = SDL_GetPerformanceCounter();
+
+    if (!composite->enabled || count == 0) {
+        return;
+    }
+    count = MIN(count, composite->max_ops);
+
+    /*
+     * Bin the ops by the tiles they touch.
+     */
+    frame_rect.w = composite->width;
+    frame_rect.h = composite->height;
+    tiles_x = (composite->width + SB_COMPOSITE_TILE_SIZE - 1) /
+              SB_COMPOSITE_TILE_SIZE;
+    for (i = 0; i < composite->tile_count; i++) {
+        composite->tiles[i].op_count = 0;
+    }
+    for (i = 0; i < count; i++) {
+        if (ops[i].kind == SB_COMPOSITE_OP_COPY &&
+            (ops[i].pixels == NULL || ops[i].dst.w <= 0 ||
+             ops[i].dst.h <= 0)) {
+            continue;
+        }
+
+        sb_composite_op_bounds(composite, &ops[i], &bounds);
+        if (!sb_composite_intersect(&bounds, &frame_rect, &area)) {
+            continue;
+        }
+
+        for (ty = area.y / SB_COMPOSITE_TILE_SIZE;
+             ty <= (area.y + area.h - 1) / SB_COMPOSITE_TILE_SIZE; ty++) {
+            for (tx = area.x / SB_COMPOSITE_TILE_SIZE;
+                 tx <= (area.x + area.w - 1) / SB_COMPOSITE_TILE_SIZE;
+                 tx++) {
+                tile = &composite->tiles[ty * tiles_x + tx];
+                tile->ops[tile->op_count++] = i;
+            }
+        }
+    }
+
+    composite->ops = ops;
+    SDL_AtomicSet(&composite->next_tile, 0);
+
+    helpers = MIN(composite->threads,
+                  (int)sb_job_get_thread_count()) - 1;
+    for (i = 0; i < (size_t)helpers; i++) {
+        sb_job_submit(&sb_composite_tiles_job, composite,
+                      &composite->helpers);
+    }
+    sb_composite_run_tiles(composite);
+    sb_job_wait(&composite->helpers);
+
+    composite->ops = NULL;
+    composite->stats.ops += count;
+    composite->stats.raster_ms += sb_composite_ms_since(start);
+}
+
+
+/*
+ * Upload the frame and stretch it over the whole window. The caller
+ * presents.
+ */
+void
+sb_composite_frame_end (SDL_Renderer *renderer,
+                        bool          linear)
+{
+    sb_composite_type *composite = &sb_composite;
+    uint64_t           start = SDL_GetPerformanceCounter();
+
+    if (!composite->enabled) {
+        return;
+    }
+
+    if (composite->texture != NULL &&
+        (composite->texture_width != composite->width ||
+         composite->texture_height != composite->height)) {
+        SDL_DestroyTexture(composite->texture);
+        composite->texture = NULL;
+    }
+    if (composite->texture == NULL) {
+        composite->texture = SDL_CreateTexture(renderer,
+                                               SDL_PIXELFORMAT_ARGB8888,
+                                               SDL_TEXTUREACCESS_STREAMING,
+                                               composite->width,
+                                               composite->height);
+        if (composite->texture == NULL) {
+            return;
+        }
+        composite->texture_width = composite->width;
+        composite->texture_height = composite->height;
+        (void)SDL_SetTextureBlendMode(composite->texture,
+                                      SDL_BLENDMODE_NONE);
+    }
+
+    (void)SDL_SetTextureScaleMode(composite->texture,
+                                  linear ? SDL_ScaleModeLinear :
+                                           SDL_ScaleModeNearest);
+    (void)SDL_UpdateTexture(composite->texture, NULL, composite->frame,
+                            composite->width * sizeof(uint32_t));
+    (void)SDL_RenderCopy(renderer, composite->texture, NULL, NULL);
+
+    composite->stats.frames++;
+    composite->stats.upload_ms += sb_composite_ms_since(start);
+}
+
+
+void
+sb_composite_get_stats (sb_composite_stats_type *stats)
+{
+    *stats = sb_composite.stats;
+}
+
+
+void
+sb_composite_reset_stats (void)
+{
+    memset(&sb_composite.stats, 0, sizeof(sb_composite.stats));
+}
+
+
+/*
+ * The draws sb_composite_check compares, each made over an opaque
+ * background. Copies are of a 32x32 texture with every level of alpha in
+ * it, including none and full.
+ *
+ * Rotated copies aren't expected to match: SDL rotates the texture into a
+ * new surface and blends that, where sb_composite_copy_rotated samples
+ * the nearest texel to each pixel centre. Only the dial is ever rotated,
+ * and it has pre-rotated frames when the compositor is in use.
+ */
+typedef struct sb_composite_check_case {
+    const char                *name;
+    sb_composite_op_kind_type  kind;
+    SDL_BlendMode              blend;
+    SDL_Color                  color;
+    SDL_Rect                   src;
+    SDL_Rect                   dst;
+    double                     angle;
+} sb_composite_check_case_type;
+
+
+#define SB_COMPOSITE_CHECK_WIDTH  160
+#define SB_COMPOSITE_CHECK_HEIGHT 120
+#define SB_COMPOSITE_CHECK_SIZE   32
+
+
+static const sb_composite_check_case_type sb_composite_check_cases[] = {
+    { "fill none", SB_COMPOSITE_OP_FILL, SDL_BLENDMODE_NONE,
+      { 200, 100, 50, 255 }, { 0, 0, 0, 0 }, { 10, 10, 100, 60 }, 0.0 },
+    { "fill blend", SB_COMPOSITE_OP_FILL, SDL_BLENDMODE_BLEND,
+      { 200, 100, 50, 128 }, { 0, 0, 0, 0 }, { -5, 20, 120, 70 }, 0.0 },
+    { "fill add", SB_COMPOSITE_OP_FILL, SDL_BLENDMODE_ADD,
+      { 90, 160, 30, 100 }, { 0, 0, 0, 0 }, { 30, 40, 140, 90 }, 0.0 },
+    { "fill mod", SB_COMPOSITE_OP_FILL, SDL_BLENDMODE_MOD,
+      { 128, 200, 255, 255 }, { 0, 0, 0, 0 }, { 0, 0, 80, 120 }, 0.0 },
+    { "copy", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_BLEND,
+      { 255, 255, 255, 255 }, { 0, 0, 32, 32 }, { 7, 9, 32, 32 }, 0.0 },
+    { "copy none", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_NONE,
+      { 255, 255, 255, 255 }, { 0, 0, 32, 32 }, { 7, 9, 32, 32 }, 0.0 },
+    { "scaled up", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_BLEND,
+      { 255, 255, 255, 255 }, { 4, 4, 24, 20 }, { 3, 5, 100, 71 }, 0.0 },
+    { "scaled down", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_BLEND,
+      { 255, 255, 255, 255 }, { 0, 0, 32, 32 }, { 20, 30, 13, 19 }, 0.0 },
+    { "scaled clipped", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_BLEND,
+      { 255, 255, 255, 255 }, { 0, 0, 32, 32 }, { -17, 90, 64, 48 }, 0.0 },
+    { "scaled none", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_NONE,
+      { 255, 255, 255, 255 }, { 0, 0, 32, 32 }, { 50, 10, 45, 70 }, 0.0 },
+    { "tinted", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_BLEND,
+      { 200, 120, 60, 180 }, { 0, 0, 32, 32 }, { 30, 20, 32, 32 }, 0.0 },
+    { "tinted scaled", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_BLEND,
+      { 255, 255, 255, 90 }, { 0, 0, 32, 32 }, { 30, 20, 77, 50 }, 0.0 },
+    { "tinted add", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_ADD,
+      { 180, 255, 90, 200 }, { 0, 0, 32, 32 }, { 30, 20, 48, 48 }, 0.0 },
+    { "tinted mod", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_MOD,
+      { 255, 160, 200, 255 }, { 0, 0, 32, 32 }, { 60, 40, 32, 32 }, 0.0 },
+    { "rotated 90", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_BLEND,
+      { 255, 255, 255, 255 }, { 0, 0, 32, 32 }, { 40, 30, 32, 32 }, 90.0 },
+    { "rotated 30", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_BLEND,
+      { 255, 255, 255, 255 }, { 0, 0, 32, 32 }, { 40, 30, 48, 40 }, 30.0 },
+    { "rotated tinted", SB_COMPOSITE_OP_COPY, SDL_BLENDMODE_BLEND,
+      { 255, 128, 64, 160 }, { 0, 0, 32, 32 }, { 50, 20, 64, 64 }, 200.0 },
+};
+
+
+/*
+ * Make the check's textures: an opaque background the size of the frame,
+ * and the sprite. Returns NULL if out of memory.
+ */
+static SDL_Surface *
+sb_composite_check_surface (bool sprite)
+{
+    SDL_Surface *surf;
+    uint32_t    *row;
+    unsigned     a;
+    int          x;
+    int          y;
+
+    surf = SDL_CreateRGBSurfaceWithFormat(
+               0,
+               sprite ? SB_COMPOSITE_CHECK_SIZE : SB_COMPOSITE_CHECK_WIDTH,
+               sprite ? SB_COMPOSITE_CHECK_SIZE : SB_COMPOSITE_CHECK_HEIGHT,
+               32, SDL_PIXELFORMAT_ARGB8888);
+    if (surf == NULL) {
+        return NULL;
+    }
+
+    for (y = 0; y < surf->h; y++) {
+        row = (uint32_t *)((uint8_t *)surf->pixels + y * surf->pitch);
+        for (x = 0; x < surf->w; x++) {
+            a = sprite ? MIN(255, (x + y * surf->w) / 4) : 255;
+            if (sprite && x % 8 == 7) {
+                a = 255;
+            }
+            row[x] = (uint32_t)a << 24 |
+                     (uint32_t)((x * 37 + y * 11) & 0xff) << 16 |
+                     (uint32_t)((x * 5 + y * 53) & 0xff) << 8 |
+                     (uint32_t)((x ^ y) * 29 & 0xff);
+        }
+    }
+
+    return surf;
+}
+
+
+static sb_composite_op_type
+sb_composite_check_op (const sb_composite_check_case_type *check,
+                       const SDL_Surface                  *sprite)
+{
+    sb_composite_op_type op;
+
+    memset(&op, 0, sizeof(op));
+    op.kind = check->kind;
+    op.pixels = (check->kind == SB_COMPOSITE_OP_COPY) ? sprite : NULL;
+    op.color = check->color;
+    op.blend = check->blend;
+    op.src = check->src;
+    op.dst = check->dst;
+    op.angle = check->angle;
+
+    return op;
+}
+
+
+/*
+ * Draw one case with SDL's software renderer, over the background.
+ */
+static void
+sb_composite_check_reference (SDL_Renderer                       *soft,
+                              SDL_Texture                        *background,
+                              SDL_Texture                        *sprite,
+                              const sb_composite_check_case_type *check)
+{
+    (void)SDL_SetTextureBlendMode(background, SDL_BLENDMODE_NONE);
+    (void)SDL_RenderCopy(soft, background, NULL, NULL);
+
+    if (check->kind == SB_COMPOSITE_OP_FILL) {
+        (void)SDL_SetRenderDrawBlendMode(soft, check->blend);
+        (void)SDL_SetRenderDrawColor(soft, check->color.r, check->color.g,
+                                     check->color.b, check->color.a);
+        (void)SDL_RenderFillRect(soft, &check->dst);
+    } else {
+        (void)SDL_SetTextureBlendMode(sprite, check->blend);
+        (void)SDL_SetTextureColorMod(sprite, check->color.r,
+                                     check->color.g, check->color.b);
+        (void)SDL_SetTextureAlphaMod(sprite, check->color.a);
+        if (check->angle != 0.0) {
+            (void)SDL_RenderCopyEx(soft, sprite, &check->src, &check->dst,
+                                   check->angle, NULL, SDL_FLIP_NONE);
+        } else {
+            (void)SDL_RenderCopy(soft, sprite, &check->src, &check->dst);
+        }
+    }
+
+    (void)SDL_RenderFlush(soft);
+}
+
+
+/*
+ * Compare the colour of every pixel of the frame with the reference; the
+ * frame is drawn opaque, so alpha is left out.
+ */
+static void
+sb_composite_check_compare (const sb_composite_type *composite,
+                            const SDL_Surface       *reference,
+                            sb_composite_check_type *result)
+{
+    const uint32_t *row;
+    uint32_t        ours;
+    uint32_t        theirs;
+    unsigned        diff;
+    int             shift;
+    int             x;
+    int             y;
+
+    result->pixels = (size_t)composite->width * composite->height;
+    result->differ = 0;
+    result->max_diff = 0;
+
+    for (y = 0; y < composite->height; y++) {
+        row = (const uint32_t *)((const uint8_t *)reference->pixels +
+                                 y * reference->pitch);
+        for (x = 0; x < composite->width; x++) {
+            ours = composite->frame[y * composite->width + x] & 0xffffff;
+            theirs = row[x] & 0xffffff;
+            if (ours == theirs) {
+                continue;
+            }
+
+            result->differ++;
+            for (shift = 0; shift < 24; shift += 8) {
+                diff = abs((int)((ours >> shift) & 0xff) -
+                           (int)((theirs >> shift) & 0xff));
+                result->max_diff = MAX(result->max_diff, diff);
+            }
+        }
+    }
+}
+
+
+/*
+ * Run every case, up to max of them, with the textures made.
+ */
+static size_t
+sb_composite_check_run (SDL_Renderer            *soft,
+                        SDL_Surface             *target,
+                        SDL_Surface             *background,
+                        SDL_Surface             *sprite,
+                        sb_composite_check_type *results,
+                        size_t                   max)
+{
+    sb_composite_type    *composite = &sb_composite;
+    sb_composite_op_type  ops[2];
+    SDL_Texture          *background_texture;
+    SDL_Texture          *sprite_texture;
+    size_t                count = 0;
+    size_t                i;
+
+    background_texture = SDL_CreateTextureFromSurface(soft, background);
+    sprite_texture = SDL_CreateTextureFromSurface(soft, sprite);
+
+    memset(ops, 0, sizeof(ops));
+    ops[0].kind = SB_COMPOSITE_OP_COPY;
+    ops[0].pixels = background;
+    ops[0].color.r = ops[0].color.g = ops[0].color.b = ops[0].color.a = 255;
+    ops[0].blend = SDL_BLENDMODE_NONE;
+    ops[0].src.w = ops[0].dst.w = SB_COMPOSITE_CHECK_WIDTH;
+    ops[0].src.h = ops[0].dst.h = SB_COMPOSITE_CHECK_HEIGHT;
+
+    for (i = 0; i < SDL_arraysize(sb_composite_check_cases) && i < max &&
+                background_texture != NULL && sprite_texture != NULL; i++) {
+        sb_composite_check_reference(soft, background_texture,
+                                     sprite_texture,
+                                     &sb_composite_check_cases[i]);
+
+        ops[1] = sb_composite_check_op(&sb_composite_check_cases[i], sprite);
+        sb_composite_frame_begin(SB_COMPOSITE_CHECK_WIDTH,
+                                 SB_COMPOSITE_CHECK_HEIGHT);
+        sb_composite_draw(ops, SDL_arraysize(ops));
+
+        results[i].name = sb_composite_check_cases[i].name;
+        results[i].exact = (sb_composite_check_cases[i].angle == 0.0);
+        sb_composite_check_compare(composite, target, &results[i]);
+        count++;
+    }
+
+    if (sprite_texture != NULL) {
+        SDL_DestroyTexture(sprite_texture);
+    }
+    if (background_texture != NULL) {
+        SDL_DestroyTexture(background_texture);
+    }
+
+    return count;
+}
+
+
+/*
+ * Draw a set of fills and plain, scaled, tinted and rotated copies both
+ * with the compositor and with SDL's software renderer, and compare them.
+ * Fills in results (up to max of them) and returns how many there are, or
+ * 0 if the compositor isn't set up or the software renderer can't be made.
+ *
+ * This uses the compositor's frame, so only call it when nothing else is
+ * being drawn, e.g. at startup.
+ */
+size_t
+sb_composite_check (sb_composite_check_type *results,
+                    size_t                   max)
+{
+    sb_composite_type *composite = &sb_composite;
+    SDL_Surface       *target;
+    SDL_Surface       *background;
+    SDL_Surface       *sprite;
+    SDL_Renderer      *soft = NULL;
+    size_t             count = 0;
+
+    if (!composite->enabled ||
+        composite->max_width < SB_COMPOSITE_CHECK_WIDTH ||
+        composite->max_height < SB_COMPOSITE_CHECK_HEIGHT) {
+        return 0;
+    }
+
+    target = SDL_CreateRGBSurfaceWithFormat(0, SB_COMPOSITE_CHECK_WIDTH,
+                                            SB_COMPOSITE_CHECK_HEIGHT, 32,
+                                            SDL_PIXELFORMAT_ARGB8888);
+    background = sb_composite_check_surface(false);
+    sprite = sb_composite_check_surface(true);
+    if (target != NULL) {
+        soft = SDL_CreateSoftwareRenderer(target);
+    }
+
+    if (soft != NULL && background != NULL && sprite != NULL) {
+        count = sb_composite_check_run(soft, target, background, sprite,
+                                       results, max);
+    }
+
+    if (soft != NULL) {
+        SDL_DestroyRenderer(soft);
+    }
+    SDL_FreeSurface(sprite);
+    SDL_FreeSurface(background);
+    SDL_FreeSurface(target);
+
+    return count;
+}
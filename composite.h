@@ -0,0 +1,109 @@
+#ifndef __COMPOSITE_H__
+#define __COMPOSITE_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+
+/*
+ * Software compositor, for machines without a GPU, where SDL's software
+ * renderer would draw the whole frame on one core.
+ *
+ * Each flush of the render buffer is handed over as a list of ops (in the
+ * order they would have been drawn). The ops are binned into screen tiles
+ * and the tiles rasterized in parallel (on the job system) into a frame
+ * buffer in memory, which is uploaded to a streaming texture and drawn over
+ * the window with a single copy at the end of the frame.
+ *
+ * Blending follows SDL's generic C blitters (premultiply, then src + (255 -
+ * srcA) * dst / 255) and scaled copies step through the source in 16.16
+ * fixed point the same way, so the output doesn't depend on the tiling or
+ * the number of threads. Rotated copies are sampled nearest-neighbour from
+ * the destination side, and triangles and quads are filled wherever a
+ * pixel's centre falls inside them.
+ *
+ * The compositor needs the pixels of everything it draws, so textures must
+ * be created with sb_composite_create_texture (sb_render_create_texture
+ * does this when compositing), which keeps an ARGB copy as user data.
+ */
+#define SB_COMPOSITE_MAX_THREADS 16
+#define SB_COMPOSITE_TILE_SIZE   64
+
+
+typedef enum {
+    SB_COMPOSITE_OP_CLEAR,
+    SB_COMPOSITE_OP_FILL,
+    SB_COMPOSITE_OP_COPY,
+    SB_COMPOSITE_OP_STRIP,
+    SB_COMPOSITE_OP_QUADS,
+} sb_composite_op_kind_type;
+
+
+/*
+ * A single draw. For copies, src is the area of the texture's pixels to
+ * use, and color is the colour and alpha modulation. Strips are triangle
+ * strips filled with color. Quads are axis-aligned, four vertices each
+ * (top left, top right, bottom left, bottom right), and filled with the
+ * colour of their first vertex. For both, dst is their bounding box.
+ */
+typedef struct sb_composite_op {
+    sb_composite_op_kind_type  kind;
+    const SDL_Surface         *pixels;
+    SDL_Color                  color;
+    SDL_BlendMode              blend;
+    SDL_Rect                   src;
+    SDL_Rect                   dst;
+    double                     angle;
+    const SDL_Vertex          *vertices;
+    size_t                     vertex_count;
+} sb_composite_op_type;
+
+
+/*
+ * How one of sb_composite_check's draws compared with SDL's software
+ * renderer: how many of the pixels came out a different colour, and the
+ * most any channel was out by. exact is false for the draws that aren't
+ * meant to match (rotated copies - see composite.c).
+ */
+typedef struct sb_composite_check {
+    const char *name;
+    bool        exact;
+    size_t      pixels;
+    size_t      differ;
+    unsigned    max_diff;
+} sb_composite_check_type;
+
+
+typedef struct sb_composite_stats {
+    uint64_t frames;
+    uint64_t ops;
+    double   raster_ms;
+    double   upload_ms;
+} sb_composite_stats_type;
+
+
+bool sb_composite_setup(int    width,
+                        int    height,
+                        size_t max_ops,
+                        int    threads);
+void sb_composite_cleanup(void);
+void sb_composite_set_threads(int threads);
+SDL_Texture *sb_composite_create_texture(SDL_Renderer *renderer,
+                                         SDL_Surface  *surf);
+void sb_composite_destroy_texture(SDL_Texture *texture);
+const SDL_Surface *sb_composite_get_pixels(SDL_Texture *texture);
+void sb_composite_update_texture(SDL_Texture    *texture,
+                                 const SDL_Rect *rect,
+                                 const uint32_t *pixels,
+                                 int             pitch);
+void sb_composite_frame_begin(int width, int height);
+void sb_composite_draw(const sb_composite_op_type *ops, size_t count);
+void sb_composite_frame_end(SDL_Renderer *renderer, bool linear);
+size_t sb_composite_check(sb_composite_check_type *results, size_t max);
+void sb_composite_get_stats(sb_composite_stats_type *stats);
+void sb_composite_reset_stats(void);
+
+
+#endif /* __COMPOSITE_H__ */
@@ -2,6 +2,7 @@
 #include <SDL2/SDL_ttf.h>
 #include "gamestate.h"
 #include "menu_main.h"
+#include "render.h"
 
 
 #define SB_ENDGAME_PAUSE_TIME 2000
@@ -34,9 +35,10 @@ static void
 sb_endgame_draw (SDL_Renderer *renderer,
                  void         *context)
 {
-    SDL_Rect rect = { 0, 0, 800, 600 };
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 180);
-    SDL_RenderFillRect(renderer, &rect);
+    SDL_Rect  rect = { 0, 0, 800, 600 };
+    SDL_Color shade = { 0, 0, 0, 180 };
+
+    sb_render_fill(0, shade, &rect);
 }
 
 
@@ -61,10 +63,12 @@ sb_endgame_cleanup (void)
 
 
 static sb_gamestate_type sb_endgame_gamestate = {
+    .name = "endgame",
     .event_cb = &sb_endgame_event,
     .update_cb = &sb_endgame_update,
     .draw_cb = &sb_endgame_draw,
-    .flags = SB_GAMESTATE_FLAG_DRAW_UNDER
+    .flags = SB_GAMESTATE_FLAG_DRAW_UNDER,
+    .events = SB_GAMESTATE_EVENTS_KEY | SB_GAMESTATE_EVENTS_MOUSE_BUTTON
 };
 
 
@@ -0,0 +1,133 @@
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include "util.h"
+#include "render.h"
+#include "font.h"
+
+
+/*
+ * Render each of chars into the atlas, side by side. map holds each
+ * character's glyph index plus one, so zero means "not in the font".
+ */
+bool
+sb_font_setup (sb_font_type *font,
+               SDL_Renderer *renderer,
+               TTF_Font     *ttf,
+               const char   *chars,
+               SDL_Color     color)
+{
+    SDL_Surface        *surfs[SB_FONT_MAX_GLYPHS];
+    SDL_Surface        *atlas;
+    SDL_Rect            rect;
+    sb_font_glyph_type *glyph;
+    size_t              count;
+    size_t              i;
+    int                 width = 0;
+    bool                ok = true;
+
+    memset(font, 0, sizeof(*font));
+    font->height = TTF_FontHeight(ttf);
+
+    count = MIN(strlen(chars), SB_FONT_MAX_GLYPHS);
+    for (i = 0; i < count; i++) {
+        glyph = &font->glyphs[i];
+        surfs[i] = TTF_RenderGlyph_Blended(ttf, (unsigned char)chars[i],
+                                           color);
+        if (surfs[i] == NULL ||
+            TTF_GlyphMetrics(ttf, (unsigned char)chars[i], NULL, NULL,
+                             NULL, NULL, &glyph->advance) != 0) {
+            ok = false;
+            continue;
+        }
+
+        glyph->rect.x = width;
+        glyph->rect.w = surfs[i]->w;
+        glyph->rect.h = surfs[i]->h;
+        width += surfs[i]->w;
+        font->map[(unsigned char)chars[i]] = i + 1;
+    }
+
+    atlas = NULL;
+    if (ok) {
+        atlas = SDL_CreateRGBSurfaceWithFormat(0, MAX(width, 1),
+                                               font->height, 32,
+                                               SDL_PIXELFORMAT_ARGB8888);
+    }
+    if (atlas != NULL) {
+        for (i = 0; i < count; i++) {
+            rect = font->glyphs[i].rect;
+            (void)SDL_SetSurfaceBlendMode(surfs[i], SDL_BLENDMODE_NONE);
+            (void)SDL_BlitSurface(surfs[i], NULL, atlas, &rect);
+        }
+        font->atlas = sb_render_create_texture(renderer, atlas);
+        SDL_FreeSurface(atlas);
+    }
+
+    for (i = 0; i < count; i++) {
+        SDL_FreeSurface(surfs[i]);
+    }
+
+    return (font->atlas != NULL);
+}
+
+
+void
+sb_font_cleanup (sb_font_type *font)
+{
+    free_texture(font->atlas);
+    font->atlas = NULL;
+}
+
+
+/*
+ * Draw a string with its top left at x, y. Returns the width drawn.
+ */
+int
+sb_font_draw (sb_font_type         *font,
+              sb_render_layer_type  layer,
+              int                   x,
+              int                   y,
+              const char           *str)
+{
+    const SDL_Color white = { 255, 255, 255, 255 };
+
+    return sb_font_draw_mod(font, layer, white, x, y, str);
+}
+
+
+/*
+ * Draw a string tinted with the given colour (and alpha).
+ */
+int
+sb_font_draw_mod (sb_font_type         *font,
+                  sb_render_layer_type  layer,
+                  SDL_Color             color,
+                  int                   x,
+                  int                   y,
+                  const char           *str)
+{
+    sb_font_glyph_type *glyph;
+    SDL_Rect            dst;
+    int                 start = x;
+
+    if (font->atlas == NULL) {
+        return 0;
+    }
+
+    for (; *str != '\0'; str++) {
+        if (font->map[(unsigned char)*str] == 0) {
+            continue;
+        }
+        glyph = &font->glyphs[font->map[(unsigned char)*str] - 1];
+
+        dst.x = x;
+        dst.y = y;
+        dst.w = glyph->rect.w;
+        dst.h = glyph->rect.h;
+        sb_render_copy_mod(layer, font->atlas, color, &glyph->rect, &dst);
+        x += glyph->advance;
+    }
+
+    return x - start;
+}
@@ -0,0 +1,51 @@
+#ifndef __FONT_H__
+#define __FONT_H__
+
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include "render.h"
+
+
+/*
+ * Bitmap fonts, for text that changes often (like the HUD). A fixed set of
+ * characters is rendered once into an atlas texture at setup; drawing a
+ * string is then one render copy per character, and never allocates.
+ * Characters not in the set are skipped.
+ */
+#define SB_FONT_MAX_GLYPHS 64
+
+typedef struct sb_font_glyph {
+    SDL_Rect rect;
+    int      advance;
+} sb_font_glyph_type;
+
+typedef struct sb_font {
+    SDL_Texture        *atlas;
+    int                 height;
+    unsigned char       map[256];
+    sb_font_glyph_type  glyphs[SB_FONT_MAX_GLYPHS];
+} sb_font_type;
+
+
+bool sb_font_setup(sb_font_type *font,
+                   SDL_Renderer *renderer,
+                   TTF_Font     *ttf,
+                   const char   *chars,
+                   SDL_Color     color);
+void sb_font_cleanup(sb_font_type *font);
+int sb_font_draw(sb_font_type         *font,
+                 sb_render_layer_type  layer,
+                 int                   x,
+                 int                   y,
+                 const char           *str);
+int sb_font_draw_mod(sb_font_type         *font,
+                     sb_render_layer_type  layer,
+                     SDL_Color             color,
+                     int                   x,
+                     int                   y,
+                     const char           *str);
+
+
+#endif /* __FONT_H__ */
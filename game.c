@@ -1,18 +1,10 @@
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_ttf.h>
 #include <math.h>
-#include "gamestate.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "rng.h"
 #include "game.h"
-#include "util.h"
-#include "menu_pause.h"
-#include "endgame.h"
-
-/*
- * Max numbers of game entities, for sizing arrays.
- */
-#define MAX_CUSTOMERS 32
-#define MAX_CABLES 16
-
 
 /*
  * Range of times (in ms) between new calls.
@@ -21,27 +13,15 @@
 #define NEW_CALL_TIME_MAX 10000
 
 
-#define HUD_FONT_NAME "media/carbon.ttf"
-#define HUD_FONT_SIZE 32
-
-
-#define SUCCESS_POINTS 10 
+#define SUCCESS_POINTS 10
 #define FAILURE_POINTS 5
 
 
 /*
- * Enumeration representing the state of an individual
- * customer on the switchboard.
+ * Snapshot header values. Bump the version whenever sb_game_type changes.
  */
-typedef enum {
-    LINE_STATE_IDLE,
-    LINE_STATE_DIALING,
-    LINE_STATE_OPERATOR_REQUEST,
-    LINE_STATE_ANSWERING,
-    LINE_STATE_OPERATOR_REPLY,
-    LINE_STATE_BUSY,
-    LINE_STATE_COUNT
-} sb_line_state_type;
+#define SNAPSHOT_MAGIC   0x53424753 // "SBGS"
+#define SNAPSHOT_VERSION 6
 
 
 /*
@@ -58,7 +38,7 @@ typedef struct {
  * An array of the min amd max times a customer stay in each state, indexed
  * by the state enum value.
  */
-static sb_line_state_update_range_type
+static const sb_line_state_update_range_type
 sb_game_line_state_update_ranges[LINE_STATE_COUNT] =
 {
     { 0,     0 },     // LINE_STATE_IDLE
@@ -71,53 +51,52 @@ sb_game_line_state_update_ranges[LINE_STATE_COUNT] =
 
 
 /*
- * There is a circular depenency between cables and customers,
- * so need a forward declaration here.
- */
-typedef struct sb_cable sb_cable_type;
-
-
-/*
- * Structure containing all information about a customer.
+ * Structure containing all information about a customer. Customers and
+ * cables refer to each other by index into the game's arrays, with -1
+ * meaning none, so the whole game can be copied as plain data. It is the
+ * same as the board's, so the board can point at the game's customers
+ * instead of copying them.
  */
-typedef struct sb_game_customer {
-    size_t                   index;
-    sb_line_state_type       line_state;
-    uint32_t                 last_update;
-    uint32_t                 next_update;
-    SDL_Rect                 port_rect;
-    SDL_Rect                 mugshot_rect;
-    SDL_Rect                 light_rect;
-    sb_cable_type           *port_cable;
-    struct sb_game_customer *target_cust;
-} sb_game_customer_type;
+typedef sb_game_board_customer_type sb_game_customer_type;
 
 
 /*
  * Structure containing all information about a cable, including
  * the associated buttons.
  */
-struct sb_cable {
-    size_t                 index;
-    sb_game_customer_type *customer;
-    SDL_Rect               cable_base_rect;
-    SDL_Rect               cord_hole_rect;
-    SDL_Rect               speak_button_rect;
-    SDL_Rect               dial_button_rect;
-    SDL_Color              color;
-};
+typedef struct sb_cable {
+    size_t            index;
+    int               customer;
+    sb_game_rect_type cable_base_rect;
+    sb_game_rect_type cord_hole_rect;
+    sb_game_rect_type speak_button_rect;
+    sb_game_rect_type dial_button_rect;
+} sb_cable_type;
 
 
-/*
- * The count of numbers on the rotary dial.
- */
-#define ROTARY_NUMS 10
 #define ROTARY_SEGMENT_ANGLE 30
 #define ROTARY_START_ANGLE 150
 #define ROTARY_RETURN_ANGLE 120
 #define ROTARY_RETURN_SPEED 0.01f
 
 
+/*
+ * The numbers on the dial sit this far from its centre, and are this big.
+ */
+#define ROTARY_NUMBER_RADIUS 42
+#define ROTARY_NUMBER_SIZE   16
+
+
+/*
+ * Clicks on the dial are looked up by angle, in sectors of one degree.
+ */
+#define ROTARY_SECTORS 360
+
+#if ROTARY_NUMS > 16
+#error ROTARY_NUMS must fit in the bits of a sector
+#endif
+
+
 typedef enum {
     SB_GAME_ROTARY_STATE_IDLE,
     SB_GAME_ROTARY_STATE_TURNING,
@@ -125,10 +104,18 @@ typedef enum {
 } sb_game_rotary_state_type;
 
 
+/*
+ * The dial. Its layout is worked out once, in sb_game_layout: sectors
+ * holds, for each degree round from the top, a bit for each number whose
+ * rect reaches into it.
+ */
 typedef struct sb_game_rotary {
     sb_game_rotary_state_type state;
-    SDL_Rect                  bounds;
-    SDL_Rect                  number_rects[ROTARY_NUMS];
+    sb_game_rect_type         bounds;
+    int                       center_x;
+    int                       center_y;
+    sb_game_rect_type         number_rects[ROTARY_NUMS];
+    uint16_t                  sectors[ROTARY_SECTORS];
     size_t                    turning_index;
     float                     start_angle;
     float                     angle;
@@ -136,40 +123,101 @@ typedef struct sb_game_rotary {
 
 
 /*
- * Structure containing game state.
+ * Structure containing game state. Everything apart from the listener and
+ * the view is plain data, and is saved as-is by sb_game_snapshot - apart
+ * from the customers past customer_count, which are left out.
+ */
+struct sb_game {
+    sb_game_listener_fn_type  listener;
+    void                     *listener_ctx;
+    sb_game_view_type         view;
+    sb_game_config_type       config;
+    sb_rng_type               rng;
+    uint32_t                  gametime;
+    uint32_t                  next_call_time;
+    sb_game_stats_type        stats;
+    size_t                    customer_count;
+    sb_game_customer_type     customers[MAX_CUSTOMERS];
+    uint32_t                  line_states[LINE_STATE_COUNT];
+    uint32_t                  active_calls;
+    sb_game_rect_type         bounds;
+    size_t                    panel_columns;
+    size_t                    cable_count;
+    sb_cable_type             cables[MAX_CABLES];
+    int                       held_cable;
+    int                       active_cable;
+    int                       pointer_x;
+    int                       pointer_y;
+    sb_game_rotary_type       rotary;
+};
+
+
+/*
+ * A snapshot is this header followed by a payload of size bytes: the game
+ * from the config up to the customers, the customer_count customers in
+ * use, then the rest of the game after the customers - which starts at
+ * line_states, so that has to stay straight after them.
+ */
+typedef struct sb_game_snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t checksum;
+} sb_game_snapshot_header_type;
+
+
+#define SNAPSHOT_HEAD_OFFSET offsetof(sb_game_type, config)
+#define SNAPSHOT_HEAD_SIZE   (offsetof(sb_game_type, customers) - \
+                              SNAPSHOT_HEAD_OFFSET)
+#define SNAPSHOT_TAIL_OFFSET offsetof(sb_game_type, line_states)
+#define SNAPSHOT_TAIL_SIZE   (sizeof(sb_game_type) - SNAPSHOT_TAIL_OFFSET)
+#define SNAPSHOT_PAYLOAD_SIZE(count) \
+    (SNAPSHOT_HEAD_SIZE + (count) * sizeof(sb_game_customer_type) + \
+     SNAPSHOT_TAIL_SIZE)
+
+
+/*
+ * Determine if a point lands within a given rectangle.
  */
-typedef struct sb_game {
-    uint32_t                gametime;
-    uint32_t                leveltime;
-    uint32_t                next_call_time;
-    uint32_t                score;
-    size_t                  customer_count;
-    sb_game_customer_type   customers[MAX_CUSTOMERS];
-    size_t                  cable_count;
-    sb_cable_type           cables[MAX_CABLES];
-    sb_cable_type          *held_cable;
-    sb_cable_type          *active_cable;
-    sb_game_rotary_type     rotary;
-    TTF_Font               *hud_font;
-    SDL_Texture            *console_texture;
-    SDL_Texture            *panel_texture;
-    SDL_Texture            *port_texture;
-    SDL_Texture            *flash_texture;
-    SDL_Texture            *plug_connected_texture;
-    SDL_Texture            *plug_loose_texture;
-    SDL_Texture            *mug_background_texture;
-    SDL_Texture            *speech_bubble_texture;
-    SDL_Texture            *button_texture;
-    SDL_Texture            *button_flash_texture;
-    SDL_Texture            *cord_texture;
-    SDL_Texture            *cord_hole_texture;
-    SDL_Texture            *rotary_texture;
-    SDL_Texture            *rotary_top_texture;
-    SDL_Texture            *mugshot_textures[MAX_CUSTOMERS];
-} sb_game_type;
-
-
-static sb_game_type sb_game;
+static inline bool
+sb_game_point_in_rect (int                      x,
+                       int                      y,
+                       const sb_game_rect_type *rect)
+{
+    return (x > rect->x && x < rect->x + rect->w &&
+            y > rect->y && y < rect->y + rect->h);
+}
+
+
+static void
+sb_game_notify_points (sb_game_type            *game,
+                       sb_game_event_kind_type  kind,
+                       int                      customer,
+                       int                      other,
+                       int                      points)
+{
+    sb_game_event_type event;
+
+    if (game->listener == NULL) {
+        return;
+    }
+
+    event.kind = kind;
+    event.customer = customer;
+    event.other = other;
+    event.points = points;
+    game->listener(&event, game->listener_ctx);
+}
+
+
+static void
+sb_game_notify (sb_game_type            *game,
+                sb_game_event_kind_type  kind,
+                int                      customer,
+                int                      other)
+{
+    sb_game_notify_points(game, kind, customer, other, 0);
+}
 
 
 /*
@@ -183,8 +231,7 @@ sb_game_rotary_angle (sb_game_type *game,
 {
     float angle;
 
-    // TODO: Use the center point, not hardcoded coords.
-    angle = atan2f(x - 100, 100 - y); 
+    angle = atan2f(x - game->rotary.center_x, game->rotary.center_y - y);
     while (angle < 0.0f) {
         angle += M_PI * 2;
     }
@@ -217,9 +264,9 @@ sb_game_rotary_angle_normalized (sb_game_type *game,
 
 
 static inline uint32_t
-sb_game_remaining_time (sb_game_type *game)
+sb_game_remaining_time (const sb_game_type *game)
 {
-    const uint32_t leveltime_ms = game->leveltime * 1000;
+    const uint32_t leveltime_ms = game->config.leveltime * 1000;
     if (game->gametime >= leveltime_ms) {
         return 0;
     }
@@ -230,16 +277,37 @@ sb_game_remaining_time (sb_game_type *game)
 
 
 static void
-sb_game_handle_success (sb_game_type *game)
+sb_game_handle_success (sb_game_customer_type *cust,
+                        sb_game_customer_type *other_cust,
+                        sb_game_type          *game)
 {
-    game->score += SUCCESS_POINTS;
+    game->stats.score += SUCCESS_POINTS;
+    game->stats.connected++;
+    sb_game_notify_points(game, SB_GAME_EVENT_SUCCESS, cust->index,
+                          other_cust->index, SUCCESS_POINTS);
 }
 
 
 static void
-sb_game_handle_failure (sb_game_type *game)
+sb_game_handle_failure (sb_game_customer_type *cust,
+                        sb_game_type          *game)
+{
+    uint32_t points = MIN(game->stats.score, FAILURE_POINTS);
+
+    game->stats.score -= points;
+    sb_game_notify_points(game, SB_GAME_EVENT_FAILURE, cust->index, -1,
+                          -(int)points);
+}
+
+
+/*
+ * Whether a customer counts as being in a call: from starting to dial until
+ * they hang up (see active_calls).
+ */
+static inline bool
+sb_game_in_call (const sb_game_customer_type *cust)
 {
-    game->score = MIN(0, game->score - FAILURE_POINTS);
+    return cust->line_state != LINE_STATE_IDLE && cust->target_cust >= 0;
 }
 
 
@@ -248,9 +316,18 @@ sb_game_update_customer_state (sb_game_customer_type *cust,
                                sb_game_type          *game,
                                sb_line_state_type     state)
 {
+    game->line_states[cust->line_state]--;
+    game->line_states[state]++;
+    game->active_calls -= sb_game_in_call(cust);
     cust->line_state = state;
+    game->active_calls += sb_game_in_call(cust);
     cust->last_update = game->gametime;
-    cust->next_update = random_range(
+
+    if (state == LINE_STATE_DIALING || state == LINE_STATE_ANSWERING) {
+        sb_game_notify(game, SB_GAME_EVENT_RING, cust->index, -1);
+    }
+
+    cust->next_update = sb_rng_range(&game->rng,
                  game->gametime + sb_game_line_state_update_ranges[state].min,
                  game->gametime + sb_game_line_state_update_ranges[state].max);
 }
@@ -264,9 +341,7 @@ sb_game_find_idle_customer (sb_game_type *game)
 {
     size_t                 i;
     size_t                 idle_count = 0;
-    size_t                 index;
     size_t                 result_num;
-    sb_game_customer_type *result = NULL;
 
     /*
      * Count the number of idle customers.
@@ -277,21 +352,25 @@ sb_game_find_idle_customer (sb_game_type *game)
         }
     }
 
-    if (idle_count > 0) {
-        /*
-         * Pick a random idle customer, loop through the array skipping
-         * non-idle customers.
-         */
-        result_num = random_range(1, idle_count);
-        for (i = 0; result_num > 0 && i < game->customer_count; i++) {
-            if (game->customers[i].line_state == LINE_STATE_IDLE) {
-                result_num--;
+    if (idle_count == 0) {
+        return NULL;
+    }
+
+    /*
+     * Pick a random idle customer, loop through the array skipping
+     * non-idle customers.
+     */
+    result_num = sb_rng_range(&game->rng, 0, idle_count - 1);
+    for (i = 0; i < game->customer_count; i++) {
+        if (game->customers[i].line_state == LINE_STATE_IDLE) {
+            if (result_num == 0) {
+                break;
             }
+            result_num--;
         }
-        result = &game->customers[i];
     }
 
-    return result;
+    return &game->customers[i];
 }
 
 
@@ -303,10 +382,9 @@ static sb_game_customer_type *
 sb_game_find_target_customer (sb_game_customer_type *src_cust,
                               sb_game_type          *game)
 {
-    size_t                 result_index;
-    sb_game_customer_type *result;
+    size_t result_index;
 
-    result_index = random_at_most(game->customer_count - 2);
+    result_index = sb_rng_range(&game->rng, 0, game->customer_count - 2);
     if (result_index >= src_cust->index) {
         result_index++;
     }
@@ -323,17 +401,21 @@ static sb_game_customer_type *
 sb_game_find_connected_customer (sb_game_customer_type *cust,
                                  sb_game_type          *game)
 {
-    sb_game_customer_type *result = NULL;
-    sb_cable_type         *cable = cust->port_cable;
-    sb_cable_type         *matching_cable;
-
-    if (cable != NULL) {
-        matching_cable = &game->cables[
-                    cable->index % 2 == 0 ? cable->index + 1 : cable->index - 1];
-        result = matching_cable->customer;
+    sb_cable_type *matching_cable;
+
+    if (cust->port_cable < 0) {
+        return NULL;
+    }
+
+    /*
+     * Cables come in pairs - 0 with 1, 2 with 3 and so on.
+     */
+    matching_cable = &game->cables[cust->port_cable ^ 1];
+    if (matching_cable->customer < 0) {
+        return NULL;
     }
 
-    return (result);
+    return &game->customers[matching_cable->customer];
 }
 
 
@@ -341,26 +423,26 @@ static void
 sb_game_talk_button_press (sb_cable_type *cable,
                            sb_game_type  *game)
 {
+    sb_game_customer_type *cust;
     sb_game_customer_type *other_cust;
 
-    if (cable->customer == NULL) {
+    if (cable->customer < 0) {
         return;
     }
+    cust = &game->customers[cable->customer];
 
-    if (game->active_cable == cable) {
+    if (game->active_cable == (int)cable->index) {
         /*
          * Deactivate the cable.
          */
-        game->active_cable = NULL;
+        game->active_cable = -1;
 
-        if (cable->customer->line_state == LINE_STATE_OPERATOR_REPLY) {
-            other_cust = sb_game_find_connected_customer(
-                                                    cable->customer, game);
+        if (cust->line_state == LINE_STATE_OPERATOR_REPLY) {
+            other_cust = sb_game_find_connected_customer(cust, game);
             if (other_cust != NULL &&
-                other_cust->target_cust == cable->customer) {
-                sb_game_handle_success(game);
-                sb_game_update_customer_state(cable->customer, game,
-                                              LINE_STATE_BUSY);
+                other_cust->target_cust == (int)cust->index) {
+                sb_game_handle_success(cust, other_cust, game);
+                sb_game_update_customer_state(cust, game, LINE_STATE_BUSY);
                 sb_game_update_customer_state(other_cust, game,
                                               LINE_STATE_BUSY);
                 /*
@@ -368,17 +450,17 @@ sb_game_talk_button_press (sb_cable_type *cable,
                  * different update time - we want both customers to move back
                  * to idle at the same time.
                  */
-                other_cust->next_update = cable->customer->next_update;
+                other_cust->next_update = cust->next_update;
             }
         }
     } else {
         /*
          * Activate the cable.
          */
-        game->active_cable = cable;
+        game->active_cable = cable->index;
 
-        if (cable->customer->line_state == LINE_STATE_DIALING) {
-            sb_game_update_customer_state(cable->customer, game,
+        if (cust->line_state == LINE_STATE_DIALING) {
+            sb_game_update_customer_state(cust, game,
                                           LINE_STATE_OPERATOR_REQUEST);
         }
     }
@@ -386,16 +468,16 @@ sb_game_talk_button_press (sb_cable_type *cable,
 
 
 /*
- * Handle a mouse motion event.
+ * Handle the pointer moving.
  */
 static void
-sb_game_mouse_motion_event (SDL_MouseMotionEvent *e,
-                            sb_game_type         *game)
+sb_game_motion_input (const sb_game_input_type *input,
+                      sb_game_type             *game)
 {
     float angle;
 
     if (game->rotary.state == SB_GAME_ROTARY_STATE_TURNING) {
-        angle = sb_game_rotary_angle_normalized(game, e->x, e->y);
+        angle = sb_game_rotary_angle_normalized(game, input->x, input->y);
 
         if (game->rotary.angle > DEG_TO_RAD(300) && angle < DEG_TO_RAD(60)) {
             /*
@@ -413,27 +495,35 @@ sb_game_mouse_motion_event (SDL_MouseMotionEvent *e,
         }
 
         game->rotary.angle = angle;
-        printf("%f\n", RAD_TO_DEG(angle));
     }
 }
 
 
 /*
- * Check whether a click has hit the rotary dial.
+ * Check whether a click has hit the rotary dial. Only the numbers whose
+ * rects reach into the click's sector need checking.
  */
 static void
-sb_game_check_rotary_click (SDL_MouseButtonEvent *e,
-                            sb_game_type         *game)
+sb_game_check_rotary_click (const sb_game_input_type *input,
+                            sb_game_type             *game)
 {
-    size_t i;
+    uint16_t numbers;
+    size_t   sector;
+    size_t   i;
 
-    for (i = 0; i < ROTARY_NUMS; i++) {
-        if (sb_point_in_rect(e->x, e->y, &game->rotary.number_rects[i])) {
+    sector = (size_t)RAD_TO_DEG(sb_game_rotary_angle(game, input->x,
+                                                     input->y));
+    numbers = game->rotary.sectors[sector % ROTARY_SECTORS];
+
+    for (i = 0; numbers != 0; i++, numbers >>= 1) {
+        if ((numbers & 1) &&
+            sb_game_point_in_rect(input->x, input->y,
+                                  &game->rotary.number_rects[i])) {
             game->rotary.state = SB_GAME_ROTARY_STATE_TURNING;
             game->rotary.turning_index = i;
 
             game->rotary.start_angle =
-                sb_game_rotary_angle_normalized(game, e->x, e->y);
+                sb_game_rotary_angle_normalized(game, input->x, input->y);
             game->rotary.angle = game->rotary.start_angle;
 
         }
@@ -443,135 +533,160 @@ sb_game_check_rotary_click (SDL_MouseButtonEvent *e,
 
 
 /*
- * Handle a mouse button down or up event.
+ * Handle the button being pressed. board_x and board_y are where it was
+ * pressed on the board, for the customers' ports.
  */
 static void
-sb_game_mouse_button_event (SDL_MouseButtonEvent *e,
-                            sb_game_type         *game)
+sb_game_button_down_input (const sb_game_input_type *input,
+                           int                       board_x,
+                           int                       board_y,
+                           sb_game_type             *game)
 {
     size_t                 i;
     sb_cable_type         *cable;
     sb_game_customer_type *cust;
     sb_game_customer_type *other_cust;
 
-    if (e->button != SDL_BUTTON_LEFT) {
-        return;
+    for (i = 0; i < game->cable_count; i++) {
+        /*
+         * Check whether this is picking up a new cable end from its base.
+         */
+        cable = &game->cables[i];
+        if (cable->customer < 0 &&
+            sb_game_point_in_rect(input->x, input->y,
+                                  &cable->cable_base_rect)) {
+            game->held_cable = i;
+        }
+
+        /*
+         * Check whether we've hit a talk button.
+         */
+        if (sb_game_point_in_rect(input->x, input->y,
+                                  &cable->speak_button_rect)) {
+            sb_game_talk_button_press(cable, game);
+        }
+
+        /*
+         * Check whether we've hit a dial button.
+         */
+        if (cable->customer >= 0 &&
+            game->customers[cable->customer].line_state == LINE_STATE_IDLE &&
+            sb_game_point_in_rect(input->x, input->y,
+                                  &cable->dial_button_rect)) {
+            sb_game_update_customer_state(&game->customers[cable->customer],
+                                          game, LINE_STATE_ANSWERING);
+            game->active_cable = -1;
+        }
     }
 
-    if (e->type == SDL_MOUSEBUTTONDOWN) {
-        for (i = 0; i < game->cable_count; i++) {
-            /*
-             * Check whether this is picking up a new cable end from its base.
-             */
-            cable = &game->cables[i];
-            if (cable->customer == NULL &&
-                sb_point_in_rect(e->x, e->y, &cable->cable_base_rect)) {
-                game->held_cable = cable;
-            }
+    // Check whether this is picking up a cable end from a customer.
+    for (i = 0; i < game->customer_count; i++) {
+        cust = &game->customers[i];
+        if (cust->port_cable >= 0 &&
+            sb_game_point_in_rect(board_x, board_y, &cust->port_rect)) {
+            game->held_cable = cust->port_cable;
 
             /*
-             * Check whether we've hit a talk button.
+             * Check if we've interupted a call, and move all involved
+             * customers back to idle.
              */
-            if (sb_point_in_rect(e->x, e->y, &cable->speak_button_rect)) {
-                sb_game_talk_button_press(cable, game);
+            if (cust->line_state == LINE_STATE_OPERATOR_REQUEST) {
+                sb_game_handle_failure(cust, game);
+                game->stats.dropped++;
+                sb_game_update_customer_state(cust, game, LINE_STATE_IDLE);
+            } else if(cust->line_state == LINE_STATE_OPERATOR_REPLY ||
+                      cust->line_state == LINE_STATE_BUSY) {
+                sb_game_handle_failure(cust, game);
+                game->stats.dropped++;
+                sb_game_update_customer_state(cust, game, LINE_STATE_IDLE);
+                other_cust = sb_game_find_connected_customer(cust, game);
+                if (other_cust != NULL) {
+                    sb_game_update_customer_state(other_cust, game,
+                                                  LINE_STATE_IDLE);
+                }
             }
 
             /*
-             * Check whether we've hit a dial button.
+             * Unplugging the cable hangs up if it was active.
              */
-            if (cable->customer != NULL &&
-                cable->customer->line_state == LINE_STATE_IDLE &&
-                sb_point_in_rect(e->x, e->y, &cable->dial_button_rect)) {
-                sb_game_update_customer_state(cable->customer, game,
-                                              LINE_STATE_ANSWERING);
-                game->active_cable = NULL;
+            if (game->held_cable == game->active_cable) {
+                game->active_cable = -1;
             }
+
+            cust->port_cable = -1;
+            game->cables[game->held_cable].customer = -1;
+            sb_game_notify(game, SB_GAME_EVENT_PLUG_OUT, cust->index, -1);
         }
+    }
 
-        // Check whether this is picking up a cable end from a customer.
-        for (i = 0; i < game->customer_count; i++) {
-            cust = &game->customers[i];
-            if (cust->port_cable != NULL &&
-                sb_point_in_rect(e->x, e->y, &cust->port_rect)) {
-                game->held_cable = cust->port_cable;
+    // Check whether we're dialing with the rotary dialer.
+    sb_game_check_rotary_click(input, game);
+}
 
-                /*
-                 * Check if we've interupted a call, and move all involved
-                 * customers back to idle.
-                 */
-                if (cust->line_state == LINE_STATE_OPERATOR_REQUEST) {
-                    sb_game_handle_failure(game);
-                    sb_game_update_customer_state(cust, game, LINE_STATE_IDLE);
-                } else if(cust->line_state == LINE_STATE_OPERATOR_REPLY ||
-                          cust->line_state == LINE_STATE_BUSY) {
-                    sb_game_handle_failure(game);
-                    sb_game_update_customer_state(cust, game, LINE_STATE_IDLE);
-                    other_cust = sb_game_find_connected_customer(cust, game);
-                    if (other_cust != NULL) {
-                        sb_game_update_customer_state(other_cust, game,
-                                                      LINE_STATE_IDLE);
-                    }
-                }
 
-                /*
-                 * Unplugging the cable hangs up if it was active.
-                 */
-                if (game->held_cable == game->active_cable) {
-                    game->active_cable = NULL;
-                }
+/*
+ * Handle the button being released, at board_x, board_y on the board.
+ */
+static void
+sb_game_button_up_input (int           board_x,
+                         int           board_y,
+                         sb_game_type *game)
+{
+    size_t                 i;
+    sb_game_customer_type *cust;
 
-                cust->port_cable = NULL;
-                game->held_cable->customer = NULL;
-            }
-        }
+    // Check whether we're putting a cable somewhere.
+    if (game->held_cable >= 0) {
+        for (i = 0; i < game->customer_count; i++) {
+            cust = &game->customers[i];
 
-        // Check whether we're dialing with the rotary dialer.
-        sb_game_check_rotary_click(e, game);
-    } else if (e->type == SDL_MOUSEBUTTONUP) {
-        // Check whether we're putting a cable somewhere.
-        if (game->held_cable != NULL) {
-            for (i = 0; i < game->customer_count; i++) {
-                cust = &game->customers[i];
-
-                if (sb_point_in_rect(e->x, e->y, &cust->port_rect) &&
-                    cust->port_cable == NULL) {
-                    cust->port_cable = game->held_cable;
-                    game->held_cable->customer = cust;
-                }
+            if (sb_game_point_in_rect(board_x, board_y, &cust->port_rect) &&
+                cust->port_cable < 0) {
+                cust->port_cable = game->held_cable;
+                game->cables[game->held_cable].customer = i;
+                sb_game_notify(game, SB_GAME_EVENT_PLUG_IN, cust->index, -1);
             }
-
-            game->held_cable = NULL;
         }
 
-        // Check whether we're releasing the rotary dialer
-        if (game->rotary.state == SB_GAME_ROTARY_STATE_TURNING) {
-            game->rotary.state = SB_GAME_ROTARY_STATE_RETURNING;
-        }
+        game->held_cable = -1;
+    }
+
+    // Check whether we're releasing the rotary dialer
+    if (game->rotary.state == SB_GAME_ROTARY_STATE_TURNING) {
+        game->rotary.state = SB_GAME_ROTARY_STATE_RETURNING;
     }
 }
 
 
 /*
- * See comment in game.h for more details.
+ * Feed a piece of pointer input to the game.
  */
-static void
-sb_game_event (SDL_Event *e,
-               void      *context)
+void
+sb_game_input (sb_game_type             *game,
+               const sb_game_input_type *input)
 {
-    switch (e->type) {
-    case SDL_MOUSEBUTTONDOWN:
-    case SDL_MOUSEBUTTONUP:
-        sb_game_mouse_button_event(&e->button, &sb_game);
+    int board_x = SB_GAME_NOWHERE;
+    int board_y = SB_GAME_NOWHERE;
+
+    game->pointer_x = input->x;
+    game->pointer_y = input->y;
+
+    if (!sb_game_on_console(input->x, input->y)) {
+        sb_game_view_to_board(&game->view, input->x, input->y,
+                              &board_x, &board_y);
+    }
+
+    switch (input->kind) {
+    case SB_GAME_INPUT_MOTION:
+        sb_game_motion_input(input, game);
         break;
 
-    case SDL_MOUSEMOTION:
-        sb_game_mouse_motion_event(&e->motion, &sb_game);
+    case SB_GAME_INPUT_BUTTON_DOWN:
+        sb_game_button_down_input(input, board_x, board_y, game);
         break;
 
-    case SDL_KEYDOWN:
-        if (e->key.keysym.sym == SDLK_ESCAPE) {
-            sb_gamestate_push(sb_menu_pause_get_gamestate());
-        }
+    case SB_GAME_INPUT_BUTTON_UP:
+        sb_game_button_up_input(board_x, board_y, game);
         break;
 
     default:
@@ -588,7 +703,8 @@ sb_game_customer_update (sb_game_customer_type *cust,
     case LINE_STATE_DIALING:
     case LINE_STATE_OPERATOR_REQUEST:
     case LINE_STATE_OPERATOR_REPLY:
-        sb_game_handle_failure(game);
+        sb_game_handle_failure(cust, game);
+        game->stats.missed++;
         sb_game_update_customer_state(cust, game, LINE_STATE_IDLE);
         break;
 
@@ -608,37 +724,43 @@ sb_game_customer_update (sb_game_customer_type *cust,
 
 
 /*
- * See comment in game.h for more details.
+ * Advance the game by frametime ms. Does nothing once the round is over.
  */
-static void
-sb_game_update (uint32_t  frametime,
-                void     *context)
+void
+sb_game_step (sb_game_type *game,
+              uint32_t      frametime)
 {
     sb_game_customer_type *src_cust;
     sb_game_customer_type *tgt_cust;
     sb_game_customer_type *cust;
-    sb_game_type          *game = &sb_game;
     size_t                 i;
+    int                    prev_segment;
 
-    game->gametime += frametime;
-
-    if (sb_game_remaining_time(game) == 0) {
-        sb_endgame_reset();
-        sb_gamestate_push(sb_endgame_get_gamestate());
+    if (sb_game_is_over(game)) {
+        return;
     }
 
+    game->gametime += frametime;
+
     if (game->gametime >= game->next_call_time) {
         /*
-         * Initiate a new call.
+         * Initiate a new call, if there is anyone free to make one.
          */
         src_cust = sb_game_find_idle_customer(game);
-        tgt_cust = sb_game_find_target_customer(src_cust, game);
+        if (src_cust != NULL) {
+            tgt_cust = sb_game_find_target_customer(src_cust, game);
+
+            src_cust->target_cust = tgt_cust->index;
+            sb_game_update_customer_state(src_cust, game, LINE_STATE_DIALING);
+            game->stats.calls++;
+            sb_game_notify(game, SB_GAME_EVENT_CALL_START, src_cust->index,
+                           tgt_cust->index);
+        }
 
-        sb_game_update_customer_state(src_cust, game, LINE_STATE_DIALING);
-        src_cust->target_cust = tgt_cust;
-        game->next_call_time = random_range(
-                                        game->gametime + NEW_CALL_TIME_MIN,
-                                        game->gametime + NEW_CALL_TIME_MAX);
+        game->next_call_time = game->gametime +
+                               sb_rng_range(&game->rng,
+                                            game->config.new_call_time_min,
+                                            game->config.new_call_time_max);
     }
 
     /*
@@ -655,8 +777,18 @@ sb_game_update (uint32_t  frametime,
      * Rotate the rotary dial if required.
      */
     if (game->rotary.state == SB_GAME_ROTARY_STATE_RETURNING) {
+        prev_segment = game->rotary.angle / DEG_TO_RAD(ROTARY_SEGMENT_ANGLE);
         game->rotary.angle -= ROTARY_RETURN_SPEED * frametime;
-        
+
+        /*
+         * Click for each number that goes past on the way back.
+         */
+        if (game->rotary.angle > game->rotary.start_angle &&
+            (int)(game->rotary.angle / DEG_TO_RAD(ROTARY_SEGMENT_ANGLE)) !=
+                                                                prev_segment) {
+            sb_game_notify(game, SB_GAME_EVENT_DIAL_CLICK, -1, -1);
+        }
+
         if (game->rotary.angle <= game->rotary.start_angle) {
             // TODO: Enter the number.
             game->rotary.state = SB_GAME_ROTARY_STATE_IDLE;
@@ -665,391 +797,173 @@ sb_game_update (uint32_t  frametime,
 }
 
 
-static void
-sb_game_draw_rotary (SDL_Renderer *renderer,
-                     sb_game_type *game)
-{
-    SDL_Rect rect;
-    float    segment_angle;
-    float    angle;
-    size_t   i;
-    int      mousex;
-    int      mousey;
-    int      endx;
-    int      endy;
-
-    if (game->rotary.state == SB_GAME_ROTARY_STATE_IDLE) {
-        endx = 100 + 50 * sinf(0);
-        endy = 100 - 50 * cosf(0);
-        angle = 0;
-    } else {
-        endx = 100 + 50 * sinf(game->rotary.angle - game->rotary.start_angle);
-        endy = 100 - 50 * cosf(game->rotary.angle - game->rotary.start_angle);
-        angle = game->rotary.angle - game->rotary.start_angle;
-    }
-    rect.x = 50;
-    rect.y = 50;
-    rect.w = 100;
-    rect.h = 100;
-    SDL_RenderCopyEx(renderer, game->rotary_texture, NULL, &rect,
-                     RAD_TO_DEG(angle), NULL, SDL_FLIP_NONE);
-    SDL_RenderCopy(renderer, game->rotary_top_texture, NULL, &rect);
-
-    for (i = 0; i < ROTARY_NUMS; i++) {
-        angle = DEG_TO_RAD(ROTARY_SEGMENT_ANGLE * i + ROTARY_START_ANGLE);
-
-        game->rotary.number_rects[i].w = 16;
-        game->rotary.number_rects[i].h = 16;
-        game->rotary.number_rects[i].x = 100 + 42 * sinf(angle) - 8;
-        game->rotary.number_rects[i].y = 100 - 42 * cosf(angle) - 8;
-
-        if (i == 0) {
-            SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-        } else {
-            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        }
-        //SDL_RenderFillRect(renderer, &game->rotary.number_rects[i]);
-    }
-}
-
-
-static void
-sb_game_draw_hud (SDL_Renderer *renderer,
-                  sb_game_type *game)
-{
-    SDL_Surface *surf;
-    SDL_Texture *texture;
-    SDL_Color    color = { 0, 0, 0, 255 };
-    char         buf[32];
-    SDL_Rect     rect = { 0, 0, 0, 0 };
-    uint32_t     remaining;
-
-    /*
-     * TODO: This is not very efficient - probably want to do bitmapped fonts
-     * instead, or at least only re-draw the text when the score changes.
-     */
-    sprintf(buf, "%d", game->score);
-    surf = TTF_RenderText_Blended(game->hud_font, buf, color);
-    texture = SDL_CreateTextureFromSurface(renderer, surf);
-    (void)SDL_QueryTexture(texture, NULL, NULL, &rect.w, &rect.h);
-    SDL_RenderCopy(renderer, texture, NULL, &rect);
-    SDL_FreeSurface(surf);
-    free_texture(texture);
-
-    rect.y += rect.h;
-    remaining = sb_game_remaining_time(game) / 1000;
-    sprintf(buf, "%d:%02d", remaining / 60, remaining % 60);
-    surf = TTF_RenderText_Blended(game->hud_font, buf, color);
-    texture = SDL_CreateTextureFromSurface(renderer, surf);
-    (void)SDL_QueryTexture(texture, NULL, NULL, &rect.w, &rect.h);
-    SDL_RenderCopy(renderer, texture, NULL, &rect);
-    SDL_FreeSurface(surf);
-    free_texture(texture);
-}
-
-
-static void
-sb_game_draw_cable_cord (SDL_Renderer *renderer,
-                         int           startx,
-                         int           starty,
-                         int           endx,
-                         int           endy,
-                         SDL_Color     color,
-                         sb_game_type *game)
+bool
+sb_game_is_over (const sb_game_type *game)
 {
-    int      distx = startx - endx;
-    int      disty = starty - endy;
-    int      centerx;
-    int      centery;
-    float    line_length;
-    int      render_count; 
-    int      i;
-    SDL_Rect rect;
-
-    line_length = sqrtf(distx * distx + disty * disty);
-    render_count = line_length / 2;
-
-    /*
-     * If the line is too short, return.
-     */
-    if (render_count == 0) {
-        return;
-    }
-
-    SDL_SetTextureColorMod(game->cord_texture, color.r, color.g, color.b);
-    for (i = 0; i < render_count; i++) {
-        centerx = startx + ((((float)i / (float)render_count - 1)) * distx);
-        centery = starty + ((((float)i / (float)render_count - 1)) * disty);
-
-        rect.x = centerx - 4;
-        rect.y = centery - 4;
-        rect.w = 8;
-        rect.h = 8;
-        SDL_RenderCopy(renderer, game->cord_texture, NULL, &rect);
-        
-    }
+    return sb_game_remaining_time(game) == 0;
 }
 
 
 /*
- * See comment in game.h for more details.
+ * Put the game back into the state it should be in at the start of a round.
+ * The layout is left alone, and the random state carries on from where it
+ * was, so successive rounds differ.
  */
-static void
-sb_game_draw (SDL_Renderer *renderer,
-              void         *context)
+void
+sb_game_reset (sb_game_type *game)
 {
-    ssize_t                i;
-    int                    startx;
-    int                    starty;
-    int                    endx;
-    int                    endy;
-    float                  progress;
-    sb_game_customer_type *cust;
-    sb_cable_type         *cable;
-    SDL_Rect               rect;
-    sb_game_type          *game = &sb_game;
-
-    SDL_SetRenderDrawColor(renderer, 180, 180, 180, 255);
-    SDL_RenderClear(renderer);
+    size_t i;
 
-    /*
-     * Draw the background
-     */
-    rect.x = 110;
-    rect.y = 10;
-    rect.w = 580;
-    rect.h = 480;
-    SDL_RenderCopy(renderer, game->panel_texture, NULL, &rect);
-    rect.x = 0;
-    rect.y = 500;
-    rect.w = 800;
-    rect.h = 100;
-    SDL_RenderCopy(renderer, game->console_texture, NULL, &rect);
+    game->gametime = 0;
+    memset(&game->stats, 0, sizeof(game->stats));
+    game->next_call_time = sb_rng_range(&game->rng,
+                                        game->config.new_call_time_min,
+                                        game->config.new_call_time_max);
+    game->held_cable = -1;
+    game->active_cable = -1;
+    game->rotary.state = SB_GAME_ROTARY_STATE_IDLE;
 
-    /*
-     * Draw customer ports + mugshots.
-     */
     for (i = 0; i < game->customer_count; i++) {
-        cust = &game->customers[i];
-
-        rect = cust->mugshot_rect;
-        rect.x += 4;
-        rect.y += 4;
-        rect.w -= 8;
-        rect.h -= 8;
-        SDL_SetRenderDrawColor(renderer, 200, 200, 255, 255);
-        SDL_RenderFillRect(renderer, &rect);
-        SDL_RenderCopy(renderer, game->mugshot_textures[cust->index], NULL,
-                       &rect);
-
-        if (cust->line_state != LINE_STATE_IDLE &&
-            cust->line_state != LINE_STATE_ANSWERING) {
-            progress = ((float)(cust->next_update - game->gametime) /
-                        (float)(cust->next_update - cust->last_update));
-            rect.y += rect.h - rect.h * progress + 1;
-            rect.h *= progress;
-
-            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 100);
-            SDL_RenderFillRect(renderer, &rect);
-        }
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-
-        SDL_RenderCopy(renderer, game->port_texture, NULL, &cust->port_rect);
-        SDL_RenderCopy(renderer, game->mug_background_texture, NULL,
-                       &cust->mugshot_rect);
-
-
-        if (cust->line_state == LINE_STATE_DIALING ||
-            cust->line_state == LINE_STATE_ANSWERING) {
-            if ((cust->next_update - game->gametime) % 1000 > 500) {
-                SDL_RenderCopy(renderer, game->flash_texture, NULL,
-                               &cust->light_rect);
-            }
-        } else if (cust->line_state == LINE_STATE_BUSY ||
-                   cust->line_state == LINE_STATE_OPERATOR_REQUEST ||
-                   cust->line_state == LINE_STATE_OPERATOR_REPLY) {
-            SDL_RenderCopy(renderer, game->flash_texture, NULL,
-                           &cust->light_rect);
-        }
+        game->customers[i].line_state = LINE_STATE_IDLE;
+        game->customers[i].last_update = 0;
+        game->customers[i].next_update = 0;
+        game->customers[i].port_cable = -1;
+        game->customers[i].target_cust = -1;
     }
+    memset(game->line_states, 0, sizeof(game->line_states));
+    game->line_states[LINE_STATE_IDLE] = game->customer_count;
+    game->active_calls = 0;
 
-    /*
-     * Draw the cables bases, buttons etc.
-     */
     for (i = 0; i < game->cable_count; i++) {
-        cable = &game->cables[i];
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        SDL_RenderCopy(renderer, game->cord_hole_texture, NULL,
-                       &cable->cord_hole_rect);
-
-        /*
-         * The cable is not held or plugged in - draw the connector at the
-         * base.
-         */
-        if (cable->customer == NULL && game->held_cable != cable) {
-            SDL_RenderCopy(renderer, game->plug_loose_texture, NULL,
-                           &cable->cable_base_rect);
-        }
-
-        
-        SDL_RenderCopy(renderer, game->button_texture, NULL,
-                       &cable->speak_button_rect);
-        SDL_RenderCopy(renderer, game->button_texture, NULL,
-                       &cable->dial_button_rect);
-    }
-
-    /*
-     * Draw any cables that are plugged in - draw all of the plugs before the
-     * cords, so that the plugs appear underneath the cords.
-     */
-    for (i = 0; i < game->customer_count; i++) {
-        cust = &game->customers[i];
-        if (cust->port_cable != NULL) {
-            cable = cust->port_cable;
-            rect.x = cust->port_rect.x + 4;
-            rect.y = cust->port_rect.y + 4;
-            rect.w = 24;
-            rect.h = 24;
-            SDL_RenderCopy(renderer, game->plug_connected_texture, NULL,
-                           &rect);
-        }
-    }
-
-    for (i = 0; i < game->customer_count; i++) {
-        cust = &game->customers[i];
-        if (cust->port_cable != NULL) {
-            cable = cust->port_cable;
-            rect.x = cust->port_rect.x + 4;
-            rect.y = cust->port_rect.y + 4;
-            rect.w = 24;
-            rect.h = 24;
-            sb_rect_center(&cable->cord_hole_rect, &startx, &starty);
-            sb_rect_center(&rect, &endx, &endy);
-            sb_game_draw_cable_cord(renderer, endx, endy, startx, starty,
-                                    cable->color, game);
-        }
+        game->cables[i].customer = -1;
     }
+}
 
-    /*
-     * If we're currently holding a cable end, draw the cable.
-     */
-    if (game->held_cable != NULL) {
-        cable = game->held_cable;
 
-        (void)SDL_GetMouseState(&endx, &endy);
+/*
+ * Fill in the settings the real game uses.
+ */
+void
+sb_game_config_default (sb_game_config_type *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->seed = 1;
+    config->leveltime = 120;
+    config->customer_count = 20;
+    config->cable_count = 6;
+    config->new_call_time_min = NEW_CALL_TIME_MIN;
+    config->new_call_time_max = NEW_CALL_TIME_MAX;
+}
 
-        sb_rect_center(&cable->cord_hole_rect, &startx, &starty);
-        sb_game_draw_cable_cord(renderer, endx, endy, startx, starty,
-                                cable->color, game);
 
-        rect = game->held_cable->cable_base_rect;
-        rect.x = endx - rect.w / 2;
-        rect.y = endy - rect.h / 2;
-        SDL_RenderCopy(renderer, game->plug_loose_texture, NULL, &rect);
+/*
+ * Mark the sectors a number's rect reaches into, from the angles of its
+ * corners either side of the number's own angle. A degree of slack is
+ * added each side so rounding never leaves part of the rect out.
+ */
+static void
+sb_game_layout_sectors (sb_game_rotary_type *rotary,
+                        size_t               number,
+                        float                angle)
+{
+    const sb_game_rect_type *rect = &rotary->number_rects[number];
+    float                    corner;
+    float                    low = 0.0f;
+    float                    high = 0.0f;
+    int                      sector;
+    int                      i;
+
+    for (i = 0; i < 4; i++) {
+        corner = RAD_TO_DEG(atan2f(rect->x + (i & 1) * rect->w -
+                                   rotary->center_x,
+                                   rotary->center_y -
+                                   (rect->y + (i >> 1) * rect->h)));
+        corner = remainderf(corner - angle, 360.0f);
+        low = MIN(low, corner);
+        high = MAX(high, corner);
     }
 
-    // Draw "conversations" for customers who are talking to the operator.
-    for (i = 0; i < game->customer_count; i++) {
-        cust = &game->customers[i];
-        if ((cust->line_state == LINE_STATE_OPERATOR_REQUEST ||
-             cust->line_state == LINE_STATE_OPERATOR_REPLY) &&
-             cust->port_cable == game->active_cable) {
-            rect = cust->mugshot_rect;
-            rect.x += 24;
-            rect.y -= 48;
-            rect.w = 100;
-            rect.h = 76;
-            SDL_RenderCopy(renderer, game->speech_bubble_texture, NULL,
-                           &rect);
-
-            if (cust->line_state == LINE_STATE_OPERATOR_REQUEST) {
-                rect.x += 30;
-                rect.y += 12;
-                rect.w = 40;
-                rect.h = 40;
-                SDL_RenderCopy(
-                    renderer,
-                    game->mugshot_textures[cust->target_cust->index],
-                    NULL, &rect);
-            }
-        }
+    for (sector = floorf(angle + low) - 1; sector <= angle + high + 1;
+         sector++) {
+        rotary->sectors[(sector + ROTARY_SECTORS) % ROTARY_SECTORS] |=
+            1 << number;
     }
-
-    sb_game_draw_rotary(renderer, game);
-
-    // Draw the HUD
-    sb_game_draw_hud(renderer, game);
 }
 
 
 /*
- * See comment in game.h for more details.
+ * Lay out the board - customers in a grid on each panel (see game.h),
+ * cables in pairs along the bottom, and the rotary dial in the top left.
  */
-void
-sb_game_setup (SDL_Renderer *renderer)
+static void
+sb_game_layout (sb_game_type *game)
 {
     size_t                 i;
     size_t                 j;
     sb_game_customer_type *cust;
     sb_cable_type         *cable;
-    sb_game_type          *game;
+    sb_game_rotary_type   *rotary = &game->rotary;
     uint8_t                columns;
-    uint8_t                rows;
     uint32_t               column_spacing;
-    uint32_t               row_spacing;
-    char                   filename[128];
-
-    game = &sb_game;
-
-    game->leveltime = 120;
-    
-    // TODO: Proper media loading.
-    game->hud_font = TTF_OpenFont(HUD_FONT_NAME, HUD_FONT_SIZE);
-    game->panel_texture = load_texture("media/panel.png", renderer);
-    game->console_texture = load_texture("media/console.png", renderer);
-    game->port_texture = load_texture("media/port.png", renderer);
-    game->flash_texture = load_texture("media/light.png", renderer);
-    game->plug_connected_texture = load_texture("media/plug_connected.png",
-                                                renderer);
-    game->plug_loose_texture = load_texture("media/plug_loose.png", renderer);
-    game->mug_background_texture = load_texture("media/mug_background.png",
-                                                renderer);
-    game->speech_bubble_texture = load_texture("media/speech_bubble.png",
-                                               renderer);
-    game->button_texture = load_texture("media/button.png", renderer);
-    game->button_flash_texture = load_texture("media/button_flash.png",
-                                              renderer);
-    game->cord_texture = load_texture("media/cord.png", renderer);
-    game->cord_hole_texture = load_texture("media/cord_hole.png", renderer);
-    game->rotary_texture = load_texture("media/rotary.png", renderer);
-    game->rotary_top_texture = load_texture("media/rotary_top.png", renderer);
-
-    for (i = 0; i < MAX_CUSTOMERS; i++) {
-        sprintf(filename, "media/mugshots/%zu.png", i + 1);
-        game->mugshot_textures[i] = load_texture(filename, renderer);
-    }
+    size_t                 panels;
+    size_t                 slot;
+    int                    panel_x;
+    int                    panel_y;
+    float                  angle;
 
     // TODO: Eventually layout etc will be done per-level etc.
-    game->customer_count = 20;
     columns = 4;
-    rows = game->customer_count / columns;
 
-    game->cable_count = 6;
+    rotary->bounds.x = 50;
+    rotary->bounds.y = 50;
+    rotary->bounds.w = 100;
+    rotary->bounds.h = 100;
+    rotary->center_x = rotary->bounds.x + rotary->bounds.w / 2;
+    rotary->center_y = rotary->bounds.y + rotary->bounds.h / 2;
+
+    memset(rotary->sectors, 0, sizeof(rotary->sectors));
+    for (i = 0; i < ROTARY_NUMS; i++) {
+        angle = DEG_TO_RAD(ROTARY_SEGMENT_ANGLE * i + ROTARY_START_ANGLE);
 
-    game->held_cable = NULL;
+        rotary->number_rects[i].w = ROTARY_NUMBER_SIZE;
+        rotary->number_rects[i].h = ROTARY_NUMBER_SIZE;
+        rotary->number_rects[i].x = rotary->center_x +
+                                    ROTARY_NUMBER_RADIUS * sinf(angle) -
+                                    ROTARY_NUMBER_SIZE / 2;
+        rotary->number_rects[i].y = rotary->center_y -
+                                    ROTARY_NUMBER_RADIUS * cosf(angle) -
+                                    ROTARY_NUMBER_SIZE / 2;
+        sb_game_layout_sectors(rotary, i,
+                               ROTARY_SEGMENT_ANGLE * i + ROTARY_START_ANGLE);
+    }
 
-    game->gametime = 0;
-    game->next_call_time = random_range(NEW_CALL_TIME_MIN, NEW_CALL_TIME_MAX);
+    panels = (game->customer_count + SB_GAME_PANEL_LINES - 1) /
+             SB_GAME_PANEL_LINES;
+    game->panel_columns = 1;
+    while (game->panel_columns * game->panel_columns < panels) {
+        game->panel_columns++;
+    }
+    game->bounds.x = 0;
+    game->bounds.y = 0;
+    game->bounds.w = game->panel_columns * SB_GAME_PANEL_WIDTH;
+    game->bounds.h = ((panels + game->panel_columns - 1) /
+                      game->panel_columns) * SB_GAME_PANEL_HEIGHT;
 
     column_spacing = 600 / (columns + 1);
     for (i = 0; i < game->customer_count; i++) {
         cust = &game->customers[i];
 
         cust->index = i;
-        cust->line_state = LINE_STATE_IDLE;
 
-        cust->mugshot_rect.x = 100 + column_spacing * ((i % columns) + 1) - 40;
-        cust->mugshot_rect.y = 64 * ((i / columns) + 1) - 24;
+        panel_x = (i / SB_GAME_PANEL_LINES % game->panel_columns) *
+                  SB_GAME_PANEL_WIDTH;
+        panel_y = (i / SB_GAME_PANEL_LINES / game->panel_columns) *
+                  SB_GAME_PANEL_HEIGHT;
+        slot = i % SB_GAME_PANEL_LINES;
+
+        cust->mugshot_rect.x = panel_x + 100 +
+                               column_spacing * ((slot % columns) + 1) - 40;
+        cust->mugshot_rect.y = panel_y + 64 * ((slot / columns) + 1) - 24;
         cust->mugshot_rect.w = 64;
         cust->mugshot_rect.h = 64;
 
@@ -1057,11 +971,11 @@ sb_game_setup (SDL_Renderer *renderer)
         cust->port_rect.y = cust->mugshot_rect.y;
         cust->port_rect.w = 32;
         cust->port_rect.h = 64;
-        
+
         cust->light_rect.w = 16;
         cust->light_rect.h = 16;
         cust->light_rect.x = cust->port_rect.x + 8;
-        cust->light_rect.y = cust->port_rect.y + 40; 
+        cust->light_rect.y = cust->port_rect.y + 40;
     }
 
     column_spacing = 800 / (game->cable_count / 2 + 1);
@@ -1096,62 +1010,394 @@ sb_game_setup (SDL_Renderer *renderer)
 
             cable->dial_button_rect.x +=
                 (float)(cable->dial_button_rect.x + 20 - 400) * 0.17f;
-
-            cable->color.r = i * 75;
-            cable->color.g = 255 - cable->color.r;
-            cable->color.b = (cable->color.r * cable->color.g) % 255;
-            cable->color.a = 255;
         }
     }
 }
 
 
 /*
- * See comment in game.h for more details.
+ * Check that the settings for a game make sense. The level time has to fit
+ * in ms.
+ */
+static bool
+sb_game_config_valid (const sb_game_config_type *config)
+{
+    return config->customer_count >= 2 &&
+           config->customer_count <= MAX_CUSTOMERS &&
+           config->cable_count % 2 == 0 &&
+           config->cable_count <= MAX_CABLES &&
+           config->leveltime <= UINT32_MAX / 1000 &&
+           config->new_call_time_min <= config->new_call_time_max;
+}
+
+
+/*
+ * Create a game with the given settings, ready to play its first round.
+ * Returns NULL if the settings don't make sense.
+ */
+sb_game_type *
+sb_game_create (const sb_game_config_type *config)
+{
+    sb_game_type *game;
+
+    if (!sb_game_config_valid(config)) {
+        return NULL;
+    }
+
+    game = calloc(1, sizeof(*game));
+    if (game == NULL) {
+        return NULL;
+    }
+
+    game->config = *config;
+    sb_rng_seed(&game->rng, config->seed);
+    game->customer_count = config->customer_count;
+    game->cable_count = config->cable_count;
+    game->view.zoom = 1.0f;
+
+    sb_game_layout(game);
+    sb_game_reset(game);
+
+    return game;
+}
+
+
+void
+sb_game_destroy (sb_game_type *game)
+{
+    free(game);
+}
+
+
+/*
+ * Set the function told about events in the game (see game.h), or NULL for
+ * none. It is called from within sb_game_step and sb_game_input.
  */
 void
-sb_game_cleanup(void)
+sb_game_set_listener (sb_game_type             *game,
+                      sb_game_listener_fn_type  listener,
+                      void                     *ctx)
 {
-    size_t i;
+    game->listener = listener;
+    game->listener_ctx = ctx;
+}
+
+
+void
+sb_game_get_stats (const sb_game_type *game,
+                   sb_game_stats_type *stats)
+{
+    *stats = game->stats;
+}
+
+
+/*
+ * Fill in a copy of the board - see comment in game.h for more details.
+ */
+void
+sb_game_get_board (const sb_game_type *game,
+                   sb_game_board_type *board)
+{
+    const sb_cable_type *cable;
+    size_t               i;
+
+    board->gametime = game->gametime;
+    board->remaining_time = sb_game_remaining_time(game);
+    board->score = game->stats.score;
+
+    board->customer_count = game->customer_count;
+    board->customers = game->customers;
+    memcpy(board->line_states, game->line_states,
+           sizeof(board->line_states));
+    board->active_calls = game->active_calls;
+    board->bounds = game->bounds;
+    board->panel_columns = game->panel_columns;
+    board->view = game->view;
+
+    board->cable_count = game->cable_count;
+    for (i = 0; i < game->cable_count; i++) {
+        cable = &game->cables[i];
+        board->cables[i].customer = cable->customer;
+        board->cables[i].cable_base_rect = cable->cable_base_rect;
+        board->cables[i].cord_hole_rect = cable->cord_hole_rect;
+        board->cables[i].speak_button_rect = cable->speak_button_rect;
+        board->cables[i].dial_button_rect = cable->dial_button_rect;
+    }
+
+    board->held_cable = game->held_cable;
+    board->active_cable = game->active_cable;
+    board->pointer_x = game->pointer_x;
+    board->pointer_y = game->pointer_y;
+
+    board->rotary_idle = (game->rotary.state == SB_GAME_ROTARY_STATE_IDLE);
+    board->rotary_angle = board->rotary_idle ? 0.0f :
+                          game->rotary.angle - game->rotary.start_angle;
+    board->rotary_bounds = game->rotary.bounds;
+    for (i = 0; i < ROTARY_NUMS; i++) {
+        board->rotary_number_rects[i] = game->rotary.number_rects[i];
+    }
+}
+
+
+/*
+ * Set how the board is shown, which is where clicks on the screen land on
+ * it. Not part of the game's state, so not saved in snapshots.
+ */
+void
+sb_game_set_view (sb_game_type            *game,
+                  const sb_game_view_type *view)
+{
+    game->view = *view;
+}
 
-    sb_game_type *game = &sb_game;
 
-    for (i = 0; i < MAX_CUSTOMERS; i++) {
-        free_texture(game->mugshot_textures[i]);
+/*
+ * Whether a point on the screen is on the console rather than the board.
+ */
+bool
+sb_game_on_console (int x,
+                    int y)
+{
+    if (x < 0 || x >= SB_GAME_SCREEN_W || y < 0 || y >= SB_GAME_SCREEN_H) {
+        return false;
     }
 
-    free_texture(game->rotary_top_texture);
-    free_texture(game->rotary_texture);
-    free_texture(game->cord_hole_texture);
-    free_texture(game->cord_texture);
-    free_texture(game->button_flash_texture);
-    free_texture(game->button_texture);
-    free_texture(game->speech_bubble_texture);
-    free_texture(game->mug_background_texture);
-    free_texture(game->plug_loose_texture);
-    free_texture(game->plug_connected_texture);
-    free_texture(game->flash_texture);
-    free_texture(game->port_texture);
-    free_texture(game->console_texture);
-
-    TTF_CloseFont(game->hud_font);
+    return y >= SB_GAME_CONSOLE_Y ||
+           (x < SB_GAME_DIAL_AREA && y < SB_GAME_DIAL_AREA);
 }
 
 
-static sb_gamestate_type sb_game_gamestate = {
-    .event_cb = &sb_game_event,
-    .update_cb = &sb_game_update,
-    .draw_cb = &sb_game_draw,
-    .ctx = NULL,
-};
+/*
+ * The board pixel at the centre of a screen pixel, and the other way
+ * round. Going from the board to the screen and back gives the same pixel
+ * unless the view is zoomed out.
+ */
+void
+sb_game_view_to_board (const sb_game_view_type *view,
+                       int                      x,
+                       int                      y,
+                       int                     *board_x,
+                       int                     *board_y)
+{
+    *board_x = floorf(view->x + (x + 0.5f) / view->zoom);
+    *board_y = floorf(view->y + (y + 0.5f) / view->zoom);
+}
+
+
+void
+sb_game_view_to_screen (const sb_game_view_type *view,
+                        int                      board_x,
+                        int                      board_y,
+                        int                     *x,
+                        int                     *y)
+{
+    *x = floorf((board_x + 0.5f - view->x) * view->zoom);
+    *y = floorf((board_y + 0.5f - view->y) * view->zoom);
+}
+
+
+/*
+ * FNV-1a, to catch truncated or corrupt snapshots.
+ */
+static uint32_t
+sb_game_checksum (const uint8_t *data,
+                  size_t         size)
+{
+    uint32_t hash = 2166136261u;
+    size_t   i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+/*
+ * Check that the references in a restored game are all in range, so that a
+ * bad snapshot can't send us off the end of an array, and that its
+ * settings are ones sb_game_create would have taken.
+ */
+static bool
+sb_game_check_state (const sb_game_type *game)
+{
+    const sb_game_customer_type *cust;
+    const sb_cable_type         *cable;
+    size_t                       i;
+
+    if (!sb_game_config_valid(&game->config) ||
+        game->customer_count != game->config.customer_count ||
+        game->cable_count != game->config.cable_count ||
+        game->held_cable < -1 ||
+        game->held_cable >= (int)game->cable_count ||
+        game->active_cable < -1 ||
+        game->active_cable >= (int)game->cable_count ||
+        (unsigned)game->rotary.state > SB_GAME_ROTARY_STATE_RETURNING ||
+        game->rotary.turning_index >= ROTARY_NUMS) {
+        return false;
+    }
+
+    for (i = 0; i < game->customer_count; i++) {
+        cust = &game->customers[i];
+        if (cust->index != i ||
+            (unsigned)cust->line_state >= LINE_STATE_COUNT ||
+            cust->port_cable < -1 ||
+            cust->port_cable >= (int)game->cable_count ||
+            cust->target_cust < -1 ||
+            cust->target_cust >= (int)game->customer_count) {
+            return false;
+        }
+    }
+
+    for (i = 0; i < game->cable_count; i++) {
+        cable = &game->cables[i];
+        if (cable->index != i ||
+            cable->customer < -1 ||
+            cable->customer >= (int)game->customer_count) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ * Size of a buffer big enough for sb_game_snapshot whatever the number of
+ * customers.
+ */
+size_t
+sb_game_snapshot_size (void)
+{
+    return sizeof(sb_game_snapshot_header_type) +
+           SNAPSHOT_PAYLOAD_SIZE(MAX_CUSTOMERS);
+}
+
+
+/*
+ * Fill in the saved parts of a game from a snapshot payload, for count
+ * customers. The saved line_states and active_calls are not trusted: they
+ * are counted again from the customers, whose states sb_game_check_state
+ * checks.
+ */
+static void
+sb_game_unpack (sb_game_type  *game,
+                const uint8_t *payload,
+                size_t         count)
+{
+    size_t i;
+
+    memcpy((uint8_t *)game + SNAPSHOT_HEAD_OFFSET, payload,
+           SNAPSHOT_HEAD_SIZE);
+    payload += SNAPSHOT_HEAD_SIZE;
+    memcpy(game->customers, payload, count * sizeof(game->customers[0]));
+    payload += count * sizeof(game->customers[0]);
+    memcpy((uint8_t *)game + SNAPSHOT_TAIL_OFFSET, payload,
+           SNAPSHOT_TAIL_SIZE);
+
+    memset(game->line_states, 0, sizeof(game->line_states));
+    game->active_calls = 0;
+    for (i = 0; i < count; i++) {
+        if ((unsigned)game->customers[i].line_state < LINE_STATE_COUNT) {
+            game->line_states[game->customers[i].line_state]++;
+            game->active_calls += sb_game_in_call(&game->customers[i]);
+        }
+    }
+}
 
 
 /*
- * See comment in game.h for more details.
+ * Save the whole state of the game (apart from its listener) into buf.
+ * Returns the number of bytes written, or 0 if buf is too small.
  */
-sb_gamestate_type *
-sb_game_get_gamestate(void)
+size_t
+sb_game_snapshot (const sb_game_type *game,
+                  void               *buf,
+                  size_t              size)
 {
-    return &sb_game_gamestate;
+    sb_game_snapshot_header_type  header;
+    uint8_t                      *payload;
+    uint8_t                      *pos;
+    size_t                        payload_size;
+
+    payload_size = SNAPSHOT_PAYLOAD_SIZE(game->customer_count);
+    if (size < sizeof(header) + payload_size) {
+        return 0;
+    }
+
+    payload = (uint8_t *)buf + sizeof(header);
+    pos = payload;
+    memcpy(pos, (const uint8_t *)game + SNAPSHOT_HEAD_OFFSET,
+           SNAPSHOT_HEAD_SIZE);
+    pos += SNAPSHOT_HEAD_SIZE;
+    memcpy(pos, game->customers,
+           game->customer_count * sizeof(game->customers[0]));
+    pos += game->customer_count * sizeof(game->customers[0]);
+    memcpy(pos, (const uint8_t *)game + SNAPSHOT_TAIL_OFFSET,
+           SNAPSHOT_TAIL_SIZE);
+
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.size = payload_size;
+    header.checksum = sb_game_checksum(payload, payload_size);
+    memcpy(buf, &header, sizeof(header));
+
+    return sizeof(header) + payload_size;
 }
 
+
+/*
+ * Put the game back into the state saved in a snapshot. The listener is
+ * left alone. If the snapshot is not one this build can use, or is
+ * damaged, false is returned and the game is unchanged.
+ *
+ * The payload is checked in a scratch game on the heap first - the game
+ * is too big to put on the stack with a big board.
+ */
+bool
+sb_game_restore (sb_game_type *game,
+                 const void   *buf,
+                 size_t        size)
+{
+    sb_game_snapshot_header_type  header;
+    sb_game_type                 *restored;
+    const uint8_t                *payload;
+    size_t                        count;
+    bool                          ok;
+
+    if (size < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, buf, sizeof(header));
+    payload = (const uint8_t *)buf + sizeof(header);
+    if (header.magic != SNAPSHOT_MAGIC ||
+        header.version != SNAPSHOT_VERSION ||
+        header.size > size - sizeof(header) ||
+        header.size < SNAPSHOT_PAYLOAD_SIZE(0) ||
+        header.checksum != sb_game_checksum(payload, header.size)) {
+        return false;
+    }
+
+    memcpy(&count, payload + offsetof(sb_game_type, customer_count) -
+                   SNAPSHOT_HEAD_OFFSET, sizeof(count));
+    if (count > MAX_CUSTOMERS || header.size != SNAPSHOT_PAYLOAD_SIZE(count)) {
+        return false;
+    }
+
+    restored = malloc(sizeof(*restored));
+    if (restored == NULL) {
+        return false;
+    }
+    sb_game_unpack(restored, payload, count);
+    ok = sb_game_check_state(restored);
+    free(restored);
+
+    if (ok) {
+        sb_game_unpack(game, payload, count);
+    }
+
+    return ok;
+}
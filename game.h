@@ -2,12 +2,268 @@
 #define __GAME_H__
 
 
-#include <SDL2/SDL.h>
-#include "gamestate.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 
-void sb_game_setup(SDL_Renderer *renderer);
-void sb_game_cleanup(void);
-sb_gamestate_type *sb_game_get_gamestate(void);
+/*
+ * The game simulation. This knows nothing about SDL - it is driven purely by
+ * calls to sb_game_step and sb_game_input, and reports anything worth
+ * hearing about through a listener - so any number of games can be run at
+ * once, e.g. by the batch driver. Drawing is done by the play gamestate.
+ */
+typedef struct sb_game sb_game_type;
+
+
+/*
+ * Max numbers of game entities, for sizing arrays.
+ */
+#define MAX_CUSTOMERS 2048
+#define MAX_CABLES 16
+
+
+/*
+ * The count of numbers on the rotary dial.
+ */
+#define ROTARY_NUMS 10
+
+
+/*
+ * Enumeration representing the state of an individual
+ * customer on the switchboard.
+ */
+typedef enum {
+    LINE_STATE_IDLE,
+    LINE_STATE_DIALING,
+    LINE_STATE_OPERATOR_REQUEST,
+    LINE_STATE_ANSWERING,
+    LINE_STATE_OPERATOR_REPLY,
+    LINE_STATE_BUSY,
+    LINE_STATE_COUNT
+} sb_line_state_type;
+
+
+/*
+ * Customers are laid out on panels of SB_GAME_PANEL_LINES, each a screenful
+ * of board coordinates, in a grid of panels as near square as it will go.
+ * The first panel is where the screen shows it when the view hasn't moved,
+ * so a board of one panel never needs to.
+ *
+ * The console - the cables along the bottom of the screen with their
+ * buttons, and the dial in the top left - isn't on the board. It is laid
+ * out in screen coordinates and stays put whatever the view, and the board
+ * can't be clicked on through it (see sb_game_on_console).
+ */
+#define SB_GAME_PANEL_LINES  20
+#define SB_GAME_PANEL_WIDTH  800
+#define SB_GAME_PANEL_HEIGHT 600
+#define SB_GAME_SCREEN_W     800
+#define SB_GAME_SCREEN_H     600
+#define SB_GAME_CONSOLE_Y    460
+#define SB_GAME_DIAL_AREA    200
+
+
+/*
+ * Board coordinates of a click that isn't on the board.
+ */
+#define SB_GAME_NOWHERE INT_MIN
+
+
+/*
+ * A rectangle in screen or board coordinates, laid out the same as an
+ * SDL_Rect.
+ */
+typedef struct sb_game_rect {
+    int x;
+    int y;
+    int w;
+    int h;
+} sb_game_rect_type;
+
+
+/*
+ * Settings for a game. Times are in ms, apart from leveltime which is in
+ * seconds. Use sb_game_config_default to get the settings the real game
+ * uses, then change whatever is being tuned.
+ */
+typedef struct sb_game_config {
+    uint32_t seed;
+    uint32_t leveltime;
+    size_t   customer_count;
+    size_t   cable_count;
+    uint32_t new_call_time_min;
+    uint32_t new_call_time_max;
+} sb_game_config_type;
+
+
+/*
+ * How the board is shown: the board coordinates at the top left of the
+ * screen, and screen pixels per board unit.
+ */
+typedef struct sb_game_view {
+    float x;
+    float y;
+    float zoom;
+} sb_game_view_type;
+
+
+/*
+ * Pointer input, in screen coordinates. Only the left button matters. The
+ * game works out where that is on the board from its view (see
+ * sb_game_set_view).
+ */
+typedef enum {
+    SB_GAME_INPUT_MOTION,
+    SB_GAME_INPUT_BUTTON_DOWN,
+    SB_GAME_INPUT_BUTTON_UP,
+} sb_game_input_kind_type;
+
+typedef struct sb_game_input {
+    sb_game_input_kind_type kind;
+    int                     x;
+    int                     y;
+} sb_game_input_type;
+
+
+/*
+ * Things that happen in the game that the outside world might want to react
+ * to, e.g. by playing a sound. customer is the customer concerned, or -1;
+ * for SB_GAME_EVENT_CALL_START other is the customer being called, and for
+ * SB_GAME_EVENT_SUCCESS the customer they were put through to. points is
+ * how much the score changed by (for success and failure).
+ */
+typedef enum {
+    SB_GAME_EVENT_RING,
+    SB_GAME_EVENT_CALL_START,
+    SB_GAME_EVENT_SUCCESS,
+    SB_GAME_EVENT_FAILURE,
+    SB_GAME_EVENT_PLUG_IN,
+    SB_GAME_EVENT_PLUG_OUT,
+    SB_GAME_EVENT_DIAL_CLICK,
+} sb_game_event_kind_type;
+
+typedef struct sb_game_event {
+    sb_game_event_kind_type kind;
+    int                     customer;
+    int                     other;
+    int                     points;
+} sb_game_event_type;
+
+typedef void (*sb_game_listener_fn_type)(const sb_game_event_type *event,
+                                         void                     *ctx);
+
+
+/*
+ * Running totals for the current round.
+ *
+ * missed is calls that timed out at any stage before being put through.
+ * dropped is calls cut off by pulling a plug out.
+ */
+typedef struct sb_game_stats {
+    uint32_t score;
+    uint32_t calls;
+    uint32_t connected;
+    uint32_t missed;
+    uint32_t dropped;
+} sb_game_stats_type;
+
+
+/*
+ * Read-only copy of the board, for code outside the game module that needs
+ * to know where things are and what state they are in. References between
+ * customers and cables are given as indices, with -1 meaning "none".
+ *
+ * There can be thousands of customers, so rather than being copied they
+ * are pointed to in the game itself - only good while the game lasts, and
+ * changing as it is stepped. line_states counts how many of them are in
+ * each state, and active_calls how many are in a call (from starting to
+ * dial until they hang up), so nobody has to go through them all for that.
+ * Their rects are in board coordinates, and bounds covers all the panels;
+ * everything else is in screen coordinates.
+ */
+typedef struct sb_game_board_customer {
+    size_t             index;
+    sb_line_state_type line_state;
+    uint32_t           last_update;
+    uint32_t           next_update;
+    sb_game_rect_type  port_rect;
+    sb_game_rect_type  mugshot_rect;
+    sb_game_rect_type  light_rect;
+    int                port_cable;
+    int                target_cust;
+} sb_game_board_customer_type;
+
+typedef struct sb_game_board_cable {
+    int               customer;
+    sb_game_rect_type cable_base_rect;
+    sb_game_rect_type cord_hole_rect;
+    sb_game_rect_type speak_button_rect;
+    sb_game_rect_type dial_button_rect;
+} sb_game_board_cable_type;
+
+typedef struct sb_game_board {
+    uint32_t                           gametime;
+    uint32_t                           remaining_time;
+    uint32_t                           score;
+    size_t                             customer_count;
+    const sb_game_board_customer_type *customers;
+    uint32_t                           line_states[LINE_STATE_COUNT];
+    uint32_t                           active_calls;
+    sb_game_rect_type                  bounds;
+    size_t                             panel_columns;
+    sb_game_view_type                  view;
+    size_t                             cable_count;
+    sb_game_board_cable_type           cables[MAX_CABLES];
+    int                                held_cable;
+    int                                active_cable;
+    int                                pointer_x;
+    int                                pointer_y;
+    bool                               rotary_idle;
+    float                              rotary_angle;
+    sb_game_rect_type                  rotary_bounds;
+    sb_game_rect_type                  rotary_number_rects[ROTARY_NUMS];
+} sb_game_board_type;
+
+
+void sb_game_config_default(sb_game_config_type *config);
+sb_game_type *sb_game_create(const sb_game_config_type *config);
+void sb_game_destroy(sb_game_type *game);
+void sb_game_set_listener(sb_game_type             *game,
+                          sb_game_listener_fn_type  listener,
+                          void                     *ctx);
+void sb_game_reset(sb_game_type *game);
+void sb_game_step(sb_game_type *game, uint32_t frametime);
+void sb_game_input(sb_game_type *game, const sb_game_input_type *input);
+bool sb_game_is_over(const sb_game_type *game);
+void sb_game_get_board(const sb_game_type *game, sb_game_board_type *board);
+void sb_game_set_view(sb_game_type *game, const sb_game_view_type *view);
+bool sb_game_on_console(int x, int y);
+void sb_game_view_to_board(const sb_game_view_type *view,
+                           int                      x,
+                           int                      y,
+                           int                     *board_x,
+                           int                     *board_y);
+void sb_game_view_to_screen(const sb_game_view_type *view,
+                            int                      board_x,
+                            int                      board_y,
+                            int                     *x,
+                            int                     *y);
+void sb_game_get_stats(const sb_game_type *game, sb_game_stats_type *stats);
+
+
+/*
+ * Snapshots hold the whole state of a game as a small versioned blob, for
+ * resuming a round after a restart or checkpointing long runs. Only the
+ * customers on the board are saved, so the blob grows with the number of
+ * lines; sb_game_snapshot_size is enough for the biggest board, and
+ * sb_game_snapshot returns how much it actually used. They are only meant
+ * to be restored by the same build of the game; restoring anything else
+ * fails cleanly.
+ */
+size_t sb_game_snapshot_size(void);
+size_t sb_game_snapshot(const sb_game_type *game, void *buf, size_t size);
+bool sb_game_restore(sb_game_type *game, const void *buf, size_t size);
 
 #endif /* __GAME_H__ */
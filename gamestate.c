@@ -1,8 +1,49 @@
 #include <assert.h>
 #include "gamestate.h"
+#include "latency.h"
+#include "render.h"
 
 #define MAX_GAMESTATES 16
 
+
+/*
+ * The SDL event types covered by each SB_GAMESTATE_EVENTS_ flag. Anything
+ * not listed here (quit, window and app events etc.) is always left on.
+ */
+static const struct {
+    uint32_t                 type;
+    sb_gamestate_events_type events;
+} sb_gamestate_event_types[] = {
+    { SDL_KEYDOWN,                  SB_GAMESTATE_EVENTS_KEY },
+    { SDL_KEYUP,                    SB_GAMESTATE_EVENTS_KEY_UP },
+    { SDL_TEXTEDITING,              SB_GAMESTATE_EVENTS_TEXT },
+    { SDL_TEXTINPUT,                SB_GAMESTATE_EVENTS_TEXT },
+    { SDL_MOUSEMOTION,              SB_GAMESTATE_EVENTS_MOUSE_MOTION },
+    { SDL_MOUSEBUTTONDOWN,          SB_GAMESTATE_EVENTS_MOUSE_BUTTON },
+    { SDL_MOUSEBUTTONUP,            SB_GAMESTATE_EVENTS_MOUSE_BUTTON },
+    { SDL_MOUSEWHEEL,               SB_GAMESTATE_EVENTS_MOUSE_WHEEL },
+    { SDL_FINGERDOWN,               SB_GAMESTATE_EVENTS_TOUCH },
+    { SDL_FINGERUP,                 SB_GAMESTATE_EVENTS_TOUCH },
+    { SDL_FINGERMOTION,             SB_GAMESTATE_EVENTS_TOUCH },
+    { SDL_DOLLARGESTURE,            SB_GAMESTATE_EVENTS_TOUCH },
+    { SDL_DOLLARRECORD,             SB_GAMESTATE_EVENTS_TOUCH },
+    { SDL_MULTIGESTURE,             SB_GAMESTATE_EVENTS_TOUCH },
+    { SDL_JOYAXISMOTION,            SB_GAMESTATE_EVENTS_JOYSTICK },
+    { SDL_JOYBALLMOTION,            SB_GAMESTATE_EVENTS_JOYSTICK },
+    { SDL_JOYHATMOTION,             SB_GAMESTATE_EVENTS_JOYSTICK },
+    { SDL_JOYBUTTONDOWN,            SB_GAMESTATE_EVENTS_JOYSTICK },
+    { SDL_JOYBUTTONUP,              SB_GAMESTATE_EVENTS_JOYSTICK },
+    { SDL_CONTROLLERAXISMOTION,     SB_GAMESTATE_EVENTS_JOYSTICK },
+    { SDL_CONTROLLERBUTTONDOWN,     SB_GAMESTATE_EVENTS_JOYSTICK },
+    { SDL_CONTROLLERBUTTONUP,       SB_GAMESTATE_EVENTS_JOYSTICK },
+    { SDL_DROPFILE,                 SB_GAMESTATE_EVENTS_DROP },
+    { SDL_DROPTEXT,                 SB_GAMESTATE_EVENTS_DROP },
+    { SDL_DROPBEGIN,                SB_GAMESTATE_EVENTS_DROP },
+    { SDL_DROPCOMPLETE,             SB_GAMESTATE_EVENTS_DROP },
+    { SDL_RENDER_TARGETS_RESET,     SB_GAMESTATE_EVENTS_RENDER },
+    { SDL_RENDER_DEVICE_RESET,      SB_GAMESTATE_EVENTS_RENDER },
+};
+
 typedef struct sb_gamestate_mgr {
     sb_gamestate_type gamestate_stack[MAX_GAMESTATES];
     size_t            gamestate_count;
@@ -16,12 +57,26 @@ typedef struct sb_gamestate_mgr {
 static sb_gamestate_mgr_type sb_gamestate_mgr;
 
 
+/*
+ * Let the gamestate that has just become the top one know.
+ */
+static void
+sb_gamestate_enter (void)
+{
+    if (sb_gamestate_mgr.gamestate_count > 0 &&
+        TOP_GAMESTATE.enter_cb != NULL) {
+        TOP_GAMESTATE.enter_cb(TOP_GAMESTATE.ctx);
+    }
+}
+
+
 void
 sb_gamestate_push (sb_gamestate_type *state)
 {
     assert(sb_gamestate_mgr.gamestate_count < MAX_GAMESTATES);
     sb_gamestate_mgr.gamestate_stack[
         sb_gamestate_mgr.gamestate_count++] = *state;
+    sb_gamestate_enter();
 }
 
 
@@ -29,6 +84,7 @@ void
 sb_gamestate_replace (sb_gamestate_type *state)
 {
     TOP_GAMESTATE = *state;
+    sb_gamestate_enter();
 }
 
 
@@ -37,6 +93,7 @@ sb_gamestate_replace_all (sb_gamestate_type *state)
 {
     sb_gamestate_mgr.gamestate_count = 1;
     TOP_GAMESTATE = *state;
+    sb_gamestate_enter();
 }
 
 
@@ -45,14 +102,90 @@ sb_gamestate_pop (void)
 {
     assert(sb_gamestate_mgr.gamestate_count > 0);
     sb_gamestate_mgr.gamestate_count--;
+    sb_gamestate_enter();
+}
+
+
+/*
+ * Check whether the given gamestate is the one currently receiving events.
+ * The stack holds copies, so compare the callbacks rather than the pointer.
+ */
+bool
+sb_gamestate_is_top (const sb_gamestate_type *state)
+{
+    return (sb_gamestate_mgr.gamestate_count > 0 &&
+            TOP_GAMESTATE.event_cb == state->event_cb &&
+            TOP_GAMESTATE.ctx == state->ctx);
 }
 
 
+const sb_gamestate_type *
+sb_gamestate_get_top (void)
+{
+    assert(sb_gamestate_mgr.gamestate_count > 0);
+    return &TOP_GAMESTATE;
+}
+
+
+/*
+ * The number of gamestates on the stack.
+ */
+size_t
+sb_gamestate_get_depth (void)
+{
+    return sb_gamestate_mgr.gamestate_count;
+}
+
+
+/*
+ * Pass an event to the top gamestate, noting mouse input for the latency
+ * figures (see latency.h).
+ */
 void
 sb_gamestate_event (SDL_Event *e)
 {
     assert(sb_gamestate_mgr.gamestate_count > 0);
     TOP_GAMESTATE.event_cb(e, TOP_GAMESTATE.ctx);
+
+    switch (e->type) {
+    case SDL_MOUSEMOTION:
+        sb_latency_input(SB_LATENCY_MOTION, e->motion.timestamp);
+        break;
+
+    case SDL_MOUSEBUTTONDOWN:
+        sb_latency_input(SB_LATENCY_BUTTON_DOWN, e->button.timestamp);
+        break;
+
+    case SDL_MOUSEBUTTONUP:
+        sb_latency_input(SB_LATENCY_BUTTON_UP, e->button.timestamp);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/*
+ * Switch off the input events that none of the given gamestates (nor the
+ * caller, who asks for events itself) consumes.
+ */
+void
+sb_gamestate_filter_events (sb_gamestate_type        *states[],
+                            size_t                    count,
+                            sb_gamestate_events_type  events)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        events |= states[i]->events;
+    }
+
+    for (i = 0; i < SDL_arraysize(sb_gamestate_event_types); i++) {
+        (void)SDL_EventState(sb_gamestate_event_types[i].type,
+                             (events & sb_gamestate_event_types[i].events) ?
+                                                    SDL_ENABLE : SDL_IGNORE);
+    }
 }
 
 
@@ -76,8 +209,9 @@ sb_gamestate_draw (SDL_Renderer *renderer)
         under_gamestate = &sb_gamestate_mgr.gamestate_stack[
                                         sb_gamestate_mgr.gamestate_count - 2];
         under_gamestate->draw_cb(renderer, under_gamestate->ctx);
+        sb_render_flush(renderer);
     }
 
-
     TOP_GAMESTATE.draw_cb(renderer, TOP_GAMESTATE.ctx);
+    sb_render_flush(renderer);
 }
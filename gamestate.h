@@ -2,6 +2,8 @@
 #define __GAMESTATE_H__
 
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <SDL2/SDL.h>
 
 
@@ -9,20 +11,55 @@ typedef void (*sb_gamestate_event_fn_type)(SDL_Event *e,
                                            void      *ctx);
 typedef void (*sb_gamestate_update_fn_type)(uint32_t  frametime,
                                             void     *ctx);
+/*
+ * Draw callbacks record their drawing into the render buffer (see render.h),
+ * which is flushed after each gamestate has drawn.
+ */
 typedef void (*sb_gamestate_draw_fn_type)(SDL_Renderer *renderer,
                                           void         *ctx);
+/*
+ * Enter callbacks are called whenever the gamestate becomes the top one -
+ * when it is pushed or replaces another, or a pop uncovers it.
+ */
+typedef void (*sb_gamestate_enter_fn_type)(void *ctx);
 
 
 typedef uint8_t sb_gamestate_flag_type;
 #define SB_GAMESTATE_FLAG_DEFAULT    0x00
 #define SB_GAMESTATE_FLAG_DRAW_UNDER 0x01
+#define SB_GAMESTATE_FLAG_NO_ALLOC   0x02 /* see alloc.h */
+
+/*
+ * The kinds of input event a gamestate wants passed to its event callback.
+ * Event types nobody asks for are switched off with SDL_EventState (see
+ * sb_gamestate_filter_events), so SDL doesn't even queue them.
+ *
+ * Mouse motion is coalesced before it gets here: a gamestate sees at most
+ * one SDL_MOUSEMOTION between any two other events, holding the latest
+ * position and the summed relative motion.
+ */
+typedef uint16_t sb_gamestate_events_type;
+#define SB_GAMESTATE_EVENTS_NONE         0x0000
+#define SB_GAMESTATE_EVENTS_KEY          0x0001 /* SDL_KEYDOWN */
+#define SB_GAMESTATE_EVENTS_KEY_UP       0x0002
+#define SB_GAMESTATE_EVENTS_TEXT         0x0004
+#define SB_GAMESTATE_EVENTS_MOUSE_MOTION 0x0008
+#define SB_GAMESTATE_EVENTS_MOUSE_BUTTON 0x0010
+#define SB_GAMESTATE_EVENTS_MOUSE_WHEEL  0x0020
+#define SB_GAMESTATE_EVENTS_TOUCH        0x0040
+#define SB_GAMESTATE_EVENTS_JOYSTICK     0x0080
+#define SB_GAMESTATE_EVENTS_DROP         0x0100
+#define SB_GAMESTATE_EVENTS_RENDER       0x0200 /* render target resets */
 
 typedef struct sb_gamestate {
+    const char                  *name;
     sb_gamestate_event_fn_type   event_cb;
     sb_gamestate_update_fn_type  update_cb;
     sb_gamestate_draw_fn_type    draw_cb;
+    sb_gamestate_enter_fn_type   enter_cb;
     void                        *ctx;
     sb_gamestate_flag_type       flags;
+    sb_gamestate_events_type     events;
 } sb_gamestate_type;
 
 
@@ -30,7 +67,13 @@ void sb_gamestate_push(sb_gamestate_type *state);
 void sb_gamestate_replace(sb_gamestate_type *state);
 void sb_gamestate_replace_all(sb_gamestate_type *state);
 void sb_gamestate_pop(void);
+bool sb_gamestate_is_top(const sb_gamestate_type *state);
+const sb_gamestate_type *sb_gamestate_get_top(void);
+size_t sb_gamestate_get_depth(void);
 void sb_gamestate_event(SDL_Event *e);
+void sb_gamestate_filter_events(sb_gamestate_type        *states[],
+                                size_t                    count,
+                                sb_gamestate_events_type  events);
 void sb_gamestate_update(uint32_t frametime);
 void sb_gamestate_draw(SDL_Renderer *renderer);
 
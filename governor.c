@@ -0,0 +1,163 @@
+#include <string.h>
+#include "common.h"
+#include "governor.h"
+
+
+/*
+ * The quality levels, best first.
+ */
+static const sb_governor_quality_type
+sb_governor_levels[SB_GOVERNOR_LEVELS] = {
+    { 1, 1, true,  0,   1.0f  },
+    { 2, 2, true,  100, 1.0f  },
+    { 3, 2, false, 250, 0.75f },
+    { 4, 4, false, 500, 0.5f  },
+};
+
+
+typedef struct sb_governor {
+    float                  budget_ms;
+    size_t                 window_frames;
+    size_t                 window_over;
+    float                  window_max_ms;
+    bool                   settling;
+    bool                   just_raised;
+    size_t                 good_windows;
+    size_t                 up_windows;
+    sb_governor_stats_type stats;
+} sb_governor_type;
+
+
+static sb_governor_type sb_governor;
+
+
+/*
+ * Start at the best quality. A budget of 0 turns the governor off, leaving
+ * the quality at its best.
+ */
+void
+sb_governor_setup (float budget_ms)
+{
+    sb_governor_type *governor = &sb_governor;
+
+    memset(governor, 0, sizeof(*governor));
+    governor->budget_ms = MAX(0.0f, budget_ms);
+    governor->up_windows = SB_GOVERNOR_UP_WINDOWS;
+}
+
+
+/*
+ * Judge a full window of frames. Returns true if the level changed.
+ */
+static bool
+sb_governor_judge (sb_governor_type *governor)
+{
+    sb_governor_stats_type *stats = &governor->stats;
+    bool                    over;
+    bool                    good;
+
+    over = (governor->window_over > SB_GOVERNOR_WINDOW / 4);
+    good = (governor->window_max_ms * 100.0f <
+            governor->budget_ms * SB_GOVERNOR_UP_PERCENT);
+
+    if (governor->settling) {
+        governor->settling = false;
+        if (!(over && governor->just_raised)) {
+            return false;
+        }
+    }
+
+    if (over) {
+        governor->good_windows = 0;
+        if (governor->just_raised) {
+            governor->up_windows = MIN(governor->up_windows * 2,
+                                       SB_GOVERNOR_UP_WINDOWS_MAX);
+        }
+        governor->just_raised = false;
+        if (stats->level + 1 >= SB_GOVERNOR_LEVELS) {
+            return false;
+        }
+        stats->level++;
+        stats->drops++;
+        governor->settling = true;
+        return true;
+    }
+
+    if (governor->just_raised) {
+        governor->up_windows = SB_GOVERNOR_UP_WINDOWS;
+        governor->just_raised = false;
+    }
+    if (!good) {
+        governor->good_windows = 0;
+        return false;
+    }
+
+    governor->good_windows++;
+    if (stats->level == 0 ||
+        governor->good_windows < governor->up_windows) {
+        return false;
+    }
+
+    stats->level--;
+    stats->raises++;
+    governor->good_windows = 0;
+    governor->settling = true;
+    governor->just_raised = true;
+    return true;
+}
+
+
+/*
+ * Record how long a frame took to update and draw. Returns true if the
+ * quality level changed, for anything that has to be redone when it does.
+ */
+bool
+sb_governor_frame (float frame_ms)
+{
+    sb_governor_type *governor = &sb_governor;
+    bool              changed;
+
+    if (governor->budget_ms <= 0.0f) {
+        return false;
+    }
+
+    governor->stats.frames++;
+    governor->window_frames++;
+    governor->window_max_ms = MAX(governor->window_max_ms, frame_ms);
+    if (frame_ms > governor->budget_ms) {
+        governor->stats.frames_over++;
+        governor->window_over++;
+    }
+
+    if (governor->window_frames < SB_GOVERNOR_WINDOW) {
+        return false;
+    }
+
+    changed = sb_governor_judge(governor);
+    governor->window_frames = 0;
+    governor->window_over = 0;
+    governor->window_max_ms = 0.0f;
+
+    return changed;
+}
+
+
+size_t
+sb_governor_get_level (void)
+{
+    return sb_governor.stats.level;
+}
+
+
+const sb_governor_quality_type *
+sb_governor_get_quality (void)
+{
+    return &sb_governor_levels[sb_governor.stats.level];
+}
+
+
+void
+sb_governor_get_stats (sb_governor_stats_type *stats)
+{
+    *stats = sb_governor.stats;
+}
@@ -0,0 +1,68 @@
+#ifndef __GOVERNOR_H__
+#define __GOVERNOR_H__
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Frame budget governor - trades drawing quality for frame time on
+ * machines that can't keep up.
+ *
+ * The main loop reports how long each frame took to update and draw
+ * (leaving out the wait in SDL_RenderPresent, so vsync doesn't look like
+ * work). Frames are judged SB_GOVERNOR_WINDOW at a time: if more than a
+ * quarter of them went over the budget the quality drops a level, and once
+ * SB_GOVERNOR_UP_WINDOWS windows in a row have had no frame over
+ * SB_GOVERNOR_UP_PERCENT of the budget it goes back up one. The window
+ * after any change is ignored while things settle, and each time a raise is
+ * undone straight away the governor waits twice as long before the next,
+ * until one sticks.
+ *
+ * Only the drawing looks at the quality; the game itself, and anything
+ * that feeds back into it, never does.
+ *
+ * Doesn't need SDL.
+ */
+#define SB_GOVERNOR_LEVELS         4
+#define SB_GOVERNOR_WINDOW         30
+#define SB_GOVERNOR_UP_WINDOWS     4
+#define SB_GOVERNOR_UP_WINDOWS_MAX 64
+#define SB_GOVERNOR_UP_PERCENT     70
+
+
+/*
+ * What is drawn at a quality level. Cords are drawn through every
+ * cord_step'th of their points, and every particle_step'th particle is
+ * drawn. Progress overlays on the mugshots are only drawn if progress is
+ * set, and the HUD text is only redone every hud_interval ms of game time.
+ * render_scale caps the internal resolution (see sb_render_set_scale).
+ */
+typedef struct sb_governor_quality {
+    size_t   cord_step;
+    size_t   particle_step;
+    bool     progress;
+    uint32_t hud_interval;
+    float    render_scale;
+} sb_governor_quality_type;
+
+
+typedef struct sb_governor_stats {
+    size_t   level;
+    uint64_t frames;
+    uint64_t frames_over;
+    uint64_t drops;
+    uint64_t raises;
+} sb_governor_stats_type;
+
+
+void sb_governor_setup(float budget_ms);
+bool sb_governor_frame(float frame_ms);
+size_t sb_governor_get_level(void);
+const sb_governor_quality_type *sb_governor_get_quality(void);
+void sb_governor_get_stats(sb_governor_stats_type *stats);
+
+
+#endif /* __GOVERNOR_H__ */
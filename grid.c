@@ -0,0 +1,165 @@
+#include <string.h>
+#include "common.h"
+#include "grid.h"
+
+
+#if MAX_CUSTOMERS > UINT16_MAX + 1
+#error Customer indices must fit in 16 bit grid entries
+#endif
+
+
+/*
+ * The range of cells a rect reaches into, clamped to the grid. Returns
+ * false if it misses the grid altogether.
+ */
+static bool
+sb_grid_cells (const sb_grid_type      *grid,
+               const sb_game_rect_type *rect,
+               int                     *x0,
+               int                     *y0,
+               int                     *x1,
+               int                     *y1)
+{
+    if (rect->x + rect->w <= grid->bounds.x ||
+        rect->y + rect->h <= grid->bounds.y ||
+        rect->x >= grid->bounds.x + grid->bounds.w ||
+        rect->y >= grid->bounds.y + grid->bounds.h) {
+        return false;
+    }
+
+    *x0 = MAX(0, (rect->x - grid->bounds.x) / grid->cell_w);
+    *y0 = MAX(0, (rect->y - grid->bounds.y) / grid->cell_h);
+    *x1 = MIN(grid->columns - 1,
+              (rect->x + rect->w - 1 - grid->bounds.x) / grid->cell_w);
+    *y1 = MIN(grid->rows - 1,
+              (rect->y + rect->h - 1 - grid->bounds.y) / grid->cell_h);
+
+    return true;
+}
+
+
+/*
+ * File count rects, all within bounds, under the cells they reach into.
+ * The cells start at SB_GRID_CELL_W x SB_GRID_CELL_H, and are made bigger
+ * if a rect wouldn't fit in one or there would be too many of them.
+ */
+void
+sb_grid_build (sb_grid_type            *grid,
+               const sb_game_rect_type *bounds,
+               const sb_game_rect_type *rects,
+               size_t                   count)
+{
+    size_t i;
+    int    x0;
+    int    y0;
+    int    x1;
+    int    y1;
+    int    x;
+    int    y;
+
+    grid->bounds = *bounds;
+    grid->cell_w = SB_GRID_CELL_W;
+    grid->cell_h = SB_GRID_CELL_H;
+    count = MIN(count, MAX_CUSTOMERS);
+    for (i = 0; i < count; i++) {
+        grid->cell_w = MAX(grid->cell_w, rects[i].w);
+        grid->cell_h = MAX(grid->cell_h, rects[i].h);
+    }
+
+    do {
+        grid->columns = MAX(1, (bounds->w + grid->cell_w - 1) / grid->cell_w);
+        grid->rows = MAX(1, (bounds->h + grid->cell_h - 1) / grid->cell_h);
+        if (grid->columns * grid->rows > SB_GRID_MAX_CELLS) {
+            grid->cell_w *= 2;
+            grid->cell_h *= 2;
+        }
+    } while (grid->columns * grid->rows > SB_GRID_MAX_CELLS);
+
+    /*
+     * Count each cell's customers, turn the counts into where each cell's
+     * run of entries starts, and fill the runs in. That moves each start
+     * on to where the next run starts, so they are moved back one after.
+     */
+    memset(grid->cell_start, 0, sizeof(grid->cell_start));
+    for (i = 0; i < count; i++) {
+        if (!sb_grid_cells(grid, &rects[i], &x0, &y0, &x1, &y1)) {
+            continue;
+        }
+        for (y = y0; y <= y1; y++) {
+            for (x = x0; x <= x1; x++) {
+                grid->cell_start[y * grid->columns + x + 1]++;
+            }
+        }
+    }
+    for (i = 1; i <= (size_t)(grid->columns * grid->rows); i++) {
+        grid->cell_start[i] += grid->cell_start[i - 1];
+    }
+    for (i = 0; i < count; i++) {
+        if (!sb_grid_cells(grid, &rects[i], &x0, &y0, &x1, &y1)) {
+            continue;
+        }
+        for (y = y0; y <= y1; y++) {
+            for (x = x0; x <= x1; x++) {
+                grid->entries[grid->cell_start[y * grid->columns + x]++] = i;
+            }
+        }
+    }
+    for (i = grid->columns * grid->rows; i > 0; i--) {
+        grid->cell_start[i] = grid->cell_start[i - 1];
+    }
+    grid->cell_start[0] = 0;
+
+    memset(grid->stamps, 0, sizeof(grid->stamps));
+    grid->stamp = 0;
+}
+
+
+/*
+ * Find the customers filed under the cells rect reaches into (which may
+ * include some just outside it), up to max of them. Returns how many were
+ * found.
+ */
+size_t
+sb_grid_query (sb_grid_type            *grid,
+               const sb_game_rect_type *rect,
+               uint16_t                *found,
+               size_t                   max)
+{
+    size_t   count = 0;
+    uint32_t i;
+    uint16_t entry;
+    int      x0;
+    int      y0;
+    int      x1;
+    int      y1;
+    int      x;
+    int      y;
+
+    if (!sb_grid_cells(grid, rect, &x0, &y0, &x1, &y1)) {
+        return 0;
+    }
+
+    /*
+     * Start the stamps again before they wrap round.
+     */
+    if (++grid->stamp == 0) {
+        memset(grid->stamps, 0, sizeof(grid->stamps));
+        grid->stamp = 1;
+    }
+
+    for (y = y0; y <= y1; y++) {
+        for (x = x0; x <= x1; x++) {
+            for (i = grid->cell_start[y * grid->columns + x];
+                 i < grid->cell_start[y * grid->columns + x + 1]; i++) {
+                entry = grid->entries[i];
+                if (grid->stamps[entry] == grid->stamp || count == max) {
+                    continue;
+                }
+                grid->stamps[entry] = grid->stamp;
+                found[count++] = entry;
+            }
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,53 @@
+#ifndef __GRID_H__
+#define __GRID_H__
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+
+
+/*
+ * A uniform grid over the board, for finding the customers in a rect
+ * (e.g. the part of the board on screen) without looking at every one.
+ *
+ * Each customer is filed under every cell its rect reaches into. Cells are
+ * at least as big as the biggest rect, so that is never more than four. A
+ * query walks the cells the rect reaches into and returns each customer
+ * there once, marking them with a stamp rather than keeping a set, so
+ * nothing is allocated once the grid is built. The cost of a query goes
+ * with the size of the rect, not the number of customers.
+ *
+ * Doesn't need SDL.
+ */
+#define SB_GRID_MAX_CELLS   4096
+#define SB_GRID_MAX_ENTRIES (MAX_CUSTOMERS * 4)
+#define SB_GRID_CELL_W      200
+#define SB_GRID_CELL_H      150
+
+
+typedef struct sb_grid {
+    sb_game_rect_type bounds;
+    int               cell_w;
+    int               cell_h;
+    int               columns;
+    int               rows;
+    uint32_t          cell_start[SB_GRID_MAX_CELLS + 1];
+    uint16_t          entries[SB_GRID_MAX_ENTRIES];
+    uint32_t          stamps[MAX_CUSTOMERS];
+    uint32_t          stamp;
+} sb_grid_type;
+
+
+void sb_grid_build(sb_grid_type            *grid,
+                   const sb_game_rect_type *bounds,
+                   const sb_game_rect_type *rects,
+                   size_t                   count);
+size_t sb_grid_query(sb_grid_type            *grid,
+                     const sb_game_rect_type *rect,
+                     uint16_t                *found,
+                     size_t                   max);
+
+
+#endif /* __GRID_H__ */
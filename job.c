@@ -0,0 +1,798 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include "common.h"
+#include "job.h"
+#include "rng.h"
+
+
+/*
+ * A job calls either func(data), or range_func(data, begin, end) for a
+ * piece of a parallel for.
+ */
+typedef struct sb_job {
+    sb_job_func_type       func;
+    sb_job_range_func_type range_func;
+    void                  *data;
+    size_t                 begin;
+    size_t                 end;
+    size_t                 grain;
+    sb_job_counter_type   *counter;
+    bool                   main;
+    struct sb_job         *next;
+} sb_job_type;
+
+
+/*
+ * A thread's deque (Chase and Lev's, without the resizing). The owner
+ * pushes and pops at bottom, thieves take from top, and only taking the
+ * last job needs a compare and swap. top and bottom get a cache line each,
+ * as they are written by different threads; the owner's stats and random
+ * state ride along with bottom.
+ */
+typedef struct sb_job_deque {
+    int64_t            top __attribute__((aligned(64)));
+    int64_t            bottom __attribute__((aligned(64)));
+    sb_job_stats_type  stats;
+    sb_rng_type        rng;
+    sb_job_type       *jobs[SB_JOB_DEQUE_SIZE];
+} sb_job_deque_type;
+
+
+/*
+ * The free job list and the main thread's queue are shared by everyone,
+ * under spinlocks - they are only held for a few instructions. Workers
+ * with nothing to do sleep on wake, and are only signalled if sleepers
+ * says someone is there.
+ */
+typedef struct sb_job_system {
+    bool               running;
+    unsigned           thread_count;
+    unsigned           started;
+    pthread_t          threads[SB_JOB_MAX_THREADS];
+    sb_job_deque_type  deques[SB_JOB_MAX_THREADS];
+    sb_job_type        jobs[SB_JOB_MAX_JOBS];
+    sb_job_type       *free_jobs;
+    int                free_lock;
+    sb_job_type       *main_jobs[SB_JOB_MAIN_SIZE];
+    size_t             main_head;
+    size_t             main_count;
+    int                main_lock;
+    pthread_mutex_t    sleep_lock;
+    pthread_cond_t     wake;
+    int                sleepers;
+    bool               quit;
+} sb_job_system_type;
+
+
+static sb_job_system_type sb_job_system;
+
+
+/*
+ * Which thread of the system this is, or -1 for threads outside it.
+ */
+static __thread int sb_job_thread_index = -1;
+
+
+static inline void
+sb_job_lock (int *lock)
+{
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+            sched_yield();
+        }
+    }
+}
+
+
+static inline void
+sb_job_unlock (int *lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+
+static bool
+sb_job_deque_push (sb_job_deque_type *deque,
+                   sb_job_type       *job)
+{
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+    if (bottom - top >= SB_JOB_DEQUE_SIZE) {
+        return false;
+    }
+
+    __atomic_store_n(&deque->jobs[bottom % SB_JOB_DEQUE_SIZE], job,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+
+static sb_job_type *
+sb_job_deque_pop (sb_job_deque_type *deque)
+{
+    sb_job_type *job = NULL;
+    int64_t      bottom;
+    int64_t      top;
+
+    bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    job = __atomic_load_n(&deque->jobs[bottom % SB_JOB_DEQUE_SIZE],
+                          __ATOMIC_RELAXED);
+    if (top == bottom) {
+        /*
+         * Last one - race any thieves for it.
+         */
+        if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                         __ATOMIC_SEQ_CST,
+                                         __ATOMIC_RELAXED)) {
+            job = NULL;
+        }
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+
+    return job;
+}
+
+
+static sb_job_type *
+sb_job_deque_steal (sb_job_deque_type *deque)
+{
+    sb_job_type *job;
+    int64_t      top;
+    int64_t      bottom;
+
+    top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) {
+        return NULL;
+    }
+
+    job = __atomic_load_n(&deque->jobs[top % SB_JOB_DEQUE_SIZE],
+                          __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+
+    return job;
+}
+
+
+static sb_job_type *
+sb_job_alloc (sb_job_system_type *system)
+{
+    sb_job_type *job;
+
+    sb_job_lock(&system->free_lock);
+    job = system->free_jobs;
+    if (job != NULL) {
+        system->free_jobs = job->next;
+    }
+    sb_job_unlock(&system->free_lock);
+
+    return job;
+}
+
+
+static void
+sb_job_free (sb_job_system_type *system,
+             sb_job_type        *job)
+{
+    sb_job_lock(&system->free_lock);
+    job->next = system->free_jobs;
+    system->free_jobs = job;
+    sb_job_unlock(&system->free_lock);
+}
+
+
+static bool
+sb_job_push_main (sb_job_system_type *system,
+                  sb_job_type        *job)
+{
+    bool pushed = false;
+
+    sb_job_lock(&system->main_lock);
+    if (system->main_count < SB_JOB_MAIN_SIZE) {
+        system->main_jobs[(system->main_head + system->main_count) %
+                          SB_JOB_MAIN_SIZE] = job;
+        system->main_count++;
+        pushed = true;
+    }
+    sb_job_unlock(&system->main_lock);
+
+    return pushed;
+}
+
+
+static sb_job_type *
+sb_job_pop_main (sb_job_system_type *system)
+{
+    sb_job_type *job = NULL;
+
+    if (__atomic_load_n(&system->main_count, __ATOMIC_RELAXED) == 0) {
+        return NULL;
+    }
+
+    sb_job_lock(&system->main_lock);
+    if (system->main_count > 0) {
+        job = system->main_jobs[system->main_head];
+        system->main_head = (system->main_head + 1) % SB_JOB_MAIN_SIZE;
+        system->main_count--;
+    }
+    sb_job_unlock(&system->main_lock);
+
+    return job;
+}
+
+
+static bool
+sb_job_any_queued (sb_job_system_type *system)
+{
+    sb_job_deque_type *deque;
+    unsigned           i;
+
+    for (i = 0; i < system->thread_count; i++) {
+        deque = &system->deques[i];
+        if (__atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST) >
+            __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void sb_job_counter_done(sb_job_system_type  *system,
+                                sb_job_counter_type *counter);
+
+
+static void sb_job_queue(const sb_job_type *job, sb_job_counter_type *after);
+
+
+/*
+ * Call a job's function. A range bigger than its grain is halved, with the
+ * top half queued for someone else to take, until what is left is small
+ * enough to do here - so idle threads steal big pieces, not small ones.
+ */
+static void
+sb_job_call (const sb_job_type *job)
+{
+    sb_job_type rest;
+    size_t      end = job->end;
+
+    if (job->range_func == NULL) {
+        job->func(job->data);
+        return;
+    }
+
+    rest = *job;
+    while (end - job->begin > job->grain) {
+        rest.begin = job->begin + (end - job->begin) / 2;
+        rest.end = end;
+        sb_job_queue(&rest, NULL);
+        end = rest.begin;
+    }
+    job->range_func(job->data, job->begin, end);
+}
+
+
+/*
+ * Run a job that couldn't be queued on the thread submitting it.
+ */
+static void
+sb_job_run_inline (sb_job_system_type *system,
+                   const sb_job_type  *job)
+{
+    if (sb_job_thread_index >= 0 && system->running) {
+        system->deques[sb_job_thread_index].stats.inline_run++;
+    }
+
+    sb_job_call(job);
+    sb_job_counter_done(system, job->counter);
+}
+
+
+/*
+ * Queue a job that is ready to run, on the main queue or this thread's
+ * deque, and wake a worker for it.
+ */
+static void
+sb_job_release (sb_job_system_type *system,
+                sb_job_type        *job)
+{
+    sb_job_type job_copy;
+
+    if (job->main) {
+        /*
+         * Main thread jobs can't be run here if this isn't the main thread,
+         * so wait for room instead.
+         */
+        while (!sb_job_push_main(system, job)) {
+            if (sb_job_thread_index == 0) {
+                job_copy = *job;
+                sb_job_free(system, job);
+                sb_job_run_inline(system, &job_copy);
+                return;
+            }
+            sched_yield();
+        }
+        return;
+    }
+
+    if (sb_job_thread_index < 0 ||
+        !sb_job_deque_push(&system->deques[sb_job_thread_index], job)) {
+        job_copy = *job;
+        sb_job_free(system, job);
+        sb_job_run_inline(system, &job_copy);
+        return;
+    }
+
+    /*
+     * Pairs with the fence in the worker between announcing it is going to
+     * sleep and looking for work, so one of us sees the other.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&system->sleepers, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&system->sleep_lock);
+        pthread_cond_signal(&system->wake);
+        pthread_mutex_unlock(&system->sleep_lock);
+    }
+}
+
+
+/*
+ * Count a job against counter as done, and release anything that was
+ * waiting for it to reach zero. The lock is held over the decrement so
+ * that sb_job_submit_after can't add a job after the list has been taken.
+ */
+static void
+sb_job_counter_done (sb_job_system_type  *system,
+                     sb_job_counter_type *counter)
+{
+    sb_job_type *waiting = NULL;
+    sb_job_type *next;
+
+    if (counter == NULL) {
+        return;
+    }
+
+    sb_job_lock(&counter->lock);
+    if (__atomic_sub_fetch(&counter->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        waiting = counter->waiting;
+        counter->waiting = NULL;
+    }
+    sb_job_unlock(&counter->lock);
+
+    for (; waiting != NULL; waiting = next) {
+        next = waiting->next;
+        sb_job_release(system, waiting);
+    }
+}
+
+
+static void
+sb_job_run (sb_job_system_type *system,
+            sb_job_type        *job)
+{
+    sb_job_type job_copy = *job;
+
+    sb_job_free(system, job);
+    system->deques[sb_job_thread_index].stats.run++;
+    sb_job_call(&job_copy);
+    sb_job_counter_done(system, job_copy.counter);
+}
+
+
+/*
+ * Find the next job for thread index to run: its own newest, then (on the
+ * main thread) main thread jobs, then the oldest of a random victim's.
+ */
+static sb_job_type *
+sb_job_find (sb_job_system_type *system,
+             int                 index)
+{
+    sb_job_deque_type *deque = &system->deques[index];
+    sb_job_type       *job;
+    unsigned           start;
+    unsigned           victim;
+    unsigned           i;
+
+    job = sb_job_deque_pop(deque);
+    if (job != NULL) {
+        return job;
+    }
+
+    if (index == 0) {
+        job = sb_job_pop_main(system);
+        if (job != NULL) {
+            return job;
+        }
+    }
+
+    start = sb_rng_range(&deque->rng, 0, system->thread_count - 1);
+    for (i = 0; i < system->thread_count; i++) {
+        victim = (start + i) % system->thread_count;
+        if (victim == (unsigned)index) {
+            continue;
+        }
+        job = sb_job_deque_steal(&system->deques[victim]);
+        if (job != NULL) {
+            deque->stats.stolen++;
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void *
+sb_job_worker (void *data)
+{
+    sb_job_system_type *system = &sb_job_system;
+    sb_job_type        *job;
+    int                 index = (int)(intptr_t)data;
+    bool                quit;
+
+    sb_job_thread_index = index;
+
+    for (;;) {
+        job = sb_job_find(system, index);
+        if (job != NULL) {
+            sb_job_run(system, job);
+            continue;
+        }
+
+        pthread_mutex_lock(&system->sleep_lock);
+        __atomic_add_fetch(&system->sleepers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!system->quit && !sb_job_any_queued(system)) {
+            system->deques[index].stats.sleeps++;
+            pthread_cond_wait(&system->wake, &system->sleep_lock);
+        }
+        __atomic_sub_fetch(&system->sleepers, 1, __ATOMIC_SEQ_CST);
+        quit = system->quit;
+        pthread_mutex_unlock(&system->sleep_lock);
+
+        if (quit) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Start the system with the given number of threads, including the calling
+ * one, which becomes thread 0 (the main thread). Returns false if not all
+ * the workers could be started; the system still runs, with fewer.
+ */
+bool
+sb_job_setup (unsigned threads)
+{
+    sb_job_system_type *system = &sb_job_system;
+    unsigned            i;
+
+    memset(system, 0, sizeof(*system));
+    system->thread_count = MAX(1, MIN(threads, SB_JOB_MAX_THREADS));
+
+    for (i = 0; i < SB_JOB_MAX_JOBS; i++) {
+        system->jobs[i].next = system->free_jobs;
+        system->free_jobs = &system->jobs[i];
+    }
+    for (i = 0; i < system->thread_count; i++) {
+        sb_rng_seed(&system->deques[i].rng, i + 1);
+    }
+
+    pthread_mutex_init(&system->sleep_lock, NULL);
+    pthread_cond_init(&system->wake, NULL);
+
+    sb_job_thread_index = 0;
+    system->running = true;
+
+    /*
+     * A worker that failed to start leaves an empty deque behind, which
+     * does no harm.
+     */
+    for (i = 1; i < system->thread_count; i++) {
+        if (pthread_create(&system->threads[i], NULL, &sb_job_worker,
+                           (void *)(intptr_t)i) != 0) {
+            break;
+        }
+        system->started++;
+    }
+
+    return (system->started == system->thread_count - 1);
+}
+
+
+/*
+ * Stop the workers. Anything still queued is dropped, so wait for all
+ * outstanding work first.
+ */
+void
+sb_job_cleanup (void)
+{
+    sb_job_system_type *system = &sb_job_system;
+    unsigned            i;
+
+    if (!system->running) {
+        return;
+    }
+
+    pthread_mutex_lock(&system->sleep_lock);
+    system->quit = true;
+    pthread_cond_broadcast(&system->wake);
+    pthread_mutex_unlock(&system->sleep_lock);
+
+    for (i = 1; i <= system->started; i++) {
+        pthread_join(system->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&system->wake);
+    pthread_mutex_destroy(&system->sleep_lock);
+    system->running = false;
+    sb_job_thread_index = -1;
+}
+
+
+unsigned
+sb_job_get_thread_count (void)
+{
+    return sb_job_system.running ? sb_job_system.thread_count : 1;
+}
+
+
+int
+sb_job_get_thread_index (void)
+{
+    return sb_job_thread_index;
+}
+
+
+/*
+ * Queue a copy of job, once after (if not NULL) has reached zero. The
+ * job's counter is counted up here.
+ */
+static void
+sb_job_queue (const sb_job_type   *job,
+              sb_job_counter_type *after)
+{
+    sb_job_system_type *system = &sb_job_system;
+    sb_job_type        *queued = NULL;
+
+    if (job->counter != NULL) {
+        __atomic_add_fetch(&job->counter->pending, 1, __ATOMIC_RELAXED);
+    }
+
+    if (system->running && sb_job_thread_index >= 0) {
+        queued = sb_job_alloc(system);
+    }
+    if (queued == NULL) {
+        if (after != NULL) {
+            sb_job_wait(after);
+        }
+        sb_job_run_inline(system, job);
+        return;
+    }
+
+    *queued = *job;
+    queued->next = NULL;
+
+    if (after != NULL) {
+        sb_job_lock(&after->lock);
+        if (__atomic_load_n(&after->pending, __ATOMIC_ACQUIRE) > 0) {
+            queued->next = after->waiting;
+            after->waiting = queued;
+            sb_job_unlock(&after->lock);
+            return;
+        }
+        sb_job_unlock(&after->lock);
+    }
+
+    sb_job_release(system, queued);
+}
+
+
+static void
+sb_job_submit_job (sb_job_counter_type *after,
+                   sb_job_func_type     func,
+                   void                *data,
+                   sb_job_counter_type *counter,
+                   bool                 main)
+{
+    sb_job_type job;
+
+    memset(&job, 0, sizeof(job));
+    job.func = func;
+    job.data = data;
+    job.counter = counter;
+    job.main = main;
+    sb_job_queue(&job, after);
+}
+
+
+/*
+ * Queue func(data) to run on any thread. counter, if not NULL, is counted
+ * up now and back down once it has run.
+ */
+void
+sb_job_submit (sb_job_func_type     func,
+               void                *data,
+               sb_job_counter_type *counter)
+{
+    sb_job_submit_job(NULL, func, data, counter, false);
+}
+
+
+/*
+ * As sb_job_submit, but the job isn't queued until after has reached zero.
+ */
+void
+sb_job_submit_after (sb_job_counter_type *after,
+                     sb_job_func_type     func,
+                     void                *data,
+                     sb_job_counter_type *counter)
+{
+    sb_job_submit_job(after, func, data, counter, false);
+}
+
+
+/*
+ * As sb_job_submit, but the job will only be run on the main thread.
+ */
+void
+sb_job_submit_main (sb_job_func_type     func,
+                    void                *data,
+                    sb_job_counter_type *counter)
+{
+    sb_job_submit_job(NULL, func, data, counter, true);
+}
+
+
+/*
+ * Call func(data, begin, end) over pieces of [0, count), in parallel. Pieces
+ * are at least grain long, apart from the last; make each worth at least a
+ * few microseconds. counter is done when the whole range is.
+ */
+void
+sb_job_parallel_for (size_t                  count,
+                     size_t                  grain,
+                     sb_job_range_func_type  func,
+                     void                   *data,
+                     sb_job_counter_type    *counter)
+{
+    sb_job_type job;
+
+    if (count == 0) {
+        return;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.range_func = func;
+    job.data = data;
+    job.begin = 0;
+    job.end = count;
+    job.grain = MAX(1, grain);
+    job.counter = counter;
+    sb_job_queue(&job, NULL);
+}
+
+
+/*
+ * Whether everything submitted against counter has run. Once this returns
+ * true (or sb_job_wait returns) the counter is free to be reused or go out
+ * of scope.
+ */
+bool
+sb_job_done (sb_job_counter_type *counter)
+{
+    if (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) > 0) {
+        return false;
+    }
+
+    /*
+     * The last job's thread may still be on its way out of the lock.
+     */
+    sb_job_lock(&counter->lock);
+    sb_job_unlock(&counter->lock);
+
+    return true;
+}
+
+
+/*
+ * Run jobs until everything submitted against counter has run.
+ */
+void
+sb_job_wait (sb_job_counter_type *counter)
+{
+    sb_job_system_type *system = &sb_job_system;
+    sb_job_type        *job;
+
+    while (!sb_job_done(counter)) {
+        job = NULL;
+        if (system->running && sb_job_thread_index >= 0) {
+            job = sb_job_find(system, sb_job_thread_index);
+        }
+
+        if (job != NULL) {
+            sb_job_run(system, job);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+
+/*
+ * Run the main thread jobs queued so far. Call once a frame from the main
+ * thread.
+ *
+ * With no workers, nothing else would run what the main thread has queued
+ * on its own deque until it waits for it, so those jobs are run here too.
+ */
+void
+sb_job_run_main (void)
+{
+    sb_job_system_type *system = &sb_job_system;
+    sb_job_deque_type  *deque = &system->deques[0];
+    sb_job_type        *job;
+    size_t              count;
+
+    if (!system->running || sb_job_thread_index != 0) {
+        return;
+    }
+
+    /*
+     * Leave anything these queue for next time.
+     */
+    count = __atomic_load_n(&system->main_count, __ATOMIC_RELAXED);
+    while (count-- > 0 && (job = sb_job_pop_main(system)) != NULL) {
+        sb_job_run(system, job);
+    }
+
+    if (system->thread_count > 1) {
+        return;
+    }
+    count = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) -
+            __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    while (count-- > 0 && (job = sb_job_deque_pop(deque)) != NULL) {
+        sb_job_run(system, job);
+    }
+}
+
+
+/*
+ * Totals over all threads. Only exact when nothing is running.
+ */
+void
+sb_job_get_stats (sb_job_stats_type *stats)
+{
+    sb_job_system_type *system = &sb_job_system;
+    unsigned            i;
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < system->thread_count; i++) {
+        stats->run += system->deques[i].stats.run;
+        stats->stolen += system->deques[i].stats.stolen;
+        stats->inline_run += system->deques[i].stats.inline_run;
+        stats->sleeps += system->deques[i].stats.sleeps;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef __JOB_H__
+#define __JOB_H__
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Job system - a fixed pool of worker threads that run small functions
+ * ("jobs") handed to them by the game.
+ *
+ * Every thread in the system (the one that called sb_job_setup counts as
+ * thread 0) has its own deque of jobs. A thread pushes and pops jobs at
+ * the bottom of its own deque, last in first out, and when that is empty
+ * steals from the top of someone else's. Idle workers sleep until
+ * something is submitted.
+ *
+ * Completion is tracked with counters: each job submitted against a
+ * counter bumps it, and it drops again when the job has run. sb_job_wait
+ * runs other jobs until a counter reaches zero, and sb_job_submit_after
+ * holds a job back until another counter has. Counters must be zeroed
+ * (SB_JOB_COUNTER_INIT or memset) before their first use.
+ *
+ * sb_job_parallel_for splits a range of work into jobs, halving it each
+ * time a piece is picked up until the pieces are small enough.
+ *
+ * Jobs submitted with sb_job_submit_main only ever run on thread 0, for
+ * work that has to be done there (most SDL video calls) - in sb_job_wait
+ * or sb_job_run_main, which the main loop calls once a frame.
+ * With only the one thread, sb_job_run_main also runs the jobs already
+ * queued on it, so background work still gets done a frame at a time.
+ *
+ * Jobs can only be submitted from threads in the system. Jobs and
+ * deques come from fixed pools, so submitting never allocates; if a pool
+ * is full the job is run straight away by the thread submitting it. This
+ * also happens for everything before sb_job_setup is called, so modules
+ * can use the job API whether or not the system is running.
+ *
+ * Doesn't need SDL, so the batch driver uses it too.
+ */
+#define SB_JOB_MAX_THREADS 64
+#define SB_JOB_MAX_JOBS    4096
+#define SB_JOB_DEQUE_SIZE  1024
+#define SB_JOB_MAIN_SIZE   256
+
+
+typedef void (*sb_job_func_type)(void *data);
+typedef void (*sb_job_range_func_type)(void *data, size_t begin, size_t end);
+
+
+struct sb_job;
+
+typedef struct sb_job_counter {
+    int            pending;
+    int            lock;
+    struct sb_job *waiting;
+} sb_job_counter_type;
+
+#define SB_JOB_COUNTER_INIT { 0, 0, NULL }
+
+
+typedef struct sb_job_stats {
+    uint64_t run;
+    uint64_t stolen;
+    uint64_t inline_run;
+    uint64_t sleeps;
+} sb_job_stats_type;
+
+
+bool sb_job_setup(unsigned threads);
+void sb_job_cleanup(void);
+unsigned sb_job_get_thread_count(void);
+int sb_job_get_thread_index(void);
+void sb_job_submit(sb_job_func_type     func,
+                   void                *data,
+                   sb_job_counter_type *counter);
+void sb_job_submit_after(sb_job_counter_type *after,
+                         sb_job_func_type     func,
+                         void                *data,
+                         sb_job_counter_type *counter);
+void sb_job_submit_main(sb_job_func_type     func,
+                        void                *data,
+                        sb_job_counter_type *counter);
+void sb_job_parallel_for(size_t                  count,
+                         size_t                  grain,
+                         sb_job_range_func_type  func,
+                         void                   *data,
+                         sb_job_counter_type    *counter);
+bool sb_job_done(sb_job_counter_type *counter);
+void sb_job_wait(sb_job_counter_type *counter);
+void sb_job_run_main(void);
+void sb_job_get_stats(sb_job_stats_type *stats);
+
+
+#endif /* __JOB_H__ */
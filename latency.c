@@ -0,0 +1,145 @@
+#include <string.h>
+#include "common.h"
+#include "latency.h"
+
+
+static const char *sb_latency_kind_names[SB_LATENCY_KIND_COUNT] = {
+    "motion",
+    "button down",
+    "button up",
+};
+
+
+/*
+ * An input waiting to be shown.
+ */
+typedef struct sb_latency_input {
+    sb_latency_kind_type kind;
+    uint32_t             timestamp;
+} sb_latency_input_type;
+
+
+/*
+ * The first drawn of the pending inputs are in the frame drawn last,
+ * waiting for it to be presented; the rest came in after it was drawn.
+ */
+typedef struct sb_latency {
+    sb_latency_input_type pending[SB_LATENCY_PENDING];
+    size_t                pending_count;
+    size_t                drawn;
+    sb_latency_stats_type stats;
+} sb_latency_type;
+
+
+static sb_latency_type sb_latency;
+
+
+const char *
+sb_latency_kind_name (sb_latency_kind_type kind)
+{
+    return sb_latency_kind_names[kind];
+}
+
+
+/*
+ * Note an input that has just been handed to a gamestate. timestamp is the
+ * event's SDL timestamp.
+ */
+void
+sb_latency_input (sb_latency_kind_type kind,
+                  uint32_t             timestamp)
+{
+    sb_latency_type *latency = &sb_latency;
+
+    if (latency->pending_count == SB_LATENCY_PENDING) {
+        latency->stats.dropped++;
+        return;
+    }
+
+    latency->pending[latency->pending_count].kind = kind;
+    latency->pending[latency->pending_count].timestamp = timestamp;
+    latency->pending_count++;
+}
+
+
+/*
+ * Tag the inputs so far as shown by the frame just drawn.
+ */
+void
+sb_latency_frame_drawn (void)
+{
+    sb_latency.drawn = sb_latency.pending_count;
+}
+
+
+/*
+ * The frame drawn last was presented at now (in SDL ticks) - time the
+ * inputs it showed.
+ */
+void
+sb_latency_frame_presented (uint32_t now)
+{
+    sb_latency_type       *latency = &sb_latency;
+    sb_latency_stats_type *stats = &latency->stats;
+    sb_latency_input_type *input;
+    uint32_t               ms;
+    size_t                 i;
+
+    for (i = 0; i < latency->drawn; i++) {
+        input = &latency->pending[i];
+
+        /*
+         * Ticks and timestamps come from the same clock, but don't trust
+         * it not to have been stamped after now.
+         */
+        ms = ((int32_t)(now - input->timestamp) > 0) ?
+                                                now - input->timestamp : 0;
+        stats->count[input->kind]++;
+        stats->max_ms[input->kind] = MAX(stats->max_ms[input->kind], ms);
+        stats->hist[input->kind][MIN(ms, SB_LATENCY_BUCKETS - 1)]++;
+    }
+
+    memmove(latency->pending, &latency->pending[latency->drawn],
+            (latency->pending_count - latency->drawn) *
+            sizeof(latency->pending[0]));
+    latency->pending_count -= latency->drawn;
+    latency->drawn = 0;
+}
+
+
+void
+sb_latency_get_stats (sb_latency_stats_type *stats)
+{
+    *stats = sb_latency.stats;
+}
+
+
+/*
+ * The latency in ms that percent of the inputs counted in a histogram
+ * were shown within, or 0 if it is empty. Anything in the last bucket is
+ * reported as SB_LATENCY_BUCKETS - 1.
+ */
+uint32_t
+sb_latency_percentile (const uint32_t hist[SB_LATENCY_BUCKETS],
+                       uint32_t       percent)
+{
+    uint64_t total = 0;
+    uint64_t seen = 0;
+    uint32_t i;
+
+    for (i = 0; i < SB_LATENCY_BUCKETS; i++) {
+        total += hist[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    for (i = 0; i < SB_LATENCY_BUCKETS - 1; i++) {
+        seen += hist[i];
+        if (seen * 100 >= total * percent) {
+            break;
+        }
+    }
+
+    return i;
+}
@@ -0,0 +1,60 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Input-to-photon latency - how long after the player moves or clicks the
+ * mouse the result is on screen.
+ *
+ * Each mouse event handed to a gamestate is noted with its SDL timestamp
+ * (when SDL pulled it off the OS queue). The next frame drawn is taken to
+ * be the first that shows it, since gamestates act on input straight
+ * away and draw from what it left behind. Once that frame has been
+ * presented, the time from the event to SDL_RenderPresent returning goes
+ * in the histogram for its kind. That is as near the photons as the game
+ * can see; the display adds its own scanout and response time on top.
+ *
+ * Motion is coalesced (see gamestate.h), so only the newest of a run of
+ * motion events is timed. Times are in whole ms, as SDL stamps events.
+ *
+ * Doesn't need SDL.
+ */
+#define SB_LATENCY_BUCKETS 128
+#define SB_LATENCY_PENDING 64
+
+
+typedef enum {
+    SB_LATENCY_MOTION,
+    SB_LATENCY_BUTTON_DOWN,
+    SB_LATENCY_BUTTON_UP,
+    SB_LATENCY_KIND_COUNT
+} sb_latency_kind_type;
+
+
+/*
+ * hist[kind][i] counts inputs shown i ms after they happened, with the last
+ * bucket counting everything slower. dropped counts inputs that couldn't
+ * be timed, because more than SB_LATENCY_PENDING arrived in one frame.
+ */
+typedef struct sb_latency_stats {
+    uint64_t count[SB_LATENCY_KIND_COUNT];
+    uint32_t max_ms[SB_LATENCY_KIND_COUNT];
+    uint32_t hist[SB_LATENCY_KIND_COUNT][SB_LATENCY_BUCKETS];
+    uint64_t dropped;
+} sb_latency_stats_type;
+
+
+const char *sb_latency_kind_name(sb_latency_kind_type kind);
+void sb_latency_input(sb_latency_kind_type kind, uint32_t timestamp);
+void sb_latency_frame_drawn(void);
+void sb_latency_frame_presented(uint32_t now);
+void sb_latency_get_stats(sb_latency_stats_type *stats);
+uint32_t sb_latency_percentile(const uint32_t hist[SB_LATENCY_BUCKETS],
+                               uint32_t       percent);
+
+
+#endif /* __LATENCY_H__ */
@@ -1,41 +1,44 @@
 #include <SDL2/SDL.h>
-#include <SDL2/SDL_ttf.h>
 #include "gamestate.h"
-#include "game.h"
+#include "play.h"
 #include "util.h"
+#include "render.h"
+#include "ui.h"
 
 
 #define FONT_NAME "media/carbon.ttf"
 #define FONT_SIZE 64
 
 
+#define MENU_LAYER_TEXT 0
+
+
 void sb_exit(void);
 
 
-SDL_Texture *sb_menu_main_new_game_texture;
-SDL_Rect     sb_menu_main_new_game_rect;
-SDL_Texture *sb_menu_main_exit_texture;
-SDL_Rect     sb_menu_main_exit_rect;
+static sb_ui_widget_type sb_menu_main_widgets[] = {
+    { .label = "New Game", .action = &sb_play_start },
+    { .label = "Exit",     .action = &sb_exit },
+};
+
+static sb_ui_menu_type sb_menu_main_menu = {
+    .widgets = sb_menu_main_widgets,
+    .widget_count = SDL_arraysize(sb_menu_main_widgets),
+};
 
 
 static void
 sb_menu_main_event (SDL_Event *e,
                     void      *context)
 {
-    switch (e->type) {
-    case SDL_MOUSEBUTTONDOWN:
-        if (sb_point_in_rect(e->button.x, e->button.y,
-                             &sb_menu_main_new_game_rect)) {
-            sb_gamestate_replace_all(sb_game_get_gamestate());
-        } else if (sb_point_in_rect(e->button.x, e->button.y,
-                                    &sb_menu_main_exit_rect)) {
-            sb_exit();
-        }
-        break;
-
-    default:
-        break;
-    }
+    sb_ui_menu_event(&sb_menu_main_menu, e);
+}
+
+
+static void
+sb_menu_main_enter (void *context)
+{
+    sb_ui_menu_reset(&sb_menu_main_menu);
 }
 
 
@@ -50,60 +53,32 @@ static void
 sb_menu_main_draw (SDL_Renderer *renderer,
                    void         *context)
 {
-    SDL_RenderCopy(renderer, sb_menu_main_new_game_texture, NULL,
-                   &sb_menu_main_new_game_rect);
-    SDL_RenderCopy(renderer, sb_menu_main_exit_texture, NULL,
-                   &sb_menu_main_exit_rect);
+    sb_ui_menu_draw(&sb_menu_main_menu, renderer, MENU_LAYER_TEXT);
 }
 
 
 void
 sb_menu_main_setup (SDL_Renderer *renderer)
 {
-    SDL_Surface  *surf;
-    SDL_Color     color = { 255, 255, 255, 255 };
-    TTF_Font     *font = TTF_OpenFont(FONT_NAME, FONT_SIZE);
-
-    surf = TTF_RenderText_Blended(font, "New Game", color);
-    sb_menu_main_new_game_texture = SDL_CreateTextureFromSurface(renderer,
-                                                                 surf);
-    SDL_FreeSurface(surf);
-    (void)SDL_QueryTexture(sb_menu_main_new_game_texture, NULL, NULL,
-                           &sb_menu_main_new_game_rect.w,
-                           &sb_menu_main_new_game_rect.h);
-    sb_menu_main_new_game_rect.x = 0;
-    sb_menu_main_new_game_rect.y = 0;
-
-    surf = TTF_RenderText_Blended(font, "Exit", color);
-    sb_menu_main_exit_texture = SDL_CreateTextureFromSurface(renderer,
-                                                             surf);
-    SDL_FreeSurface(surf);
-    (void)SDL_QueryTexture(sb_menu_main_exit_texture, NULL, NULL,
-                           &sb_menu_main_exit_rect.w,
-                           &sb_menu_main_exit_rect.h);
-    sb_menu_main_exit_rect.x = 0;
-    sb_menu_main_exit_rect.y = FONT_SIZE;
-
-    TTF_CloseFont(font);
+    sb_ui_menu_setup(&sb_menu_main_menu, renderer, FONT_NAME, FONT_SIZE);
 }
 
 
 void
 sb_menu_main_cleanup (void)
 {
-    free_texture(sb_menu_main_exit_texture);
-    sb_menu_main_exit_texture = NULL;
-
-    free_texture(sb_menu_main_new_game_texture);
-    sb_menu_main_new_game_texture = NULL;
+    sb_ui_menu_cleanup(&sb_menu_main_menu);
 }
 
 
 static sb_gamestate_type sb_menu_main_gamestate = {
+    .name = "main menu",
     .event_cb = &sb_menu_main_event,
     .update_cb = &sb_menu_main_update,
     .draw_cb = &sb_menu_main_draw,
+    .enter_cb = &sb_menu_main_enter,
     .ctx = NULL,
+    .events = SB_UI_MENU_EVENTS,
 };
 
 sb_gamestate_type *
@@ -1,38 +1,55 @@
 #include <SDL2/SDL.h>
-#include <SDL2/SDL_ttf.h>
 #include "gamestate.h"
 #include "util.h"
+#include "render.h"
+#include "ui.h"
 #include "menu_main.h"
+#include "play.h"
 
 
 #define FONT_NAME "media/carbon.ttf"
 #define FONT_SIZE 64
 
 
-SDL_Texture *sb_menu_pause_resume_texture;
-SDL_Rect     sb_menu_pause_resume_rect;
-SDL_Texture *sb_menu_pause_exit_texture;
-SDL_Rect     sb_menu_pause_exit_rect;
+/*
+ * Render layers - the shade goes over the game underneath, then the text
+ * over the shade.
+ */
+#define MENU_LAYER_SHADE 0
+#define MENU_LAYER_TEXT  1
+
+
+static void
+sb_menu_pause_exit (void)
+{
+    sb_play_abandon();
+    sb_gamestate_replace_all(sb_menu_main_get_gamestate());
+}
+
+
+static sb_ui_widget_type sb_menu_pause_widgets[] = {
+    { .label = "Resume", .action = &sb_gamestate_pop },
+    { .label = "Exit",   .action = &sb_menu_pause_exit },
+};
+
+static sb_ui_menu_type sb_menu_pause_menu = {
+    .widgets = sb_menu_pause_widgets,
+    .widget_count = SDL_arraysize(sb_menu_pause_widgets),
+};
 
 
 static void
 sb_menu_pause_event (SDL_Event *e,
                      void      *context)
 {
-    switch (e->type) {
-    case SDL_MOUSEBUTTONDOWN:
-        if (sb_point_in_rect(e->button.x, e->button.y,
-                             &sb_menu_pause_resume_rect)) {
-            sb_gamestate_pop();
-        } else if (sb_point_in_rect(e->button.x, e->button.y,
-                                    &sb_menu_pause_exit_rect)) {
-            sb_gamestate_replace_all(sb_menu_main_get_gamestate());
-        }
-        break;
-
-    default:
-        break;
-    }
+    sb_ui_menu_event(&sb_menu_pause_menu, e);
+}
+
+
+static void
+sb_menu_pause_enter (void *context)
+{
+    sb_ui_menu_reset(&sb_menu_pause_menu);
 }
 
 
@@ -47,64 +64,37 @@ static void
 sb_menu_pause_draw (SDL_Renderer *renderer,
                     void         *context)
 {
-    SDL_Rect rect = { 0, 0, 800, 600 };
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 180);
-    SDL_RenderFillRect(renderer, &rect);
-    SDL_RenderCopy(renderer, sb_menu_pause_resume_texture, NULL,
-                   &sb_menu_pause_resume_rect);
-    SDL_RenderCopy(renderer, sb_menu_pause_exit_texture, NULL,
-                   &sb_menu_pause_exit_rect);
+    SDL_Rect  rect = { 0, 0, 800, 600 };
+    SDL_Color shade = { 0, 0, 0, 180 };
+
+    sb_render_fill(MENU_LAYER_SHADE, shade, &rect);
+    sb_ui_menu_draw(&sb_menu_pause_menu, renderer, MENU_LAYER_TEXT);
 }
 
 
 void
 sb_menu_pause_setup (SDL_Renderer *renderer)
 {
-    SDL_Surface *surf;
-    SDL_Color    color = { 255, 255, 255, 255 };
-    TTF_Font    *font = TTF_OpenFont(FONT_NAME, FONT_SIZE);
-
-    surf = TTF_RenderText_Blended(font, "Resume", color);
-    sb_menu_pause_resume_texture = SDL_CreateTextureFromSurface(renderer,
-                                                                surf);
-    SDL_FreeSurface(surf);
-    (void)SDL_QueryTexture(sb_menu_pause_resume_texture, NULL, NULL,
-                           &sb_menu_pause_resume_rect.w,
-                           &sb_menu_pause_resume_rect.h);
-    sb_menu_pause_resume_rect.x = 0;
-    sb_menu_pause_resume_rect.y = 0;
-
-
-    surf = TTF_RenderText_Blended(font, "Exit", color);
-    sb_menu_pause_exit_texture = SDL_CreateTextureFromSurface(renderer, surf);
-    SDL_FreeSurface(surf);
-    (void)SDL_QueryTexture(sb_menu_pause_exit_texture, NULL, NULL,
-                           &sb_menu_pause_exit_rect.w,
-                           &sb_menu_pause_exit_rect.h);
-    sb_menu_pause_exit_rect.x = 0;
-    sb_menu_pause_exit_rect.y = FONT_SIZE;
-
-    TTF_CloseFont(font);
+    sb_ui_menu_setup(&sb_menu_pause_menu, renderer, FONT_NAME, FONT_SIZE);
 }
 
 
 void
 sb_menu_pause_cleanup (void)
 {
-    free_texture(sb_menu_pause_resume_texture);
-    sb_menu_pause_resume_texture = NULL;
-
-    free_texture(sb_menu_pause_exit_texture);
-    sb_menu_pause_exit_texture = NULL;
+    sb_ui_menu_cleanup(&sb_menu_pause_menu);
 }
 
 
 static sb_gamestate_type sb_menu_pause_gamestate = {
+    .name = "pause menu",
     .event_cb = &sb_menu_pause_event,
     .update_cb = &sb_menu_pause_update,
     .draw_cb = &sb_menu_pause_draw,
+    .enter_cb = &sb_menu_pause_enter,
     .ctx = NULL,
-    .flags = SB_GAMESTATE_FLAG_DRAW_UNDER
+    .flags = SB_GAMESTATE_FLAG_DRAW_UNDER,
+    .events = SB_UI_MENU_EVENTS
 };
 
 
@@ -113,4 +103,3 @@ sb_menu_pause_get_gamestate (void)
 {
     return &sb_menu_pause_gamestate;
 }
-
@@ -0,0 +1,162 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "common.h"
+#include "game.h"
+#include "latency.h"
+#include "metrics.h"
+
+
+typedef struct sb_metrics {
+    sb_metrics_segment_type *segment;
+    sb_metrics_data_type     data;
+    sb_game_board_type       board;
+} sb_metrics_type;
+
+
+static sb_metrics_type sb_metrics;
+
+
+/*
+ * Create the shared memory segment. Returns false (and publishing does
+ * nothing) if that fails.
+ */
+bool
+sb_metrics_setup (void)
+{
+    sb_metrics_type *metrics = &sb_metrics;
+    void            *mem;
+    int              fd;
+
+    memset(metrics, 0, sizeof(*metrics));
+
+    fd = shm_open(SB_METRICS_SHM_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(sb_metrics_segment_type)) != 0) {
+        close(fd);
+        shm_unlink(SB_METRICS_SHM_NAME);
+        return false;
+    }
+
+    mem = mmap(NULL, sizeof(sb_metrics_segment_type),
+               PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        shm_unlink(SB_METRICS_SHM_NAME);
+        return false;
+    }
+
+    /*
+     * Writing the whole segment now also faults its pages in, so the first
+     * publish doesn't have to.
+     */
+    metrics->segment = mem;
+    memset(metrics->segment, 0, sizeof(sb_metrics_segment_type));
+    metrics->segment->version = SB_METRICS_VERSION;
+    metrics->segment->pid = getpid();
+    __atomic_store_n(&metrics->segment->magic, SB_METRICS_MAGIC,
+                     __ATOMIC_RELEASE);
+
+    return true;
+}
+
+
+void
+sb_metrics_cleanup (void)
+{
+    sb_metrics_type *metrics = &sb_metrics;
+
+    if (metrics->segment == NULL) {
+        return;
+    }
+
+    munmap(metrics->segment, sizeof(sb_metrics_segment_type));
+    metrics->segment = NULL;
+    shm_unlink(SB_METRICS_SHM_NAME);
+}
+
+
+/*
+ * Update the metrics for a frame and copy them into the shared segment.
+ * quality is the frame budget governor's level (see governor.h).
+ */
+void
+sb_metrics_publish (uint32_t            frametime,
+                    size_t              quality,
+                    const sb_game_type *game)
+{
+    sb_metrics_type         *metrics = &sb_metrics;
+    sb_metrics_data_type    *data = &metrics->data;
+    sb_metrics_segment_type *segment = metrics->segment;
+    sb_game_board_type      *board = &metrics->board;
+    sb_game_stats_type       stats;
+    uint32_t                 seq;
+
+    if (segment == NULL) {
+        return;
+    }
+
+    data->frames++;
+    data->frametime_total += frametime;
+    data->frametime_last = frametime;
+    data->frametime_max = MAX(data->frametime_max, frametime);
+    data->frame_hist[MIN(frametime / SB_METRICS_FRAME_BUCKET_MS,
+                         SB_METRICS_FRAME_BUCKETS - 1)]++;
+    data->quality = quality;
+    sb_latency_get_stats(&data->latency);
+
+    sb_game_get_stats(game, &stats);
+    sb_game_get_board(game, board);
+    data->gametime = board->gametime;
+    data->score = stats.score;
+    data->calls = stats.calls;
+    data->connected = stats.connected;
+    data->missed = stats.missed;
+    data->dropped = stats.dropped;
+
+    memcpy(data->line_states, board->line_states,
+           sizeof(data->line_states));
+    data->active_calls = board->active_calls;
+
+    /*
+     * Seqlock write - the fences keep the data writes between the two
+     * sequence number updates, as seen from other cores.
+     */
+    seq = segment->seq;
+    __atomic_store_n(&segment->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&segment->data, data, sizeof(*data));
+    __atomic_store_n(&segment->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Take a consistent copy of the data in a metrics segment, for readers.
+ * Returns false if the segment doesn't hold metrics this code understands.
+ */
+bool
+sb_metrics_read (const sb_metrics_segment_type *segment,
+                 sb_metrics_data_type          *data)
+{
+    uint32_t before;
+    uint32_t after;
+
+    if (__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) !=
+                                                        SB_METRICS_MAGIC ||
+        segment->version != SB_METRICS_VERSION) {
+        return false;
+    }
+
+    do {
+        before = __atomic_load_n(&segment->seq, __ATOMIC_ACQUIRE);
+        memcpy(data, &segment->data, sizeof(*data));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&segment->seq, __ATOMIC_RELAXED);
+    } while (before % 2 != 0 || before != after);
+
+    return true;
+}
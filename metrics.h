@@ -0,0 +1,72 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+#include "latency.h"
+
+
+/*
+ * Live metrics, published every frame into a POSIX shared memory segment so
+ * a separate process (e.g. switchboard-metrics) can watch a running game.
+ *
+ * The segment holds a single sb_metrics_segment_type. The data in it is
+ * guarded by a seqlock: the writer makes seq odd while it updates the data
+ * and even again when it is done, so a reader copies the data and retries
+ * if seq was odd or changed in the meantime. The writer never waits for
+ * readers, and after setup publishing is just memory writes.
+ */
+#define SB_METRICS_SHM_NAME "/switchboard-metrics"
+#define SB_METRICS_MAGIC    0x53424d54 // "SBMT"
+#define SB_METRICS_VERSION  3
+
+
+/*
+ * Frame time histogram - bucket i counts frames taking [i * 2, i * 2 + 2)
+ * ms, with the last bucket counting everything slower.
+ */
+#define SB_METRICS_FRAME_BUCKETS   32
+#define SB_METRICS_FRAME_BUCKET_MS 2
+
+
+typedef struct sb_metrics_data {
+    uint64_t              frames;
+    uint64_t              frametime_total;
+    uint32_t              frametime_last;
+    uint32_t              frametime_max;
+    uint32_t              frame_hist[SB_METRICS_FRAME_BUCKETS];
+    uint32_t              quality;
+    uint32_t              gametime;
+    uint32_t              score;
+    uint32_t              calls;
+    uint32_t              connected;
+    uint32_t              missed;
+    uint32_t              dropped;
+    uint32_t              active_calls;
+    uint32_t              line_states[LINE_STATE_COUNT];
+    sb_latency_stats_type latency;
+} sb_metrics_data_type;
+
+
+typedef struct sb_metrics_segment {
+    uint32_t             magic;
+    uint32_t             version;
+    uint32_t             pid;
+    uint32_t             seq;
+    sb_metrics_data_type data;
+} sb_metrics_segment_type;
+
+
+bool sb_metrics_setup(void);
+void sb_metrics_cleanup(void);
+void sb_metrics_publish(uint32_t            frametime,
+                        size_t              quality,
+                        const sb_game_type *game);
+bool sb_metrics_read(const sb_metrics_segment_type *segment,
+                     sb_metrics_data_type          *data);
+
+
+#endif /* __METRICS_H__ */
@@ -0,0 +1,212 @@
+/*
+ * Metrics reader - attaches to the metrics segment of a game started with
+ * --metrics and prints what it finds, once or every second. Doesn't need
+ * SDL, and never makes the game wait.
+ */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "game.h"
+#include "latency.h"
+#include "metrics.h"
+
+
+static const char *sb_reader_line_state_names[LINE_STATE_COUNT] = {
+    "idle",
+    "dialing",
+    "operator request",
+    "answering",
+    "operator reply",
+    "busy",
+};
+
+
+static void
+sb_reader_usage (const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --follow            print again every second until the game\n"
+            "                      goes away\n"
+            "  --histogram         include the frame time histogram\n",
+            name);
+}
+
+
+/*
+ * Print input latency percentiles for each kind of input, over the whole
+ * game and, if there is an earlier sample, over the time since it.
+ */
+static void
+sb_reader_print_latency (const sb_metrics_data_type *data,
+                         const sb_metrics_data_type *prev)
+{
+    const sb_latency_stats_type *latency = &data->latency;
+    uint32_t                     recent[SB_LATENCY_BUCKETS];
+    uint64_t                     count;
+    size_t                       i;
+    size_t                       j;
+
+    for (i = 0; i < SB_LATENCY_KIND_COUNT; i++) {
+        if (latency->count[i] == 0) {
+            continue;
+        }
+        printf("latency %-11s n %" PRIu64 "  p50 %" PRIu32 " p90 %" PRIu32
+               " p99 %" PRIu32 " max %" PRIu32 " ms",
+               sb_latency_kind_name(i), latency->count[i],
+               sb_latency_percentile(latency->hist[i], 50),
+               sb_latency_percentile(latency->hist[i], 90),
+               sb_latency_percentile(latency->hist[i], 99),
+               latency->max_ms[i]);
+
+        count = (prev != NULL) ?
+                latency->count[i] - prev->latency.count[i] : 0;
+        if (count > 0) {
+            for (j = 0; j < SB_LATENCY_BUCKETS; j++) {
+                recent[j] = latency->hist[i][j] - prev->latency.hist[i][j];
+            }
+            printf("  (last second p50 %" PRIu32 " p99 %" PRIu32 ")",
+                   sb_latency_percentile(recent, 50),
+                   sb_latency_percentile(recent, 99));
+        }
+        printf("\n");
+    }
+}
+
+
+/*
+ * Print one sample. prev is the sample from a second ago, if there was one,
+ * for working out the frame rate and recent latency.
+ */
+static void
+sb_reader_print (const sb_metrics_segment_type *segment,
+                 const sb_metrics_data_type    *data,
+                 const sb_metrics_data_type    *prev,
+                 bool                           histogram)
+{
+    size_t   i;
+    uint64_t frames;
+
+    printf("pid %" PRIu32 "  frames %" PRIu64, segment->pid, data->frames);
+    if (prev != NULL) {
+        frames = data->frames - prev->frames;
+        printf("  fps %" PRIu64, frames);
+    }
+    if (data->frames > 0) {
+        printf("  frame ms last %" PRIu32 " mean %.2f max %" PRIu32,
+               data->frametime_last,
+               (double)data->frametime_total / data->frames,
+               data->frametime_max);
+    }
+    printf("  quality level %" PRIu32, data->quality);
+    printf("\n");
+
+    printf("time %" PRIu32 ".%03" PRIu32 "s  score %" PRIu32
+           "  calls %" PRIu32 "  connected %" PRIu32 "  missed %" PRIu32
+           "  dropped %" PRIu32 "  active %" PRIu32 "\n",
+           data->gametime / 1000, data->gametime % 1000, data->score,
+           data->calls, data->connected, data->missed, data->dropped,
+           data->active_calls);
+
+    for (i = 0; i < LINE_STATE_COUNT; i++) {
+        printf("%s%s %" PRIu32, i == 0 ? "lines: " : ", ",
+               sb_reader_line_state_names[i], data->line_states[i]);
+    }
+    printf("\n");
+
+    sb_reader_print_latency(data, prev);
+
+    if (histogram) {
+        for (i = 0; i < SB_METRICS_FRAME_BUCKETS; i++) {
+            if (data->frame_hist[i] == 0) {
+                continue;
+            }
+            if (i == SB_METRICS_FRAME_BUCKETS - 1) {
+                printf("  %3zu+     ms  %" PRIu32 "\n",
+                       i * SB_METRICS_FRAME_BUCKET_MS, data->frame_hist[i]);
+            } else {
+                printf("  %3zu-%-3zu  ms  %" PRIu32 "\n",
+                       i * SB_METRICS_FRAME_BUCKET_MS,
+                       (i + 1) * SB_METRICS_FRAME_BUCKET_MS,
+                       data->frame_hist[i]);
+            }
+        }
+    }
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    const sb_metrics_segment_type *segment;
+    sb_metrics_data_type           data;
+    sb_metrics_data_type           prev;
+    bool                           follow = false;
+    bool                           histogram = false;
+    bool                           have_prev = false;
+    void                          *mem;
+    int                            fd;
+    int                            i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--follow") == 0) {
+            follow = true;
+        } else if (strcmp(argv[i], "--histogram") == 0) {
+            histogram = true;
+        } else {
+            sb_reader_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    fd = shm_open(SB_METRICS_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "No metrics segment - is switchboard running with "
+                        "--metrics?\n");
+        return EXIT_FAILURE;
+    }
+
+    mem = mmap(NULL, sizeof(sb_metrics_segment_type), PROT_READ, MAP_SHARED,
+               fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    segment = mem;
+
+    do {
+        if (!sb_metrics_read(segment, &data)) {
+            fprintf(stderr, "Metrics segment is from a different version\n");
+            break;
+        }
+
+        sb_reader_print(segment, &data, have_prev ? &prev : NULL, histogram);
+        prev = data;
+        have_prev = true;
+
+        if (follow) {
+            printf("\n");
+            fflush(stdout);
+            sleep(1);
+
+            /*
+             * The game unlinks the segment on exit, but our mapping keeps
+             * the last numbers around - stop once it's gone.
+             */
+            if (kill(segment->pid, 0) != 0) {
+                break;
+            }
+        }
+    } while (follow);
+
+    munmap(mem, sizeof(sb_metrics_segment_type));
+
+    return EXIT_SUCCESS;
+}
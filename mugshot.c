@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include "util.h"
+#include "job.h"
+#include "mugshot.h"
+
+
+/*
+ * Max number of decoded mugshots turned into textures per frame, so a burst
+ * of loads is spread over a few frames rather than causing a hitch.
+ */
+#define SB_MUGSHOT_UPLOADS_PER_FRAME 4
+
+
+/*
+ * Pixel size of each variant, indexed by sb_mugshot_size_type.
+ */
+static const int sb_mugshot_pixels[SB_MUGSHOT_SIZE_COUNT] = {
+    SB_MUGSHOT_SLOT_PIXELS,
+    SB_MUGSHOT_BUBBLE_PIXELS,
+};
+
+
+typedef enum {
+    SB_MUGSHOT_SLOT_EMPTY,
+    SB_MUGSHOT_SLOT_LOADING,
+    SB_MUGSHOT_SLOT_READY,
+} sb_mugshot_slot_state_type;
+
+
+/*
+ * A cache entry, holding every size of one mugshot. A READY slot with no
+ * textures records that there is no image for that customer, so we don't
+ * keep trying to load it.
+ */
+typedef struct sb_mugshot_slot {
+    sb_mugshot_slot_state_type state;
+    size_t                     id;
+    SDL_Texture               *textures[SB_MUGSHOT_SIZE_COUNT];
+    uint64_t                   last_used;
+} sb_mugshot_slot_type;
+
+
+/*
+ * Decoded and scaled images waiting to be turned into textures.
+ */
+typedef struct sb_mugshot_result {
+    size_t       slot;
+    SDL_Surface *surfs[SB_MUGSHOT_SIZE_COUNT];
+} sb_mugshot_result_type;
+
+
+/*
+ * The cache. Everything is owned by the main thread except the result
+ * queue, which is shared with the loader jobs under the lock. At most one
+ * load or result exists per LOADING slot, so the queue can't overflow.
+ */
+typedef struct sb_mugshot_cache {
+    sb_mugshot_slot_type   slots[SB_MUGSHOT_MAX_BUDGET];
+    size_t                 budget;
+    uint64_t               frame;
+    SDL_mutex             *lock;
+    sb_job_counter_type    loads;
+    sb_mugshot_result_type results[SB_MUGSHOT_MAX_BUDGET];
+    size_t                 result_count;
+} sb_mugshot_cache_type;
+
+
+static sb_mugshot_cache_type sb_mugshot_cache;
+
+
+/*
+ * Loader job - decode and scale the mugshot for a slot. Each load is a job
+ * of its own, so a burst of them is spread over all the cores.
+ */
+static void
+sb_mugshot_load (void *data)
+{
+    sb_mugshot_cache_type *cache = &sb_mugshot_cache;
+    size_t                 slot = (size_t)(uintptr_t)data;
+    size_t                 i;
+    char                   filename[128];
+    SDL_Surface           *surf;
+    SDL_Surface           *surfs[SB_MUGSHOT_SIZE_COUNT];
+
+    /*
+     * The slot's id doesn't change while it is LOADING.
+     */
+    snprintf(filename, sizeof(filename), "media/mugshots/%zu.png",
+             cache->slots[slot].id + 1);
+    surf = IMG_Load(filename);
+
+    /*
+     * Do the (relatively expensive) filtered scaling here, off the main
+     * thread, so drawing never has to scale.
+     */
+    for (i = 0; i < SB_MUGSHOT_SIZE_COUNT; i++) {
+        surfs[i] = NULL;
+        if (surf != NULL) {
+            surfs[i] = scale_surface(surf, sb_mugshot_pixels[i],
+                                     sb_mugshot_pixels[i]);
+        }
+    }
+    SDL_FreeSurface(surf);
+
+    SDL_LockMutex(cache->lock);
+    cache->results[cache->result_count].slot = slot;
+    memcpy(cache->results[cache->result_count].surfs, surfs, sizeof(surfs));
+    cache->result_count++;
+    SDL_UnlockMutex(cache->lock);
+}
+
+
+static sb_mugshot_slot_type *
+sb_mugshot_find (sb_mugshot_cache_type *cache,
+                 size_t                 id)
+{
+    size_t i;
+
+    for (i = 0; i < cache->budget; i++) {
+        if (cache->slots[i].state != SB_MUGSHOT_SLOT_EMPTY &&
+            cache->slots[i].id == id) {
+            return &cache->slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Find a slot to load into - an empty one if possible, otherwise evict the
+ * least recently used mugshot. Anything used this frame is on screen, so is
+ * never evicted; if that's everything, return NULL.
+ */
+static sb_mugshot_slot_type *
+sb_mugshot_alloc_slot (sb_mugshot_cache_type *cache)
+{
+    sb_mugshot_slot_type *slot;
+    sb_mugshot_slot_type *lru = NULL;
+    size_t                i;
+
+    for (i = 0; i < cache->budget; i++) {
+        slot = &cache->slots[i];
+        if (slot->state == SB_MUGSHOT_SLOT_EMPTY) {
+            return slot;
+        }
+
+        if (slot->state == SB_MUGSHOT_SLOT_READY &&
+            slot->last_used < cache->frame &&
+            (lru == NULL || slot->last_used < lru->last_used)) {
+            lru = slot;
+        }
+    }
+
+    if (lru != NULL) {
+        for (i = 0; i < SB_MUGSHOT_SIZE_COUNT; i++) {
+            free_texture(lru->textures[i]);
+            lru->textures[i] = NULL;
+        }
+        lru->state = SB_MUGSHOT_SLOT_EMPTY;
+    }
+
+    return lru;
+}
+
+
+/*
+ * Start loading a mugshot in the background if it isn't already cached or
+ * on its way, e.g. when a customer is about to be shown.
+ */
+void
+sb_mugshot_prefetch (size_t id)
+{
+    sb_mugshot_cache_type *cache = &sb_mugshot_cache;
+    sb_mugshot_slot_type  *slot;
+
+    slot = sb_mugshot_find(cache, id);
+    if (slot != NULL) {
+        /*
+         * Count a prefetch as a use, so it isn't evicted before it is
+         * drawn.
+         */
+        slot->last_used = cache->frame;
+        return;
+    }
+
+    slot = sb_mugshot_alloc_slot(cache);
+    if (slot == NULL) {
+        return;
+    }
+
+    slot->state = SB_MUGSHOT_SLOT_LOADING;
+    slot->id = id;
+    slot->last_used = cache->frame;
+
+    sb_job_submit(&sb_mugshot_load, (void *)(uintptr_t)(slot - cache->slots),
+                  &cache->loads);
+}
+
+
+/*
+ * Get the texture for a mugshot at the given size if it is loaded. If not, a
+ * load is started and NULL returned - the caller should draw without it for
+ * now.
+ */
+SDL_Texture *
+sb_mugshot_get (size_t               id,
+                sb_mugshot_size_type size)
+{
+    sb_mugshot_cache_type *cache = &sb_mugshot_cache;
+    sb_mugshot_slot_type  *slot;
+
+    slot = sb_mugshot_find(cache, id);
+    if (slot == NULL) {
+        sb_mugshot_prefetch(id);
+        return NULL;
+    }
+
+    slot->last_used = cache->frame;
+    return slot->textures[size];
+}
+
+
+/*
+ * Create textures for any mugshots the loader has finished with, and move
+ * on to the next frame for LRU purposes.
+ */
+void
+sb_mugshot_update (SDL_Renderer *renderer)
+{
+    sb_mugshot_cache_type  *cache = &sb_mugshot_cache;
+    sb_mugshot_result_type  results[SB_MUGSHOT_UPLOADS_PER_FRAME];
+    sb_mugshot_slot_type   *slot;
+    size_t                  count;
+    size_t                  i;
+    size_t                  j;
+
+    cache->frame++;
+
+    SDL_LockMutex(cache->lock);
+    count = MIN(cache->result_count, SB_MUGSHOT_UPLOADS_PER_FRAME);
+    cache->result_count -= count;
+    memcpy(results, &cache->results[cache->result_count],
+           count * sizeof(results[0]));
+    SDL_UnlockMutex(cache->lock);
+
+    for (i = 0; i < count; i++) {
+        slot = &cache->slots[results[i].slot];
+        slot->state = SB_MUGSHOT_SLOT_READY;
+        for (j = 0; j < SB_MUGSHOT_SIZE_COUNT; j++) {
+            if (results[i].surfs[j] != NULL) {
+                slot->textures[j] = sb_render_create_texture(
+                                                renderer, results[i].surfs[j]);
+                SDL_FreeSurface(results[i].surfs[j]);
+            }
+        }
+    }
+}
+
+
+/*
+ * Set up an empty cache holding at most budget mugshots.
+ */
+void
+sb_mugshot_setup (size_t budget)
+{
+    sb_mugshot_cache_type *cache = &sb_mugshot_cache;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->budget = MAX(1, MIN(budget, SB_MUGSHOT_MAX_BUDGET));
+    cache->lock = SDL_CreateMutex();
+}
+
+
+void
+sb_mugshot_cleanup (void)
+{
+    sb_mugshot_cache_type *cache = &sb_mugshot_cache;
+    size_t                 i;
+    size_t                 j;
+
+    sb_job_wait(&cache->loads);
+
+    for (i = 0; i < cache->result_count; i++) {
+        for (j = 0; j < SB_MUGSHOT_SIZE_COUNT; j++) {
+            SDL_FreeSurface(cache->results[i].surfs[j]);
+        }
+    }
+    cache->result_count = 0;
+
+    for (i = 0; i < cache->budget; i++) {
+        for (j = 0; j < SB_MUGSHOT_SIZE_COUNT; j++) {
+            free_texture(cache->slots[i].textures[j]);
+            cache->slots[i].textures[j] = NULL;
+        }
+        cache->slots[i].state = SB_MUGSHOT_SLOT_EMPTY;
+    }
+
+    SDL_DestroyMutex(cache->lock);
+}
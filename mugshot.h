@@ -0,0 +1,38 @@
+#ifndef __MUGSHOT_H__
+#define __MUGSHOT_H__
+
+
+#include <SDL2/SDL.h>
+
+
+/*
+ * Customer mugshots are loaded on demand into a cache holding at most
+ * "budget" mugshots, least recently used first out. Decoding happens in
+ * jobs on the job system; the textures are created on the main thread by
+ * sb_mugshot_update, which should be called once per frame.
+ */
+#define SB_MUGSHOT_MAX_BUDGET 256
+
+
+/*
+ * Each mugshot is scaled down once, when it is loaded, to every size it is
+ * drawn at - so draw at exactly these sizes.
+ */
+#define SB_MUGSHOT_SLOT_PIXELS   56
+#define SB_MUGSHOT_BUBBLE_PIXELS 40
+
+typedef enum {
+    SB_MUGSHOT_SIZE_SLOT,
+    SB_MUGSHOT_SIZE_BUBBLE,
+    SB_MUGSHOT_SIZE_COUNT
+} sb_mugshot_size_type;
+
+
+void sb_mugshot_setup(size_t budget);
+void sb_mugshot_cleanup(void);
+void sb_mugshot_update(SDL_Renderer *renderer);
+void sb_mugshot_prefetch(size_t id);
+SDL_Texture *sb_mugshot_get(size_t id, sb_mugshot_size_type size);
+
+
+#endif /* __MUGSHOT_H__ */
@@ -0,0 +1,172 @@
+#include <math.h>
+#include <string.h>
+#include "common.h"
+#include "rng.h"
+#include "simd.h"
+#include "particle.h"
+
+
+#if SB_PARTICLE_PER_EMITTER % 4 != 0
+#error SB_PARTICLE_PER_EMITTER must be a multiple of 4
+#endif
+
+
+/*
+ * See particle.h for details.
+ */
+void
+sb_particle_reset (sb_particles_type *particles,
+                   uint32_t           seed)
+{
+    memset(particles, 0, sizeof(*particles));
+    sb_rng_seed(&particles->rng, seed);
+}
+
+
+/*
+ * Find an emitter for a new burst - a free one, or failing that the one
+ * that has been going longest.
+ */
+static sb_particle_emitter_type *
+sb_particle_find_emitter (sb_particles_type *particles)
+{
+    sb_particle_emitter_type *emitter;
+    sb_particle_emitter_type *oldest = NULL;
+    size_t                    i;
+
+    for (i = 0; i < SB_PARTICLE_EMITTERS; i++) {
+        emitter = &particles->emitters[i];
+        if (!emitter->active) {
+            return emitter;
+        }
+        if (oldest == NULL || emitter->serial < oldest->serial) {
+            oldest = emitter;
+        }
+    }
+
+    return oldest;
+}
+
+
+/*
+ * See particle.h for details.
+ */
+void
+sb_particle_burst (sb_particles_type            *particles,
+                   const sb_particle_burst_type *burst)
+{
+    sb_particle_emitter_type *emitter = sb_particle_find_emitter(particles);
+    sb_rng_type              *rng = &particles->rng;
+    float                     angle;
+    float                     speed;
+    uint32_t                  life;
+    size_t                    i;
+
+    emitter->active = true;
+    emitter->serial = particles->serial++;
+    emitter->count = MIN(burst->count, SB_PARTICLE_PER_EMITTER);
+    emitter->age = 0;
+    emitter->life = 0;
+    emitter->gravity = burst->gravity;
+    emitter->grow = burst->grow;
+    emitter->r = burst->r;
+    emitter->g = burst->g;
+    emitter->b = burst->b;
+    emitter->a = burst->a;
+
+    for (i = 0; i < emitter->count; i++) {
+        angle = sb_rng_float(rng) * 2.0f * (float)M_PI;
+        speed = burst->speed_min +
+                sb_rng_float(rng) * (burst->speed_max - burst->speed_min);
+        life = MAX(1, sb_rng_range(rng, burst->life_min, burst->life_max));
+
+        emitter->x[i] = burst->x;
+        emitter->y[i] = burst->y;
+        emitter->vx[i] = cosf(angle) * speed;
+        emitter->vy[i] = sinf(angle) * speed;
+        emitter->size[i] = burst->size;
+        emitter->life_left[i] = life;
+        emitter->fade[i] = 1.0f / life;
+        emitter->life = MAX(emitter->life, life);
+    }
+}
+
+
+/*
+ * Move an emitter's particles on by time ms. The last group of four may
+ * run past count; those lanes hold nothing anyone looks at.
+ */
+static void
+sb_particle_step_emitter (sb_particle_emitter_type *emitter,
+                          uint32_t                  time)
+{
+    sb_simd_type dt = sb_simd_set(time / 1000.0f);
+    sb_simd_type gravity = sb_simd_set(emitter->gravity * time / 1000.0f);
+    sb_simd_type grow = sb_simd_set(emitter->grow * time / 1000.0f);
+    sb_simd_type elapsed = sb_simd_set(time);
+    sb_simd_type vy;
+    size_t       i;
+
+    for (i = 0; i < emitter->count; i += 4) {
+        vy = sb_simd_add(sb_simd_load(&emitter->vy[i]), gravity);
+        sb_simd_store(&emitter->vy[i], vy);
+        sb_simd_store(&emitter->x[i],
+                      sb_simd_add(sb_simd_load(&emitter->x[i]),
+                                  sb_simd_mul(sb_simd_load(&emitter->vx[i]),
+                                              dt)));
+        sb_simd_store(&emitter->y[i],
+                      sb_simd_add(sb_simd_load(&emitter->y[i]),
+                                  sb_simd_mul(vy, dt)));
+        sb_simd_store(&emitter->size[i],
+                      sb_simd_add(sb_simd_load(&emitter->size[i]), grow));
+        sb_simd_store(&emitter->life_left[i],
+                      sb_simd_sub(sb_simd_load(&emitter->life_left[i]),
+                                  elapsed));
+    }
+}
+
+
+/*
+ * See particle.h for details.
+ */
+void
+sb_particle_step (sb_particles_type *particles,
+                  uint32_t           time)
+{
+    sb_particle_emitter_type *emitter;
+    size_t                    i;
+
+    for (i = 0; i < SB_PARTICLE_EMITTERS; i++) {
+        emitter = &particles->emitters[i];
+        if (!emitter->active) {
+            continue;
+        }
+
+        emitter->age += time;
+        if (emitter->age >= emitter->life) {
+            emitter->active = false;
+            continue;
+        }
+        sb_particle_step_emitter(emitter, time);
+    }
+}
+
+
+/*
+ * The number of particles in emitters still going (some of which may have
+ * faded out already).
+ */
+size_t
+sb_particle_count (const sb_particles_type *particles)
+{
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < SB_PARTICLE_EMITTERS; i++) {
+        if (particles->emitters[i].active) {
+            count += particles->emitters[i].count;
+        }
+    }
+
+    return count;
+}
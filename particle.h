@@ -0,0 +1,95 @@
+#ifndef __PARTICLE_H__
+#define __PARTICLE_H__
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rng.h"
+
+
+/*
+ * Particle effects - sparks, glows and the like.
+ *
+ * Particles are thrown out in bursts, each burst taking one of a fixed set
+ * of emitters, so nothing is allocated however many there are. When every
+ * emitter is busy the oldest is reused. An emitter's particles are kept as
+ * structure of arrays and stepped four at a time (see simd.h); they all
+ * have the emitter's colour, gravity and growth, and fade out over their
+ * own lifetimes. The emitter is freed once the longest lived has gone, and
+ * is meant to be drawn as one batch.
+ *
+ * Bursts are random, from the effects' own random number generator, so
+ * they never disturb the game's.
+ *
+ * Doesn't need SDL.
+ */
+#define SB_PARTICLE_EMITTERS    64
+#define SB_PARTICLE_PER_EMITTER 256
+
+
+/*
+ * A burst of count particles from x, y, flying out in every direction at
+ * speeds between speed_min and speed_max (pixels per second). Particles
+ * are size pixels across, growing by grow pixels per second, and each
+ * lives for between life_min and life_max ms.
+ */
+typedef struct sb_particle_burst {
+    float    x;
+    float    y;
+    size_t   count;
+    float    speed_min;
+    float    speed_max;
+    float    gravity;
+    float    size;
+    float    grow;
+    uint32_t life_min;
+    uint32_t life_max;
+    uint8_t  r;
+    uint8_t  g;
+    uint8_t  b;
+    uint8_t  a;
+} sb_particle_burst_type;
+
+
+/*
+ * For each particle, life is the ms it has left and fade one over the ms
+ * it started with, so life * fade is how much of its alpha it has left.
+ */
+typedef struct sb_particle_emitter {
+    bool     active;
+    uint32_t serial;
+    size_t   count;
+    uint32_t age;
+    uint32_t life;
+    float    gravity;
+    float    grow;
+    uint8_t  r;
+    uint8_t  g;
+    uint8_t  b;
+    uint8_t  a;
+    float    x[SB_PARTICLE_PER_EMITTER];
+    float    y[SB_PARTICLE_PER_EMITTER];
+    float    vx[SB_PARTICLE_PER_EMITTER];
+    float    vy[SB_PARTICLE_PER_EMITTER];
+    float    size[SB_PARTICLE_PER_EMITTER];
+    float    life_left[SB_PARTICLE_PER_EMITTER];
+    float    fade[SB_PARTICLE_PER_EMITTER];
+} sb_particle_emitter_type;
+
+
+typedef struct sb_particles {
+    sb_particle_emitter_type emitters[SB_PARTICLE_EMITTERS];
+    uint32_t                 serial;
+    sb_rng_type              rng;
+} sb_particles_type;
+
+
+void sb_particle_reset(sb_particles_type *particles, uint32_t seed);
+void sb_particle_burst(sb_particles_type            *particles,
+                       const sb_particle_burst_type *burst);
+void sb_particle_step(sb_particles_type *particles, uint32_t time);
+size_t sb_particle_count(const sb_particles_type *particles);
+
+
+#endif /* __PARTICLE_H__ */
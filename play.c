@@ -0,0 +1,1812 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gamestate.h"
+#include "game.h"
+#include "cable.h"
+#include "particle.h"
+#include "rng.h"
+#include "grid.h"
+#include "play.h"
+#include "util.h"
+#include "render.h"
+#include "audio.h"
+#include "mugshot.h"
+#include "font.h"
+#include "rotation.h"
+#include "governor.h"
+#include "menu_pause.h"
+#include "endgame.h"
+
+
+#define HUD_FONT_NAME "media/carbon.ttf"
+#define HUD_FONT_SIZE 32
+
+
+/*
+ * Render layers used by the game, from the bottom up. Anything within a
+ * layer may be drawn in any order.
+ */
+enum {
+    GAME_LAYER_BACKGROUND,
+    GAME_LAYER_MUGSHOT_FILL,
+    GAME_LAYER_MUGSHOT,
+    GAME_LAYER_PROGRESS,
+    GAME_LAYER_FRAME,
+    GAME_LAYER_LIGHT,
+    GAME_LAYER_CONSOLE,
+    GAME_LAYER_CORD_HOLE,
+    GAME_LAYER_CABLE_BASE,
+    GAME_LAYER_PLUG,
+    GAME_LAYER_CORD,
+    GAME_LAYER_HELD_CORD,
+    GAME_LAYER_HELD_PLUG,
+    GAME_LAYER_EFFECTS,
+    GAME_LAYER_BUBBLE,
+    GAME_LAYER_BUBBLE_MUGSHOT,
+    GAME_LAYER_ROTARY,
+    GAME_LAYER_ROTARY_TOP,
+    GAME_LAYER_POPUP,
+    GAME_LAYER_INDICATOR,
+    GAME_LAYER_HUD,
+};
+
+
+/*
+ * Width of the cords, in pixels.
+ */
+#define CORD_WIDTH 6.0f
+
+
+/*
+ * Effects (see sb_play_game_event). Score changes float POPUP_RISE pixels
+ * up from the caller's light over POPUP_TIME ms, fading as they go; at
+ * most POPUP_COUNT are shown at once.
+ */
+#define POPUP_FONT_SIZE 20
+#define POPUP_COUNT     16
+#define POPUP_TIME      1000
+#define POPUP_RISE      40
+#define EFFECTS_SEED    1
+
+
+/*
+ * sb_play_set_particle_stress keeps the particle count up with bursts of
+ * STRESS_BURST, leaving STRESS_SPARE emitters for the game's own effects.
+ */
+#define STRESS_BURST 250
+#define STRESS_SPARE 16
+
+
+/*
+ * Number of mugshot textures to keep loaded. Should be at least the number
+ * of mugshots on screen, plus some slack for speech bubbles. There are
+ * only MUGSHOT_COUNT faces, shared out in turn on boards with more
+ * customers, and they aren't drawn at all below MUGSHOT_MIN_ZOOM.
+ */
+#define MUGSHOT_CACHE_BUDGET 48
+#define MUGSHOT_COUNT        21
+#define MUGSHOT_MIN_ZOOM     0.5f
+
+
+/*
+ * The camera over boards bigger than the screen (see game.h). Each press
+ * of an arrow key pans PAN_STEP pixels, and each step of the wheel or +/-
+ * zooms by ZOOM_STEP, between ZOOM_MIN (or less, if the whole board fits)
+ * and ZOOM_MAX. A board of one panel never moves.
+ */
+#define PAN_STEP  100
+#define ZOOM_STEP 1.25f
+#define ZOOM_MIN  0.25f
+#define ZOOM_MAX  2.0f
+
+
+/*
+ * Lights lit off the screen are shown as an indicator at the edge nearest
+ * them, up to INDICATOR_COUNT at once. Clicking one moves the camera to
+ * the customer.
+ */
+#define INDICATOR_COUNT 32
+
+
+/*
+ * A round in progress is saved here every RESUME_SAVE_INTERVAL ms of play
+ * (and on exit), so it can be picked up again if the game is closed or
+ * crashes.
+ */
+#define RESUME_FILE          "resume.dat"
+#define RESUME_TMP_FILE      "resume.dat.tmp"
+#define RESUME_SAVE_INTERVAL 5000
+
+
+/*
+ * A score change floating up from where it happened, on the board. Free
+ * once its age reaches POPUP_TIME.
+ */
+typedef struct sb_play_popup {
+    int      points;
+    int      x;
+    int      y;
+    uint32_t age;
+} sb_play_popup_type;
+
+
+/*
+ * Structure containing everything needed to show the game.
+ */
+typedef struct sb_play {
+    sb_game_type           *game;
+    sb_game_board_type      board;
+    sb_game_view_type       view;
+    bool                    panning;
+    int                     pointer_x;
+    int                     pointer_y;
+    sb_play_cursor_type     cursor;
+    SDL_Cursor             *plug_cursor;
+    bool                    plug_cursor_shown;
+    int                     held_x;
+    int                     held_y;
+    sb_grid_type            grid;
+    sb_game_rect_type       customer_rects[MAX_CUSTOMERS];
+    uint16_t                visible[MAX_CUSTOMERS];
+    uint16_t                watched[MAX_CUSTOMERS];
+    size_t                  watched_count;
+    bool                    watching[MAX_CUSTOMERS];
+    SDL_Rect                indicator_rects[INDICATOR_COUNT];
+    int                     indicator_customers[INDICATOR_COUNT];
+    size_t                  indicator_count;
+    bool                    in_round;
+    uint32_t                save_time;
+    uint8_t                *snapshot;
+    size_t                  snapshot_size;
+    SDL_Color               cable_colors[MAX_CABLES];
+    sb_cables_type          cables;
+    uint32_t                cable_time;
+    sb_particles_type       particles;
+    SDL_Vertex              particle_vertices[SB_PARTICLE_PER_EMITTER * 4];
+    sb_play_popup_type      popups[POPUP_COUNT];
+    uint32_t                effects_time;
+    size_t                  particle_stress;
+    sb_rng_type             stress_rng;
+    sb_font_type            popup_font;
+    sb_font_type            hud_font;
+    char                    hud_score[32];
+    char                    hud_time[32];
+    uint32_t                hud_updated;
+    sb_rotation_type        rotary_rotation;
+    SDL_Texture            *console_texture;
+    SDL_Texture            *panel_texture;
+    SDL_Texture            *port_texture;
+    SDL_Texture            *flash_texture;
+    SDL_Texture            *plug_connected_texture;
+    SDL_Texture            *plug_loose_texture;
+    SDL_Texture            *mug_background_texture;
+    SDL_Texture            *speech_bubble_texture;
+    SDL_Texture            *button_texture;
+    SDL_Texture            *button_flash_texture;
+    SDL_Texture            *cord_hole_texture;
+    SDL_Texture            *rotary_texture;
+    SDL_Texture            *rotary_top_texture;
+} sb_play_type;
+
+
+static sb_play_type sb_play;
+
+
+static inline SDL_Rect
+sb_play_rect (const sb_game_rect_type *rect)
+{
+    SDL_Rect result = { rect->x, rect->y, rect->w, rect->h };
+
+    return result;
+}
+
+
+/*
+ * Where a point on the board is on the screen. Edges are rounded to the
+ * nearest pixel, so a rect covers the pixels whose centres are in it, as
+ * sb_game_view_to_board sees them.
+ */
+static inline int
+sb_play_view_x (const sb_play_type *play,
+                float               x)
+{
+    return floorf((x - play->view.x) * play->view.zoom + 0.5f);
+}
+
+
+static inline int
+sb_play_view_y (const sb_play_type *play,
+                float               y)
+{
+    return floorf((y - play->view.y) * play->view.zoom + 0.5f);
+}
+
+
+/*
+ * Where a rect on the board is on the screen.
+ */
+static SDL_Rect
+sb_play_view_rect (const sb_play_type      *play,
+                   const sb_game_rect_type *rect)
+{
+    SDL_Rect result;
+
+    result.x = sb_play_view_x(play, rect->x);
+    result.y = sb_play_view_y(play, rect->y);
+    result.w = sb_play_view_x(play, rect->x + rect->w) - result.x;
+    result.h = sb_play_view_y(play, rect->y + rect->h) - result.y;
+
+    return result;
+}
+
+
+/*
+ * Move the view to show board coordinates x, y at the top left of the
+ * screen at the given zoom, keeping to the board, and tell the game so
+ * clicks land in the right place. Where the board is smaller than the
+ * screen it is centred instead.
+ */
+static void
+sb_play_set_view (sb_play_type *play,
+                  float         x,
+                  float         y,
+                  float         zoom)
+{
+    const sb_game_rect_type *bounds = &play->board.bounds;
+    sb_game_view_type       *view = &play->view;
+    float                    fit;
+    float                    w;
+    float                    h;
+
+    if (bounds->w <= SB_GAME_SCREEN_W && bounds->h <= SB_GAME_SCREEN_H) {
+        x = 0.0f;
+        y = 0.0f;
+        zoom = 1.0f;
+    } else {
+        fit = MIN((float)SB_GAME_SCREEN_W / bounds->w,
+                  (float)SB_GAME_SCREEN_H / bounds->h);
+        zoom = MAX(MAX(ZOOM_MIN, fit), MIN(zoom, ZOOM_MAX));
+
+        w = SB_GAME_SCREEN_W / zoom;
+        h = SB_GAME_SCREEN_H / zoom;
+        if (w >= bounds->w) {
+            x = bounds->x + (bounds->w - w) / 2.0f;
+        } else {
+            x = MAX(bounds->x, MIN(x, bounds->x + bounds->w - w));
+        }
+        if (h >= bounds->h) {
+            y = bounds->y + (bounds->h - h) / 2.0f;
+        } else {
+            y = MAX(bounds->y, MIN(y, bounds->y + bounds->h - h));
+        }
+    }
+
+    view->x = x;
+    view->y = y;
+    view->zoom = zoom;
+    sb_game_set_view(play->game, view);
+}
+
+
+/*
+ * Zoom by factor, keeping the board under screen point x, y where it is.
+ */
+static void
+sb_play_zoom (sb_play_type *play,
+              float         factor,
+              int           x,
+              int           y)
+{
+    const sb_game_view_type *view = &play->view;
+    float                    zoom = view->zoom * factor;
+
+    sb_play_set_view(play,
+                     view->x + x / view->zoom - x / zoom,
+                     view->y + y / view->zoom - y / zoom,
+                     zoom);
+}
+
+
+/*
+ * Pan the view by a distance on the screen.
+ */
+static void
+sb_play_pan (sb_play_type *play,
+             int           dx,
+             int           dy)
+{
+    const sb_game_view_type *view = &play->view;
+
+    sb_play_set_view(play, view->x + dx / view->zoom,
+                     view->y + dy / view->zoom, view->zoom);
+}
+
+
+/*
+ * Centre the part of the screen above the console on a customer's light.
+ */
+static void
+sb_play_show_customer (sb_play_type *play,
+                       int           customer)
+{
+    const sb_game_rect_type *light;
+    const sb_game_view_type *view = &play->view;
+
+    light = &play->board.customers[customer].light_rect;
+    sb_play_set_view(play,
+                     light->x + light->w / 2.0f -
+                     SB_GAME_SCREEN_W / 2.0f / view->zoom,
+                     light->y + light->h / 2.0f -
+                     SB_GAME_CONSOLE_Y / 2.0f / view->zoom,
+                     view->zoom);
+}
+
+
+/*
+ * Keep an eye on a customer for edge indicators - anyone whose light could
+ * come on. Lights only come on by ringing or being plugged into, so that
+ * is when customers are added; sb_play_draw_indicators drops them again
+ * once they have gone quiet.
+ */
+static void
+sb_play_watch (sb_play_type *play,
+               int           customer)
+{
+    if (customer < 0 || customer >= (int)play->board.customer_count ||
+        play->watching[customer]) {
+        return;
+    }
+    play->watching[customer] = true;
+    play->watched[play->watched_count++] = customer;
+}
+
+
+/*
+ * Start watching again from scratch, for a new or resumed round - the only
+ * time every customer is looked at.
+ */
+static void
+sb_play_watch_all (sb_play_type *play)
+{
+    const sb_game_board_customer_type *cust;
+    size_t                             i;
+
+    memset(play->watching, 0, sizeof(play->watching));
+    play->watched_count = 0;
+    play->indicator_count = 0;
+    for (i = 0; i < play->board.customer_count; i++) {
+        cust = &play->board.customers[i];
+        if (cust->line_state != LINE_STATE_IDLE || cust->port_cable >= 0) {
+            sb_play_watch(play, i);
+        }
+    }
+}
+
+
+/*
+ * File the customers in the grid, each under everything drawn for them
+ * bar the speech bubble, which is only ever drawn for one of them. The
+ * layout only changes when a round saved with a different number of lines
+ * is resumed, so this is done at setup and on resume.
+ */
+static void
+sb_play_build_grid (sb_play_type *play)
+{
+    const sb_game_board_customer_type *cust;
+    sb_game_rect_type                  bounds = play->board.bounds;
+    sb_game_rect_type                 *rect;
+    int                                x1;
+    int                                y1;
+    size_t                             i;
+
+    for (i = 0; i < play->board.customer_count; i++) {
+        cust = &play->board.customers[i];
+        rect = &play->customer_rects[i];
+
+        *rect = cust->mugshot_rect;
+        x1 = MAX(rect->x + rect->w, MAX(cust->port_rect.x + cust->port_rect.w,
+                                        cust->light_rect.x +
+                                        cust->light_rect.w));
+        y1 = MAX(rect->y + rect->h, MAX(cust->port_rect.y + cust->port_rect.h,
+                                        cust->light_rect.y +
+                                        cust->light_rect.h));
+        rect->x = MIN(rect->x, MIN(cust->port_rect.x, cust->light_rect.x));
+        rect->y = MIN(rect->y, MIN(cust->port_rect.y, cust->light_rect.y));
+        rect->w = x1 - rect->x;
+        rect->h = y1 - rect->y;
+
+        x1 = MAX(bounds.x + bounds.w, rect->x + rect->w);
+        y1 = MAX(bounds.y + bounds.h, rect->y + rect->h);
+        bounds.x = MIN(bounds.x, rect->x);
+        bounds.y = MIN(bounds.y, rect->y);
+        bounds.w = x1 - bounds.x;
+        bounds.h = y1 - bounds.y;
+    }
+
+    sb_grid_build(&play->grid, &bounds, play->customer_rects,
+                  play->board.customer_count);
+}
+
+
+/*
+ * Bursts for calls put through ([1]) and lost ([0]): sparks from a port,
+ * and a glow swelling out of a light.
+ */
+static const sb_particle_burst_type sb_play_sparks[2] = {
+    { 0.0f, 0.0f, 24, 60.0f, 180.0f, 600.0f, 3.0f, -2.0f, 250, 500,
+      255, 90, 40, 255 },
+    { 0.0f, 0.0f, 32, 80.0f, 240.0f, 600.0f, 3.0f, -2.0f, 300, 600,
+      255, 230, 120, 255 },
+};
+
+static const sb_particle_burst_type sb_play_glows[2] = {
+    { 0.0f, 0.0f, 1, 0.0f, 0.0f, 0.0f, 16.0f, 60.0f, 400, 400,
+      255, 60, 40, 160 },
+    { 0.0f, 0.0f, 1, 0.0f, 0.0f, 0.0f, 16.0f, 60.0f, 400, 400,
+      255, 240, 160, 160 },
+};
+
+
+/*
+ * Thrown all over the board to keep up the particle count for
+ * sb_play_set_particle_stress.
+ */
+static const sb_particle_burst_type sb_play_stress_burst = {
+    0.0f, 0.0f, STRESS_BURST, 20.0f, 120.0f, 200.0f, 3.0f, 0.0f, 1500, 1500,
+    255, 255, 255, 200,
+};
+
+
+static void
+sb_play_reset_effects (sb_play_type *play)
+{
+    size_t i;
+
+    sb_particle_reset(&play->particles, EFFECTS_SEED);
+    sb_rng_seed(&play->stress_rng, EFFECTS_SEED);
+    for (i = 0; i < POPUP_COUNT; i++) {
+        play->popups[i].age = POPUP_TIME;
+    }
+    play->effects_time = play->board.gametime;
+}
+
+
+/*
+ * Start a burst from the centre of rect.
+ */
+static void
+sb_play_burst (sb_play_type                 *play,
+               const sb_particle_burst_type *burst,
+               const sb_game_rect_type      *rect)
+{
+    sb_particle_burst_type at = *burst;
+    SDL_Rect               area = sb_play_rect(rect);
+    int                    x;
+    int                    y;
+
+    sb_rect_center(&area, &x, &y);
+    at.x = x;
+    at.y = y;
+    sb_particle_burst(&play->particles, &at);
+}
+
+
+/*
+ * Show a call being put through (or lost) at a customer: a glow from
+ * their light, and sparks from their port if there is a plug in it. The
+ * score change, if any, floats up from the light, taking the place of the
+ * oldest popup if they are all in use.
+ */
+static void
+sb_play_effect (sb_play_type *play,
+                int           customer,
+                bool          success,
+                int           points)
+{
+    const sb_game_board_customer_type *cust;
+    sb_play_popup_type                *popup = &play->popups[0];
+    size_t                             i;
+
+    if (customer < 0 || customer >= (int)play->board.customer_count) {
+        return;
+    }
+    cust = &play->board.customers[customer];
+
+    sb_play_burst(play, &sb_play_glows[success], &cust->light_rect);
+    if (cust->port_cable >= 0) {
+        sb_play_burst(play, &sb_play_sparks[success], &cust->port_rect);
+    }
+
+    if (points == 0) {
+        return;
+    }
+    for (i = 1; i < POPUP_COUNT; i++) {
+        if (play->popups[i].age > popup->age) {
+            popup = &play->popups[i];
+        }
+    }
+    popup->points = points;
+    popup->x = cust->light_rect.x;
+    popup->y = cust->light_rect.y;
+    popup->age = 0;
+}
+
+
+/*
+ * Listener for events in the game.
+ */
+static void
+sb_play_game_event (const sb_game_event_type *event,
+                    void                     *ctx)
+{
+    sb_play_type *play = ctx;
+
+    switch (event->kind) {
+    case SB_GAME_EVENT_RING:
+        sb_audio_play(SB_AUDIO_EFFECT_RING);
+        sb_play_watch(play, event->customer);
+        break;
+
+    case SB_GAME_EVENT_CALL_START:
+        /*
+         * The target will be shown in a speech bubble once the call is
+         * answered - get their mugshot ready.
+         */
+        sb_mugshot_prefetch(event->other % MUGSHOT_COUNT);
+        break;
+
+    case SB_GAME_EVENT_SUCCESS:
+        sb_play_effect(play, event->customer, true, event->points);
+        sb_play_effect(play, event->other, true, 0);
+        break;
+
+    case SB_GAME_EVENT_FAILURE:
+        sb_audio_play(SB_AUDIO_EFFECT_BUSY);
+        sb_play_effect(play, event->customer, false, event->points);
+        break;
+
+    case SB_GAME_EVENT_PLUG_IN:
+        sb_audio_play(SB_AUDIO_EFFECT_PLUG);
+        sb_play_watch(play, event->customer);
+        break;
+
+    case SB_GAME_EVENT_PLUG_OUT:
+        sb_audio_play(SB_AUDIO_EFFECT_PLUG);
+        break;
+
+    case SB_GAME_EVENT_DIAL_CLICK:
+        sb_audio_play(SB_AUDIO_EFFECT_DIAL_CLICK);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/*
+ * The edge indicator at a point on the screen, or -1.
+ */
+static int
+sb_play_find_indicator (sb_play_type *play,
+                        int           x,
+                        int           y)
+{
+    size_t i;
+
+    for (i = 0; i < play->indicator_count; i++) {
+        if (sb_point_in_rect(x, y, &play->indicator_rects[i])) {
+            return play->indicator_customers[i];
+        }
+    }
+
+    return -1;
+}
+
+
+/*
+ * Move the camera for a key press, if it is one of the camera's keys.
+ */
+static void
+sb_play_camera_key (sb_play_type *play,
+                    SDL_Keycode   key)
+{
+    switch (key) {
+    case SDLK_LEFT:
+        sb_play_pan(play, -PAN_STEP, 0);
+        break;
+
+    case SDLK_RIGHT:
+        sb_play_pan(play, PAN_STEP, 0);
+        break;
+
+    case SDLK_UP:
+        sb_play_pan(play, 0, -PAN_STEP);
+        break;
+
+    case SDLK_DOWN:
+        sb_play_pan(play, 0, PAN_STEP);
+        break;
+
+    case SDLK_PLUS:
+    case SDLK_EQUALS:
+    case SDLK_KP_PLUS:
+        sb_play_zoom(play, ZOOM_STEP, SB_GAME_SCREEN_W / 2,
+                     SB_GAME_SCREEN_H / 2);
+        break;
+
+    case SDLK_MINUS:
+    case SDLK_KP_MINUS:
+        sb_play_zoom(play, 1.0f / ZOOM_STEP, SB_GAME_SCREEN_W / 2,
+                     SB_GAME_SCREEN_H / 2);
+        break;
+
+    case SDLK_HOME:
+        sb_play_set_view(play, 0.0f, 0.0f, 1.0f);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/*
+ * See comment in gamestate.h for more details.
+ *
+ * Besides feeding the game, the pointer works the camera: the wheel zooms
+ * about it, dragging with the right button pans, and clicking an edge
+ * indicator moves to the customer it stands for (without the game seeing
+ * the click).
+ */
+static void
+sb_play_event (SDL_Event *e,
+               void      *context)
+{
+    sb_play_type       *play = &sb_play;
+    sb_game_input_type  input;
+    int                 customer;
+
+    switch (e->type) {
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+        play->pointer_x = e->button.x;
+        play->pointer_y = e->button.y;
+        if (e->button.button == SDL_BUTTON_RIGHT) {
+            play->panning = (e->type == SDL_MOUSEBUTTONDOWN);
+        }
+
+        if (e->type == SDL_MOUSEBUTTONDOWN &&
+            e->button.button == SDL_BUTTON_LEFT) {
+            customer = sb_play_find_indicator(play, e->button.x,
+                                              e->button.y);
+            if (customer >= 0) {
+                sb_play_show_customer(play, customer);
+                break;
+            }
+        }
+
+        /*
+         * Other buttons don't do anything, but still say where the pointer
+         * is.
+         */
+        if (e->button.button != SDL_BUTTON_LEFT) {
+            input.kind = SB_GAME_INPUT_MOTION;
+        } else if (e->type == SDL_MOUSEBUTTONDOWN) {
+            input.kind = SB_GAME_INPUT_BUTTON_DOWN;
+        } else {
+            input.kind = SB_GAME_INPUT_BUTTON_UP;
+        }
+        input.x = e->button.x;
+        input.y = e->button.y;
+        sb_game_input(play->game, &input);
+        break;
+
+    case SDL_MOUSEMOTION:
+        if (play->panning) {
+            sb_play_pan(play, play->pointer_x - e->motion.x,
+                        play->pointer_y - e->motion.y);
+        }
+        play->pointer_x = e->motion.x;
+        play->pointer_y = e->motion.y;
+
+        input.kind = SB_GAME_INPUT_MOTION;
+        input.x = e->motion.x;
+        input.y = e->motion.y;
+        sb_game_input(play->game, &input);
+        break;
+
+    case SDL_MOUSEWHEEL:
+        if (e->wheel.y != 0) {
+            sb_play_zoom(play, powf(ZOOM_STEP, e->wheel.y),
+                         play->pointer_x, play->pointer_y);
+        }
+        break;
+
+    case SDL_KEYDOWN:
+        if (e->key.keysym.sym == SDLK_ESCAPE) {
+            sb_gamestate_push(sb_menu_pause_get_gamestate());
+        } else {
+            sb_play_camera_key(play, e->key.keysym.sym);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/*
+ * Save the round in progress to the resume file. It is written to a
+ * temporary file first, so a crash part way through never leaves a
+ * half-written save behind.
+ */
+static void
+sb_play_save (sb_play_type *play)
+{
+    FILE   *file;
+    size_t  size;
+    bool    ok;
+
+    size = sb_game_snapshot(play->game, play->snapshot, play->snapshot_size);
+    if (size == 0) {
+        return;
+    }
+
+    file = fopen(RESUME_TMP_FILE, "wb");
+    if (file == NULL) {
+        return;
+    }
+
+    ok = (fwrite(play->snapshot, 1, size, file) == size);
+    ok = (fclose(file) == 0) && ok;
+    if (ok) {
+        (void)rename(RESUME_TMP_FILE, RESUME_FILE);
+    } else {
+        (void)remove(RESUME_TMP_FILE);
+    }
+}
+
+
+/*
+ * See comment in gamestate.h for more details.
+ */
+static void
+sb_play_update (uint32_t  frametime,
+                void     *context)
+{
+    sb_play_type *play = &sb_play;
+
+    sb_game_step(play->game, frametime);
+
+    if (sb_game_is_over(play->game)) {
+        play->in_round = false;
+        (void)remove(RESUME_FILE);
+        sb_endgame_reset();
+        sb_gamestate_push(sb_endgame_get_gamestate());
+        return;
+    }
+
+    play->save_time += frametime;
+    if (play->save_time >= RESUME_SAVE_INTERVAL) {
+        play->save_time = 0;
+        sb_play_save(play);
+    }
+}
+
+
+/*
+ * Draw the dial, from its pre-rotated frames if there are any (see
+ * sb_play_setup).
+ */
+static void
+sb_play_draw_rotary (SDL_Renderer *renderer,
+                     sb_play_type *play)
+{
+    SDL_Rect rect = sb_play_rect(&play->board.rotary_bounds);
+
+    if (play->rotary_rotation.atlas != NULL) {
+        sb_rotation_draw(&play->rotary_rotation, GAME_LAYER_ROTARY, &rect,
+                         RAD_TO_DEG(play->board.rotary_angle));
+    } else {
+        sb_render_copy_ex(GAME_LAYER_ROTARY, play->rotary_texture, NULL,
+                          &rect, RAD_TO_DEG(play->board.rotary_angle));
+    }
+    sb_render_copy(GAME_LAYER_ROTARY_TOP, play->rotary_top_texture, NULL,
+                   &rect);
+}
+
+
+/*
+ * Draw the score and time left, redoing the text no more often than the
+ * quality allows. A new round's game time is behind the last update, so
+ * the difference wraps and the text is redone straight away.
+ */
+static void
+sb_play_draw_hud (sb_play_type                   *play,
+                  const sb_governor_quality_type *quality)
+{
+    const sb_game_board_type *board = &play->board;
+    uint32_t                  remaining;
+
+    if (board->gametime - play->hud_updated >= quality->hud_interval ||
+        play->hud_score[0] == '\0') {
+        play->hud_updated = board->gametime;
+        snprintf(play->hud_score, sizeof(play->hud_score), "%" PRIu32,
+                 board->score);
+
+        remaining = board->remaining_time / 1000;
+        snprintf(play->hud_time, sizeof(play->hud_time),
+                 "%" PRIu32 ":%02" PRIu32, remaining / 60, remaining % 60);
+    }
+
+    (void)sb_font_draw(&play->hud_font, GAME_LAYER_HUD, 0, 0,
+                       play->hud_score);
+    (void)sb_font_draw(&play->hud_font, GAME_LAYER_HUD, 0,
+                       play->hud_font.height, play->hud_time);
+}
+
+
+/*
+ * Work out where the held plug goes this frame (see sb_play_cursor_type).
+ * SDL only sees the mouse move when it pumps events, so pump them again -
+ * anything new stays queued for the next frame - and take where the mouse
+ * is now. Outside the window, or under a menu (where the game isn't
+ * hearing about the mouse), it's where the game last heard.
+ */
+static void
+sb_play_latch_pointer (sb_play_type *play)
+{
+    const sb_game_board_type *board = &play->board;
+
+    play->held_x = board->pointer_x;
+    play->held_y = board->pointer_y;
+    if (board->held_cable < 0 || play->cursor == SB_PLAY_CURSOR_GAME ||
+        !sb_gamestate_is_top(sb_play_get_gamestate())) {
+        return;
+    }
+
+    SDL_PumpEvents();
+    if (SDL_GetMouseFocus() != NULL) {
+        (void)SDL_GetMouseState(&play->held_x, &play->held_y);
+    }
+}
+
+
+/*
+ * Show the held plug as the mouse cursor, or go back to the usual one.
+ */
+static void
+sb_play_show_plug_cursor (sb_play_type *play,
+                          bool          show)
+{
+    if (show == play->plug_cursor_shown) {
+        return;
+    }
+
+    SDL_SetCursor(show ? play->plug_cursor : SDL_GetDefaultCursor());
+    play->plug_cursor_shown = show;
+}
+
+
+/*
+ * Move the cords on by however much game time has passed since the last
+ * frame, so they stand still while the game is paused. Plugged in cords
+ * run from their hole to the plug, and the held one to the pointer. They
+ * hang on the screen rather than the board, so the console's end of them
+ * stays put when the view moves.
+ */
+static void
+sb_play_step_cables (sb_play_type *play)
+{
+    const sb_game_board_type       *board = &play->board;
+    const sb_game_board_cable_type *cable;
+    const sb_game_rect_type        *port;
+    sb_cable_anchor_type            anchors[MAX_CABLES];
+    SDL_Rect                        rect;
+    int                             x;
+    int                             y;
+    size_t                          i;
+
+    if (board->gametime < play->cable_time) {
+        sb_cable_reset(&play->cables);
+        play->cable_time = board->gametime;
+    }
+
+    memset(anchors, 0, sizeof(anchors));
+    for (i = 0; i < board->cable_count; i++) {
+        cable = &board->cables[i];
+        rect = sb_play_rect(&cable->cord_hole_rect);
+        sb_rect_center(&rect, &x, &y);
+        anchors[i].start_x = x;
+        anchors[i].start_y = y;
+
+        if (board->held_cable == (int)i) {
+            anchors[i].active = true;
+            anchors[i].end_x = play->held_x;
+            anchors[i].end_y = play->held_y;
+        } else if (cable->customer >= 0) {
+            port = &board->customers[cable->customer].port_rect;
+            anchors[i].active = true;
+            anchors[i].end_x = sb_play_view_x(play, port->x + 16);
+            anchors[i].end_y = sb_play_view_y(play, port->y + 16);
+        }
+    }
+
+    sb_cable_step(&play->cables, anchors,
+                  board->gametime - play->cable_time);
+    play->cable_time = board->gametime;
+}
+
+
+/*
+ * Move the effects on by however much game time has passed, like the
+ * cords, topping the particles up to the stress count if one is set.
+ */
+static void
+sb_play_step_effects (sb_play_type *play)
+{
+    sb_particle_burst_type burst = sb_play_stress_burst;
+    uint32_t               time;
+    size_t                 i;
+
+    if (play->board.gametime < play->effects_time) {
+        sb_play_reset_effects(play);
+    }
+    time = play->board.gametime - play->effects_time;
+    play->effects_time = play->board.gametime;
+
+    sb_particle_step(&play->particles, time);
+    for (i = 0; i < POPUP_COUNT; i++) {
+        play->popups[i].age = MIN(play->popups[i].age + time, POPUP_TIME);
+    }
+
+    for (i = 0; i < SB_PARTICLE_EMITTERS &&
+                sb_particle_count(&play->particles) < play->particle_stress;
+         i++) {
+        burst.x = sb_rng_range(&play->stress_rng, 0, 799);
+        burst.y = sb_rng_range(&play->stress_rng, 0, 499);
+        sb_particle_burst(&play->particles, &burst);
+    }
+}
+
+
+/*
+ * Draw each emitter's particles, as squares centred on them, in one batch.
+ * Only every step'th particle is drawn. Particles move over the board, so
+ * are put through the view here.
+ */
+static void
+sb_play_draw_particles (sb_play_type *play,
+                        size_t        step)
+{
+    const sb_particle_emitter_type *emitter;
+    const sb_game_view_type        *view = &play->view;
+    SDL_Vertex                     *quad;
+    SDL_Color                       color;
+    float                           half;
+    float                           x;
+    float                           y;
+    size_t                          count;
+    size_t                          i;
+    size_t                          j;
+
+    for (i = 0; i < SB_PARTICLE_EMITTERS; i++) {
+        emitter = &play->particles.emitters[i];
+        if (!emitter->active) {
+            continue;
+        }
+
+        color.r = emitter->r;
+        color.g = emitter->g;
+        color.b = emitter->b;
+        count = 0;
+        for (j = 0; j < emitter->count; j += step) {
+            if (emitter->life_left[j] <= 0.0f || emitter->size[j] <= 0.0f) {
+                continue;
+            }
+            color.a = emitter->a *
+                      MIN(1.0f, emitter->life_left[j] * emitter->fade[j]);
+            half = emitter->size[j] * view->zoom / 2.0f;
+            x = (emitter->x[j] - view->x) * view->zoom;
+            y = (emitter->y[j] - view->y) * view->zoom;
+
+            quad = &play->particle_vertices[count];
+            quad[0].position.x = x - half;
+            quad[0].position.y = y - half;
+            quad[1].position.x = x + half;
+            quad[1].position.y = y - half;
+            quad[2].position.x = x - half;
+            quad[2].position.y = y + half;
+            quad[3].position.x = x + half;
+            quad[3].position.y = y + half;
+            quad[0].color = quad[1].color = quad[2].color = quad[3].color =
+                color;
+            count += 4;
+        }
+
+        sb_render_quads(GAME_LAYER_EFFECTS, play->particle_vertices, count);
+    }
+}
+
+
+static void
+sb_play_draw_popups (sb_play_type *play)
+{
+    const sb_play_popup_type *popup;
+    SDL_Color                 color;
+    char                      buf[16];
+    size_t                    i;
+
+    for (i = 0; i < POPUP_COUNT; i++) {
+        popup = &play->popups[i];
+        if (popup->age >= POPUP_TIME) {
+            continue;
+        }
+
+        color.r = (popup->points > 0) ? 40 : 220;
+        color.g = (popup->points > 0) ? 200 : 40;
+        color.b = 40;
+        color.a = 255 - 255 * popup->age / POPUP_TIME;
+        snprintf(buf, sizeof(buf), "%+d", popup->points);
+        (void)sb_font_draw_mod(&play->popup_font, GAME_LAYER_POPUP, color,
+                               sb_play_view_x(play, popup->x),
+                               sb_play_view_y(play, popup->y) -
+                               play->popup_font.height -
+                               POPUP_RISE * popup->age / POPUP_TIME,
+                               buf);
+    }
+}
+
+
+/*
+ * Draw a cord as a single triangle strip, CORD_WIDTH wide either side of
+ * the line through every step'th of its particles (and always the last,
+ * so it still reaches the plug).
+ */
+static void
+sb_play_draw_cable_cord (sb_render_layer_type  layer,
+                         size_t                cable,
+                         SDL_Color             color,
+                         size_t                step,
+                         sb_play_type         *play)
+{
+    float      xs[SB_CABLE_POINTS];
+    float      ys[SB_CABLE_POINTS];
+    size_t     points[SB_CABLE_POINTS];
+    SDL_FPoint strip[SB_CABLE_POINTS * 2];
+    size_t     count = 0;
+    float      dx;
+    float      dy;
+    float      length;
+    size_t     prev;
+    size_t     next;
+    size_t     i;
+
+    sb_cable_get_points(&play->cables, cable, xs, ys);
+
+    for (i = 0; i < SB_CABLE_POINTS - 1; i += step) {
+        points[count++] = i;
+    }
+    points[count++] = SB_CABLE_POINTS - 1;
+
+    for (i = 0; i < count; i++) {
+        prev = points[(i == 0) ? 0 : i - 1];
+        next = points[MIN(i + 1, count - 1)];
+        dx = xs[next] - xs[prev];
+        dy = ys[next] - ys[prev];
+        length = sqrtf(dx * dx + dy * dy);
+        if (length > 0.0f) {
+            dx *= CORD_WIDTH / 2.0f / length;
+            dy *= CORD_WIDTH / 2.0f / length;
+        } else {
+            dx = CORD_WIDTH / 2.0f;
+            dy = 0.0f;
+        }
+
+        strip[i * 2].x = xs[points[i]] - dy;
+        strip[i * 2].y = ys[points[i]] + dx;
+        strip[i * 2 + 1].x = xs[points[i]] + dy;
+        strip[i * 2 + 1].y = ys[points[i]] - dx;
+    }
+
+    sb_render_strip(layer, color, strip, count * 2);
+}
+
+
+/*
+ * Whether a customer's light is lit, and if so whether it is on right now
+ * - lines waiting to be answered flash.
+ */
+static bool
+sb_play_light_lit (const sb_game_board_type          *board,
+                   const sb_game_board_customer_type *cust,
+                   bool                              *on)
+{
+    switch (cust->line_state) {
+    case LINE_STATE_DIALING:
+    case LINE_STATE_ANSWERING:
+        *on = ((cust->next_update - board->gametime) % 1000 > 500);
+        return true;
+
+    case LINE_STATE_BUSY:
+    case LINE_STATE_OPERATOR_REQUEST:
+    case LINE_STATE_OPERATOR_REPLY:
+        *on = true;
+        return true;
+
+    default:
+        *on = false;
+        return false;
+    }
+}
+
+
+/*
+ * Draw the panels the view reaches.
+ */
+static void
+sb_play_draw_panels (sb_play_type *play)
+{
+    const sb_game_board_type *board = &play->board;
+    const sb_game_view_type  *view = &play->view;
+    sb_game_rect_type         panel;
+    SDL_Rect                  rect;
+    size_t                    panels;
+    int                       column0;
+    int                       column1;
+    int                       row0;
+    int                       row1;
+    int                       column;
+    int                       row;
+
+    panels = (board->customer_count + SB_GAME_PANEL_LINES - 1) /
+             SB_GAME_PANEL_LINES;
+    column0 = MAX(0, floorf(view->x / SB_GAME_PANEL_WIDTH));
+    row0 = MAX(0, floorf(view->y / SB_GAME_PANEL_HEIGHT));
+    column1 = MIN((int)board->panel_columns - 1,
+                  floorf((view->x + SB_GAME_SCREEN_W / view->zoom) /
+                         SB_GAME_PANEL_WIDTH));
+    row1 = MIN((int)((panels - 1) / board->panel_columns),
+               floorf((view->y + SB_GAME_SCREEN_H / view->zoom) /
+                      SB_GAME_PANEL_HEIGHT));
+
+    for (row = row0; row <= row1; row++) {
+        for (column = column0; column <= column1; column++) {
+            if (row * board->panel_columns + column >= panels) {
+                continue;
+            }
+            panel.x = column * SB_GAME_PANEL_WIDTH + 110;
+            panel.y = row * SB_GAME_PANEL_HEIGHT + 10;
+            panel.w = 580;
+            panel.h = 480;
+            rect = sb_play_view_rect(play, &panel);
+            sb_render_copy(GAME_LAYER_BACKGROUND, play->panel_texture, NULL,
+                           &rect);
+        }
+    }
+}
+
+
+/*
+ * Draw the customers the grid says are in view - their ports, lights and
+ * mugshots.
+ */
+static void
+sb_play_draw_customers (sb_play_type                   *play,
+                        const sb_governor_quality_type *quality)
+{
+    const sb_game_board_type          *board = &play->board;
+    const sb_game_view_type           *view = &play->view;
+    const sb_game_board_customer_type *cust;
+    sb_game_rect_type                  area;
+    SDL_Rect                           rect;
+    float                              progress;
+    bool                               on;
+    size_t                             count;
+    size_t                             i;
+    const SDL_Color                    mugshot_color = { 200, 200, 255, 255 };
+    const SDL_Color                    progress_color = { 255, 255, 255, 100 };
+
+    area.x = floorf(view->x);
+    area.y = floorf(view->y);
+    area.w = ceilf(SB_GAME_SCREEN_W / view->zoom) + 1;
+    area.h = ceilf(SB_GAME_SCREEN_H / view->zoom) + 1;
+    count = sb_grid_query(&play->grid, &area, play->visible, MAX_CUSTOMERS);
+
+    for (i = 0; i < count; i++) {
+        cust = &board->customers[play->visible[i]];
+
+        area = cust->mugshot_rect;
+        area.x += 4;
+        area.y += 4;
+        area.w -= 8;
+        area.h -= 8;
+        rect = sb_play_view_rect(play, &area);
+        sb_render_fill(GAME_LAYER_MUGSHOT_FILL, mugshot_color, &rect);
+        if (view->zoom >= MUGSHOT_MIN_ZOOM) {
+            sb_render_copy(GAME_LAYER_MUGSHOT,
+                           sb_mugshot_get(cust->index % MUGSHOT_COUNT,
+                                          SB_MUGSHOT_SIZE_SLOT),
+                           NULL, &rect);
+        }
+
+        if (quality->progress &&
+            cust->line_state != LINE_STATE_IDLE &&
+            cust->line_state != LINE_STATE_ANSWERING) {
+            progress = ((float)(cust->next_update - board->gametime) /
+                        (float)(cust->next_update - cust->last_update));
+            rect.y += rect.h - rect.h * progress + 1;
+            rect.h *= progress;
+
+            sb_render_fill(GAME_LAYER_PROGRESS, progress_color, &rect);
+        }
+
+        rect = sb_play_view_rect(play, &cust->port_rect);
+        sb_render_copy(GAME_LAYER_FRAME, play->port_texture, NULL, &rect);
+        rect = sb_play_view_rect(play, &cust->mugshot_rect);
+        sb_render_copy(GAME_LAYER_FRAME, play->mug_background_texture, NULL,
+                       &rect);
+
+        if (sb_play_light_lit(board, cust, &on) && on) {
+            rect = sb_play_view_rect(play, &cust->light_rect);
+            sb_render_copy(GAME_LAYER_LIGHT, play->flash_texture, NULL,
+                           &rect);
+        }
+    }
+}
+
+
+/*
+ * Show the lit lights that are off the screen (or under the console) as
+ * indicators at the edge of the board nearest them, keeping out of the
+ * way of the dial. Customers whose lights can't come on again without
+ * them being watched afresh are dropped from the watch list here.
+ */
+static void
+sb_play_draw_indicators (sb_play_type *play)
+{
+    const sb_game_board_type          *board = &play->board;
+    const sb_game_board_customer_type *cust;
+    SDL_Rect                          *rect;
+    int                                customer;
+    int                                x;
+    int                                y;
+    bool                               on;
+    size_t                             i = 0;
+
+    play->indicator_count = 0;
+    while (i < play->watched_count) {
+        customer = play->watched[i];
+        cust = &board->customers[customer];
+        if (cust->line_state == LINE_STATE_IDLE && cust->port_cable < 0) {
+            play->watching[customer] = false;
+            play->watched[i] = play->watched[--play->watched_count];
+            continue;
+        }
+        i++;
+
+        if (!sb_play_light_lit(board, cust, &on) ||
+            play->indicator_count == INDICATOR_COUNT) {
+            continue;
+        }
+        x = sb_play_view_x(play, cust->light_rect.x +
+                                 cust->light_rect.w / 2.0f);
+        y = sb_play_view_y(play, cust->light_rect.y +
+                                 cust->light_rect.h / 2.0f);
+        if (x >= 0 && x < SB_GAME_SCREEN_W &&
+            y >= 0 && y < SB_GAME_CONSOLE_Y) {
+            continue;
+        }
+
+        rect = &play->indicator_rects[play->indicator_count];
+        rect->w = cust->light_rect.w;
+        rect->h = cust->light_rect.h;
+        rect->x = MAX(0, MIN(x - rect->w / 2, SB_GAME_SCREEN_W - rect->w));
+        rect->y = MAX(0, MIN(y - rect->h / 2, SB_GAME_CONSOLE_Y - rect->h));
+        if (rect->x < SB_GAME_DIAL_AREA && rect->y < SB_GAME_DIAL_AREA) {
+            if (rect->x == 0) {
+                rect->y = SB_GAME_DIAL_AREA;
+            } else {
+                rect->x = SB_GAME_DIAL_AREA;
+            }
+        }
+        play->indicator_customers[play->indicator_count++] = customer;
+
+        if (on) {
+            sb_render_copy(GAME_LAYER_INDICATOR, play->flash_texture, NULL,
+                           rect);
+        }
+    }
+}
+
+
+/*
+ * See comment in gamestate.h for more details.
+ *
+ * Only what is in view is drawn: the panels it reaches, the customers the
+ * grid finds there, and whatever the cables are plugged into. Nothing
+ * here looks at every customer on the board.
+ */
+static void
+sb_play_draw (SDL_Renderer *renderer,
+              void         *context)
+{
+    size_t                             i;
+    const sb_game_board_customer_type *cust;
+    const sb_game_board_cable_type    *cable;
+    sb_game_rect_type                  area;
+    SDL_Rect                           rect;
+    sb_play_type                      *play = &sb_play;
+    sb_game_board_type                *board = &play->board;
+    const SDL_Color                    background_color =
+                                                    { 180, 180, 180, 255 };
+    const sb_governor_quality_type    *quality = sb_governor_get_quality();
+
+    sb_game_get_board(play->game, board);
+    sb_mugshot_update(renderer);
+    sb_play_step_effects(play);
+
+    sb_render_clear(GAME_LAYER_BACKGROUND, background_color);
+
+    /*
+     * Draw the background
+     */
+    sb_play_draw_panels(play);
+    rect.x = 0;
+    rect.y = 500;
+    rect.w = 800;
+    rect.h = 100;
+    sb_render_copy(GAME_LAYER_CONSOLE, play->console_texture, NULL, &rect);
+
+    /*
+     * Draw customer ports + mugshots.
+     */
+    sb_play_draw_customers(play, quality);
+
+    /*
+     * Everything from here on follows the held plug, so find where it is
+     * as late as drawing allows. Under a menu it's drawn, as the menu
+     * wants the usual cursor.
+     */
+    sb_play_latch_pointer(play);
+    sb_play_show_plug_cursor(play,
+                             board->held_cable >= 0 &&
+                             play->cursor == SB_PLAY_CURSOR_HARDWARE &&
+                             play->plug_cursor != NULL &&
+                             sb_gamestate_is_top(sb_play_get_gamestate()));
+    sb_play_step_cables(play);
+
+    /*
+     * Draw the cables bases, buttons etc.
+     */
+    for (i = 0; i < board->cable_count; i++) {
+        cable = &board->cables[i];
+        rect = sb_play_rect(&cable->cord_hole_rect);
+        sb_render_copy(GAME_LAYER_CORD_HOLE, play->cord_hole_texture, NULL,
+                       &rect);
+
+        /*
+         * The cable is not held or plugged in - draw the connector at the
+         * base.
+         */
+        if (cable->customer < 0 && board->held_cable != (int)i) {
+            rect = sb_play_rect(&cable->cable_base_rect);
+            sb_render_copy(GAME_LAYER_CABLE_BASE, play->plug_loose_texture,
+                           NULL, &rect);
+        }
+
+        rect = sb_play_rect(&cable->speak_button_rect);
+        sb_render_copy(GAME_LAYER_CABLE_BASE, play->button_texture, NULL,
+                       &rect);
+        rect = sb_play_rect(&cable->dial_button_rect);
+        sb_render_copy(GAME_LAYER_CABLE_BASE, play->button_texture, NULL,
+                       &rect);
+    }
+
+    /*
+     * Draw any cables that are plugged in - the plugs go in a lower layer
+     * than the cords, so that the plugs appear underneath the cords.
+     */
+    for (i = 0; i < board->cable_count; i++) {
+        cable = &board->cables[i];
+        if (cable->customer >= 0) {
+            cust = &board->customers[cable->customer];
+            area.x = cust->port_rect.x + 4;
+            area.y = cust->port_rect.y + 4;
+            area.w = 24;
+            area.h = 24;
+            rect = sb_play_view_rect(play, &area);
+            sb_render_copy(GAME_LAYER_PLUG, play->plug_connected_texture,
+                           NULL, &rect);
+            sb_play_draw_cable_cord(GAME_LAYER_CORD, i, play->cable_colors[i],
+                                    quality->cord_step, play);
+        }
+    }
+
+    /*
+     * If we're currently holding a cable end, draw the cable.
+     */
+    if (board->held_cable >= 0) {
+        cable = &board->cables[board->held_cable];
+
+        sb_play_draw_cable_cord(GAME_LAYER_HELD_CORD, board->held_cable,
+                                play->cable_colors[board->held_cable],
+                                quality->cord_step, play);
+
+        if (!play->plug_cursor_shown) {
+            rect = sb_play_rect(&cable->cable_base_rect);
+            rect.x = play->held_x - rect.w / 2;
+            rect.y = play->held_y - rect.h / 2;
+            sb_render_copy(GAME_LAYER_HELD_PLUG, play->plug_loose_texture,
+                           NULL, &rect);
+        }
+    }
+
+    /*
+     * Draw the "conversation" of the customer on the active cable, if they
+     * are talking to the operator.
+     */
+    if (board->active_cable >= 0 &&
+        board->cables[board->active_cable].customer >= 0) {
+        cust = &board->customers[board->cables[board->active_cable].customer];
+        if (cust->line_state == LINE_STATE_OPERATOR_REQUEST ||
+            cust->line_state == LINE_STATE_OPERATOR_REPLY) {
+            area.x = cust->mugshot_rect.x + 24;
+            area.y = cust->mugshot_rect.y - 48;
+            area.w = 100;
+            area.h = 76;
+            rect = sb_play_view_rect(play, &area);
+            sb_render_copy(GAME_LAYER_BUBBLE, play->speech_bubble_texture,
+                           NULL, &rect);
+
+            if (cust->line_state == LINE_STATE_OPERATOR_REQUEST &&
+                cust->target_cust >= 0) {
+                area.x += 30;
+                area.y += 12;
+                area.w = SB_MUGSHOT_BUBBLE_PIXELS;
+                area.h = SB_MUGSHOT_BUBBLE_PIXELS;
+                rect = sb_play_view_rect(play, &area);
+                sb_render_copy(GAME_LAYER_BUBBLE_MUGSHOT,
+                               sb_mugshot_get(cust->target_cust %
+                                              MUGSHOT_COUNT,
+                                              SB_MUGSHOT_SIZE_BUBBLE),
+                               NULL, &rect);
+            }
+        }
+    }
+
+    sb_play_draw_particles(play, quality->particle_step);
+    sb_play_draw_rotary(renderer, play);
+    sb_play_draw_popups(play);
+    sb_play_draw_indicators(play);
+
+    // Draw the HUD
+    sb_play_draw_hud(play, quality);
+}
+
+
+/*
+ * Make a cursor of the held plug, at the size it is drawn and held by its
+ * middle. Leaves it NULL if the platform can't do colour cursors.
+ */
+static void
+sb_play_create_plug_cursor (sb_play_type *play)
+{
+    const sb_game_rect_type *base = &play->board.cables[0].cable_base_rect;
+    SDL_Surface             *plug_surf;
+    SDL_Surface             *cursor_surf;
+
+    plug_surf = IMG_Load("media/plug_loose.png");
+    if (plug_surf == NULL) {
+        return;
+    }
+    cursor_surf = scale_surface(plug_surf, base->w, base->h);
+    SDL_FreeSurface(plug_surf);
+    if (cursor_surf == NULL) {
+        return;
+    }
+
+    play->plug_cursor = SDL_CreateColorCursor(cursor_surf, base->w / 2,
+                                              base->h / 2);
+    SDL_FreeSurface(cursor_surf);
+}
+
+
+/*
+ * See comment in play.h for more details.
+ */
+void
+sb_play_setup (SDL_Renderer *renderer,
+               size_t        lines)
+{
+    sb_play_type        *play = &sb_play;
+    sb_game_config_type  config;
+    TTF_Font            *hud_ttf;
+    SDL_Surface         *rotary_surf;
+    SDL_Color            hud_color = { 0, 0, 0, 255 };
+    SDL_Color            popup_color = { 255, 255, 255, 255 };
+    size_t               i;
+    sb_texture_load_type texture_loads[] = {
+        { "media/panel.png",          &play->panel_texture },
+        { "media/console.png",        &play->console_texture },
+        { "media/port.png",           &play->port_texture },
+        { "media/light.png",          &play->flash_texture },
+        { "media/plug_connected.png", &play->plug_connected_texture },
+        { "media/plug_loose.png",     &play->plug_loose_texture },
+        { "media/mug_background.png", &play->mug_background_texture },
+        { "media/speech_bubble.png",  &play->speech_bubble_texture },
+        { "media/button.png",         &play->button_texture },
+        { "media/button_flash.png",   &play->button_flash_texture },
+        { "media/cord_hole.png",      &play->cord_hole_texture },
+        { "media/rotary.png",         &play->rotary_texture },
+        { "media/rotary_top.png",     &play->rotary_top_texture },
+    };
+
+    /*
+     * Seed from the clock, so every session plays differently.
+     */
+    sb_game_config_default(&config);
+    config.seed = SDL_GetPerformanceCounter();
+    if (lines != 0) {
+        config.customer_count = MAX(2, MIN(lines, MAX_CUSTOMERS));
+    }
+    play->game = sb_game_create(&config);
+    sb_game_set_listener(play->game, &sb_play_game_event, play);
+    play->snapshot_size = sb_game_snapshot_size();
+    play->snapshot = malloc(play->snapshot_size);
+    sb_game_get_board(play->game, &play->board);
+    sb_play_build_grid(play);
+    sb_play_set_view(play, 0.0f, 0.0f, 1.0f);
+    sb_play_reset_effects(play);
+
+    /*
+     * The HUD only ever shows numbers, so only they go in the atlas.
+     */
+    hud_ttf = load_font(HUD_FONT_NAME, HUD_FONT_SIZE);
+    if (hud_ttf != NULL) {
+        (void)sb_font_setup(&play->hud_font, renderer, hud_ttf,
+                            "0123456789:", hud_color);
+        TTF_CloseFont(hud_ttf);
+    }
+
+    /*
+     * Popups are drawn tinted, so their font is white.
+     */
+    hud_ttf = load_font(HUD_FONT_NAME, POPUP_FONT_SIZE);
+    if (hud_ttf != NULL) {
+        (void)sb_font_setup(&play->popup_font, renderer, hud_ttf,
+                            "+-0123456789", popup_color);
+        TTF_CloseFont(hud_ttf);
+    }
+
+    // TODO: Proper media loading.
+    load_textures(renderer, texture_loads, SDL_arraysize(texture_loads));
+    sb_play_create_plug_cursor(play);
+
+    /*
+     * Rotated copies are slow when drawing on the CPU, so the dial is drawn
+     * from frames rotated ahead of time instead.
+     */
+    if (sb_render_is_software()) {
+        rotary_surf = IMG_Load("media/rotary.png");
+        if (rotary_surf != NULL) {
+            (void)sb_rotation_setup(&play->rotary_rotation, renderer,
+                                    rotary_surf,
+                                    play->board.rotary_bounds.w,
+                                    play->board.rotary_bounds.h);
+            SDL_FreeSurface(rotary_surf);
+        }
+    }
+
+    /*
+     * Each pair of cables shares a colour.
+     */
+    for (i = 0; i < MAX_CABLES; i++) {
+        play->cable_colors[i].r = (i / 2) * 75;
+        play->cable_colors[i].g = 255 - play->cable_colors[i].r;
+        play->cable_colors[i].b = (play->cable_colors[i].r *
+                                   play->cable_colors[i].g) % 255;
+        play->cable_colors[i].a = 255;
+    }
+
+    /*
+     * Start loading the mugshots for everyone on the board.
+     */
+    sb_mugshot_setup(MUGSHOT_CACHE_BUDGET);
+    for (i = 0; i < MIN(config.customer_count, MUGSHOT_COUNT); i++) {
+        sb_mugshot_prefetch(i);
+    }
+}
+
+
+/*
+ * See comment in play.h for more details.
+ */
+void
+sb_play_cleanup (void)
+{
+    sb_play_type *play = &sb_play;
+
+    /*
+     * Quitting mid-round - keep it for next time.
+     */
+    if (play->in_round) {
+        sb_play_save(play);
+    }
+    free(play->snapshot);
+    play->snapshot = NULL;
+
+    sb_mugshot_cleanup();
+
+    sb_font_cleanup(&play->hud_font);
+    sb_font_cleanup(&play->popup_font);
+    sb_rotation_cleanup(&play->rotary_rotation);
+
+    sb_play_show_plug_cursor(play, false);
+    if (play->plug_cursor != NULL) {
+        SDL_FreeCursor(play->plug_cursor);
+        play->plug_cursor = NULL;
+    }
+
+    free_texture(play->rotary_top_texture);
+    free_texture(play->rotary_texture);
+    free_texture(play->cord_hole_texture);
+    free_texture(play->button_flash_texture);
+    free_texture(play->button_texture);
+    free_texture(play->speech_bubble_texture);
+    free_texture(play->mug_background_texture);
+    free_texture(play->plug_loose_texture);
+    free_texture(play->plug_connected_texture);
+    free_texture(play->flash_texture);
+    free_texture(play->port_texture);
+    free_texture(play->console_texture);
+
+    sb_game_destroy(play->game);
+    play->game = NULL;
+}
+
+
+static sb_gamestate_type sb_play_gamestate = {
+    .name = "play",
+    .event_cb = &sb_play_event,
+    .update_cb = &sb_play_update,
+    .draw_cb = &sb_play_draw,
+    .ctx = NULL,
+    .flags = SB_GAMESTATE_FLAG_NO_ALLOC,
+    .events = SB_GAMESTATE_EVENTS_KEY |
+              SB_GAMESTATE_EVENTS_MOUSE_MOTION |
+              SB_GAMESTATE_EVENTS_MOUSE_BUTTON |
+              SB_GAMESTATE_EVENTS_MOUSE_WHEEL,
+};
+
+
+/*
+ * Start a new round, replacing whatever gamestates are currently running.
+ */
+void
+sb_play_start (void)
+{
+    sb_game_reset(sb_play.game);
+    sb_game_get_board(sb_play.game, &sb_play.board);
+    sb_play_set_view(&sb_play, 0.0f, 0.0f, 1.0f);
+    sb_play_watch_all(&sb_play);
+    sb_play_reset_effects(&sb_play);
+    sb_play.in_round = true;
+    sb_play.save_time = 0;
+    sb_gamestate_replace_all(&sb_play_gamestate);
+}
+
+
+/*
+ * Keep at least count particles going (up to 12000), thrown all over the
+ * board, for stress testing the effects. Zero turns this off.
+ */
+void
+sb_play_set_particle_stress (size_t count)
+{
+    sb_play.particle_stress = MIN(count, (SB_PARTICLE_EMITTERS -
+                                          STRESS_SPARE) * STRESS_BURST);
+}
+
+
+/*
+ * Choose how a held plug follows the pointer (see sb_play_cursor_type).
+ */
+void
+sb_play_set_cursor (sb_play_cursor_type cursor)
+{
+    sb_play.cursor = cursor;
+}
+
+
+/*
+ * Pick up the round saved in the resume file, if there is one, starting
+ * paused. Returns false (changing nothing) if there's nothing to resume.
+ *
+ * Whether the saved round is already over can only be seen once it is
+ * restored, so the game as it was is kept in a second buffer and put back
+ * if it is.
+ */
+bool
+sb_play_resume (void)
+{
+    sb_play_type *play = &sb_play;
+    FILE         *file;
+    uint8_t      *saved;
+    size_t        saved_size;
+    size_t        size;
+    bool          ok;
+
+    file = fopen(RESUME_FILE, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    size = fread(play->snapshot, 1, play->snapshot_size, file);
+    fclose(file);
+
+    saved = malloc(play->snapshot_size);
+    if (saved == NULL) {
+        return false;
+    }
+    saved_size = sb_game_snapshot(play->game, saved, play->snapshot_size);
+
+    ok = sb_game_restore(play->game, play->snapshot, size);
+    if (ok && sb_game_is_over(play->game)) {
+        (void)sb_game_restore(play->game, saved, saved_size);
+        ok = false;
+    }
+    free(saved);
+
+    if (!ok) {
+        return false;
+    }
+
+    sb_game_get_board(play->game, &play->board);
+    sb_play_build_grid(play);
+    sb_play_set_view(play, 0.0f, 0.0f, 1.0f);
+    sb_play_watch_all(play);
+    play->in_round = true;
+    play->save_time = 0;
+    sb_gamestate_replace_all(&sb_play_gamestate);
+    sb_gamestate_push(sb_menu_pause_get_gamestate());
+
+    return true;
+}
+
+
+/*
+ * Give up on the round in progress, so it won't be resumed.
+ */
+void
+sb_play_abandon (void)
+{
+    sb_play.in_round = false;
+    (void)remove(RESUME_FILE);
+}
+
+
+/*
+ * Get the game being played, e.g. for the bot to play it.
+ */
+sb_game_type *
+sb_play_get_game (void)
+{
+    return sb_play.game;
+}
+
+
+/*
+ * See comment in play.h for more details.
+ */
+sb_gamestate_type *
+sb_play_get_gamestate (void)
+{
+    return &sb_play_gamestate;
+}
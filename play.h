@@ -0,0 +1,49 @@
+#ifndef __PLAY_H__
+#define __PLAY_H__
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+#include "gamestate.h"
+#include "game.h"
+
+
+/*
+ * How a held plug follows the pointer. The game only hears where the mouse
+ * was when the frame's events were handled, and by the time the frame is
+ * on screen the OS cursor can be a frame or more further on.
+ *
+ * SB_PLAY_CURSOR_HARDWARE makes the plug the mouse cursor, which the OS
+ * moves however long frames take, and ends the cord where the mouse is as
+ * late in the frame as possible. SB_PLAY_CURSOR_LATCHED draws the plug
+ * there too instead - it's what hardware falls back to if the cursor can't
+ * be made, and is needed for the plug to show up in --capture recordings.
+ * SB_PLAY_CURSOR_GAME draws both where the game was told the pointer is,
+ * for when the bot is playing rather than the mouse.
+ */
+typedef enum {
+    SB_PLAY_CURSOR_HARDWARE,
+    SB_PLAY_CURSOR_LATCHED,
+    SB_PLAY_CURSOR_GAME,
+} sb_play_cursor_type;
+
+
+/*
+ * The gamestate for playing a round - owns the game being played, and draws
+ * it and feeds it input. The board has the given number of lines, or the
+ * game's usual number if that is 0; boards too big for the screen are
+ * shown through a camera that can be panned and zoomed.
+ */
+void sb_play_setup(SDL_Renderer *renderer, size_t lines);
+void sb_play_cleanup(void);
+void sb_play_start(void);
+bool sb_play_resume(void);
+void sb_play_abandon(void);
+void sb_play_set_particle_stress(size_t count);
+void sb_play_set_cursor(sb_play_cursor_type cursor);
+sb_game_type *sb_play_get_game(void);
+sb_gamestate_type *sb_play_get_gamestate(void);
+
+
+#endif /* __PLAY_H__ */
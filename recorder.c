@@ -0,0 +1,242 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+#include "job.h"
+#include "recorder.h"
+
+
+static const char *sb_recorder_phase_names[SB_RECORDER_PHASE_COUNT] = {
+    "events",
+    "jobs",
+    "update",
+    "draw",
+    "capture",
+    "present",
+};
+
+static const char *sb_recorder_line_state_names[LINE_STATE_COUNT] = {
+    "idle",
+    "dial",
+    "req",
+    "ans",
+    "reply",
+    "busy",
+};
+
+
+/*
+ * The ring holds the last count frames (up to SB_RECORDER_FRAMES), the
+ * oldest at count % SB_RECORDER_FRAMES once it has filled. While a hitch
+ * is pending, countdown is how many more frames to record before it is
+ * written. The dump is the copy being written, which belongs to the
+ * writer job until writing is done.
+ */
+typedef struct sb_recorder {
+    float                  threshold_ms;
+    sb_recorder_frame_type ring[SB_RECORDER_FRAMES];
+    uint64_t               count;
+    bool                   pending;
+    size_t                 countdown;
+    uint64_t               hitch_frame;
+    time_t                 hitch_time;
+    float                  hitch_ms;
+    sb_recorder_frame_type dump[SB_RECORDER_FRAMES];
+    size_t                 dump_count;
+    uint64_t               dump_frame;
+    time_t                 dump_time;
+    float                  dump_ms;
+    sb_job_counter_type    writing;
+    sb_recorder_stats_type stats;
+} sb_recorder_type;
+
+
+static sb_recorder_type sb_recorder;
+
+
+/*
+ * Start recording, writing out frames that take longer than threshold_ms.
+ * A threshold of 0 turns the recorder off.
+ */
+void
+sb_recorder_setup (float threshold_ms)
+{
+    sb_recorder_type *recorder = &sb_recorder;
+
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->threshold_ms = MAX(0.0f, threshold_ms);
+}
+
+
+/*
+ * Writer job - write the dump out as a table, one frame per line, with the
+ * frames over the threshold marked. "handled" is the number of events.
+ */
+static void
+sb_recorder_write (void *data)
+{
+    sb_recorder_type             *recorder = data;
+    const sb_recorder_frame_type *frame;
+    FILE                         *file;
+    struct tm                     tm;
+    char                          stamp[32];
+    char                          filename[64];
+    size_t                        i;
+    size_t                        j;
+
+    localtime_r(&recorder->dump_time, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    snprintf(filename, sizeof(filename), "hitch-%s-%" PRIu64 ".txt", stamp,
+             recorder->dump_frame);
+
+    file = fopen(filename, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to write hitch report %s\n", filename);
+        return;
+    }
+
+    fprintf(file, "Frame %" PRIu64 " took %.1f ms (threshold %.1f ms)\n",
+            recorder->dump_frame, recorder->dump_ms, recorder->threshold_ms);
+    fprintf(file, "Times in ms, frames over the threshold marked *\n\n");
+
+    fprintf(file, "  %8s %8s %7s", "frame", "ticks", "total");
+    for (i = 0; i < SB_RECORDER_PHASE_COUNT; i++) {
+        fprintf(file, " %7s", sb_recorder_phase_names[i]);
+    }
+    fprintf(file, " %7s %-12s %5s %7s %8s", "handled", "gamestate", "depth",
+            "quality", "gametime");
+    for (i = 0; i < LINE_STATE_COUNT; i++) {
+        fprintf(file, " %5s", sb_recorder_line_state_names[i]);
+    }
+    fprintf(file, " %4s %6s %6s %8s\n", "held", "active", "allocs",
+            "bytes");
+
+    for (i = 0; i < recorder->dump_count; i++) {
+        frame = &recorder->dump[i];
+        fprintf(file, "%c %8" PRIu64 " %8" PRIu32 " %7.2f",
+                frame->frame_ms > recorder->threshold_ms ? '*' : ' ',
+                frame->frame, frame->ticks, frame->frame_ms);
+        for (j = 0; j < SB_RECORDER_PHASE_COUNT; j++) {
+            fprintf(file, " %7.2f", frame->phase_ms[j]);
+        }
+        fprintf(file, " %7" PRIu32 " %-12s %5" PRIu32 " %7" PRIu32
+                      " %8" PRIu32,
+                frame->events,
+                frame->gamestate != NULL ? frame->gamestate : "-",
+                frame->gamestate_depth, frame->quality, frame->gametime);
+        for (j = 0; j < LINE_STATE_COUNT; j++) {
+            fprintf(file, " %5" PRIu32, frame->line_states[j]);
+        }
+        fprintf(file, " %4d %6d %6" PRIu64 " %8" PRIu64 "\n",
+                frame->held_cable, frame->active_cable, frame->allocs,
+                frame->alloc_bytes);
+    }
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Unable to write hitch report %s\n", filename);
+        return;
+    }
+    __atomic_fetch_add(&recorder->stats.written, 1, __ATOMIC_RELAXED);
+    fprintf(stderr, "Frame %" PRIu64 " took %.1f ms, wrote %s\n",
+            recorder->dump_frame, recorder->dump_ms, filename);
+}
+
+
+/*
+ * Copy the ring out, oldest first, and hand it to the writer - unless the
+ * last one is still being written, in which case this one is dropped.
+ */
+static void
+sb_recorder_dump (sb_recorder_type *recorder)
+{
+    uint64_t first;
+    size_t   i;
+
+    recorder->pending = false;
+    if (!sb_job_done(&recorder->writing)) {
+        recorder->stats.skipped++;
+        return;
+    }
+
+    recorder->dump_count = MIN(recorder->count, SB_RECORDER_FRAMES);
+    first = recorder->count - recorder->dump_count;
+    for (i = 0; i < recorder->dump_count; i++) {
+        recorder->dump[i] = recorder->ring[(first + i) % SB_RECORDER_FRAMES];
+    }
+    recorder->dump_frame = recorder->hitch_frame;
+    recorder->dump_time = recorder->hitch_time;
+    recorder->dump_ms = recorder->hitch_ms;
+
+    sb_job_submit(&sb_recorder_write, recorder, &recorder->writing);
+}
+
+
+/*
+ * Write out whatever is still to be written, and wait for it.
+ */
+void
+sb_recorder_cleanup (void)
+{
+    sb_recorder_type *recorder = &sb_recorder;
+
+    if (recorder->pending) {
+        sb_recorder_dump(recorder);
+    }
+    sb_job_wait(&recorder->writing);
+}
+
+
+/*
+ * Record a frame that has just finished.
+ */
+void
+sb_recorder_frame (const sb_recorder_frame_type *frame)
+{
+    sb_recorder_type *recorder = &sb_recorder;
+
+    if (recorder->threshold_ms <= 0.0f) {
+        return;
+    }
+
+    recorder->ring[recorder->count % SB_RECORDER_FRAMES] = *frame;
+    recorder->count++;
+    recorder->stats.frames++;
+
+    /*
+     * Further hitches before the report is written just go in it, as the
+     * worst of them.
+     */
+    if (frame->frame_ms > recorder->threshold_ms) {
+        recorder->stats.hitches++;
+        recorder->stats.worst_ms = MAX(recorder->stats.worst_ms,
+                                       frame->frame_ms);
+        if (!recorder->pending) {
+            recorder->pending = true;
+            recorder->countdown = SB_RECORDER_AFTER;
+            recorder->hitch_frame = frame->frame;
+            recorder->hitch_time = time(NULL);
+            recorder->hitch_ms = frame->frame_ms;
+            return;
+        }
+        if (frame->frame_ms > recorder->hitch_ms) {
+            recorder->hitch_frame = frame->frame;
+            recorder->hitch_ms = frame->frame_ms;
+        }
+    }
+
+    if (recorder->pending && --recorder->countdown == 0) {
+        sb_recorder_dump(recorder);
+    }
+}
+
+
+/*
+ * Get the recorder's counts. written is bumped by the writer job, so is
+ * only exact after sb_recorder_cleanup.
+ */
+void
+sb_recorder_get_stats (sb_recorder_stats_type *stats)
+{
+    *stats = sb_recorder.stats;
+}
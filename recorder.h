@@ -0,0 +1,80 @@
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "game.h"
+
+
+/*
+ * Hitch flight recorder - keeps the last SB_RECORDER_FRAMES frames of
+ * what the main loop was doing, and writes them out when a frame takes
+ * too long, so there is something to go on when a rare stall is reported.
+ *
+ * Each frame the main loop fills in a sb_recorder_frame_type and hands it
+ * over, which is just a copy into a ring. When a frame goes over the
+ * threshold, the recorder waits SB_RECORDER_AFTER more frames (what
+ * happens next is often as telling) and then copies the ring out and has
+ * a job thread write it to hitch-<date>-<time>-<frame>.txt, so the main
+ * thread never waits on the disk. Hitches while that is going on are
+ * counted but not written separately.
+ *
+ * Doesn't need SDL.
+ */
+#define SB_RECORDER_FRAMES 240
+#define SB_RECORDER_AFTER  30
+
+
+/*
+ * The parts of a frame that are timed.
+ */
+typedef enum {
+    SB_RECORDER_PHASE_EVENTS,
+    SB_RECORDER_PHASE_JOBS,
+    SB_RECORDER_PHASE_UPDATE,
+    SB_RECORDER_PHASE_DRAW,
+    SB_RECORDER_PHASE_CAPTURE,
+    SB_RECORDER_PHASE_PRESENT,
+    SB_RECORDER_PHASE_COUNT
+} sb_recorder_phase_type;
+
+
+/*
+ * One frame. gamestate is the name of the gamestate on top at the end of
+ * it, and allocs and alloc_bytes are the main thread's allocations.
+ */
+typedef struct sb_recorder_frame {
+    uint64_t    frame;
+    uint32_t    ticks;
+    float       frame_ms;
+    float       phase_ms[SB_RECORDER_PHASE_COUNT];
+    uint32_t    events;
+    const char *gamestate;
+    uint32_t    gamestate_depth;
+    uint32_t    quality;
+    uint32_t    gametime;
+    uint32_t    line_states[LINE_STATE_COUNT];
+    int         held_cable;
+    int         active_cable;
+    uint64_t    allocs;
+    uint64_t    alloc_bytes;
+} sb_recorder_frame_type;
+
+
+typedef struct sb_recorder_stats {
+    uint64_t frames;
+    uint64_t hitches;
+    uint64_t written;
+    uint64_t skipped;
+    float    worst_ms;
+} sb_recorder_stats_type;
+
+
+void sb_recorder_setup(float threshold_ms);
+void sb_recorder_cleanup(void);
+void sb_recorder_frame(const sb_recorder_frame_type *frame);
+void sb_recorder_get_stats(sb_recorder_stats_type *stats);
+
+
+#endif /* __RECORDER_H__ */
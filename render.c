@@ -0,0 +1,950 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "util.h"
+#include "render.h"
+#include "composite.h"
+
+#if !SDL_VERSION_ATLEAST(2, 0, 18)
+#error SDL 2.0.18 or later is needed for SDL_RenderGeometry
+#endif
+
+
+/*
+ * Max number of commands, and of strip and quad vertices, per flush.
+ * There's room for a full screen of particles (see particle.h).
+ */
+#define SB_RENDER_MAX_CMDS     4096
+#define SB_RENDER_MAX_VERTICES 65536
+
+
+typedef enum {
+    SB_RENDER_CMD_CLEAR,
+    SB_RENDER_CMD_FILL,
+    SB_RENDER_CMD_COPY,
+    SB_RENDER_CMD_STRIP,
+    SB_RENDER_CMD_QUADS,
+} sb_render_cmd_kind_type;
+
+
+/*
+ * A single recorded draw. For fills and strips color is the draw colour;
+ * for copies it is the texture colour and alpha modulation. The vertices
+ * of strips and quads are in the buffer's vertex pool, from first_vertex
+ * on.
+ */
+typedef struct sb_render_cmd {
+    sb_render_layer_type     layer;
+    sb_render_cmd_kind_type  kind;
+    uint32_t                 seq;
+    SDL_Texture             *texture;
+    SDL_Color                color;
+    SDL_BlendMode            blend;
+    bool                     has_src;
+    SDL_Rect                 src;
+    SDL_Rect                 dst;
+    double                   angle;
+    size_t                   first_vertex;
+    size_t                   vertex_count;
+} sb_render_cmd_type;
+
+
+typedef struct sb_render_buffer {
+    sb_render_cmd_type   cmds[SB_RENDER_MAX_CMDS];
+    sb_render_cmd_type  *sorted[SB_RENDER_MAX_CMDS];
+    SDL_Rect             fill_rects[SB_RENDER_MAX_CMDS];
+    size_t               cmd_count;
+    SDL_Vertex           vertices[SB_RENDER_MAX_VERTICES];
+    size_t               vertex_count;
+    int                  indices[SB_RENDER_MAX_VERTICES * 3];
+    sb_render_stats_type stats;
+    int                  width;
+    int                  height;
+    float                scale;
+    bool                 linear;
+    bool                 scale_changed;
+    SDL_Texture         *target;
+    int                  target_width;
+    int                  target_height;
+    bool                 compositing;
+    bool                 software;
+    sb_composite_op_type ops[SB_RENDER_MAX_CMDS];
+} sb_render_buffer_type;
+
+
+static sb_render_buffer_type sb_render_buffer;
+
+
+static const SDL_Color sb_render_white = { 255, 255, 255, 255 };
+
+
+static inline bool
+sb_render_color_equal (SDL_Color a,
+                       SDL_Color b)
+{
+    return (a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a);
+}
+
+
+/*
+ * Strips and quads are drawn as triangles, from the vertex pool.
+ */
+static inline bool
+sb_render_is_geometry (const sb_render_cmd_type *cmd)
+{
+    return (cmd->kind == SB_RENDER_CMD_STRIP ||
+            cmd->kind == SB_RENDER_CMD_QUADS);
+}
+
+
+static inline uint32_t
+sb_render_color_key (SDL_Color color)
+{
+    return ((uint32_t)color.r << 24 | (uint32_t)color.g << 16 |
+            (uint32_t)color.b << 8 | color.a);
+}
+
+
+/*
+ * Check whether moving from one command to the next needs any renderer
+ * state to be changed. The colour of strips and quads is in their
+ * vertices, so any colours can go in one draw call.
+ */
+static inline bool
+sb_render_state_differs (const sb_render_cmd_type *prev,
+                         const sb_render_cmd_type *cmd)
+{
+    return (prev == NULL ||
+            prev->kind != cmd->kind ||
+            prev->texture != cmd->texture ||
+            prev->blend != cmd->blend ||
+            (!sb_render_is_geometry(cmd) &&
+             !sb_render_color_equal(prev->color, cmd->color)));
+}
+
+
+/*
+ * Order by layer, then by state, then by the order commands were recorded
+ * so the sort is stable.
+ */
+static int
+sb_render_cmd_compare (const void *a,
+                       const void *b)
+{
+    const sb_render_cmd_type *cmd_a = *(const sb_render_cmd_type **)a;
+    const sb_render_cmd_type *cmd_b = *(const sb_render_cmd_type **)b;
+    uint32_t                  key_a;
+    uint32_t                  key_b;
+
+    if (cmd_a->layer != cmd_b->layer) {
+        return cmd_a->layer < cmd_b->layer ? -1 : 1;
+    }
+
+    if (cmd_a->kind != cmd_b->kind) {
+        return cmd_a->kind < cmd_b->kind ? -1 : 1;
+    }
+
+    if (cmd_a->texture != cmd_b->texture) {
+        return (uintptr_t)cmd_a->texture < (uintptr_t)cmd_b->texture ? -1 : 1;
+    }
+
+    if (cmd_a->blend != cmd_b->blend) {
+        return cmd_a->blend < cmd_b->blend ? -1 : 1;
+    }
+
+    key_a = sb_render_color_key(cmd_a->color);
+    key_b = sb_render_color_key(cmd_b->color);
+    if (key_a != key_b) {
+        return key_a < key_b ? -1 : 1;
+    }
+
+    return cmd_a->seq < cmd_b->seq ? -1 : (cmd_a->seq > cmd_b->seq);
+}
+
+
+static sb_render_cmd_type *
+sb_render_add (sb_render_layer_type    layer,
+               sb_render_cmd_kind_type kind)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+    sb_render_cmd_type    *cmd;
+
+    if (buffer->cmd_count >= SB_RENDER_MAX_CMDS) {
+        buffer->stats.dropped++;
+        return NULL;
+    }
+
+    cmd = &buffer->cmds[buffer->cmd_count];
+    cmd->layer = layer;
+    cmd->kind = kind;
+    cmd->seq = buffer->cmd_count++;
+    cmd->texture = NULL;
+    cmd->color = sb_render_white;
+    cmd->blend = SDL_BLENDMODE_BLEND;
+    cmd->has_src = false;
+    cmd->angle = 0.0;
+
+    return cmd;
+}
+
+
+/*
+ * Clear the whole render target. Clears are drawn before anything else in
+ * the same layer.
+ */
+void
+sb_render_clear (sb_render_layer_type layer,
+                 SDL_Color            color)
+{
+    sb_render_cmd_type *cmd = sb_render_add(layer, SB_RENDER_CMD_CLEAR);
+
+    if (cmd != NULL) {
+        cmd->color = color;
+        cmd->blend = SDL_BLENDMODE_NONE;
+    }
+}
+
+
+/*
+ * Fill a rectangle, blending with whatever is underneath.
+ */
+void
+sb_render_fill (sb_render_layer_type  layer,
+                SDL_Color             color,
+                const SDL_Rect       *rect)
+{
+    sb_render_cmd_type *cmd = sb_render_add(layer, SB_RENDER_CMD_FILL);
+
+    if (cmd != NULL) {
+        cmd->color = color;
+        cmd->dst = *rect;
+    }
+}
+
+
+/*
+ * Copy (part of) a texture, tinted with the given colour.
+ */
+void
+sb_render_copy_mod (sb_render_layer_type  layer,
+                    SDL_Texture          *texture,
+                    SDL_Color             color,
+                    const SDL_Rect       *src,
+                    const SDL_Rect       *dst)
+{
+    sb_render_cmd_type *cmd;
+
+    /*
+     * Copying a missing texture is a no-op in SDL - don't bother recording
+     * it.
+     */
+    if (texture == NULL) {
+        return;
+    }
+
+    cmd = sb_render_add(layer, SB_RENDER_CMD_COPY);
+    if (cmd != NULL) {
+        cmd->texture = texture;
+        cmd->color = color;
+        cmd->dst = *dst;
+        if (src != NULL) {
+            cmd->has_src = true;
+            cmd->src = *src;
+        }
+    }
+}
+
+
+/*
+ * Copy (part of) a texture.
+ */
+void
+sb_render_copy (sb_render_layer_type  layer,
+                SDL_Texture          *texture,
+                const SDL_Rect       *src,
+                const SDL_Rect       *dst)
+{
+    sb_render_copy_mod(layer, texture, sb_render_white, src, dst);
+}
+
+
+/*
+ * Copy (part of) a texture, rotated clockwise about its center by angle
+ * degrees.
+ */
+void
+sb_render_copy_ex (sb_render_layer_type  layer,
+                   SDL_Texture          *texture,
+                   const SDL_Rect       *src,
+                   const SDL_Rect       *dst,
+                   double                angle)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+    size_t                 count = buffer->cmd_count;
+
+    sb_render_copy(layer, texture, src, dst);
+    if (buffer->cmd_count > count) {
+        buffer->cmds[count].angle = angle;
+    }
+}
+
+
+/*
+ * Fill a triangle strip - triangles (0, 1, 2), (1, 2, 3) and so on -
+ * blending with whatever is underneath.
+ */
+void
+sb_render_strip (sb_render_layer_type  layer,
+                 SDL_Color             color,
+                 const SDL_FPoint     *points,
+                 size_t                count)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+    sb_render_cmd_type    *cmd;
+    SDL_Vertex            *vertex;
+    size_t                 i;
+
+    if (count < 3) {
+        return;
+    }
+    if (buffer->vertex_count + count > SB_RENDER_MAX_VERTICES) {
+        buffer->stats.dropped++;
+        return;
+    }
+
+    cmd = sb_render_add(layer, SB_RENDER_CMD_STRIP);
+    if (cmd == NULL) {
+        return;
+    }
+    cmd->color = color;
+    cmd->first_vertex = buffer->vertex_count;
+    cmd->vertex_count = count;
+
+    for (i = 0; i < count; i++) {
+        vertex = &buffer->vertices[buffer->vertex_count++];
+        vertex->position = points[i];
+        vertex->color = color;
+        vertex->tex_coord.x = 0.0f;
+        vertex->tex_coord.y = 0.0f;
+    }
+}
+
+
+/*
+ * Fill axis-aligned quads, each given as four vertices - top left, top
+ * right, bottom left, bottom right - blending with whatever is underneath.
+ * Each quad should be one colour, as the compositor uses the colour of its
+ * first vertex. However many there are, the quads in a layer are drawn
+ * together in one call.
+ */
+void
+sb_render_quads (sb_render_layer_type  layer,
+                 const SDL_Vertex     *vertices,
+                 size_t                count)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+    sb_render_cmd_type    *cmd;
+
+    count -= count % 4;
+    if (count == 0) {
+        return;
+    }
+    if (buffer->vertex_count + count > SB_RENDER_MAX_VERTICES) {
+        buffer->stats.dropped++;
+        return;
+    }
+
+    cmd = sb_render_add(layer, SB_RENDER_CMD_QUADS);
+    if (cmd == NULL) {
+        return;
+    }
+    cmd->first_vertex = buffer->vertex_count;
+    cmd->vertex_count = count;
+
+    memcpy(&buffer->vertices[buffer->vertex_count], vertices,
+           count * sizeof(*vertices));
+    buffer->vertex_count += count;
+}
+
+
+/*
+ * Map a rect from window coordinates onto the internal render target. The
+ * edges are scaled rather than the size, so adjacent rects stay adjacent.
+ */
+static inline void
+sb_render_scale_rect (sb_render_buffer_type *buffer,
+                      SDL_Rect              *rect)
+{
+    int right;
+    int bottom;
+
+    if (buffer->target == NULL && !buffer->compositing) {
+        return;
+    }
+
+    right = floorf((rect->x + rect->w) * buffer->scale + 0.5f);
+    bottom = floorf((rect->y + rect->h) * buffer->scale + 0.5f);
+    rect->x = floorf(rect->x * buffer->scale + 0.5f);
+    rect->y = floorf(rect->y * buffer->scale + 0.5f);
+    rect->w = right - rect->x;
+    rect->h = bottom - rect->y;
+}
+
+
+/*
+ * Submit a run of fills that share the same state.
+ */
+static void
+sb_render_submit_fills (SDL_Renderer          *renderer,
+                        sb_render_buffer_type *buffer,
+                        size_t                 start,
+                        size_t                 end)
+{
+    size_t i;
+
+    if (end - start == 1) {
+        SDL_RenderFillRect(renderer, &buffer->sorted[start]->dst);
+    } else {
+        for (i = start; i < end; i++) {
+            buffer->fill_rects[i - start] = buffer->sorted[i]->dst;
+        }
+        SDL_RenderFillRects(renderer, buffer->fill_rects, end - start);
+    }
+    buffer->stats.draw_calls++;
+}
+
+
+/*
+ * Scale the strip and quad vertices onto the internal render target, and
+ * set each command's dst to its bounding box.
+ */
+static void
+sb_render_scale_geometry (sb_render_buffer_type *buffer)
+{
+    sb_render_cmd_type *cmd;
+    SDL_FPoint         *pos;
+    float               scale = buffer->scale;
+    float               x0;
+    float               y0;
+    float               x1;
+    float               y1;
+    size_t              i;
+    size_t              j;
+
+    if (buffer->target == NULL && !buffer->compositing) {
+        scale = 1.0f;
+    }
+
+    for (i = 0; i < buffer->cmd_count; i++) {
+        cmd = &buffer->cmds[i];
+        if (!sb_render_is_geometry(cmd)) {
+            continue;
+        }
+
+        x0 = y0 = INFINITY;
+        x1 = y1 = -INFINITY;
+        for (j = cmd->first_vertex;
+             j < cmd->first_vertex + cmd->vertex_count; j++) {
+            pos = &buffer->vertices[j].position;
+            pos->x *= scale;
+            pos->y *= scale;
+            x0 = MIN(x0, pos->x);
+            y0 = MIN(y0, pos->y);
+            x1 = MAX(x1, pos->x);
+            y1 = MAX(y1, pos->y);
+        }
+        cmd->dst.x = floorf(x0);
+        cmd->dst.y = floorf(y0);
+        cmd->dst.w = (int)ceilf(x1) - cmd->dst.x + 1;
+        cmd->dst.h = (int)ceilf(y1) - cmd->dst.y + 1;
+    }
+}
+
+
+/*
+ * Submit a run of strips or quads as one list of triangles.
+ */
+static void
+sb_render_submit_geometry (SDL_Renderer          *renderer,
+                           sb_render_buffer_type *buffer,
+                           size_t                 start,
+                           size_t                 end)
+{
+    const sb_render_cmd_type *cmd;
+    size_t                    count = 0;
+    size_t                    i;
+    size_t                    j;
+
+    for (i = start; i < end; i++) {
+        cmd = buffer->sorted[i];
+        if (cmd->kind == SB_RENDER_CMD_QUADS) {
+            for (j = cmd->first_vertex;
+                 j + 3 < cmd->first_vertex + cmd->vertex_count; j += 4) {
+                buffer->indices[count++] = j;
+                buffer->indices[count++] = j + 1;
+                buffer->indices[count++] = j + 2;
+                buffer->indices[count++] = j + 2;
+                buffer->indices[count++] = j + 1;
+                buffer->indices[count++] = j + 3;
+            }
+            continue;
+        }
+
+        for (j = cmd->first_vertex;
+             j + 2 < cmd->first_vertex + cmd->vertex_count; j++) {
+            buffer->indices[count++] = j;
+            buffer->indices[count++] = j + 1;
+            buffer->indices[count++] = j + 2;
+        }
+    }
+
+    (void)SDL_RenderGeometry(renderer, NULL, buffer->vertices,
+                             buffer->vertex_count, buffer->indices, count);
+    buffer->stats.draw_calls++;
+}
+
+
+/*
+ * Hand the sorted commands to the software compositor, instead of SDL.
+ */
+static void
+sb_render_composite (sb_render_buffer_type *buffer)
+{
+    sb_render_cmd_type   *cmd;
+    sb_composite_op_type *op;
+    size_t                i;
+
+    for (i = 0; i < buffer->cmd_count; i++) {
+        cmd = buffer->sorted[i];
+        op = &buffer->ops[i];
+
+        op->color = cmd->color;
+        op->blend = cmd->blend;
+        op->dst = cmd->dst;
+        op->angle = cmd->angle;
+        op->pixels = NULL;
+        op->vertices = NULL;
+        op->vertex_count = 0;
+
+        switch (cmd->kind) {
+        case SB_RENDER_CMD_CLEAR:
+            op->kind = SB_COMPOSITE_OP_CLEAR;
+            break;
+
+        case SB_RENDER_CMD_FILL:
+            op->kind = SB_COMPOSITE_OP_FILL;
+            break;
+
+        case SB_RENDER_CMD_COPY:
+            op->kind = SB_COMPOSITE_OP_COPY;
+            op->pixels = sb_composite_get_pixels(cmd->texture);
+            (void)SDL_GetTextureBlendMode(cmd->texture, &op->blend);
+            if (cmd->has_src) {
+                op->src = cmd->src;
+            } else if (op->pixels != NULL) {
+                op->src.x = 0;
+                op->src.y = 0;
+                op->src.w = op->pixels->w;
+                op->src.h = op->pixels->h;
+            }
+            break;
+
+        case SB_RENDER_CMD_STRIP:
+            op->kind = SB_COMPOSITE_OP_STRIP;
+            op->vertices = &buffer->vertices[cmd->first_vertex];
+            op->vertex_count = cmd->vertex_count;
+            break;
+
+        case SB_RENDER_CMD_QUADS:
+            op->kind = SB_COMPOSITE_OP_QUADS;
+            op->vertices = &buffer->vertices[cmd->first_vertex];
+            op->vertex_count = cmd->vertex_count;
+            break;
+        }
+    }
+
+    sb_composite_draw(buffer->ops, buffer->cmd_count);
+    buffer->stats.draw_calls++;
+}
+
+
+/*
+ * Sort and submit everything recorded since the last flush.
+ */
+void
+sb_render_flush (SDL_Renderer *renderer)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+    sb_render_cmd_type    *prev = NULL;
+    sb_render_cmd_type    *cmd;
+    size_t                 i;
+    size_t                 run_start = 0;
+
+    if (buffer->cmd_count == 0) {
+        return;
+    }
+
+    for (i = 0; i < buffer->cmd_count; i++) {
+        if (sb_render_state_differs(prev, &buffer->cmds[i])) {
+            buffer->stats.state_changes_unsorted++;
+        }
+        prev = &buffer->cmds[i];
+        buffer->sorted[i] = prev;
+    }
+
+    qsort(buffer->sorted, buffer->cmd_count, sizeof(buffer->sorted[0]),
+          &sb_render_cmd_compare);
+
+    for (i = 0; i < buffer->cmd_count; i++) {
+        if (!sb_render_is_geometry(buffer->sorted[i])) {
+            sb_render_scale_rect(buffer, &buffer->sorted[i]->dst);
+        }
+    }
+    sb_render_scale_geometry(buffer);
+
+    if (buffer->compositing) {
+        sb_render_composite(buffer);
+        buffer->stats.commands += buffer->cmd_count;
+        buffer->cmd_count = 0;
+        buffer->vertex_count = 0;
+        return;
+    }
+
+    prev = NULL;
+    for (i = 0; i < buffer->cmd_count; i++) {
+        cmd = buffer->sorted[i];
+
+        if (sb_render_state_differs(prev, cmd)) {
+            /*
+             * Finish off any run of fills, strips or quads before changing
+             * state.
+             */
+            if (prev != NULL && prev->kind == SB_RENDER_CMD_FILL) {
+                sb_render_submit_fills(renderer, buffer, run_start, i);
+            } else if (prev != NULL && sb_render_is_geometry(prev)) {
+                sb_render_submit_geometry(renderer, buffer, run_start, i);
+            }
+            run_start = i;
+
+            buffer->stats.state_changes++;
+            if (cmd->kind == SB_RENDER_CMD_COPY) {
+                SDL_SetTextureColorMod(cmd->texture,
+                                       cmd->color.r,
+                                       cmd->color.g,
+                                       cmd->color.b);
+                SDL_SetTextureAlphaMod(cmd->texture, cmd->color.a);
+            } else {
+                SDL_SetRenderDrawBlendMode(renderer, cmd->blend);
+                SDL_SetRenderDrawColor(renderer,
+                                       cmd->color.r,
+                                       cmd->color.g,
+                                       cmd->color.b,
+                                       cmd->color.a);
+            }
+        }
+
+        switch (cmd->kind) {
+        case SB_RENDER_CMD_CLEAR:
+            SDL_RenderClear(renderer);
+            buffer->stats.draw_calls++;
+            break;
+
+        case SB_RENDER_CMD_COPY:
+            if (cmd->angle != 0.0) {
+                SDL_RenderCopyEx(renderer, cmd->texture,
+                                 cmd->has_src ? &cmd->src : NULL, &cmd->dst,
+                                 cmd->angle, NULL, SDL_FLIP_NONE);
+            } else {
+                SDL_RenderCopy(renderer, cmd->texture,
+                               cmd->has_src ? &cmd->src : NULL, &cmd->dst);
+            }
+            buffer->stats.draw_calls++;
+            break;
+
+        case SB_RENDER_CMD_FILL:
+        case SB_RENDER_CMD_STRIP:
+        case SB_RENDER_CMD_QUADS:
+            /*
+             * Submitted as a batch when the run ends.
+             */
+            break;
+        }
+
+        prev = cmd;
+    }
+
+    if (prev->kind == SB_RENDER_CMD_FILL) {
+        sb_render_submit_fills(renderer, buffer, run_start, buffer->cmd_count);
+    } else if (sb_render_is_geometry(prev)) {
+        sb_render_submit_geometry(renderer, buffer, run_start,
+                                  buffer->cmd_count);
+    }
+
+    /*
+     * Leave the renderer how the rest of the code expects to find it.
+     */
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+    buffer->stats.commands += buffer->cmd_count;
+    buffer->cmd_count = 0;
+    buffer->vertex_count = 0;
+}
+
+
+/*
+ * (Re)create the internal render target for the current scale, or free it if
+ * drawing straight to the window.
+ */
+static void
+sb_render_update_target (SDL_Renderer          *renderer,
+                         sb_render_buffer_type *buffer)
+{
+    int width = floorf(buffer->width * buffer->scale + 0.5f);
+    int height = floorf(buffer->height * buffer->scale + 0.5f);
+
+    buffer->scale_changed = false;
+
+    /*
+     * The compositor draws at the reduced size itself.
+     */
+    if (buffer->compositing) {
+        return;
+    }
+
+    if (buffer->target != NULL &&
+        (buffer->target_width != width || buffer->target_height != height ||
+         buffer->scale >= SB_RENDER_SCALE_MAX)) {
+        SDL_DestroyTexture(buffer->target);
+        buffer->target = NULL;
+    }
+
+    if (buffer->scale >= SB_RENDER_SCALE_MAX ||
+        !SDL_RenderTargetSupported(renderer)) {
+        return;
+    }
+
+    if (buffer->target == NULL) {
+        buffer->target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                           SDL_TEXTUREACCESS_TARGET,
+                                           width, height);
+        if (buffer->target == NULL) {
+            SDL_Log("Unable to create render target: %s", SDL_GetError());
+            return;
+        }
+        buffer->target_width = width;
+        buffer->target_height = height;
+        (void)SDL_SetTextureBlendMode(buffer->target, SDL_BLENDMODE_NONE);
+    }
+
+    (void)SDL_SetTextureScaleMode(buffer->target,
+                                  buffer->linear ? SDL_ScaleModeLinear :
+                                                   SDL_ScaleModeNearest);
+}
+
+
+/*
+ * Set up for drawing into a window of the given size.
+ */
+void
+sb_render_setup (SDL_Renderer *renderer,
+                 int           width,
+                 int           height)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+    SDL_RendererInfo       info;
+
+    buffer->width = width;
+    buffer->height = height;
+    buffer->software = (SDL_GetRendererInfo(renderer, &info) == 0 &&
+                        (info.flags & SDL_RENDERER_SOFTWARE));
+    buffer->scale = SB_RENDER_SCALE_MAX;
+    buffer->scale_changed = true;
+}
+
+
+/*
+ * Draw with the software compositor (see composite.h) on the given number
+ * of threads, rather than through SDL. Must be called straight after
+ * sb_render_setup, before any textures are created.
+ */
+bool
+sb_render_use_compositor (int threads)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+
+    buffer->compositing = sb_composite_setup(buffer->width, buffer->height,
+                                             SB_RENDER_MAX_CMDS, threads);
+
+    return buffer->compositing;
+}
+
+
+/*
+ * Whether drawing into textures works - it doesn't with the compositor, as
+ * it can't see what was drawn.
+ */
+bool
+sb_render_targets_supported (SDL_Renderer *renderer)
+{
+    return (!sb_render_buffer.compositing &&
+            SDL_RenderTargetSupported(renderer));
+}
+
+
+/*
+ * Whether drawing happens on the CPU - with the compositor, or SDL's
+ * software renderer - so rotated and scaled copies are expensive.
+ */
+bool
+sb_render_is_software (void)
+{
+    return (sb_render_buffer.compositing || sb_render_buffer.software);
+}
+
+
+/*
+ * Create a texture from a surface. Textures drawn through the render buffer
+ * should be created this way (and freed with sb_render_destroy_texture) so
+ * the compositor can draw them.
+ */
+SDL_Texture *
+sb_render_create_texture (SDL_Renderer *renderer,
+                          SDL_Surface  *surf)
+{
+    if (surf == NULL) {
+        return NULL;
+    }
+
+    if (sb_render_buffer.compositing) {
+        return sb_composite_create_texture(renderer, surf);
+    }
+
+    return SDL_CreateTextureFromSurface(renderer, surf);
+}
+
+
+/*
+ * Replace an area of a texture made by sb_render_create_texture with ARGB
+ * pixels, pitch bytes to a row.
+ */
+void
+sb_render_update_texture (SDL_Texture    *texture,
+                          const SDL_Rect *rect,
+                          const uint32_t *pixels,
+                          int             pitch)
+{
+    if (texture == NULL) {
+        return;
+    }
+
+    if (sb_render_buffer.compositing) {
+        sb_composite_update_texture(texture, rect, pixels, pitch);
+    } else {
+        (void)SDL_UpdateTexture(texture, rect, pixels, pitch);
+    }
+}
+
+
+void
+sb_render_destroy_texture (SDL_Texture *texture)
+{
+    if (sb_render_buffer.compositing) {
+        sb_composite_destroy_texture(texture);
+    } else if (texture != NULL) {
+        SDL_DestroyTexture(texture);
+    }
+}
+
+
+void
+sb_render_cleanup (void)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+
+    if (buffer->compositing) {
+        sb_composite_cleanup();
+        buffer->compositing = false;
+    }
+
+    if (buffer->target != NULL) {
+        SDL_DestroyTexture(buffer->target);
+        buffer->target = NULL;
+    }
+}
+
+
+/*
+ * Change the internal render scale and the filter used to stretch it back
+ * up to the window. Takes effect from the next frame, so it is safe to call
+ * at any time.
+ */
+void
+sb_render_set_scale (float scale,
+                     bool  linear)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+
+    buffer->scale = MAX(SB_RENDER_SCALE_MIN, MIN(SB_RENDER_SCALE_MAX, scale));
+    buffer->linear = linear;
+    buffer->scale_changed = true;
+}
+
+
+float
+sb_render_get_scale (void)
+{
+    return sb_render_buffer.scale;
+}
+
+
+/*
+ * Start a frame - everything flushed from here until sb_render_frame_end
+ * goes to the internal target if rendering at a reduced scale.
+ */
+void
+sb_render_frame_begin (SDL_Renderer *renderer)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+
+    if (buffer->scale_changed) {
+        sb_render_update_target(renderer, buffer);
+    }
+
+    if (buffer->compositing) {
+        sb_composite_frame_begin(floorf(buffer->width * buffer->scale + 0.5f),
+                                 floorf(buffer->height * buffer->scale +
+                                        0.5f));
+    } else if (buffer->target != NULL) {
+        (void)SDL_SetRenderTarget(renderer, buffer->target);
+    }
+}
+
+
+/*
+ * Finish a frame, stretching the internal target over the window if there
+ * is one. The caller presents.
+ */
+void
+sb_render_frame_end (SDL_Renderer *renderer)
+{
+    sb_render_buffer_type *buffer = &sb_render_buffer;
+
+    if (buffer->compositing) {
+        sb_composite_frame_end(renderer, buffer->linear);
+        buffer->stats.draw_calls++;
+    } else if (buffer->target != NULL) {
+        (void)SDL_SetRenderTarget(renderer, NULL);
+        (void)SDL_RenderCopy(renderer, buffer->target, NULL, NULL);
+        buffer->stats.draw_calls++;
+    }
+
+    buffer->stats.frames++;
+}
+
+
+void
+sb_render_get_stats (sb_render_stats_type *stats)
+{
+    *stats = sb_render_buffer.stats;
+}
@@ -0,0 +1,94 @@
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+
+/*
+ * Draw calls are not made straight away - they are recorded as commands and
+ * submitted when the buffer is flushed (after each gamestate has drawn).
+ *
+ * Layers are drawn in increasing order. Within a layer commands are grouped
+ * by texture and colour to cut down on state changes, so the order of
+ * commands within a layer is not preserved - anything that has to appear on
+ * top of something else must be given a higher layer.
+ */
+typedef uint8_t sb_render_layer_type;
+
+
+/*
+ * Limits on the internal render scale. Below 1 the frame is drawn into a
+ * smaller target texture, with all layout scaled down to match, then
+ * stretched over the window in one copy - trading sharpness for fill rate.
+ * Everything outside this module keeps working in window coordinates.
+ */
+#define SB_RENDER_SCALE_MIN  0.5f
+#define SB_RENDER_SCALE_MAX  1.0f
+#define SB_RENDER_SCALE_STEP 0.125f
+
+
+/*
+ * Counts kept over the life of the buffer, for reporting.
+ *
+ * state_changes_unsorted is the number of texture, colour and blend changes
+ * that submitting commands in the order they were recorded would have
+ * needed; state_changes is the number actually made.
+ */
+typedef struct sb_render_stats {
+    uint64_t frames;
+    uint64_t commands;
+    uint64_t dropped;
+    uint64_t draw_calls;
+    uint64_t state_changes;
+    uint64_t state_changes_unsorted;
+} sb_render_stats_type;
+
+
+void sb_render_setup(SDL_Renderer *renderer, int width, int height);
+void sb_render_cleanup(void);
+bool sb_render_use_compositor(int threads);
+bool sb_render_targets_supported(SDL_Renderer *renderer);
+bool sb_render_is_software(void);
+SDL_Texture *sb_render_create_texture(SDL_Renderer *renderer,
+                                      SDL_Surface  *surf);
+void sb_render_update_texture(SDL_Texture    *texture,
+                              const SDL_Rect *rect,
+                              const uint32_t *pixels,
+                              int             pitch);
+void sb_render_destroy_texture(SDL_Texture *texture);
+void sb_render_set_scale(float scale, bool linear);
+float sb_render_get_scale(void);
+void sb_render_frame_begin(SDL_Renderer *renderer);
+void sb_render_frame_end(SDL_Renderer *renderer);
+void sb_render_clear(sb_render_layer_type layer, SDL_Color color);
+void sb_render_fill(sb_render_layer_type  layer,
+                    SDL_Color             color,
+                    const SDL_Rect       *rect);
+void sb_render_copy(sb_render_layer_type  layer,
+                    SDL_Texture          *texture,
+                    const SDL_Rect       *src,
+                    const SDL_Rect       *dst);
+void sb_render_copy_mod(sb_render_layer_type  layer,
+                        SDL_Texture          *texture,
+                        SDL_Color             color,
+                        const SDL_Rect       *src,
+                        const SDL_Rect       *dst);
+void sb_render_copy_ex(sb_render_layer_type  layer,
+                       SDL_Texture          *texture,
+                       const SDL_Rect       *src,
+                       const SDL_Rect       *dst,
+                       double                angle);
+void sb_render_strip(sb_render_layer_type  layer,
+                     SDL_Color             color,
+                     const SDL_FPoint     *points,
+                     size_t                count);
+void sb_render_quads(sb_render_layer_type  layer,
+                     const SDL_Vertex     *vertices,
+                     size_t                count);
+void sb_render_flush(SDL_Renderer *renderer);
+void sb_render_get_stats(sb_render_stats_type *stats);
+
+
+#endif /* __RENDER_H__ */
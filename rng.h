@@ -0,0 +1,66 @@
+#ifndef __RNG_H__
+#define __RNG_H__
+
+
+#include <stdint.h>
+
+
+/*
+ * Small seedable random number generator (xorshift32). Each game and bot
+ * keeps its own, so that a given seed always produces the same run, however
+ * many other instances are running alongside it.
+ */
+typedef struct sb_rng {
+    uint32_t state;
+} sb_rng_type;
+
+
+static inline void
+sb_rng_seed (sb_rng_type *rng,
+             uint32_t     seed)
+{
+    /*
+     * xorshift gets stuck on zero.
+     */
+    rng->state = seed != 0 ? seed : 1;
+}
+
+
+static inline uint32_t
+sb_rng_next (sb_rng_type *rng)
+{
+    uint32_t x = rng->state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng->state = x;
+
+    return x;
+}
+
+
+/*
+ * Find a random number in the closed interval [min, max].
+ */
+static inline uint32_t
+sb_rng_range (sb_rng_type *rng,
+              uint32_t     min,
+              uint32_t     max)
+{
+    return min + (uint32_t)(((uint64_t)sb_rng_next(rng) *
+                             ((uint64_t)max - min + 1)) >> 32);
+}
+
+
+/*
+ * Find a random number in [0, 1).
+ */
+static inline float
+sb_rng_float (sb_rng_type *rng)
+{
+    return (float)(sb_rng_next(rng) >> 8) / (float)(1 << 24);
+}
+
+
+#endif /* __RNG_H__ */
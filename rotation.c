@@ -0,0 +1,153 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "util.h"
+#include "render.h"
+#include "rotation.h"
+
+
+#define SB_ROTATION_ROWS \
+    ((SB_ROTATION_FRAMES + SB_ROTATION_COLUMNS - 1) / SB_ROTATION_COLUMNS)
+
+
+/*
+ * Scale surf to width x height, and make an empty atlas with room for
+ * every frame at that size.
+ */
+bool
+sb_rotation_setup (sb_rotation_type *rotation,
+                   SDL_Renderer     *renderer,
+                   SDL_Surface      *surf,
+                   int               width,
+                   int               height)
+{
+    SDL_Surface *atlas;
+
+    memset(rotation, 0, sizeof(*rotation));
+    if (surf == NULL || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    rotation->width = width;
+    rotation->height = height;
+    rotation->source = scale_surface(surf, width, height);
+    rotation->frame = malloc(width * height * sizeof(uint32_t));
+
+    atlas = SDL_CreateRGBSurfaceWithFormat(0, width * SB_ROTATION_COLUMNS,
+                                           height * SB_ROTATION_ROWS, 32,
+                                           SDL_PIXELFORMAT_ARGB8888);
+    if (atlas != NULL) {
+        rotation->atlas = sb_render_create_texture(renderer, atlas);
+        SDL_FreeSurface(atlas);
+    }
+
+    if (rotation->source == NULL || rotation->frame == NULL ||
+        rotation->atlas == NULL) {
+        sb_rotation_cleanup(rotation);
+        return false;
+    }
+
+    return true;
+}
+
+
+void
+sb_rotation_cleanup (sb_rotation_type *rotation)
+{
+    free_texture(rotation->atlas);
+    SDL_FreeSurface(rotation->source);
+    free(rotation->frame);
+    memset(rotation, 0, sizeof(*rotation));
+}
+
+
+static void
+sb_rotation_frame_rect (const sb_rotation_type *rotation,
+                        size_t                  frame,
+                        SDL_Rect               *rect)
+{
+    rect->x = (frame % SB_ROTATION_COLUMNS) * rotation->width;
+    rect->y = (frame / SB_ROTATION_COLUMNS) * rotation->height;
+    rect->w = rotation->width;
+    rect->h = rotation->height;
+}
+
+
+/*
+ * Rotate the source clockwise into a frame, by mapping each pixel centre
+ * back into the unrotated image, and upload it to its cell of the atlas.
+ */
+static void
+sb_rotation_build (sb_rotation_type *rotation,
+                   size_t            frame)
+{
+    const SDL_Surface *source = rotation->source;
+    uint32_t          *out = rotation->frame;
+    double             angle = DEG_TO_RAD(frame * 360.0 /
+                                          SB_ROTATION_FRAMES);
+    double             c = cos(angle);
+    double             s = sin(angle);
+    double             cx = rotation->width / 2.0;
+    double             cy = rotation->height / 2.0;
+    double             rx;
+    double             ry;
+    int                sx;
+    int                sy;
+    int                x;
+    int                y;
+    SDL_Rect           rect;
+
+    for (y = 0; y < rotation->height; y++) {
+        ry = y + 0.5 - cy;
+
+        for (x = 0; x < rotation->width; x++) {
+            rx = x + 0.5 - cx;
+            sx = (int)floor(rx * c + ry * s + cx);
+            sy = (int)floor(-rx * s + ry * c + cy);
+
+            if (sx < 0 || sy < 0 || sx >= source->w || sy >= source->h) {
+                *out++ = 0;
+            } else {
+                *out++ = ((const uint32_t *)((const uint8_t *)source->pixels +
+                                             sy * source->pitch))[sx];
+            }
+        }
+    }
+
+    sb_rotation_frame_rect(rotation, frame, &rect);
+    sb_render_update_texture(rotation->atlas, &rect, rotation->frame,
+                             rotation->width * sizeof(uint32_t));
+    rotation->built[frame] = true;
+}
+
+
+/*
+ * Draw the image rotated clockwise about the centre of dst by angle
+ * degrees.
+ */
+void
+sb_rotation_draw (sb_rotation_type     *rotation,
+                  sb_render_layer_type  layer,
+                  const SDL_Rect       *dst,
+                  double                angle)
+{
+    SDL_Rect src;
+    long     frame;
+
+    if (rotation->atlas == NULL) {
+        return;
+    }
+
+    frame = lround(angle * SB_ROTATION_FRAMES / 360.0) % SB_ROTATION_FRAMES;
+    if (frame < 0) {
+        frame += SB_ROTATION_FRAMES;
+    }
+
+    if (!rotation->built[frame]) {
+        sb_rotation_build(rotation, frame);
+    }
+
+    sb_rotation_frame_rect(rotation, frame, &src);
+    sb_render_copy(layer, rotation->atlas, &src, dst);
+}
@@ -0,0 +1,47 @@
+#ifndef __ROTATION_H__
+#define __ROTATION_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include "render.h"
+
+
+/*
+ * Pre-rotated frames of an image, for drawing it at any angle where
+ * rotated copies are expensive (see sb_render_is_software). Angles are
+ * rounded to the nearest of SB_ROTATION_FRAMES steps.
+ *
+ * The image is scaled to the size it is drawn at once, at setup, and each
+ * frame is rotated from that (nearest-neighbour, about the centre) the
+ * first time it is drawn, into its cell of an atlas texture. Drawing is
+ * then a plain copy, and never allocates. Anything that rotates out of the
+ * frame's rect is cut off, so this suits round images like the dial.
+ */
+#define SB_ROTATION_FRAMES  360
+#define SB_ROTATION_COLUMNS 19
+
+typedef struct sb_rotation {
+    SDL_Texture *atlas;
+    SDL_Surface *source;
+    uint32_t    *frame;
+    int          width;
+    int          height;
+    bool         built[SB_ROTATION_FRAMES];
+} sb_rotation_type;
+
+
+bool sb_rotation_setup(sb_rotation_type *rotation,
+                       SDL_Renderer     *renderer,
+                       SDL_Surface      *surf,
+                       int               width,
+                       int               height);
+void sb_rotation_cleanup(sb_rotation_type *rotation);
+void sb_rotation_draw(sb_rotation_type     *rotation,
+                      sb_render_layer_type  layer,
+                      const SDL_Rect       *dst,
+                      double                angle);
+
+
+#endif /* __ROTATION_H__ */
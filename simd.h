@@ -0,0 +1,101 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+
+#include <math.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "common.h"
+
+
+/*
+ * Four lanes of floats, for the structure of arrays simulations (cable and
+ * particle physics). SSE where it is available, plain C otherwise. Loads
+ * and stores don't need to be aligned.
+ *
+ * Doesn't need SDL.
+ */
+#ifdef __SSE2__
+typedef __m128 sb_simd_type;
+
+#define sb_simd_load(p)     _mm_loadu_ps(p)
+#define sb_simd_store(p, v) _mm_storeu_ps((p), (v))
+#define sb_simd_set(f)      _mm_set1_ps(f)
+#define sb_simd_add(a, b)   _mm_add_ps((a), (b))
+#define sb_simd_sub(a, b)   _mm_sub_ps((a), (b))
+#define sb_simd_mul(a, b)   _mm_mul_ps((a), (b))
+#define sb_simd_div(a, b)   _mm_div_ps((a), (b))
+#define sb_simd_max(a, b)   _mm_max_ps((a), (b))
+#define sb_simd_sqrt(a)     _mm_sqrt_ps(a)
+#else
+typedef struct {
+    float v[4];
+} sb_simd_type;
+
+
+static inline sb_simd_type
+sb_simd_load (const float *p)
+{
+    sb_simd_type result;
+
+    memcpy(result.v, p, sizeof(result.v));
+
+    return result;
+}
+
+
+static inline void
+sb_simd_store (float        *p,
+               sb_simd_type  a)
+{
+    memcpy(p, a.v, sizeof(a.v));
+}
+
+
+static inline sb_simd_type
+sb_simd_set (float f)
+{
+    sb_simd_type result = { { f, f, f, f } };
+
+    return result;
+}
+
+
+#define SB_SIMD_OP(name, expr)                                              \
+    static inline sb_simd_type                                              \
+    name (sb_simd_type a,                                                   \
+          sb_simd_type b)                                                   \
+    {                                                                       \
+        int i;                                                              \
+                                                                            \
+        for (i = 0; i < 4; i++) {                                           \
+            a.v[i] = (expr);                                                \
+        }                                                                   \
+                                                                            \
+        return a;                                                           \
+    }
+
+SB_SIMD_OP(sb_simd_add, a.v[i] + b.v[i])
+SB_SIMD_OP(sb_simd_sub, a.v[i] - b.v[i])
+SB_SIMD_OP(sb_simd_mul, a.v[i] * b.v[i])
+SB_SIMD_OP(sb_simd_div, a.v[i] / b.v[i])
+SB_SIMD_OP(sb_simd_max, MAX(a.v[i], b.v[i]))
+
+
+static inline sb_simd_type
+sb_simd_sqrt (sb_simd_type a)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        a.v[i] = sqrtf(a.v[i]);
+    }
+
+    return a;
+}
+#endif
+
+
+#endif /* __SIMD_H__ */
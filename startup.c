@@ -0,0 +1,512 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+#include "common.h"
+#include "startup.h"
+
+
+/*
+ * The game's own files, evicted from the page cache before a cold run when
+ * the whole cache can't be dropped.
+ */
+#define SB_STARTUP_MEDIA_DIR "media"
+
+
+typedef enum {
+    SB_STARTUP_DROP_NONE,
+    SB_STARTUP_DROP_FILES,
+    SB_STARTUP_DROP_ALL,
+} sb_startup_drop_type;
+
+
+typedef struct sb_startup {
+    bool                  running;
+    uint64_t              start;
+    uint64_t              last;
+    double                total_ms;
+    sb_startup_entry_type entries[SB_STARTUP_MAX_ENTRIES];
+    size_t                count;
+} sb_startup_type;
+
+
+/*
+ * Timings sent back by one --startup-runs child. wall_ms is from just
+ * before it was forked to its total arriving, so also covers exec and
+ * dynamic linking.
+ */
+typedef struct sb_startup_run {
+    sb_startup_entry_type entries[SB_STARTUP_MAX_ENTRIES];
+    size_t                count;
+    double                total_ms;
+    double                wall_ms;
+} sb_startup_run_type;
+
+
+static sb_startup_type sb_startup;
+
+
+static double
+sb_startup_ms (uint64_t start,
+               uint64_t end)
+{
+    return (end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+
+static sb_startup_entry_type *
+sb_startup_add (const char *name)
+{
+    sb_startup_type       *startup = &sb_startup;
+    sb_startup_entry_type *entry;
+
+    if (!startup->running || startup->count == SB_STARTUP_MAX_ENTRIES) {
+        return NULL;
+    }
+
+    entry = &startup->entries[startup->count++];
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+
+    return entry;
+}
+
+
+/*
+ * Start the clock. Call first thing in main().
+ */
+void
+sb_startup_begin (void)
+{
+    sb_startup_type *startup = &sb_startup;
+
+    memset(startup, 0, sizeof(*startup));
+    startup->running = true;
+    startup->start = SDL_GetPerformanceCounter();
+    startup->last = startup->start;
+}
+
+
+/*
+ * Record the phase that has just finished, and start timing the next.
+ */
+void
+sb_startup_mark (const char *phase)
+{
+    sb_startup_type       *startup = &sb_startup;
+    sb_startup_entry_type *entry;
+    uint64_t               now = SDL_GetPerformanceCounter();
+
+    entry = sb_startup_add(phase);
+    if (entry != NULL) {
+        entry->ms = sb_startup_ms(startup->last, now);
+    }
+    startup->last = now;
+}
+
+
+/*
+ * Record an asset loaded during the current phase.
+ */
+void
+sb_startup_asset (const char *name,
+                  double      decode_ms,
+                  double      upload_ms)
+{
+    sb_startup_entry_type *entry;
+
+    entry = sb_startup_add(name);
+    if (entry != NULL) {
+        entry->asset = true;
+        entry->ms = decode_ms;
+        entry->upload_ms = upload_ms;
+    }
+}
+
+
+/*
+ * Stop recording - the first frame is up.
+ */
+void
+sb_startup_end (void)
+{
+    sb_startup_type *startup = &sb_startup;
+
+    if (startup->running) {
+        startup->total_ms = sb_startup_ms(startup->start,
+                                          SDL_GetPerformanceCounter());
+        startup->running = false;
+    }
+}
+
+
+bool
+sb_startup_running (void)
+{
+    return sb_startup.running;
+}
+
+
+/*
+ * Print each phase with the assets loaded during it underneath (which
+ * are recorded before the phase itself is). raw prints one tab separated
+ * line per entry instead, for sb_startup_bench to read back.
+ */
+void
+sb_startup_print (bool raw)
+{
+    sb_startup_type             *startup = &sb_startup;
+    const sb_startup_entry_type *entry;
+    size_t                       first_asset = 0;
+    size_t                       i;
+    size_t                       j;
+
+    if (raw) {
+        for (i = 0; i < startup->count; i++) {
+            entry = &startup->entries[i];
+            if (entry->asset) {
+                printf("asset\t%.3f\t%.3f\t%s\n", entry->ms,
+                       entry->upload_ms, entry->name);
+            } else {
+                printf("phase\t%.3f\t%s\n", entry->ms, entry->name);
+            }
+        }
+        printf("total\t%.3f\n", startup->total_ms);
+        fflush(stdout);
+        return;
+    }
+
+    printf("Startup (%.1f ms to first frame):\n", startup->total_ms);
+    printf("  %-36s %9s\n", "phase", "ms");
+    for (i = 0; i < startup->count; i++) {
+        entry = &startup->entries[i];
+        if (entry->asset) {
+            continue;
+        }
+
+        printf("  %-36s %9.2f\n", entry->name, entry->ms);
+        for (j = first_asset; j < i; j++) {
+            printf("    %-34s %9.2f decode %6.2f upload\n",
+                   startup->entries[j].name, startup->entries[j].ms,
+                   startup->entries[j].upload_ms);
+        }
+        first_asset = i + 1;
+    }
+}
+
+
+/*
+ * Ask the kernel to drop a file's pages from the page cache.
+ */
+static bool
+sb_startup_evict_file (const char *filename)
+{
+    bool result;
+    int  fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    result = (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0);
+    close(fd);
+
+    return result;
+}
+
+
+/*
+ * Evict every file under a directory. Returns how many were evicted.
+ */
+static int
+sb_startup_evict_dir (const char *dirname)
+{
+    DIR           *dir;
+    struct dirent *ent;
+    struct stat    st;
+    char           path[512];
+    int            result = 0;
+
+    dir = opendir(dirname);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dirname, ent->d_name);
+        if (stat(path, &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            result += sb_startup_evict_dir(path);
+        } else if (S_ISREG(st.st_mode) && sb_startup_evict_file(path)) {
+            result++;
+        }
+    }
+    closedir(dir);
+
+    return result;
+}
+
+
+/*
+ * Get the next run off to a cold start. Dropping the whole page cache
+ * needs root; without it, the game's media and executable are evicted,
+ * which leaves the system libraries cached.
+ */
+static sb_startup_drop_type
+sb_startup_drop_caches (const char *exe)
+{
+    FILE *file;
+    bool  dropped;
+    int   evicted;
+
+    sync();
+
+    file = fopen("/proc/sys/vm/drop_caches", "w");
+    if (file != NULL) {
+        dropped = (fputs("1\n", file) >= 0);
+        dropped = (fclose(file) == 0 && dropped);
+        if (dropped) {
+            return SB_STARTUP_DROP_ALL;
+        }
+    }
+
+    evicted = sb_startup_evict_dir(SB_STARTUP_MEDIA_DIR);
+    if (strchr(exe, '/') != NULL && sb_startup_evict_file(exe)) {
+        evicted++;
+    }
+
+    return (evicted > 0) ? SB_STARTUP_DROP_FILES : SB_STARTUP_DROP_NONE;
+}
+
+
+/*
+ * Read one line of sb_startup_print's raw output into run.
+ */
+static void
+sb_startup_parse (char                *line,
+                  sb_startup_run_type *run)
+{
+    sb_startup_entry_type *entry;
+    char                  *fields[4];
+    char                  *save;
+    size_t                 count = 0;
+
+    line[strcspn(line, "\n")] = '\0';
+    fields[0] = strtok_r(line, "\t", &save);
+    while (fields[count] != NULL && ++count < SDL_arraysize(fields)) {
+        fields[count] = strtok_r(NULL, "\t", &save);
+    }
+
+    if (count == 2 && strcmp(fields[0], "total") == 0) {
+        run->total_ms = strtod(fields[1], NULL);
+        return;
+    }
+    if (run->count == SB_STARTUP_MAX_ENTRIES) {
+        return;
+    }
+
+    entry = &run->entries[run->count];
+    memset(entry, 0, sizeof(*entry));
+    if (count == 3 && strcmp(fields[0], "phase") == 0) {
+        entry->ms = strtod(fields[1], NULL);
+        snprintf(entry->name, sizeof(entry->name), "%s", fields[2]);
+        run->count++;
+    } else if (count == 4 && strcmp(fields[0], "asset") == 0) {
+        entry->asset = true;
+        entry->ms = strtod(fields[1], NULL);
+        entry->upload_ms = strtod(fields[2], NULL);
+        snprintf(entry->name, sizeof(entry->name), "%s", fields[3]);
+        run->count++;
+    }
+}
+
+
+/*
+ * Run the game (argv, which must make it print its raw timings and exit
+ * after the first frame) and collect what it sends back. Returns false
+ * if it never got as far as a first frame.
+ */
+static bool
+sb_startup_run (char *const          argv[],
+                sb_startup_run_type *run)
+{
+    FILE    *output;
+    char     line[256];
+    uint64_t start;
+    pid_t    pid;
+    int      fds[2];
+    int      status;
+
+    memset(run, 0, sizeof(*run));
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    start = SDL_GetPerformanceCounter();
+    pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        (void)dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    output = fdopen(fds[0], "r");
+    if (output == NULL) {
+        close(fds[0]);
+    } else {
+        while (fgets(line, sizeof(line), output) != NULL) {
+            sb_startup_parse(line, run);
+            if (run->total_ms > 0.0 && run->wall_ms == 0.0) {
+                run->wall_ms = sb_startup_ms(start,
+                                             SDL_GetPerformanceCounter());
+            }
+        }
+        fclose(output);
+    }
+    (void)waitpid(pid, &status, 0);
+
+    return run->wall_ms > 0.0;
+}
+
+
+/*
+ * Print one line of the benchmark table: the cold run's time, and the
+ * mean and fastest of the warm ones.
+ */
+static void
+sb_startup_print_row (const char *indent,
+                      const char *name,
+                      double      cold_ms,
+                      double      warm_total_ms,
+                      double      warm_min_ms,
+                      int         warm_runs)
+{
+    printf("  %s%-*s %9.2f", indent, (int)(36 - strlen(indent)), name,
+           cold_ms);
+    if (warm_runs > 0) {
+        printf(" %9.2f %9.2f", warm_total_ms / warm_runs, warm_min_ms);
+    }
+    printf("\n");
+}
+
+
+/*
+ * Print entry i of the cold run against the same entry of the warm runs.
+ * Entries are matched up by position, as every run loads the same things
+ * in the same order; a warm run that doesn't match is left out.
+ */
+static void
+sb_startup_print_entry (const sb_startup_run_type *results,
+                        int                        runs,
+                        size_t                     i)
+{
+    const sb_startup_entry_type *entry = &results[0].entries[i];
+    const sb_startup_entry_type *warm;
+    double                       warm_total = 0.0;
+    double                       warm_min = HUGE_VAL;
+    int                          warm_runs = 0;
+    int                          run;
+
+    for (run = 1; run < runs; run++) {
+        warm = &results[run].entries[i];
+        if (i < results[run].count && strcmp(warm->name, entry->name) == 0) {
+            warm_total += warm->ms + warm->upload_ms;
+            warm_min = MIN(warm_min, warm->ms + warm->upload_ms);
+            warm_runs++;
+        }
+    }
+
+    sb_startup_print_row(entry->asset ? "  " : "", entry->name,
+                         entry->ms + entry->upload_ms, warm_total, warm_min,
+                         warm_runs);
+}
+
+
+/*
+ * Start the game runs times over from argv, the first time cold, and
+ * print each phase of the first run against the average of the others.
+ * Returns the exit status for main().
+ */
+int
+sb_startup_bench (char *const argv[],
+                  int         runs)
+{
+    static sb_startup_run_type  results[SB_STARTUP_MAX_RUNS];
+    static const char          *drop_names[] = {
+        "page cache not dropped",
+        "game files evicted from the page cache",
+        "page cache dropped",
+    };
+    const sb_startup_run_type  *cold = &results[0];
+    sb_startup_drop_type        drop;
+    double                      exec_total = 0.0;
+    double                      exec_min = HUGE_VAL;
+    double                      wall_total = 0.0;
+    double                      wall_min = HUGE_VAL;
+    int                         run;
+    size_t                      first_asset = 0;
+    size_t                      i;
+    size_t                      j;
+
+    runs = MAX(1, MIN(SB_STARTUP_MAX_RUNS, runs));
+    drop = sb_startup_drop_caches(argv[0]);
+
+    for (run = 0; run < runs; run++) {
+        if (!sb_startup_run(argv, &results[run])) {
+            fprintf(stderr, "Startup run %d didn't reach the first frame\n",
+                    run + 1);
+            return 1;
+        }
+        if (run > 0) {
+            exec_total += results[run].wall_ms - results[run].total_ms;
+            exec_min = MIN(exec_min,
+                           results[run].wall_ms - results[run].total_ms);
+            wall_total += results[run].wall_ms;
+            wall_min = MIN(wall_min, results[run].wall_ms);
+        }
+    }
+
+    printf("Startup benchmark (%d runs, first cold - %s):\n", runs,
+           drop_names[drop]);
+    printf("  %-36s %9s", "phase", "cold ms");
+    if (runs > 1) {
+        printf(" %9s %9s", "warm ms", "warm min");
+    }
+    printf("\n");
+
+    sb_startup_print_row("", "exec and link", cold->wall_ms - cold->total_ms,
+                         exec_total, exec_min, runs - 1);
+    for (i = 0; i < cold->count; i++) {
+        if (cold->entries[i].asset) {
+            continue;
+        }
+        sb_startup_print_entry(results, runs, i);
+        for (j = first_asset; j < i; j++) {
+            sb_startup_print_entry(results, runs, j);
+        }
+        first_asset = i + 1;
+    }
+    sb_startup_print_row("", "total", cold->wall_ms, wall_total, wall_min,
+                         runs - 1);
+
+    return 0;
+}
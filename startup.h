@@ -0,0 +1,48 @@
+#ifndef __STARTUP_H__
+#define __STARTUP_H__
+
+
+#include <stdbool.h>
+
+
+/*
+ * Startup profiler - times each phase from main() to the first presented
+ * frame, and each asset loaded along the way.
+ *
+ * main() calls sb_startup_mark as each phase finishes, which records the
+ * time since the previous mark under that phase's name. Assets loaded
+ * during a phase are recorded against it with sb_startup_asset: decode
+ * time (which may have happened on a job thread, in parallel with other
+ * assets) and upload time. sb_startup_end stops recording once the first
+ * frame is up, so loads after that cost nothing. All of these are only
+ * called from the main thread.
+ *
+ * sb_startup_bench runs the game as a child process several times over
+ * for --startup-runs, each exiting after its first frame and sending back
+ * its timings, and prints the first (cold) run against the rest (warm).
+ * Before the cold run it drops the page cache if it is allowed to, and
+ * otherwise evicts the game's own files from it.
+ */
+#define SB_STARTUP_MAX_ENTRIES 96
+#define SB_STARTUP_NAME_SIZE   48
+#define SB_STARTUP_MAX_RUNS    32
+
+
+typedef struct sb_startup_entry {
+    char   name[SB_STARTUP_NAME_SIZE];
+    bool   asset;
+    double ms;
+    double upload_ms;
+} sb_startup_entry_type;
+
+
+void sb_startup_begin(void);
+void sb_startup_mark(const char *phase);
+void sb_startup_asset(const char *name, double decode_ms, double upload_ms);
+void sb_startup_end(void);
+bool sb_startup_running(void);
+void sb_startup_print(bool raw);
+int sb_startup_bench(char *const argv[], int runs);
+
+
+#endif /* __STARTUP_H__ */
@@ -1,16 +1,948 @@
+#include <inttypes.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include "gamestate.h"
 #include "menu_main.h"
 #include "menu_pause.h"
 #include "endgame.h"
-#include "game.h"
+#include "play.h"
+#include "util.h"
+#include "bot.h"
+#include "metrics.h"
+#include "alloc.h"
+#include "capture.h"
+#include "composite.h"
+#include "blit.h"
+#include "job.h"
+#include "startup.h"
+#include "governor.h"
+#include "latency.h"
+#include "recorder.h"
+#include "ui.h"
+#include "render.h"
+#include "audio.h"
 
 
 static bool sb_run = true;
 
 
+/*
+ * --compositor-bench draws this many frames on each thread count, up to
+ * SB_COMPOSITOR_BENCH_THREADS.
+ */
+#define SB_COMPOSITOR_BENCH_FRAMES  200
+#define SB_COMPOSITOR_BENCH_THREADS 8
+
+
+/*
+ * --particle-bench plays this many frames of a bot game with no particles,
+ * then with SB_PARTICLE_BENCH_COUNT kept going, after letting each settle
+ * for half as many.
+ */
+#define SB_PARTICLE_BENCH_FRAMES 300
+#define SB_PARTICLE_BENCH_COUNT  10000
+
+
+/*
+ * Frame budget for the governor unless --frame-budget says otherwise - a
+ * little under a 60 Hz frame, to leave room for presenting.
+ */
+#define SB_FRAME_BUDGET_MS 14.0f
+
+
+/*
+ * Frames longer than this are written out by the hitch recorder unless
+ * --hitch-ms says otherwise - long enough that only a real stall, not a
+ * missed vsync or two, leaves a report behind.
+ */
+#define SB_HITCH_MS 100.0f
+
+
+/*
+ * --job-bench decodes every image this many times over on each thread
+ * count, up to SB_JOB_BENCH_THREADS.
+ */
+#define SB_JOB_BENCH_ROUNDS  8
+#define SB_JOB_BENCH_THREADS 8
+
+
+/*
+ * The bot, if it is playing, and whether it was playing the game last frame.
+ * Its input is sent as mouse events, from where its pointer last was.
+ */
+static sb_bot_type *sb_bot;
+static bool         sb_bot_playing;
+static uint32_t     sb_bot_idle_time;
+static bool         sb_bot_button_down;
+static int          sb_bot_mouse_x;
+static int          sb_bot_mouse_y;
+
+
+/*
+ * Options set from the command line.
+ */
+typedef struct sb_options {
+    bool                bot;
+    sb_bot_config_type  bot_config;
+    bool                render_stats;
+    size_t              lines;
+    sb_play_cursor_type cursor;
+    int                 audio_buffer;
+    bool                audio_stats;
+    bool                latency_stats;
+    float               render_scale;
+    bool                render_linear;
+    float               frame_budget;
+    float               hitch_ms;
+    bool                metrics;
+    bool                alloc_stats;
+    bool                alloc_strict;
+    const char         *capture_file;
+    uint32_t            capture_fps;
+    int                 compositor_threads;
+    bool                compositor_bench;
+    bool                compositor_check;
+    bool                particle_bench;
+    sb_blit_impl_type   blit_impl;
+    int                 jobs;
+    bool                job_bench;
+    bool                startup_bench;
+    bool                startup_raw;
+    int                 startup_runs;
+} sb_options_type;
+
+
+/*
+ * Print a summary of how much the render buffer saved, averaged per frame.
+ */
+static void
+sb_print_render_stats (void)
+{
+    sb_render_stats_type stats;
+    double               frames;
+
+    sb_render_get_stats(&stats);
+    if (stats.frames == 0) {
+        return;
+    }
+    frames = stats.frames;
+
+    printf("Render stats over %" PRIu64 " frames (per frame):\n",
+           stats.frames);
+    printf("  commands:                %.1f\n", stats.commands / frames);
+    printf("  draw calls:              %.1f\n", stats.draw_calls / frames);
+    printf("  state changes unsorted:  %.1f\n",
+           stats.state_changes_unsorted / frames);
+    printf("  state changes submitted: %.1f\n", stats.state_changes / frames);
+    printf("  state changes saved:     %.1f\n",
+           ((double)stats.state_changes_unsorted - stats.state_changes) /
+           frames);
+    if (stats.dropped != 0) {
+        printf("  dropped commands:        %" PRIu64 "\n", stats.dropped);
+    }
+}
+
+
+/*
+ * Print how the frame budget governor got on.
+ */
+static void
+sb_print_governor_stats (void)
+{
+    sb_governor_stats_type stats;
+
+    sb_governor_get_stats(&stats);
+    if (stats.frames == 0) {
+        return;
+    }
+
+    printf("Governor stats over %" PRIu64 " frames:\n", stats.frames);
+    printf("  frames over budget:      %" PRIu64 "\n", stats.frames_over);
+    printf("  quality drops:           %" PRIu64 "\n", stats.drops);
+    printf("  quality raises:          %" PRIu64 "\n", stats.raises);
+    printf("  final quality level:     %zu of %d\n", stats.level,
+           SB_GOVERNOR_LEVELS - 1);
+}
+
+
+/*
+ * Print how many hitches the recorder saw. Call after sb_recorder_cleanup
+ * so every report has been written.
+ */
+static void
+sb_print_recorder_stats (void)
+{
+    sb_recorder_stats_type stats;
+
+    sb_recorder_get_stats(&stats);
+    if (stats.frames == 0) {
+        return;
+    }
+
+    printf("Hitch recorder over %" PRIu64 " frames:\n", stats.frames);
+    printf("  hitches:                 %" PRIu64 "\n", stats.hitches);
+    printf("  reports written:         %" PRIu64 "\n", stats.written);
+    if (stats.skipped != 0) {
+        printf("  reports skipped:         %" PRIu64 "\n", stats.skipped);
+    }
+    if (stats.hitches != 0) {
+        printf("  worst frame:             %.1f ms\n", stats.worst_ms);
+    }
+}
+
+
+/*
+ * Print percentiles of the time from mouse input to the frame showing it
+ * being presented, for each kind of input.
+ */
+static void
+sb_print_latency_stats (void)
+{
+    sb_latency_stats_type stats;
+    size_t                i;
+
+    sb_latency_get_stats(&stats);
+    printf("Input latency (ms):\n");
+    printf("  %-12s %8s %5s %5s %5s %5s\n", "", "inputs", "p50", "p90",
+           "p99", "max");
+    for (i = 0; i < SB_LATENCY_KIND_COUNT; i++) {
+        if (stats.count[i] == 0) {
+            continue;
+        }
+        printf("  %-12s %8" PRIu64 " %5" PRIu32 " %5" PRIu32 " %5" PRIu32
+               " %5" PRIu32 "\n", sb_latency_kind_name(i), stats.count[i],
+               sb_latency_percentile(stats.hist[i], 50),
+               sb_latency_percentile(stats.hist[i], 90),
+               sb_latency_percentile(stats.hist[i], 99), stats.max_ms[i]);
+    }
+    if (stats.dropped != 0) {
+        printf("  not timed: %" PRIu64 "\n", stats.dropped);
+    }
+}
+
+
+/*
+ * Print the audio latency and voice counts. Call after sb_audio_cleanup so
+ * the audio thread has stopped.
+ */
+static void
+sb_print_audio_stats (void)
+{
+    sb_audio_stats_type stats;
+
+    sb_audio_get_stats(&stats);
+    printf("Audio stats (%" PRIu32 " Hz, %" PRIu32 " frame buffer):\n",
+           stats.frequency, stats.buffer_frames);
+    printf("  effects played:  %" PRIu64 "\n", stats.triggers);
+    printf("  effects dropped: %" PRIu64 "\n", stats.dropped);
+    printf("  peak voices:     %" PRIu32 "\n", stats.peak_voices);
+    if (stats.triggers != 0) {
+        printf("  latency mean:    %.2f ms\n",
+               stats.latency_total_ms / stats.triggers);
+        printf("  latency max:     %.2f ms\n", stats.latency_max_ms);
+    }
+}
+
+
+/*
+ * Draw at the scale the user asked for, or lower if the governor wants.
+ * Changing the scale may recreate the render target, so the allocation
+ * checks start warming up again.
+ */
+static void
+sb_apply_render_scale (const sb_options_type *options)
+{
+    sb_render_set_scale(MIN(options->render_scale,
+                            sb_governor_get_quality()->render_scale),
+                        options->render_linear);
+    sb_alloc_settle();
+}
+
+
+/*
+ * Handle keys that work whatever gamestate is running. Returns true if the
+ * event was used up.
+ */
+static bool
+sb_global_key_event (SDL_KeyboardEvent *e,
+                     sb_options_type   *options)
+{
+    switch (e->keysym.sym) {
+    case SDLK_F5:
+        options->render_scale -= SB_RENDER_SCALE_STEP;
+        break;
+
+    case SDLK_F6:
+        options->render_scale += SB_RENDER_SCALE_STEP;
+        break;
+
+    case SDLK_F7:
+        options->render_linear = !options->render_linear;
+        break;
+
+    default:
+        return false;
+    }
+
+    options->render_scale = MAX(SB_RENDER_SCALE_MIN,
+                                MIN(SB_RENDER_SCALE_MAX,
+                                    options->render_scale));
+    sb_apply_render_scale(options);
+
+    return true;
+}
+
+
+/*
+ * Print how the recording went, and how much it cost the main thread.
+ */
+static void
+sb_print_capture_stats (void)
+{
+    sb_capture_stats_type stats;
+
+    sb_capture_get_stats(&stats);
+    printf("Capture stats:\n");
+    printf("  frames captured: %" PRIu64 "\n", stats.captured);
+    printf("  frames dropped:  %" PRIu64 "\n", stats.dropped);
+    printf("  frames written:  %" PRIu64 " (+%" PRIu64 " repeats)\n",
+           stats.written, stats.repeated);
+    if (stats.captured > stats.dropped) {
+        printf("  readback mean:   %.2f ms\n",
+               stats.readback_total_ms / (stats.captured - stats.dropped));
+        printf("  readback max:    %.2f ms\n", stats.readback_max_ms);
+    }
+}
+
+
+/*
+ * Turn a piece of the bot's input into the mouse event a player's would
+ * arrive as, and hand it to the gamestates like one - so bot load goes
+ * through the same handling, camera and latency timing as play does.
+ */
+static void
+sb_bot_inject (const sb_game_input_type *input,
+               void                     *ctx)
+{
+    SDL_Event e;
+
+    memset(&e, 0, sizeof(e));
+    if (input->kind == SB_GAME_INPUT_MOTION) {
+        e.type = SDL_MOUSEMOTION;
+        e.motion.timestamp = SDL_GetTicks();
+        e.motion.state = sb_bot_button_down ? SDL_BUTTON_LMASK : 0;
+        e.motion.x = input->x;
+        e.motion.y = input->y;
+        e.motion.xrel = input->x - sb_bot_mouse_x;
+        e.motion.yrel = input->y - sb_bot_mouse_y;
+    } else {
+        sb_bot_button_down = (input->kind == SB_GAME_INPUT_BUTTON_DOWN);
+        e.type = sb_bot_button_down ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+        e.button.timestamp = SDL_GetTicks();
+        e.button.button = SDL_BUTTON_LEFT;
+        e.button.state = sb_bot_button_down ? SDL_PRESSED : SDL_RELEASED;
+        e.button.clicks = 1;
+        e.button.x = input->x;
+        e.button.y = input->y;
+    }
+
+    sb_bot_mouse_x = input->x;
+    sb_bot_mouse_y = input->y;
+    sb_gamestate_event(&e);
+}
+
+
+/*
+ * Make a new bot, playing through sb_bot_inject.
+ */
+static sb_bot_type *
+sb_create_bot (const sb_options_type *options)
+{
+    sb_bot_type *bot = sb_bot_create(&options->bot_config);
+
+    if (bot != NULL) {
+        sb_bot_set_input(bot, &sb_bot_inject, NULL);
+    }
+    sb_bot_button_down = false;
+
+    return bot;
+}
+
+
+/*
+ * Let the bot play. It only acts while the game is on top; at the end of a
+ * round (or on the main menu) it starts another once it has "noticed", and
+ * while paused it just waits.
+ */
+static void
+sb_bot_update (uint32_t         frametime,
+               sb_options_type *options)
+{
+    if (sb_gamestate_is_top(sb_play_get_gamestate())) {
+        sb_bot_playing = true;
+        sb_bot_step(sb_bot, sb_play_get_game(), frametime);
+        return;
+    }
+
+    if (sb_bot_playing) {
+        sb_bot_reset(sb_bot);
+        sb_bot_button_down = false;
+        sb_bot_playing = false;
+        sb_bot_idle_time = 0;
+    }
+
+    if (!sb_gamestate_is_top(sb_endgame_get_gamestate()) &&
+        !sb_gamestate_is_top(sb_menu_main_get_gamestate())) {
+        return;
+    }
+
+    sb_bot_idle_time += frametime;
+    if (sb_bot_idle_time >= options->bot_config.reaction_time) {
+        sb_bot_idle_time = 0;
+        sb_play_start();
+    }
+}
+
+
+static void
+sb_parse_options (int              argc,
+                  char            *argv[],
+                  sb_options_type *options)
+{
+    int i;
+
+    memset(options, 0, sizeof(*options));
+    options->bot_config.reaction_time = 400;
+    options->bot_config.accuracy = 0.95f;
+    options->bot_config.seed = 1;
+    options->audio_buffer = 512;
+    options->cursor = SB_PLAY_CURSOR_HARDWARE;
+    options->render_scale = 1.0f;
+    options->frame_budget = SB_FRAME_BUDGET_MS;
+    options->hitch_ms = SB_HITCH_MS;
+    options->capture_fps = 30;
+    options->blit_impl = SB_BLIT_IMPL_COUNT - 1;
+    options->jobs = SDL_GetCPUCount();
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bot") == 0) {
+            options->bot = true;
+        } else if (strcmp(argv[i], "--bot-reaction") == 0 && i + 1 < argc) {
+            options->bot_config.reaction_time = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--bot-accuracy") == 0 && i + 1 < argc) {
+            options->bot_config.accuracy = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--bot-seed") == 0 && i + 1 < argc) {
+            options->bot_config.seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+            options->lines = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cursor") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "hardware") == 0) {
+                options->cursor = SB_PLAY_CURSOR_HARDWARE;
+            } else if (strcmp(argv[i], "latched") == 0) {
+                options->cursor = SB_PLAY_CURSOR_LATCHED;
+            } else {
+                fprintf(stderr, "Unknown cursor %s\n", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--render-stats") == 0) {
+            options->render_stats = true;
+        } else if (strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc) {
+            options->audio_buffer = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--latency-stats") == 0) {
+            options->latency_stats = true;
+        } else if (strcmp(argv[i], "--audio-stats") == 0) {
+            options->audio_stats = true;
+        } else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+            options->render_scale = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--render-filter") == 0 && i + 1 < argc) {
+            options->render_linear = (strcmp(argv[++i], "linear") == 0);
+        } else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc) {
+            options->frame_budget = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--hitch-ms") == 0 && i + 1 < argc) {
+            options->hitch_ms = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            options->metrics = true;
+        } else if (strcmp(argv[i], "--alloc-stats") == 0) {
+            options->alloc_stats = true;
+        } else if (strcmp(argv[i], "--alloc-strict") == 0) {
+            options->alloc_strict = true;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            options->capture_file = argv[++i];
+        } else if (strcmp(argv[i], "--capture-fps") == 0 && i + 1 < argc) {
+            options->capture_fps = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--compositor") == 0 && i + 1 < argc) {
+            options->compositor_threads = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--compositor-bench") == 0) {
+            options->compositor_bench = true;
+        } else if (strcmp(argv[i], "--compositor-check") == 0) {
+            options->compositor_check = true;
+        } else if (strcmp(argv[i], "--particle-bench") == 0) {
+            options->particle_bench = true;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options->jobs = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--job-bench") == 0) {
+            options->job_bench = true;
+        } else if (strcmp(argv[i], "--startup-bench") == 0) {
+            options->startup_bench = true;
+        } else if (strcmp(argv[i], "--startup-runs") == 0 && i + 1 < argc) {
+            options->startup_runs = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--startup-raw") == 0) {
+            options->startup_bench = true;
+            options->startup_raw = true;
+        } else if (strcmp(argv[i], "--blit") == 0 && i + 1 < argc) {
+            if (!sb_blit_parse_impl(argv[++i], &options->blit_impl)) {
+                fprintf(stderr, "Unknown pixel kernels %s\n", argv[i]);
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+        }
+    }
+}
+
+
+static void
+sb_handle_event (SDL_Event       *e,
+                 sb_options_type *options)
+{
+    if (e->type == SDL_QUIT) {
+        sb_run = false;
+    } else if (e->type == SDL_RENDER_TARGETS_RESET) {
+        sb_ui_targets_reset();
+        sb_gamestate_event(e);
+    } else if (e->type == SDL_KEYDOWN &&
+               sb_global_key_event(&e->key, options)) {
+        return;
+    } else {
+        sb_gamestate_event(e);
+    }
+}
+
+
+/*
+ * Handle all the events that arrived since the last frame, returning how
+ * many were handled. A fast mouse can send dozens of motion events a
+ * frame, so runs of them are merged into one holding the latest position -
+ * any other event in between (e.g. a button press) ends the run, so it
+ * still sees the pointer where it was at the time, and events are handled
+ * in the order they happened. A merged event keeps the timestamp of the
+ * first in its run, so the input latency counted from it isn't understated.
+ */
+static uint32_t
+sb_pump_events (sb_options_type *options)
+{
+    SDL_Event e;
+    SDL_Event motion;
+    bool      motion_pending = false;
+    uint32_t  count = 0;
+
+    while (SDL_PollEvent(&e)) {
+        if (e.type == SDL_MOUSEMOTION) {
+            if (motion_pending && motion.motion.which == e.motion.which) {
+                e.motion.timestamp = motion.motion.timestamp;
+                e.motion.xrel += motion.motion.xrel;
+                e.motion.yrel += motion.motion.yrel;
+            } else if (motion_pending) {
+                sb_handle_event(&motion, options);
+                count++;
+            }
+            motion = e;
+            motion_pending = true;
+            continue;
+        }
+
+        if (motion_pending) {
+            sb_handle_event(&motion, options);
+            motion_pending = false;
+            count++;
+        }
+        sb_handle_event(&e, options);
+        count++;
+    }
+
+    if (motion_pending) {
+        sb_handle_event(&motion, options);
+        count++;
+    }
+
+    return count;
+}
+
+
+static void
+sb_draw_frame (SDL_Renderer *renderer)
+{
+    sb_render_frame_begin(renderer);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    sb_gamestate_draw(renderer);
+    sb_render_frame_end(renderer);
+}
+
+
+/*
+ * Hand the frame that has just finished to the hitch recorder. marks holds
+ * the performance counter at the start of the frame and at the end of each
+ * phase. Call before sb_alloc_frame_end, while the frame's allocations are
+ * still counted.
+ */
+static void
+sb_record_frame (uint64_t                 frame,
+                 uint32_t                 ticks,
+                 const uint64_t           marks[SB_RECORDER_PHASE_COUNT + 1],
+                 uint32_t                 events,
+                 const sb_gamestate_type *top)
+{
+    static sb_game_board_type board;
+    sb_recorder_frame_type    record;
+    double                    ms_per_count;
+    size_t                    i;
+
+    ms_per_count = 1000.0 / SDL_GetPerformanceFrequency();
+    record.frame = frame;
+    record.ticks = ticks;
+    record.frame_ms = (SDL_GetPerformanceCounter() - marks[0]) * ms_per_count;
+    for (i = 0; i < SB_RECORDER_PHASE_COUNT; i++) {
+        record.phase_ms[i] = (marks[i + 1] - marks[i]) * ms_per_count;
+    }
+    record.events = events;
+    record.gamestate = top->name;
+    record.gamestate_depth = sb_gamestate_get_depth();
+    record.quality = sb_governor_get_level();
+
+    sb_game_get_board(sb_play_get_game(), &board);
+    record.gametime = board.gametime;
+    memcpy(record.line_states, board.line_states,
+           sizeof(record.line_states));
+    record.held_cable = board.held_cable;
+    record.active_cable = board.active_cable;
+
+    sb_alloc_get_frame(&record.allocs, &record.alloc_bytes);
+    sb_recorder_frame(&record);
+}
+
+
+/*
+ * Time the compositor drawing the same stretch of a bot game on 1, 2, 4
+ * and 8 threads. Each run starts from the same snapshot with a fresh bot,
+ * so every run draws the same frames.
+ */
+static void
+sb_compositor_bench (SDL_Renderer    *renderer,
+                     sb_options_type *options)
+{
+    sb_composite_stats_type stats;
+    sb_game_type           *game = sb_play_get_game();
+    void                   *snapshot;
+    size_t                  snapshot_size;
+    uint64_t                start;
+    double                  frame_ms;
+    double                  base_ms = 0.0;
+    int                     threads;
+    int                     frame;
+
+    sb_play_start();
+    snapshot_size = sb_game_snapshot_size();
+    snapshot = malloc(snapshot_size);
+    (void)sb_game_snapshot(game, snapshot, snapshot_size);
+
+    printf("Compositor benchmark (%d frames per run, %s kernels):\n",
+           SB_COMPOSITOR_BENCH_FRAMES, sb_blit_impl_name(sb_blit_get_impl()));
+    printf("  threads  raster ms  upload ms  frame ms  speedup\n");
+
+    for (threads = 1; threads <= SB_COMPOSITOR_BENCH_THREADS; threads *= 2) {
+        sb_composite_set_threads(threads);
+        sb_bot_destroy(sb_bot);
+        sb_bot = sb_create_bot(options);
+        sb_play_start();
+        (void)sb_game_restore(game, snapshot, snapshot_size);
+
+        /*
+         * Let the board fill up with calls before timing anything.
+         */
+        for (frame = 0; frame < SB_COMPOSITOR_BENCH_FRAMES; frame++) {
+            sb_bot_update(16, options);
+            sb_gamestate_update(16);
+        }
+
+        sb_composite_reset_stats();
+        start = SDL_GetPerformanceCounter();
+        for (frame = 0; frame < SB_COMPOSITOR_BENCH_FRAMES; frame++) {
+            sb_bot_update(16, options);
+            sb_gamestate_update(16);
+            sb_draw_frame(renderer);
+            SDL_RenderPresent(renderer);
+        }
+        frame_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+                   SDL_GetPerformanceFrequency() / SB_COMPOSITOR_BENCH_FRAMES;
+        sb_composite_get_stats(&stats);
+
+        if (threads == 1) {
+            base_ms = frame_ms;
+        }
+        printf("  %7d  %9.2f  %9.2f  %8.2f  %6.2fx\n", threads,
+               stats.raster_ms / stats.frames, stats.upload_ms / stats.frames,
+               frame_ms, base_ms / frame_ms);
+    }
+
+    free(snapshot);
+}
+
+
+/*
+ * Compare the compositor's drawing with SDL's software renderer, on the
+ * --compositor threads (or all of them) and the --blit kernels. Returns
+ * the exit status: 0 if every draw that should match did.
+ */
+static int
+sb_compositor_check (const sb_options_type *options)
+{
+    sb_composite_check_type results[32];
+    size_t                  count;
+    size_t                  i;
+    int                     threads;
+    int                     status = 0;
+
+    threads = options->compositor_threads > 0 ? options->compositor_threads :
+                                                options->jobs;
+    (void)sb_job_setup(threads);
+    if (!sb_blit_setup(options->blit_impl)) {
+        fprintf(stderr, "Pixel kernels failed their self-check, using %s\n",
+                sb_blit_impl_name(sb_blit_get_impl()));
+    }
+    if (!sb_composite_setup(800, 600, 16, threads)) {
+        fprintf(stderr, "Unable to start the compositor\n");
+        sb_job_cleanup();
+        return 1;
+    }
+
+    count = sb_composite_check(results, SDL_arraysize(results));
+    if (count == 0) {
+        fprintf(stderr, "Unable to draw with SDL's software renderer\n");
+        status = 1;
+    } else {
+        printf("Compositor check against SDL's software renderer "
+               "(%d threads, %s kernels):\n", threads,
+               sb_blit_impl_name(sb_blit_get_impl()));
+        printf("  draw            pixels  differ  max diff\n");
+    }
+    for (i = 0; i < count; i++) {
+        printf("  %-14s  %6zu  %6zu  %8u%s\n", results[i].name,
+               results[i].pixels, results[i].differ, results[i].max_diff,
+               results[i].exact ? "" : "  (not expected to match)");
+        if (results[i].exact && results[i].differ > 0) {
+            status = 1;
+        }
+    }
+
+    sb_composite_cleanup();
+    sb_job_cleanup();
+
+    return status;
+}
+
+
+/*
+ * Time whole frames of a bot game, as it would be played, with and without
+ * the particle stress test. Both runs start from the same snapshot with a
+ * fresh bot.
+ */
+static void
+sb_particle_bench (SDL_Renderer    *renderer,
+                   sb_options_type *options)
+{
+    SDL_RendererInfo  info;
+    sb_game_type     *game = sb_play_get_game();
+    void             *snapshot;
+    size_t            snapshot_size;
+    size_t            counts[] = { 0, SB_PARTICLE_BENCH_COUNT };
+    uint64_t          start;
+    uint64_t          frame_start;
+    double            frame_ms;
+    double            worst_ms;
+    size_t            i;
+    int               frame;
+
+    sb_play_start();
+    snapshot_size = sb_game_snapshot_size();
+    snapshot = malloc(snapshot_size);
+    (void)sb_game_snapshot(game, snapshot, snapshot_size);
+
+    if (SDL_GetRendererInfo(renderer, &info) != 0) {
+        info.name = "unknown";
+    }
+    printf("Particle benchmark (%d frames per run, %s):\n",
+           SB_PARTICLE_BENCH_FRAMES,
+           options->compositor_threads > 0 ? "compositor" : info.name);
+    printf("  particles  frame ms  worst ms     fps\n");
+
+    for (i = 0; i < SDL_arraysize(counts); i++) {
+        sb_bot_destroy(sb_bot);
+        sb_bot = sb_create_bot(options);
+        sb_play_start();
+        (void)sb_game_restore(game, snapshot, snapshot_size);
+        sb_play_set_particle_stress(counts[i]);
+
+        for (frame = 0; frame < SB_PARTICLE_BENCH_FRAMES / 2; frame++) {
+            sb_bot_update(16, options);
+            sb_gamestate_update(16);
+            sb_draw_frame(renderer);
+            SDL_RenderPresent(renderer);
+        }
+
+        worst_ms = 0.0;
+        start = SDL_GetPerformanceCounter();
+        for (frame = 0; frame < SB_PARTICLE_BENCH_FRAMES; frame++) {
+            frame_start = SDL_GetPerformanceCounter();
+            sb_bot_update(16, options);
+            sb_gamestate_update(16);
+            sb_draw_frame(renderer);
+            SDL_RenderPresent(renderer);
+            frame_ms = (SDL_GetPerformanceCounter() - frame_start) * 1000.0 /
+                       SDL_GetPerformanceFrequency();
+            worst_ms = MAX(worst_ms, frame_ms);
+        }
+        frame_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+                   SDL_GetPerformanceFrequency() / SB_PARTICLE_BENCH_FRAMES;
+
+        printf("  %9zu  %8.2f  %8.2f  %6.1f\n", counts[i], frame_ms,
+               worst_ms, 1000.0 / frame_ms);
+    }
+
+    sb_play_set_particle_stress(0);
+    free(snapshot);
+}
+
+
+typedef struct sb_job_bench {
+    char         filenames[64][128];
+    size_t       count;
+    SDL_Surface *surfs[SB_JOB_BENCH_ROUNDS * 64];
+} sb_job_bench_type;
+
+
+static void
+sb_job_bench_decode (void   *data,
+                     size_t  begin,
+                     size_t  end)
+{
+    sb_job_bench_type *bench = data;
+    size_t             i;
+
+    for (i = begin; i < end; i++) {
+        bench->surfs[i] = IMG_Load(bench->filenames[i % bench->count]);
+    }
+}
+
+
+/*
+ * Time decoding all the game's images, as loading does, on 1, 2, 4 and 8
+ * threads of the job system.
+ */
+static void
+sb_job_bench (void)
+{
+    static sb_job_bench_type bench;
+    static const char       *images[] = {
+        "panel", "console", "port", "light", "plug_connected",
+        "plug_loose", "mug_background", "speech_bubble", "button",
+        "button_flash", "cord_hole", "rotary", "rotary_top",
+    };
+    sb_job_counter_type      counter = SB_JOB_COUNTER_INIT;
+    sb_job_stats_type        stats;
+    SDL_RWops               *file;
+    uint64_t                 start;
+    double                   ms;
+    double                   base_ms = 0.0;
+    size_t                   total;
+    size_t                   i;
+    unsigned                 threads;
+
+    for (i = 0; i < SDL_arraysize(images); i++) {
+        snprintf(bench.filenames[bench.count++], sizeof(bench.filenames[0]),
+                 "media/%s.png", images[i]);
+    }
+    for (i = 1; bench.count < SDL_arraysize(bench.filenames); i++) {
+        snprintf(bench.filenames[bench.count], sizeof(bench.filenames[0]),
+                 "media/mugshots/%zu.png", i);
+        file = SDL_RWFromFile(bench.filenames[bench.count], "rb");
+        if (file == NULL) {
+            break;
+        }
+        SDL_RWclose(file);
+        bench.count++;
+    }
+    total = bench.count * SB_JOB_BENCH_ROUNDS;
+
+    printf("Job system benchmark (%zu images decoded %d times):\n",
+           bench.count, SB_JOB_BENCH_ROUNDS);
+    printf("  threads   time ms  speedup  stolen\n");
+
+    for (threads = 1; threads <= SB_JOB_BENCH_THREADS; threads *= 2) {
+        (void)sb_job_setup(threads);
+        start = SDL_GetPerformanceCounter();
+        sb_job_parallel_for(total, 1, &sb_job_bench_decode, &bench,
+                            &counter);
+        sb_job_wait(&counter);
+        ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+             SDL_GetPerformanceFrequency();
+        sb_job_get_stats(&stats);
+        sb_job_cleanup();
+
+        for (i = 0; i < total; i++) {
+            SDL_FreeSurface(bench.surfs[i]);
+            bench.surfs[i] = NULL;
+        }
+
+        if (threads == 1) {
+            base_ms = ms;
+        }
+        printf("  %7u  %8.1f  %6.2fx  %6" PRIu64 "\n", threads, ms,
+               base_ms / ms, stats.stolen);
+    }
+}
+
+
+/*
+ * --startup-bench --startup-runs N: start the game N times over with the
+ * same options, each one printing its timings raw and exiting after the
+ * first frame, and print how they compare.
+ */
+static int
+sb_startup_bench_runs (int   argc,
+                       char *argv[],
+                       int   runs)
+{
+    char **child_argv;
+    int    child_argc = 0;
+    int    result;
+    int    i;
+
+    child_argv = calloc(argc + 2, sizeof(child_argv[0]));
+    if (child_argv == NULL) {
+        return 1;
+    }
+
+    child_argv[child_argc++] = argv[0];
+    child_argv[child_argc++] = "--startup-raw";
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--startup-runs") == 0 && i + 1 < argc) {
+            i++;
+        } else if (strcmp(argv[i], "--startup-bench") != 0) {
+            child_argv[child_argc++] = argv[i];
+        }
+    }
+
+    result = sb_startup_bench(child_argv, runs);
+    free(child_argv);
+
+    return result;
+}
+
+
 void
 sb_exit (void)
 {
@@ -21,60 +953,225 @@ sb_exit (void)
 int
 main (int argc, char *argv[])
 {
-    SDL_Window          *window;
-    SDL_Renderer        *renderer;
-    SDL_Event            e;
-    uint32_t             last_ticks = 0;
-    uint32_t             ticks;
-    uint32_t             frametime;
+    SDL_Window              *window;
+    SDL_Renderer            *renderer;
+    uint32_t                 last_ticks = 0;
+    uint32_t                 ticks;
+    uint32_t                 frametime;
+    uint64_t                 marks[SB_RECORDER_PHASE_COUNT + 1];
+    uint64_t                 frame = 0;
+    uint32_t                 events;
+    sb_options_type          options;
+    sb_gamestate_type       *gamestates[4];
+    const sb_gamestate_type *top;
+
+    sb_startup_begin();
+    sb_parse_options(argc, argv, &options);
+
+    if (options.job_bench) {
+        sb_job_bench();
+        return 0;
+    }
+    if (options.compositor_check) {
+        return sb_compositor_check(&options);
+    }
+    if (options.startup_bench && options.startup_runs > 0) {
+        return sb_startup_bench_runs(argc, argv, options.startup_runs);
+    }
 
     // TODO: Error handling basically everywhere!
 
-    (void)SDL_Init(SDL_INIT_VIDEO);
+    /*
+     * The hitch recorder notes each frame's allocations too.
+     */
+    if (options.alloc_stats || options.alloc_strict || options.hitch_ms > 0) {
+        sb_alloc_setup(options.alloc_strict);
+    }
+
+    (void)SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+    sb_startup_mark("SDL_Init");
+    if (options.compositor_bench) {
+        options.compositor_threads = SB_COMPOSITOR_BENCH_THREADS;
+    }
+    if (!sb_job_setup(MAX(options.jobs, options.compositor_threads))) {
+        fprintf(stderr, "Unable to start all the job threads\n");
+    }
+    sb_startup_mark("job system");
     window = SDL_CreateWindow("Switchboard",
                               SDL_WINDOWPOS_UNDEFINED,
                               SDL_WINDOWPOS_UNDEFINED,
                               800, 600,
                               SDL_WINDOW_SHOWN);
+    sb_startup_mark("window");
     renderer = SDL_CreateRenderer(window, -1, 0);
+    sb_startup_mark("renderer");
     (void)SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    sb_render_setup(renderer, 800, 600);
+    if (options.compositor_threads > 0 && !sb_blit_setup(options.blit_impl)) {
+        fprintf(stderr, "Pixel kernels failed their self-check, using %s\n",
+                sb_blit_impl_name(sb_blit_get_impl()));
+    }
+    if (options.compositor_threads > 0 &&
+        !sb_render_use_compositor(options.compositor_threads)) {
+        fprintf(stderr, "Unable to start the compositor\n");
+        options.compositor_bench = false;
+    }
+    sb_governor_setup(options.frame_budget);
+    sb_apply_render_scale(&options);
+    sb_startup_mark("render setup");
     (void)TTF_Init();
+    sb_startup_mark("TTF_Init");
+    (void)sb_audio_setup(options.audio_buffer);
+    sb_startup_mark("audio");
+    if (options.capture_file != NULL &&
+        !sb_capture_setup(renderer, options.capture_file,
+                          options.capture_fps)) {
+        fprintf(stderr, "Unable to record to %s\n", options.capture_file);
+        options.capture_file = NULL;
+    }
+    if (options.metrics && !sb_metrics_setup()) {
+        fprintf(stderr, "Unable to create metrics segment %s\n",
+                SB_METRICS_SHM_NAME);
+    }
+    sb_startup_mark("capture and metrics");
 
-    sb_game_setup(renderer);
+    /*
+     * The bot's pointer isn't the mouse, and recordings don't show the
+     * mouse cursor.
+     */
+    sb_play_setup(renderer, options.lines);
+    if (options.bot || options.compositor_bench || options.particle_bench) {
+        sb_play_set_cursor(SB_PLAY_CURSOR_GAME);
+    } else if (options.capture_file != NULL) {
+        sb_play_set_cursor(SB_PLAY_CURSOR_LATCHED);
+    } else {
+        sb_play_set_cursor(options.cursor);
+    }
+    sb_startup_mark("play setup");
     sb_endgame_setup(renderer);
+    sb_startup_mark("endgame setup");
     sb_menu_pause_setup(renderer);
+    sb_startup_mark("pause menu setup");
     sb_menu_main_setup(renderer);
+    sb_startup_mark("main menu setup");
     sb_gamestate_push(sb_menu_main_get_gamestate());
 
+    /*
+     * Only have SDL queue the events something will look at - the global
+     * keys need key presses, and the menu caches render target resets,
+     * whatever is running.
+     */
+    gamestates[0] = sb_play_get_gamestate();
+    gamestates[1] = sb_endgame_get_gamestate();
+    gamestates[2] = sb_menu_pause_get_gamestate();
+    gamestates[3] = sb_menu_main_get_gamestate();
+    sb_gamestate_filter_events(gamestates, SDL_arraysize(gamestates),
+                               SB_GAMESTATE_EVENTS_KEY |
+                               SB_GAMESTATE_EVENTS_RENDER);
+
+    if (options.compositor_bench) {
+        sb_compositor_bench(renderer, &options);
+        sb_run = false;
+    } else if (options.particle_bench) {
+        sb_particle_bench(renderer, &options);
+        sb_run = false;
+    } else if (options.bot) {
+        sb_bot = sb_create_bot(&options);
+        sb_play_start();
+    } else {
+        /*
+         * Carry on with the last round if it didn't finish.
+         */
+        (void)sb_play_resume();
+    }
+    sb_recorder_setup(options.hitch_ms);
+    sb_startup_mark("game start");
+
     while (sb_run) {
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT) {
-                sb_run = false;
-            } else {
-                sb_gamestate_event(&e);
-            }
-        }
+        marks[0] = SDL_GetPerformanceCounter();
+        sb_alloc_frame_begin();
+        events = sb_pump_events(&options);
+        marks[SB_RECORDER_PHASE_EVENTS + 1] = SDL_GetPerformanceCounter();
+        sb_job_run_main();
+        marks[SB_RECORDER_PHASE_JOBS + 1] = SDL_GetPerformanceCounter();
 
         ticks = SDL_GetTicks();
         frametime = ticks - last_ticks;
         last_ticks = ticks;
 
+        if (sb_bot != NULL) {
+            sb_bot_update(frametime, &options);
+        }
+
         sb_gamestate_update(frametime);
+        marks[SB_RECORDER_PHASE_UPDATE + 1] = SDL_GetPerformanceCounter();
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
-        sb_gamestate_draw(renderer);
+        sb_draw_frame(renderer);
+        sb_latency_frame_drawn();
+        marks[SB_RECORDER_PHASE_DRAW + 1] = SDL_GetPerformanceCounter();
+        sb_capture_frame(renderer, ticks);
+        if (sb_governor_frame((SDL_GetPerformanceCounter() - marks[0]) *
+                              1000.0 / SDL_GetPerformanceFrequency())) {
+            sb_apply_render_scale(&options);
+        }
+        marks[SB_RECORDER_PHASE_CAPTURE + 1] = SDL_GetPerformanceCounter();
         SDL_RenderPresent(renderer);
+        sb_latency_frame_presented(SDL_GetTicks());
+        marks[SB_RECORDER_PHASE_PRESENT + 1] = SDL_GetPerformanceCounter();
+
+        if (sb_startup_running()) {
+            sb_startup_mark("first frame");
+            sb_startup_end();
+            if (options.startup_bench) {
+                sb_startup_print(options.startup_raw);
+                sb_run = false;
+            }
+        }
+
+        sb_metrics_publish(frametime, sb_governor_get_level(),
+                           sb_play_get_game());
+
+        top = sb_gamestate_get_top();
+        sb_record_frame(frame++, ticks, marks, events, top);
+        sb_alloc_frame_end(top->name,
+                           (top->flags & SB_GAMESTATE_FLAG_NO_ALLOC) != 0);
+    }
+
+    sb_recorder_cleanup();
+    if (options.render_stats) {
+        sb_print_render_stats();
+        sb_print_governor_stats();
+        sb_print_recorder_stats();
+    }
+    if (options.alloc_stats) {
+        sb_alloc_print_stats();
+    }
+    if (options.latency_stats) {
+        sb_print_latency_stats();
     }
 
     sb_menu_pause_cleanup();
     sb_menu_main_cleanup();
     sb_endgame_cleanup();
-    sb_game_cleanup();
+    sb_play_cleanup();
+    sb_bot_destroy(sb_bot);
+    sb_metrics_cleanup();
+
+    sb_audio_cleanup();
+    if (options.audio_stats) {
+        sb_print_audio_stats();
+    }
+
+    if (options.capture_file != NULL) {
+        sb_capture_cleanup();
+        sb_print_capture_stats();
+    }
 
     TTF_Quit();
+    sb_render_cleanup();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
+    sb_job_cleanup();
     SDL_Quit();
 
     return 0;
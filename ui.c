@@ -0,0 +1,322 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include "util.h"
+#include "render.h"
+#include "ui.h"
+
+
+/*
+ * Text colour for each widget state.
+ */
+static const SDL_Color sb_ui_normal_color = { 200, 200, 200, 255 };
+static const SDL_Color sb_ui_hover_color = { 255, 255, 255, 255 };
+static const SDL_Color sb_ui_pressed_color = { 255, 220, 120, 255 };
+
+
+/*
+ * Every menu that has been set up and not yet cleaned up.
+ */
+static sb_ui_menu_type *sb_ui_menus[SB_UI_MAX_MENUS];
+static size_t           sb_ui_menu_count;
+
+
+static void
+sb_ui_set_state (sb_ui_menu_type   *menu,
+                 sb_ui_widget_type *widget,
+                 bool               hover,
+                 bool               pressed)
+{
+    if (widget->hover != hover || widget->pressed != pressed) {
+        widget->hover = hover;
+        widget->pressed = pressed;
+        widget->dirty = true;
+        menu->dirty = true;
+    }
+}
+
+
+/*
+ * Rasterize and lay out every widget in the menu. The menu's widget list
+ * must already be filled in with labels and actions.
+ */
+void
+sb_ui_menu_setup (sb_ui_menu_type *menu,
+                  SDL_Renderer    *renderer,
+                  const char      *font_name,
+                  int              font_size)
+{
+    sb_ui_widget_type *widget;
+    SDL_Surface       *surf;
+    SDL_Color          color = { 255, 255, 255, 255 };
+    TTF_Font          *font = load_font(font_name, font_size);
+    size_t             i;
+
+    menu->bounds.x = 0;
+    menu->bounds.y = 0;
+    menu->bounds.w = 0;
+    menu->bounds.h = 0;
+
+    for (i = 0; i < menu->widget_count; i++) {
+        widget = &menu->widgets[i];
+
+        surf = TTF_RenderText_Blended(font, widget->label, color);
+        widget->texture = sb_render_create_texture(renderer, surf);
+        SDL_FreeSurface(surf);
+        (void)SDL_QueryTexture(widget->texture, NULL, NULL,
+                               &widget->rect.w, &widget->rect.h);
+        widget->rect.x = 0;
+        widget->rect.y = font_size * i;
+        widget->hover = false;
+        widget->pressed = false;
+        widget->dirty = true;
+
+        menu->bounds.w = MAX(menu->bounds.w, widget->rect.x + widget->rect.w);
+        menu->bounds.h = MAX(menu->bounds.h, widget->rect.y + widget->rect.h);
+    }
+
+    TTF_CloseFont(font);
+
+    /*
+     * If the renderer can't draw to textures, the widgets are just drawn
+     * individually every frame.
+     */
+    menu->cache = NULL;
+    if (sb_render_targets_supported(renderer) &&
+        menu->bounds.w > 0 && menu->bounds.h > 0) {
+        menu->cache = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                        SDL_TEXTUREACCESS_TARGET,
+                                        menu->bounds.w, menu->bounds.h);
+        (void)SDL_SetTextureBlendMode(menu->cache, SDL_BLENDMODE_BLEND);
+    }
+    menu->cleared = false;
+    menu->dirty = true;
+
+    if (sb_ui_menu_count < SB_UI_MAX_MENUS) {
+        sb_ui_menus[sb_ui_menu_count++] = menu;
+    }
+}
+
+
+void
+sb_ui_menu_cleanup (sb_ui_menu_type *menu)
+{
+    size_t i;
+
+    for (i = 0; i < menu->widget_count; i++) {
+        free_texture(menu->widgets[i].texture);
+        menu->widgets[i].texture = NULL;
+    }
+
+    free_texture(menu->cache);
+    menu->cache = NULL;
+
+    for (i = 0; i < sb_ui_menu_count; i++) {
+        if (sb_ui_menus[i] == menu) {
+            sb_ui_menus[i] = sb_ui_menus[--sb_ui_menu_count];
+            break;
+        }
+    }
+}
+
+
+/*
+ * SDL has lost the contents of render targets (SDL_RENDER_TARGETS_RESET),
+ * so redraw every menu's cache in full next time it is drawn. Call for
+ * every reset, as only the top gamestate sees the event.
+ */
+void
+sb_ui_targets_reset (void)
+{
+    sb_ui_menu_type *menu;
+    size_t           i;
+    size_t           j;
+
+    for (i = 0; i < sb_ui_menu_count; i++) {
+        menu = sb_ui_menus[i];
+        for (j = 0; j < menu->widget_count; j++) {
+            menu->widgets[j].dirty = true;
+        }
+        menu->cleared = false;
+        menu->dirty = true;
+    }
+}
+
+
+/*
+ * Find the widget at a point, or NULL if there isn't one.
+ */
+sb_ui_widget_type *
+sb_ui_hit_test (sb_ui_menu_type *menu,
+                int              x,
+                int              y)
+{
+    size_t i;
+
+    for (i = 0; i < menu->widget_count; i++) {
+        if (sb_point_in_rect(x, y, &menu->widgets[i].rect)) {
+            return &menu->widgets[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Forget every widget's hover and pressed state, e.g. when the menu comes
+ * back on top - it won't have seen the mouse while it was away, and a
+ * widget whose action switched gamestate never saw its button released.
+ */
+void
+sb_ui_menu_reset (sb_ui_menu_type *menu)
+{
+    size_t i;
+
+    for (i = 0; i < menu->widget_count; i++) {
+        sb_ui_set_state(menu, &menu->widgets[i], false, false);
+    }
+}
+
+
+/*
+ * Track hover and pressed state, and run a widget's action when the left
+ * button is pressed on it.
+ */
+void
+sb_ui_menu_event (sb_ui_menu_type *menu,
+                  SDL_Event       *e)
+{
+    sb_ui_widget_type *hit;
+    sb_ui_widget_type *widget;
+    sb_ui_widget_type *clicked = NULL;
+    size_t             i;
+    int                x;
+    int                y;
+
+    switch (e->type) {
+    case SDL_MOUSEMOTION:
+        x = e->motion.x;
+        y = e->motion.y;
+        break;
+
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+        if (e->button.button != SDL_BUTTON_LEFT) {
+            return;
+        }
+        x = e->button.x;
+        y = e->button.y;
+        break;
+
+    default:
+        return;
+    }
+
+    hit = sb_ui_hit_test(menu, x, y);
+    for (i = 0; i < menu->widget_count; i++) {
+        widget = &menu->widgets[i];
+
+        if (e->type == SDL_MOUSEBUTTONDOWN) {
+            if (widget == hit) {
+                clicked = widget;
+            }
+            sb_ui_set_state(menu, widget, widget == hit, widget == hit);
+        } else if (e->type == SDL_MOUSEBUTTONUP) {
+            sb_ui_set_state(menu, widget, widget == hit, false);
+        } else {
+            sb_ui_set_state(menu, widget, widget == hit, widget->pressed);
+        }
+    }
+
+    /*
+     * Run the action last, as it may well switch gamestate.
+     */
+    if (clicked != NULL && clicked->action != NULL) {
+        clicked->action();
+    }
+}
+
+
+static SDL_Color
+sb_ui_widget_color (sb_ui_widget_type *widget)
+{
+    if (widget->pressed) {
+        return sb_ui_pressed_color;
+    } else if (widget->hover) {
+        return sb_ui_hover_color;
+    }
+
+    return sb_ui_normal_color;
+}
+
+
+/*
+ * Redraw any widgets whose state has changed into the menu's cached texture.
+ * Widgets don't overlap and each one's texture covers its whole rect, so
+ * copying without blending replaces the old contents exactly. The rest of
+ * the cache isn't covered by any widget, so it is cleared to transparent
+ * when the texture is new or its contents have been lost - SDL leaves them
+ * undefined.
+ */
+static void
+sb_ui_menu_update_cache (sb_ui_menu_type *menu,
+                         SDL_Renderer    *renderer)
+{
+    SDL_Texture       *old_target = SDL_GetRenderTarget(renderer);
+    sb_ui_widget_type *widget;
+    SDL_Color          color;
+    size_t             i;
+
+    (void)SDL_SetRenderTarget(renderer, menu->cache);
+
+    if (!menu->cleared) {
+        (void)SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        (void)SDL_RenderClear(renderer);
+        menu->cleared = true;
+    }
+
+    for (i = 0; i < menu->widget_count; i++) {
+        widget = &menu->widgets[i];
+        if (!widget->dirty) {
+            continue;
+        }
+
+        color = sb_ui_widget_color(widget);
+        (void)SDL_SetTextureColorMod(widget->texture,
+                                     color.r, color.g, color.b);
+        (void)SDL_SetTextureBlendMode(widget->texture, SDL_BLENDMODE_NONE);
+        (void)SDL_RenderCopy(renderer, widget->texture, NULL, &widget->rect);
+        (void)SDL_SetTextureBlendMode(widget->texture, SDL_BLENDMODE_BLEND);
+        widget->dirty = false;
+    }
+
+    (void)SDL_SetRenderTarget(renderer, old_target);
+    menu->dirty = false;
+}
+
+
+/*
+ * Draw the menu - normally one copy of the cached texture.
+ */
+void
+sb_ui_menu_draw (sb_ui_menu_type      *menu,
+                 SDL_Renderer         *renderer,
+                 sb_render_layer_type  layer)
+{
+    size_t i;
+
+    if (menu->cache == NULL) {
+        for (i = 0; i < menu->widget_count; i++) {
+            sb_render_copy_mod(layer, menu->widgets[i].texture,
+                               sb_ui_widget_color(&menu->widgets[i]),
+                               NULL, &menu->widgets[i].rect);
+        }
+        return;
+    }
+
+    if (menu->dirty) {
+        sb_ui_menu_update_cache(menu, renderer);
+    }
+
+    sb_render_copy(layer, menu->cache, NULL, &menu->bounds);
+}
@@ -0,0 +1,71 @@
+#ifndef __UI_H__
+#define __UI_H__
+
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include "gamestate.h"
+#include "render.h"
+
+
+/*
+ * Retained-mode menus. A menu is declared as a list of widgets (currently
+ * just text buttons stacked from the top left); the text is rasterized and
+ * laid out once at setup, and the menu is composed into a cached texture
+ * that is only touched when a widget's hover or pressed state changes. So
+ * drawing a menu is a single copy per frame. A menu's gamestate should
+ * call sb_ui_menu_reset from its enter callback.
+ *
+ * Menus that have been set up are kept track of (up to SB_UI_MAX_MENUS),
+ * so that sb_ui_targets_reset can throw away every cache when SDL loses
+ * the contents of render targets, whichever gamestate is on top.
+ */
+#define SB_UI_MAX_MENUS 8
+
+
+typedef void (*sb_ui_action_fn_type)(void);
+
+
+typedef struct sb_ui_widget {
+    const char           *label;
+    sb_ui_action_fn_type  action;
+    SDL_Texture          *texture;
+    SDL_Rect              rect;
+    bool                  hover;
+    bool                  pressed;
+    bool                  dirty;
+} sb_ui_widget_type;
+
+
+typedef struct sb_ui_menu {
+    sb_ui_widget_type *widgets;
+    size_t             widget_count;
+    SDL_Rect           bounds;
+    SDL_Texture       *cache;
+    bool               cleared;
+    bool               dirty;
+} sb_ui_menu_type;
+
+
+void sb_ui_menu_setup(sb_ui_menu_type *menu,
+                      SDL_Renderer    *renderer,
+                      const char      *font_name,
+                      int              font_size);
+void sb_ui_menu_cleanup(sb_ui_menu_type *menu);
+sb_ui_widget_type *sb_ui_hit_test(sb_ui_menu_type *menu, int x, int y);
+void sb_ui_menu_reset(sb_ui_menu_type *menu);
+void sb_ui_menu_event(sb_ui_menu_type *menu, SDL_Event *e);
+void sb_ui_targets_reset(void);
+
+
+/*
+ * The events sb_ui_menu_event uses, for gamestates that pass theirs on.
+ */
+#define SB_UI_MENU_EVENTS (SB_GAMESTATE_EVENTS_MOUSE_MOTION |                \
+                           SB_GAMESTATE_EVENTS_MOUSE_BUTTON)
+void sb_ui_menu_draw(sb_ui_menu_type      *menu,
+                     SDL_Renderer         *renderer,
+                     sb_render_layer_type  layer);
+
+
+#endif /* __UI_H__ */
@@ -1,26 +1,198 @@
 #include <stdlib.h>
+#include <math.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
+#include "job.h"
+#include "startup.h"
 #include "util.h"
 
 
+/*
+ * Accumulate the source pixels in row y between x0 and x1 (fractional
+ * source coordinates) into sums, weighted by how much of each pixel is
+ * covered and by weight_y.
+ */
+static void
+scale_surface_row (const uint32_t *row,
+                   float           x0,
+                   float           x1,
+                   float           weight_y,
+                   float           sums[5])
+{
+    int      x;
+    float    weight;
+    float    alpha;
+    uint32_t pixel;
+
+    for (x = (int)x0; x < x1; x++) {
+        weight = (MIN(x1, x + 1) - MAX(x0, x)) * weight_y;
+        pixel = row[x];
+        alpha = (pixel >> 24) * weight;
+
+        sums[0] += alpha * ((pixel >> 16) & 0xff);
+        sums[1] += alpha * ((pixel >> 8) & 0xff);
+        sums[2] += alpha * (pixel & 0xff);
+        sums[3] += alpha;
+        sums[4] += weight;
+    }
+}
+
+
+/*
+ * See util.h for details.
+ */
+SDL_Surface *
+scale_surface (SDL_Surface *src,
+               int          width,
+               int          height)
+{
+    SDL_Surface *argb;
+    SDL_Surface *dst;
+    uint32_t    *dst_row;
+    float        scale_x = (float)src->w / width;
+    float        scale_y = (float)src->h / height;
+    float        sums[5];
+    float        y0;
+    float        y1;
+    int          x;
+    int          y;
+    int          sy;
+
+    argb = SDL_ConvertSurfaceFormat(src, SDL_PIXELFORMAT_ARGB8888, 0);
+    dst = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32,
+                                         SDL_PIXELFORMAT_ARGB8888);
+    if (argb == NULL || dst == NULL) {
+        SDL_FreeSurface(argb);
+        SDL_FreeSurface(dst);
+        return NULL;
+    }
+
+    for (y = 0; y < height; y++) {
+        y0 = y * scale_y;
+        y1 = MIN(src->h, (y + 1) * scale_y);
+        dst_row = (uint32_t *)((uint8_t *)dst->pixels + y * dst->pitch);
+
+        for (x = 0; x < width; x++) {
+            memset(sums, 0, sizeof(sums));
+            for (sy = (int)y0; sy < y1; sy++) {
+                scale_surface_row(
+                    (uint32_t *)((uint8_t *)argb->pixels + sy * argb->pitch),
+                    x * scale_x, MIN(src->w, (x + 1) * scale_x),
+                    MIN(y1, sy + 1) - MAX(y0, sy), sums);
+            }
+
+            if (sums[3] <= 0.0f) {
+                dst_row[x] = 0;
+            } else {
+                dst_row[x] =
+                    (uint32_t)lrintf(sums[3] / sums[4]) << 24 |
+                    (uint32_t)lrintf(sums[0] / sums[3]) << 16 |
+                    (uint32_t)lrintf(sums[1] / sums[3]) << 8 |
+                    (uint32_t)lrintf(sums[2] / sums[3]);
+            }
+        }
+    }
+
+    SDL_FreeSurface(argb);
+
+    return dst;
+}
+
+
+typedef struct sb_texture_decoded {
+    SDL_Surface *surf;
+    double       ms;
+} sb_texture_decoded_type;
+
+
+typedef struct sb_texture_decode {
+    const sb_texture_load_type *loads;
+    sb_texture_decoded_type    *images;
+} sb_texture_decode_type;
+
+
+/*
+ * Job - decode images [begin, end).
+ */
+static void
+decode_textures (void   *data,
+                 size_t  begin,
+                 size_t  end)
+{
+    sb_texture_decode_type *decode = data;
+    uint64_t                start;
+    size_t                  i;
+
+    for (i = begin; i < end; i++) {
+        start = SDL_GetPerformanceCounter();
+        decode->images[i].surf = IMG_Load(decode->loads[i].filename);
+        decode->images[i].ms = (SDL_GetPerformanceCounter() - start) *
+                               1000.0 / SDL_GetPerformanceFrequency();
+    }
+}
+
+
+/*
+ * See util.h for details. The images are decoded in parallel on the job
+ * system; the textures are then created here, as SDL needs that done on
+ * the main thread. Each one is recorded with the startup profiler.
+ */
+void
+load_textures (SDL_Renderer               *renderer,
+               const sb_texture_load_type *loads,
+               size_t                      count)
+{
+    sb_texture_decode_type   decode;
+    sb_texture_decoded_type *image;
+    sb_job_counter_type      counter = SB_JOB_COUNTER_INIT;
+    uint64_t                 start;
+    size_t                   i;
+
+    decode.loads = loads;
+    decode.images = calloc(count, sizeof(decode.images[0]));
+    if (decode.images == NULL) {
+        for (i = 0; i < count; i++) {
+            *loads[i].texture = load_texture(loads[i].filename, renderer);
+        }
+        return;
+    }
+
+    sb_job_parallel_for(count, 1, &decode_textures, &decode, &counter);
+    sb_job_wait(&counter);
+
+    for (i = 0; i < count; i++) {
+        image = &decode.images[i];
+        start = SDL_GetPerformanceCounter();
+        *loads[i].texture = NULL;
+        if (image->surf != NULL) {
+            *loads[i].texture = sb_render_create_texture(renderer,
+                                                         image->surf);
+            SDL_FreeSurface(image->surf);
+        }
+        sb_startup_asset(loads[i].filename, image->ms,
+                         (SDL_GetPerformanceCounter() - start) * 1000.0 /
+                         SDL_GetPerformanceFrequency());
+    }
+
+    free(decode.images);
+}
+
+
 /*
  * See util.h for details.
  */
-long
-random_at_most (long max) {
-    // max <= RAND_MAX < ULONG_MAX, so this is okay.
-    unsigned long num_bins = (unsigned long)max + 1;
-    unsigned long num_rand = (unsigned long)RAND_MAX + 1;
-    unsigned long bin_size = num_rand / num_bins;
-    unsigned long defect   = num_rand % num_bins;
-    long x;
-
-    do {
-        x = random();
-        // This is carefully written not to overflow
-    } while (num_rand - defect <= (unsigned long)x);
-
-    // Truncated division is intentional
-    return x/bin_size;
+TTF_Font *
+load_font (const char *filename,
+           int         size)
+{
+    TTF_Font *font;
+    uint64_t  start = SDL_GetPerformanceCounter();
+
+    font = TTF_OpenFont(filename, size);
+    sb_startup_asset(filename,
+                     (SDL_GetPerformanceCounter() - start) * 1000.0 /
+                     SDL_GetPerformanceFrequency(), 0.0);
+
+    return font;
 }
@@ -6,14 +6,9 @@
 #include <stdbool.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
-
-
-#define MIN(a, b) ((a) > (b) ? (b) : (a))
-#define MAX(a, b) ((a) < (b) ? (b) : (a))
-
-
-#define DEG_TO_RAD(angle) ((angle) * M_PI / 180.0)
-#define RAD_TO_DEG(angle) ((angle) * 180.0 / M_PI)
+#include <SDL2/SDL_ttf.h>
+#include "common.h"
+#include "render.h"
 
 
 /*
@@ -38,20 +33,12 @@ sb_rect_center(SDL_Rect *rect, int *x, int *y)
 }
 
 /*
- * Find a random number in the closed interval [0, max].
- * Assumes 0 <= max <= RAND_MAX
- */
-long random_at_most(long max);
-
-
-/*
- * Find a random number in the closed interval [min, max].
+ * Make a copy of a surface scaled to the given size, as a 32-bit ARGB
+ * surface. Each destination pixel is the (alpha weighted) average of the
+ * source area it covers, so this gives a clean result when shrinking a lot,
+ * unlike the renderer's scaling. Returns NULL on failure.
  */
-static inline long
-random_range (long min, long max)
-{
-    return min + random_at_most(max - min);
-}
+SDL_Surface *scale_surface(SDL_Surface *src, int width, int height);
 
 
 static inline SDL_Texture *
@@ -63,17 +50,38 @@ load_texture (const char   *filename,
 
     surf = IMG_Load(filename);
     if (surf != NULL) {
-        result = SDL_CreateTextureFromSurface(renderer, surf);
+        result = sb_render_create_texture(renderer, surf);
+        SDL_FreeSurface(surf);
     }
 
     return result;
 }
 
 
+/*
+ * One texture for load_textures to load: the image file, and where to put
+ * the texture (NULL if it couldn't be loaded).
+ */
+typedef struct sb_texture_load {
+    const char   *filename;
+    SDL_Texture **texture;
+} sb_texture_load_type;
+
+void load_textures(SDL_Renderer               *renderer,
+                   const sb_texture_load_type *loads,
+                   size_t                      count);
+
+
+/*
+ * Open a font, recording how long it took with the startup profiler.
+ */
+TTF_Font *load_font(const char *filename, int size);
+
+
 static inline void
 free_texture (SDL_Texture *texture)
 {
-    SDL_DestroyTexture(texture);
+    sb_render_destroy_texture(texture);
 }
 
 